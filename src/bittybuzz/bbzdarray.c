@@ -1,5 +1,130 @@
 #include "bbzdarray.h"
 
+/**
+ * @brief Number of slots taken by the header in the first segment of a
+ * dynamic array.
+ * @param[in] hd The first segment of the dynamic array.
+ */
+#define darray_hdrlen(hd) (bbzheap_aseg_hasnext(hd) ? BBZDARRAY_HDR_LEN : 0)
+
+/**
+ * @brief Position, counted from the first segment, of the segment holding
+ * an element.
+ * @details The first segment holds BBZHEAP_ELEMS_PER_ASEG - h elements
+ * followed by the header ; the other ones are full.
+ * @param[in] idx The index of the element.
+ * @param[in] h The length of the header (see darray_hdrlen()).
+ */
+#define darray_segof(idx, h) (((idx) + (h)) / (uint16_t)(BBZHEAP_ELEMS_PER_ASEG))
+
+/**
+ * @brief Position of an element in its segment.
+ * @param[in] idx The index of the element.
+ * @param[in] h The length of the header (see darray_hdrlen()).
+ */
+#define darray_slotof(idx, h) (darray_segof(idx, h) == 0 ? (idx) : ((idx) + (h)) % (uint16_t)(BBZHEAP_ELEMS_PER_ASEG))
+
+/**
+ * @brief Position, counted from the first segment, of the last segment of a
+ * dynamic array that has a header.
+ * @param[in] hd The first segment of the dynamic array.
+ */
+#define darray_lastseg(hd) ((bbzdarray_hdr_size(hd) + BBZDARRAY_HDR_LEN - 1) / (uint16_t)(BBZHEAP_ELEMS_PER_ASEG))
+
+/**
+ * @brief Returns the size of a dynamic array.
+ * @details Without a header, the elements are the valid slots at the
+ * beginning of the first segment.
+ * @param[in] hd The first segment of the dynamic array.
+ */
+static uint16_t darray_size(bbzheap_aseg_t* hd) {
+    if (bbzheap_aseg_hasnext(hd)) return bbzdarray_hdr_size(hd);
+    uint16_t n = 0;
+    while (n < BBZHEAP_ELEMS_PER_ASEG && bbzheap_aseg_elem_isvalid(hd->values[n])) ++n;
+    return n;
+}
+
+/**
+ * @brief Finds the slot of an element of a dynamic array.
+ * @details The first and the last segments are found in constant time ; the
+ * other ones by walking the segments.
+ * @param[in] hd The first segment of the dynamic array.
+ * @param[in] idx The index of the element.
+ * @param[out] slot The slot of the element in the returned segment.
+ * @return The segment holding the element, or NULL if the index is out of
+ * range.
+ */
+static bbzheap_aseg_t* darray_slot(bbzheap_aseg_t* hd, uint16_t idx, uint8_t* slot) {
+    if (!bbzheap_aseg_hasnext(hd)) {
+        if (idx >= BBZHEAP_ELEMS_PER_ASEG ||
+            !bbzheap_aseg_elem_isvalid(hd->values[idx])) return NULL;
+        *slot = (uint8_t)idx;
+        return hd;
+    }
+    if (idx >= bbzdarray_hdr_size(hd)) return NULL;
+    uint16_t k = darray_segof(idx, BBZDARRAY_HDR_LEN);
+    bbzheap_aseg_t* sd = hd;
+    if (k == darray_lastseg(hd)) {
+        sd = bbzheap_aseg_at(bbzdarray_hdr_tail(hd));
+    }
+    else {
+        while (k-- != 0) {
+            sd = bbzheap_aseg_at(bbzheap_aseg_next_get(sd));
+        }
+    }
+    *slot = (uint8_t)darray_slotof(idx, BBZDARRAY_HDR_LEN);
+    return sd;
+}
+
+/**
+ * @brief Moves the elements of the header slots of the first segment of a
+ * dynamic array to the beginning of its second segment, or back.
+ * @param[out] dst The segment to move the elements to.
+ * @param[in] d The first slot to move the elements to.
+ * @param[in] src The segment of the elements to move.
+ * @param[in] s The first slot of the elements to move.
+ */
+static void darray_move_hdr(bbzheap_aseg_t* dst, uint8_t d,
+                            const bbzheap_aseg_t* src, uint8_t s) {
+    for (uint8_t i = 0; i < BBZDARRAY_HDR_LEN; ++i) {
+        dst->values[d + i] = src->values[s + i];
+        if (bbzheap_aseg_elem_isvalid(dst->values[d + i])) {
+            bbzheap_gc_write(bbzheap_aseg_elem_get(dst->values[d + i]));
+        }
+    }
+}
+
+/**
+ * @brief Moves to the segment holding an element when going through the
+ * elements of a dynamic array in order.
+ * @param[in] sd The segment holding the previous element, or the first
+ * segment for the first element.
+ * @param[in] idx The index of the element.
+ * @param[in] h The length of the header (see darray_hdrlen()).
+ * @return The segment holding the element.
+ */
+static bbzheap_aseg_t* darray_step(bbzheap_aseg_t* sd, uint16_t idx, uint8_t h) {
+    if (darray_segof(idx, h) != 0 && darray_slotof(idx, h) == 0) {
+        return bbzheap_aseg_at(bbzheap_aseg_next_get(sd));
+    }
+    return sd;
+}
+
+/**
+ * @brief Frees a chain of array segments.
+ * @param[in] si The index of the first segment to free.
+ */
+static void darray_free_segs(uint16_t si) {
+    bbzheap_aseg_t* sd = bbzheap_aseg_at(si);
+    while (1) {
+        uint8_t last = !bbzheap_aseg_hasnext(sd);
+        si = bbzheap_aseg_next_get(sd);
+        bbzheap_aseg_free(sd);
+        if (last) break;
+        sd = bbzheap_aseg_at(si);
+    }
+}
+
 /****************************************/
 /****************************************/
 
@@ -16,16 +141,8 @@ uint8_t bbzdarray_new(bbzheap_idx_t* d) {
 /****************************************/
 
 void bbzdarray_destroy(bbzheap_idx_t d) {
-    bbzdarray_t* da = (bbzdarray_t*)bbzheap_obj_at(d);
-    uint16_t si = da->value;
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si);
-    while (1) {
-        bbzheap_tseg_makeinvalid(*sd);
-        if (!bbzheap_aseg_hasnext(sd)) break;
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
-    }
-    bbzheap_obj_makeinvalid(*((bbzobj_t*)da));
+    darray_free_segs(bbzheap_obj_at(d)->t.value);
+    bbzheap_obj_free(d);
 }
 
 /****************************************/
@@ -35,21 +152,11 @@ uint8_t bbzdarray_get(bbzheap_idx_t d,
                       uint16_t idx,
                       bbzheap_idx_t* v) {
     if (!bbztype_isdarray(*bbzheap_obj_at(d))) return 0;
-    const uint16_t qot = idx / ((uint16_t)(BBZHEAP_ELEMS_PER_ASEG)),
-            rem = idx % ((uint16_t)(BBZHEAP_ELEMS_PER_ASEG));
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    /* Loop to fetch the last segment */
-    for (idx = 0; idx < qot && bbzheap_aseg_hasnext(sd); ++idx) {
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
-    }
-    if (idx == qot &&
-        bbzheap_aseg_elem_isvalid(sd->values[rem])) {
-        *v = bbzheap_aseg_elem_get(sd->values[rem]);
-        return 1;
-    }
-    return 0;
+    uint8_t slot;
+    bbzheap_aseg_t* sd = darray_slot(bbzheap_aseg_at(bbzheap_obj_at(d)->t.value), idx, &slot);
+    if (!sd) return 0;
+    *v = bbzheap_aseg_elem_get(sd->values[slot]);
+    return 1;
 }
 
 /****************************************/
@@ -58,85 +165,29 @@ uint8_t bbzdarray_get(bbzheap_idx_t d,
 uint8_t bbzdarray_set(bbzheap_idx_t d,
                       uint16_t idx,
                       bbzheap_idx_t v) {
-    uint16_t qot = idx / (uint16_t)(BBZHEAP_ELEMS_PER_ASEG),
-            rem = idx % (uint16_t)(BBZHEAP_ELEMS_PER_ASEG);
-    uint16_t i = 0;
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    /* Loop to fetch the last segment */
-    for (i = 0; i < qot && bbzheap_aseg_hasnext(sd); ++i) {
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
-    }
-    bbzheap_idx_t value;
-    bbzvm_assign(&value, sd->values + rem);
-    if (i == qot &&
-        bbzheap_aseg_elem_isvalid(value)) {
-        bbzheap_aseg_elem_set(v, v);
-        bbzvm_assign(sd->values + rem, &v);
-        return 1;
-    }
-    return 0;
+    bbzheap_gc_write(v);
+    uint8_t slot;
+    bbzheap_aseg_t* sd = darray_slot(bbzheap_aseg_at(bbzheap_obj_at(d)->t.value), idx, &slot);
+    if (!sd) return 0;
+    bbzheap_aseg_elem_set(v, v);
+    bbzvm_assign(sd->values + slot, &v);
+    return 1;
 }
 
 /****************************************/
 /****************************************/
 
 uint8_t bbzdarray_remove(bbzheap_idx_t d, uint16_t idx) {
-    bbzheap_aseg_t* v = (bbzheap_aseg_t*)NULL; // The value to remove
-    bbzheap_idx_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    bbzheap_aseg_t* prevsd = (bbzheap_aseg_t*)NULL; // To keep track of the previous segment
-    /* If the array is empty, return with Failure */
-    if (!bbzheap_aseg_hasnext(sd) &&
-        !bbzheap_aseg_elem_isvalid(sd->values[0])) {
-        return 0;
-    }
-    /* Loop to fetch the last segment */
-    for (uint16_t i = 0; bbzheap_aseg_hasnext(sd); ++i) {
-        if (i == idx / (BBZHEAP_ELEMS_PER_ASEG)) {
-            v = sd;
-        }
-        si = bbzheap_aseg_next_get(sd);
-        prevsd = sd;
-        sd = bbzheap_aseg_at(si);
-    }
-    /* We are now at the last segment */
+    const uint16_t size = bbzdarray_size(d);
     /* If the element to remove was not found, return with Failure */
-    if (v == NULL) {
-        return 0;
-    }
-    /* Find the last valid element */
-    for (si = 0; // Reusing 'si' as the position in the segment
-         si < BBZHEAP_ELEMS_PER_ASEG &&
-         bbzheap_aseg_elem_isvalid(sd->values[si]);
-         ++si);
-    if (si > 0) {
-        // If a valid element was found,
-        // place the last element in place of the element to remove
-        // and remove the latter
-        bbzheap_aseg_elem_set(v->values[idx % (BBZHEAP_ELEMS_PER_ASEG)],
-                              bbzheap_aseg_elem_get(sd->values[si - 1]));
-        sd->values[si - 1] &= ~BBZHEAP_MASK_VALID_SEG_ELEM;
+    if (idx >= size) return 0;
+    if (idx != size - 1) {
+        /* Place the last element in place of the element to remove */
+        bbzheap_idx_t v;
+        bbzdarray_get(d, size - 1, &v);
+        bbzdarray_set(d, idx, v);
     }
-    else {
-        if (prevsd != NULL) {
-            /* If no valid element were found, remove the last one of
-             * the previous segment */
-            bbzheap_aseg_elem_set(v->values[idx % (BBZHEAP_ELEMS_PER_ASEG)],
-                                  bbzheap_aseg_elem_get(
-                                      sd->values[BBZHEAP_ELEMS_PER_ASEG - 1]));
-            prevsd->values[BBZHEAP_ELEMS_PER_ASEG - 1] &=
-                    ~BBZHEAP_MASK_VALID_SEG_ELEM;
-            /* Remove the empty segment */
-            bbzheap_tseg_makeinvalid(*sd);
-            bbzheap_aseg_next_set(prevsd, BBZHEAP_SEG_NO_NEXT);
-        }
-        else {
-            return 0; // Should never be reached.
-        }
-    }
-    return 1;
+    return bbzdarray_pop(d);
 }
 
 /****************************************/
@@ -144,35 +195,39 @@ uint8_t bbzdarray_remove(bbzheap_idx_t d, uint16_t idx) {
 
 uint8_t bbzdarray_push(bbzheap_idx_t d,
                        bbzheap_idx_t v) {
-    /* Initialisation for the loop */
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    /* Loop to fetch the last segment */
-    while (bbzheap_aseg_hasnext(sd)) {
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
+    bbzheap_gc_write(v);
+    bbzheap_aseg_t* hd = bbzheap_aseg_at(bbzheap_obj_at(d)->t.value);
+    const uint16_t size = darray_size(hd);
+    if (!bbzheap_aseg_hasnext(hd)) {
+        if (size < BBZHEAP_ELEMS_PER_ASEG) {
+            /* Append value to the only segment */
+            bbzheap_aseg_elem_set(v, v);
+            bbzvm_assign(hd->values + size, &v);
+            return 1;
+        }
+        /* First segment is full ; move its last elements to a new segment
+         * to make room for the header */
+        uint16_t o;
+        if (!bbzheap_aseg_alloc(&o)) return 0;
+        darray_move_hdr(bbzheap_aseg_at(o), 0,
+                        hd, BBZHEAP_ELEMS_PER_ASEG - BBZDARRAY_HDR_LEN);
+        bbzheap_aseg_next_set(hd, o);
+        bbzdarray_hdr_tail(hd) = o;
+        bbzdarray_hdr_size(hd) = size;
     }
-    /* We are now at the last segment */
-    /* Find the first free space */
-    for (si = 0; // Reusing 'si' as the position in the segment
-         si < BBZHEAP_ELEMS_PER_ASEG &&
-         bbzheap_aseg_elem_isvalid(sd->values[si]);
-         ++si);
-
-    if (si >= BBZHEAP_ELEMS_PER_ASEG) {
+    bbzheap_aseg_t* sd = bbzheap_aseg_at(bbzdarray_hdr_tail(hd));
+    if (darray_segof(size, BBZDARRAY_HDR_LEN) != darray_lastseg(hd)) {
         /* Last segment is full ; add a new segment */
         uint16_t o;
         if (!bbzheap_aseg_alloc(&o)) return 0;
         bbzheap_aseg_next_set(sd, o);
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
-        si = 0;
+        bbzdarray_hdr_tail(hd) = o;
+        sd = bbzheap_aseg_at(o);
     }
-
     /* Append value to segment */
     bbzheap_aseg_elem_set(v, v);
-    bbzvm_assign(sd->values + si, &v);
-
+    bbzvm_assign(sd->values + darray_slotof(size, BBZDARRAY_HDR_LEN), &v);
+    bbzdarray_hdr_size(hd) = size + 1;
     return 1;
 }
 
@@ -180,43 +235,40 @@ uint8_t bbzdarray_push(bbzheap_idx_t d,
 /****************************************/
 
 uint8_t bbzdarray_pop(bbzheap_idx_t d) {
-    bbzheap_idx_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    bbzheap_aseg_t* prevsd = (bbzheap_aseg_t*)NULL; // To keep track of the previous segment
+    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
+    bbzheap_aseg_t* hd = bbzheap_aseg_at(si);
+    uint16_t size = darray_size(hd);
     /* If the array is empty, return with Failure */
-    if (!bbzheap_aseg_hasnext(sd) &&
-        !bbzheap_aseg_elem_isvalid(sd->values[0])) {
-        return 0;
-    }
-    /* Loop to fetch the last segment */
-    while (bbzheap_aseg_hasnext(sd)) {
-        si = bbzheap_aseg_next_get(sd);
-        prevsd = sd;
-        sd = bbzheap_aseg_at(si);
+    if (size == 0) return 0;
+    --size;
+    if (!bbzheap_aseg_hasnext(hd)) {
+        hd->values[size] &= ~BBZHEAP_MASK_VALID_SEG_ELEM;
+        return 1;
     }
-    /* We are now at the last segment */
-    /* Find the last valid element */
-    for (si = 0; // Reusing 'si' as the position in the segment
-         si < BBZHEAP_ELEMS_PER_ASEG &&
-         bbzheap_aseg_elem_isvalid(sd->values[si]);
-         ++si);
-    if (si > 0) {
-        /* If a valid element was found, remove the last one */
-        sd->values[si - 1] &= ~BBZHEAP_MASK_VALID_SEG_ELEM;
+    bbzheap_aseg_t* sd = bbzheap_aseg_at(bbzdarray_hdr_tail(hd));
+    sd->values[darray_slotof(size, BBZDARRAY_HDR_LEN)] &= ~BBZHEAP_MASK_VALID_SEG_ELEM;
+    if (size <= BBZHEAP_ELEMS_PER_ASEG) {
+        /* The elements fit in the first segment again ; move them back in
+         * place of the header */
+        si = bbzheap_aseg_next_get(hd);
+        darray_move_hdr(hd, BBZHEAP_ELEMS_PER_ASEG - BBZDARRAY_HDR_LEN,
+                        bbzheap_aseg_at(si), 0);
+        darray_free_segs(si);
+        bbzheap_aseg_next_set(hd, BBZHEAP_SEG_NO_NEXT);
+        return 1;
     }
-    else {
-        if (prevsd != NULL) {
-            /* If no valid element were found, remove the last one of
-             * the previous segment */
-            prevsd->values[BBZHEAP_ELEMS_PER_ASEG-1] &=
-                    ~BBZHEAP_MASK_VALID_SEG_ELEM;
-            /* Remove the empty segment */
-            bbzheap_tseg_makeinvalid(*sd);
-            bbzheap_aseg_next_set(prevsd, BBZHEAP_SEG_NO_NEXT);
-        }
-        else {
-            return 0; // Should never be reached.
+    bbzdarray_hdr_size(hd) = size;
+    const uint16_t k = darray_segof(size, BBZDARRAY_HDR_LEN);
+    if (darray_slotof(size, BBZDARRAY_HDR_LEN) == 0) {
+        /* The last segment is now empty ; remove it. Finding the new last
+         * segment is the only walk, and happens once every
+         * BBZHEAP_ELEMS_PER_ASEG pops. */
+        for (uint16_t i = 1; i < k; ++i) {
+            si = bbzheap_aseg_next_get(bbzheap_aseg_at(si));
         }
+        bbzheap_aseg_next_set(bbzheap_aseg_at(si), BBZHEAP_SEG_NO_NEXT);
+        bbzheap_aseg_free(sd);
+        bbzdarray_hdr_tail(hd) = si;
     }
     return 1;
 }
@@ -225,22 +277,7 @@ uint8_t bbzdarray_pop(bbzheap_idx_t d) {
 /****************************************/
 
 uint16_t bbzdarray_size(bbzheap_idx_t d) {
-    uint16_t size = 0;
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    while (1) {
-        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
-            if (!bbzheap_aseg_elem_isvalid(sd->values[i])) {
-                bbzheap_aseg_next_set(sd, BBZHEAP_SEG_NO_NEXT);
-                return size;
-            }
-            ++size;
-        }
-        if (!bbzheap_aseg_hasnext(sd)) break;
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
-    }
-    return size;
+    return darray_size(bbzheap_aseg_at(bbzheap_obj_at(d)->t.value));
 }
 
 /****************************************/
@@ -249,19 +286,13 @@ uint16_t bbzdarray_size(bbzheap_idx_t d) {
 uint8_t bbzdarray_clone(bbzheap_idx_t d,
                         bbzheap_idx_t* newd) {
     if(!bbzdarray_new(newd)) return 0;
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    while (1) {
-        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
-            if (!bbzheap_aseg_elem_isvalid(sd->values[i])) {
-                break;
-            }
-            if (!bbzdarray_push(*newd, bbzheap_aseg_elem_get(sd->values[i])))
-                return 0;
-        }
-        if (!bbzheap_aseg_hasnext(sd)) break;
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
+    bbzheap_aseg_t* sd = bbzheap_aseg_at(bbzheap_obj_at(d)->t.value); // Segment data
+    const uint16_t size = darray_size(sd);
+    const uint8_t h = darray_hdrlen(sd);
+    for (uint16_t i = 0; i < size; ++i) {
+        sd = darray_step(sd, i, h);
+        if (!bbzdarray_push(*newd, bbzheap_aseg_elem_get(sd->values[darray_slotof(i, h)])))
+            return 0;
     }
     return 1;
 }
@@ -270,27 +301,16 @@ uint8_t bbzdarray_clone(bbzheap_idx_t d,
 /****************************************/
 
 void bbzdarray_clear(bbzheap_idx_t d) {
-    uint16_t i;
-    bbzdarray_t* da = (bbzdarray_t*)bbzheap_obj_at(d); // darray
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(da->value); // Segment data
-    /* If the array is empty, it's already cleared! */
-    if (!bbzheap_aseg_hasnext(sd) &&
-        !bbzheap_aseg_elem_isvalid(sd->values[0])) {
-        return;
-    }
-    /* Loop to fetch the last segment */
-    while (bbzheap_aseg_hasnext(sd)) {
-        bbzheap_tseg_makeinvalid(*sd);
-        da->value = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(da->value);
+    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
+    bbzheap_aseg_t* hd = bbzheap_aseg_at(si); // Segment data
+    /* Keep the first segment only */
+    if (bbzheap_aseg_hasnext(hd)) {
+        darray_free_segs(bbzheap_aseg_next_get(hd));
+        bbzheap_aseg_next_set(hd, BBZHEAP_SEG_NO_NEXT);
     }
-    /* We are now at the last segment */
-    /* Invalidate all valid elements in the segment */
-    for (i = 0; // Reusing 'i' as the position in the segment
-         i < BBZHEAP_ELEMS_PER_ASEG &&
-         bbzheap_aseg_elem_isvalid(sd->values[i]);
-         ++i) {
-        sd->values[i] &= ~BBZHEAP_MASK_VALID_SEG_ELEM;
+    /* Invalidate all elements in the segment, and the header if any */
+    for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
+        hd->values[i] = 0;
     }
 }
 
@@ -300,18 +320,12 @@ void bbzdarray_clear(bbzheap_idx_t d) {
 void bbzdarray_foreach(bbzheap_idx_t d,
                        bbzdarray_elem_funp fun,
                        void* params) {
-    uint16_t si = bbzheap_obj_at(d)->t.value; // Segment index
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si); // Segment data
-    while (1) {
-        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
-            if (!bbzheap_aseg_elem_isvalid(sd->values[i])) {
-                return;
-            }
-            fun(d, bbzheap_aseg_elem_get(sd->values[i]), params);
-        }
-        if (!bbzheap_aseg_hasnext(sd)) break;
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
+    bbzheap_aseg_t* hd = bbzheap_aseg_at(bbzheap_obj_at(d)->t.value);
+    bbzheap_aseg_t* sd = hd; // Segment data
+    const uint8_t h = darray_hdrlen(hd);
+    for (uint16_t i = 0; i < darray_size(hd); ++i) {
+        sd = darray_step(sd, i, h);
+        fun(d, bbzheap_aseg_elem_get(sd->values[darray_slotof(i, h)]), params);
     }
 }
 
@@ -321,31 +335,19 @@ void bbzdarray_foreach(bbzheap_idx_t d,
 uint16_t bbzdarray_find(bbzheap_idx_t d,
                         bbzdarray_elem_cmpp cmp,
                         bbzheap_idx_t data) {
-    uint16_t pos = 0;
-    bbzdarray_t* da = (bbzdarray_t*)bbzheap_obj_at(d);
-    uint16_t si = da->value;
-    bbzheap_aseg_t* sd = bbzheap_aseg_at(si);
-    /* Go through the darray segments */
-    while (1) {
-        /* Go through the subelements of the segment */
-        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
-            /* No more elements? */
-            if (!bbzheap_aseg_elem_isvalid(sd->values[i])) {
-                break;
-            }
-            /* Element found? */
-            if (bbzheap_obj_isvalid(*bbzheap_obj_at(
-                    bbzheap_aseg_elem_get(sd->values[i]))) &&
-                cmp(bbzheap_obj_at(bbzheap_aseg_elem_get(sd->values[i])),
-                    bbzheap_obj_at(data)) == 0) {
-                return pos;
-            }
-            ++pos;
+    bbzheap_aseg_t* sd = bbzheap_aseg_at(bbzheap_obj_at(d)->t.value);
+    const uint16_t size = darray_size(sd);
+    const uint8_t h = darray_hdrlen(sd);
+    uint16_t pos;
+    /* Go through the elements */
+    for (pos = 0; pos < size; ++pos) {
+        sd = darray_step(sd, pos, h);
+        bbzheap_idx_t x = bbzheap_aseg_elem_get(sd->values[darray_slotof(pos, h)]);
+        /* Element found? */
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(x)) &&
+            cmp(bbzheap_obj_at(x), bbzheap_obj_at(data)) == 0) {
+            return pos;
         }
-        /* Go to next segment */
-        if (!bbzheap_aseg_hasnext(sd)) break;
-        si = bbzheap_aseg_next_get(sd);
-        sd = bbzheap_aseg_at(si);
     }
     return pos;
 }
@@ -360,6 +362,10 @@ uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l) {
         ++i)
         if(!bbzheap_obj_isvalid(*bbzheap_obj_at(i))) {
             /* Empty slot found */
+            /* Allocate an array segment before validating the slot, as
+             * the allocation may collect garbage */
+            uint16_t s;
+            if(!bbzheap_aseg_alloc(&s)) return 0;
             bbzobj_t* x = bbzheap_obj_at(i);
             /* Set valid bit and type */
             bbzheap_obj_makevalid(*x);
@@ -367,15 +373,16 @@ uint8_t bbzdarray_lambda_alloc(bbzheap_idx_t d, uint8_t* l) {
             /* Set the bit that tells it's a dynamic array */
             x->t.mdata |= BBZTABLE_DARRAY_MASK;
             x->t.mdata &= ~BBZTABLE_DARRAY_HAS_SELF_MASK;
+            x->t.value = s;
+            bbzheap_gc_newobj(*x);
             /* Set result */
             *l = i;
-            /* Allocate an array segment */
-            if(!bbzheap_aseg_alloc(&(x->t.value))) return 0;
-            uint16_t idx = bbzdarray_size(d);
-            uint16_t v;
-            for (uint16_t j = 0; j < idx; ++j) {
-                bbzdarray_get(d, j, &v);
-                if (!bbzdarray_push(*l, v)) return 0;
+            bbzheap_aseg_t* sd = bbzheap_aseg_at(bbzheap_obj_at(d)->t.value);
+            const uint16_t size = darray_size(sd);
+            const uint8_t h = darray_hdrlen(sd);
+            for (uint16_t j = 0; j < size; ++j) {
+                sd = darray_step(sd, j, h);
+                if (!bbzdarray_push(*l, bbzheap_aseg_elem_get(sd->values[darray_slotof(j, h)]))) return 0;
             }
             /* Success */
             return 1;
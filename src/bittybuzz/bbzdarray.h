@@ -107,6 +107,7 @@ extern "C" {
 
     /**
      *  @brief Return the count of sequential valid values in the table.
+     *  @details The size is cached in the header of the dynamic array.
      *  @param[in] d The position of the dynamic array's object in the heap.
      *  @return The size of the dynamic array.
      */
@@ -181,6 +182,36 @@ extern "C" {
  */
 #define bbzdarray_isempty(d) (bbzdarray_size(d) == 0)
 
+/**
+ * @brief Number of slots of the first segment of a dynamic array taken by
+ * its header.
+ * @details Only dynamic arrays that do not fit in their first segment have
+ * a header, made of the last slots of that segment. It caches the size of
+ * the dynamic array and the index of its last segment, so that
+ * bbzdarray_size(), bbzdarray_push() and bbzdarray_pop() do not walk the
+ * segments. Its slots never have the valid bit set, so the garbage
+ * collector ignores them. The size of a dynamic array of one segment is
+ * the number of valid slots at its beginning.
+ */
+#define BBZDARRAY_HDR_LEN 2
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * The size of a dynamic array, as found in its first segment.
+ * @param[in] hd The first segment of the dynamic array.
+ */
+#define bbzdarray_hdr_size(hd) ((hd)->values[BBZHEAP_ELEMS_PER_ASEG - 1])
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * The index of the last segment of a dynamic array, as found in its first
+ * segment.
+ * @param[in] hd The first segment of the dynamic array.
+ */
+#define bbzdarray_hdr_tail(hd) ((hd)->values[BBZHEAP_ELEMS_PER_ASEG - 2])
+
 #include "bbzheap.h" // Include AFTER bbzdarray.h because of
                      // circular dependencies.
 
@@ -38,6 +38,7 @@ typedef enum bbzvm_error {
     BBZVM_ERROR_VSTIG,      /**< @brief Too many vstig entries */ // =12
     BBZVM_ERROR_MEM,        /**< @brief Out of memory */ // =13
     BBZVM_ERROR_MATH,       /**< @brief Math error */ // =14
+    BBZVM_ERROR_PTRS,       /**< @brief Too many distinct C closures and userdata (see BBZHEAP_PTRS_CAP) */ // =15
     BBZVM_ERROR_COUNT       /**< @brief Number of errors defined by BittyBuzz. */
 } bbzvm_error;
 
@@ -100,7 +101,15 @@ typedef enum bbzvm_instr {
     BBZVM_INSTR_JUMP,    /**< @brief Set PC to argument */ // =44
     BBZVM_INSTR_JUMPZ,   /**< @brief Set PC to argument if stack top is zero, pop operand */ // =45
     BBZVM_INSTR_JUMPNZ,  /**< @brief Set PC to argument if stack top is not zero, pop operand */ // =46
-    BBZVM_INSTR_COUNT    /**< @brief Used to count how many instructions have been defined */ // =47
+    /*
+     * BittyBuzz-only opcodes, emitted by bo2bbo in place of common
+     * sequences of Buzz opcodes
+     */
+    BBZVM_INSTR_GLOADS,  /**< @brief Push global variable corresponding to string argument (PUSHS + GLOAD) */ // =47
+    BBZVM_INSTR_LTGETS,  /**< @brief Push value for key (string 2nd argument) in local variable at 1st argument (LLOAD + PUSHS + TGET) */ // =48
+    BBZVM_INSTR_ADDI,    /**< @brief Push stack(#0) + integer argument, pop operand (PUSHI + ADD) */ // =49
+    BBZVM_INSTR_JLT,     /**< @brief Set PC to argument unless stack(#1) < stack(#0), pop operands (LT + JUMPZ) */ // =50
+    BBZVM_INSTR_COUNT    /**< @brief Used to count how many instructions have been defined */ // =51
 } bbzvm_instr;
 
 /**
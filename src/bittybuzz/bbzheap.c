@@ -13,63 +13,367 @@
 void bbzheap_clear() {
     vm->heap.rtobj = vm->heap.data + BBZHEAP_RSV_ACTREC_MAX * sizeof(bbzobj_t);
     vm->heap.ltseg = vm->heap.data + BBZHEAP_SIZE;
+    vm->heap.ofree = BBZHEAP_OBJ_NO_FREE;
+    vm->heap.sfree = BBZHEAP_SEG_NO_NEXT;
+    vm->heap.gcoverflows = 0;
+#if defined(BBZ_IMMEDIATE_INTS) && defined(DEBUG)
+    for (uint8_t k = 0; k < BBZHEAP_IMM_OBJS; ++k) vm->heap.immidx[k] = 0;
+#endif // BBZ_IMMEDIATE_INTS && DEBUG
     for(int16_t i = (BBZHEAP_RSV_ACTREC_MAX-1)* sizeof(bbzobj_t); i >= 0; --i) {
         vm->heap.data[i] = 0;
     }
+#ifdef BBZ_LAZY_GC
+    vm->heap.gcfree = 0;
+    bbzheap_gc_safepoint();
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_GENERATIONAL_GC
+    vm->heap.young = BBZHEAP_RSV_ACTREC_MAX;
+    vm->heap.syoung = 0;
+    vm->heap.remnum = 0;
+    vm->heap.remlost = 0;
+    vm->heap.minorgcs = 0;
+#endif // BBZ_GENERATIONAL_GC
+#ifdef BBZ_INCREMENTAL_GC
+    vm->heap.gcphase = BBZHEAP_GC_IDLE;
+    vm->heap.gccycles = 0;
+    vm->heap.gcmaxwork = 0;
+#endif // BBZ_INCREMENTAL_GC
+#ifdef BBZ_HEAP_COMPACTION
+    vm->heap.compactions = 0;
+#endif // BBZ_HEAP_COMPACTION
+#ifdef BBZ_HEAP_ROOTS
+    vm->heap.rootnum = 0;
+    vm->heap.rootlost = 0;
+#endif // BBZ_HEAP_ROOTS
+#ifdef BBZ_HEAP_STATS
+    for(uint8_t i = 0; i < sizeof(bbzheap_stats_t); ++i) {
+        ((uint8_t*)&vm->heap.stats)[i] = 0;
+    }
+#endif // BBZ_HEAP_STATS
+#ifdef BBZ_SMALL_OBJECTS
+    for(uint16_t i = 0; i < BBZHEAP_PTRS_CAP; ++i) {
+        vm->heap.ptrflags[i] = 0;
+    }
+#endif // BBZ_SMALL_OBJECTS
+#ifdef BBZ_INTERN_STRINGS
+    /* Slot 0 is reserved for activation records, so it never holds a string */
+    for(uint16_t i = 0; i < BBZHEAP_STRINGS_CAP; ++i) {
+        vm->heap.strings[i] = 0;
+    }
+#endif // BBZ_INTERN_STRINGS
 }
 
 /****************************************/
 /****************************************/
 
-static uint8_t bbzheap_obj_alloc_prepare_obj(uint8_t t, bbzobj_t* x) {
+#ifdef BBZ_LAZY_GC
+/**
+ * @brief Subtracts some allocated space from the free space estimate.
+ * @param[in] n The number of bytes allocated.
+ */
+#define gc_consume(n) vm->heap.gcfree = (vm->heap.gcfree > (n)) ? vm->heap.gcfree - (n) : 0
+
+/**
+ * @brief Records an object as allocated since the last safe point.
+ * @param[in] i The index of the object.
+ */
+#define gc_track(i) do{                                 \
+    if ((i) < vm->heap.newmin) vm->heap.newmin = (i);   \
+    if ((i) > vm->heap.newmax) vm->heap.newmax = (i);   \
+}while(0)
+
+static void bbzheap_gc_retry();
+#else // BBZ_LAZY_GC
+#define gc_consume(n)
+#define gc_track(i)
+#endif // BBZ_LAZY_GC
+
+#ifdef BBZ_INTERN_STRINGS
+/**
+ * @brief Records a newly allocated string object in the string map.
+ * @param[in] t The type of the object.
+ * @param[in] strid The string ID, if the object is a string.
+ * @param[in] i The index of the object.
+ */
+#define intern_string(t, strid, i) do{                              \
+    if ((t) == BBZTYPE_STRING && (strid) < BBZHEAP_STRINGS_CAP)     \
+        vm->heap.strings[strid] = (i);                              \
+}while(0)
+#else // BBZ_INTERN_STRINGS
+#define intern_string(t, strid, i)
+#endif // BBZ_INTERN_STRINGS
+
+#ifdef BBZ_GENERATIONAL_GC
+/**
+ * @brief Whether new objects and segments are taken from the unclaimed
+ * space rather than from the free lists.
+ * @details Allocating in the unclaimed space keeps the nursery contiguous.
+ * When that space gets scarce, the free lists are used first, as the
+ * slots they hold cannot be turned into segments, nor segments into slots.
+ */
+#define nursery_hasroom() (vm->heap.ltseg - vm->heap.rtobj >= BBZHEAP_NURSERY_SIZE)
+
+#endif // BBZ_GENERATIONAL_GC
+#ifdef BBZ_HEAP_STATS
+/**
+ * @brief Counts an allocation request.
+ * @param[in] k The type of the object, or BBZHEAP_STATS_TSEG.
+ * @param[in] ok Whether the allocation succeeded.
+ */
+#define stats_alloc(k, ok) do{                                  \
+    if (ok) ++vm->heap.stats.allocs[k];                         \
+    else ++vm->heap.stats.allocfails[k];                        \
+}while(0)
+
+/**
+ * @brief Counts a new live object.
+ */
+#define stats_newobj() do{                                      \
+    if (++vm->heap.stats.objs > vm->heap.stats.objspeak)        \
+        vm->heap.stats.objspeak = vm->heap.stats.objs;          \
+}while(0)
+
+/**
+ * @brief Counts a new live table segment.
+ */
+#define stats_newseg() do{                                      \
+    if (++vm->heap.stats.segs > vm->heap.stats.segspeak)        \
+        vm->heap.stats.segspeak = vm->heap.stats.segs;          \
+}while(0)
+
+/**
+ * @brief Counts the end of a garbage collection.
+ */
+#define stats_gcdone() do{                                      \
+    ++vm->heap.stats.gcs;                                       \
+    if (vm->heap.stats.gclast > vm->heap.stats.gcmax)           \
+        vm->heap.stats.gcmax = vm->heap.stats.gclast;           \
+}while(0)
+#else // BBZ_HEAP_STATS
+#define stats_alloc(k, ok)
+#define stats_newobj()
+#define stats_newseg()
+#define stats_gcdone()
+#endif // BBZ_HEAP_STATS
+
+static uint8_t bbzheap_tseg_alloc_once(bbzheap_idx_t* s);
+
+static void bbzheap_obj_alloc_prepare_obj(uint8_t t, bbzobj_t* x, bbzheap_idx_t s) {
     /* Set valid bit and type */
     x->mdata = ((t << BBZTYPE_TYPEIDX) & BBZTYPE_MASK) | BBZHEAP_OBJ_MASK_VALID;
     /* Take care of special initialisations */
     if (t == BBZTYPE_TABLE) {
-        if (!bbzheap_tseg_alloc(&x->t.value)) return 0;
+        x->t.value = s;
     }
     else if (t == BBZTYPE_CLOSURE) {
         bbzclosure_unmake_lambda(*x);
         (x)->l.value.actrec = BBZHEAP_CLOSURE_DFLT_ACTREC; // Default activation record
     }
-    /* Success */
-    return 1;
+    bbzheap_gc_newobj(*x);
 }
 
-uint8_t bbzheap_obj_alloc(uint8_t t,
-                          bbzheap_idx_t* o) {
-    /* Look for empty slot */
-    for(uint16_t i = BBZHEAP_RSV_ACTREC_MAX;
-        i < (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
-        ++i) {
-        if(!bbzheap_obj_isvalid(*bbzheap_obj_at(i))) {
-            /* Empty slot found */
-            /* Set result */
+/**
+ * @brief Allocates an object without collecting garbage.
+ * @param[in] t The type of the object.
+ * @param[in,out] o See bbzheap_obj_alloc().
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t bbzheap_obj_alloc_once(uint8_t t,
+                                      bbzheap_idx_t* o) {
+    /* A table needs its first segment. Get it before the slot, so that a
+     * collection never sees a valid table without segment. */
+    bbzheap_idx_t s = BBZHEAP_SEG_NO_NEXT;
+    if (t == BBZTYPE_TABLE && !bbzheap_tseg_alloc_once(&s)) return 0;
+    /* Reuse the string if it already exists */
+    bbzheap_idx_t strid = *o;
+#ifdef BBZ_INTERN_STRINGS
+    if (t == BBZTYPE_STRING && strid < BBZHEAP_STRINGS_CAP) {
+        /* The map is not updated by the garbage collector, so the entry
+         * is only trusted if it still designates the same string. */
+        bbzheap_idx_t i = vm->heap.strings[strid];
+        bbzobj_t* x = (bbzobj_t*)vm->heap.data + i;
+        if ((uint8_t*)(x + 1) <= vm->heap.rtobj &&
+            bbzheap_obj_isvalid(*x) &&
+            bbztype_isstring(*x) &&
+            x->s.value == strid) {
             *o = i;
-            return bbzheap_obj_alloc_prepare_obj(t, bbzheap_obj_at(i));
+            gc_track(i);
+            return 1;
         }
-        else {
-            if (t == BBZTYPE_STRING &&
-                bbztype_isstring(*bbzheap_obj_at(i)) &&
-                *o == bbzheap_obj_at(i)->s.value) {
+    }
+    else
+#endif // BBZ_INTERN_STRINGS
+    if (t == BBZTYPE_STRING) {
+        for(uint16_t i = BBZHEAP_RSV_ACTREC_MAX;
+            i < (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+            ++i) {
+            bbzobj_t* x = bbzheap_obj_at(i);
+            if (bbzheap_obj_isvalid(*x) &&
+                bbztype_isstring(*x) &&
+                strid == x->s.value) {
                 *o = i;
+                gc_track(i);
                 return 1;
             }
         }
     }
+    /* Take the first free slot, if any */
+    if (vm->heap.ofree != BBZHEAP_OBJ_NO_FREE
+#ifdef BBZ_GENERATIONAL_GC
+        /* ...unless there is room in the nursery */
+        && !nursery_hasroom()
+#endif // BBZ_GENERATIONAL_GC
+        ) {
+        bbzheap_idx_t i = vm->heap.ofree;
+        bbzobj_t* x = bbzheap_obj_at(i);
+        vm->heap.ofree = x->s.value;
+        *o = i;
+        bbzheap_obj_alloc_prepare_obj(t, x, s);
+#ifdef BBZ_GENERATIONAL_GC
+        /* The free slots are older than the nursery; the slot may get
+         * references to nursery objects without any barrier */
+        bbzheap_gc_remember(i);
+#endif // BBZ_GENERATIONAL_GC
+        stats_newobj();
+        gc_consume(sizeof(bbzobj_t));
+        gc_track(i);
+        intern_string(t, strid, i);
+        return 1;
+    }
     /* No empty slot found, must create a new one */
     /* ...but first, make sure there is room */
-    if(vm->heap.rtobj + sizeof(bbzobj_t) > vm->heap.ltseg) { return 0; }
+    if(vm->heap.rtobj + sizeof(bbzobj_t) > vm->heap.ltseg) {
+        if (t == BBZTYPE_TABLE) bbzheap_tseg_free(bbzheap_tseg_at(s));
+        return 0;
+    }
     /* Set result */
     *o = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
     vm->heap.rtobj += sizeof(bbzobj_t);
-    return bbzheap_obj_alloc_prepare_obj(t, (bbzobj_t*)(vm->heap.rtobj - sizeof(bbzobj_t)));
+    bbzheap_obj_alloc_prepare_obj(t, (bbzobj_t*)(vm->heap.rtobj - sizeof(bbzobj_t)), s);
+    stats_newobj();
+    gc_consume(sizeof(bbzobj_t));
+    gc_track(*o);
+    intern_string(t, strid, *o);
+    return 1;
+}
+
+uint8_t bbzheap_obj_alloc(uint8_t t,
+                          bbzheap_idx_t* o) {
+#ifdef BBZ_LAZY_GC
+    bbzheap_idx_t strid = *o;
+    if (bbzheap_obj_alloc_once(t, o)) {
+        stats_alloc(t, 1);
+        return 1;
+    }
+    /* Out of memory ; collect garbage and retry */
+    bbzheap_gc_retry();
+    *o = strid;
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+    uint8_t ok = bbzheap_obj_alloc_once(t, o);
+    stats_alloc(t, ok);
+    return ok;
+#else // BBZ_HEAP_STATS
+    return bbzheap_obj_alloc_once(t, o);
+#endif // BBZ_HEAP_STATS
 }
 
 /****************************************/
 /****************************************/
 
+void bbzheap_obj_free(bbzheap_idx_t i) {
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_idx_isimm(i)) return;
+#endif // BBZ_IMMEDIATE_INTS
+    bbzobj_t* x = bbzheap_obj_at(i);
+    if (!bbzheap_obj_isvalid(*x)) return;
+    if (i < BBZHEAP_RSV_ACTREC_MAX) {
+        bbzheap_obj_makeinvalid(*x);
+        return;
+    }
+#ifdef BBZ_HEAP_STATS
+    --vm->heap.stats.objs;
+#endif // BBZ_HEAP_STATS
+    /* Clear the type too, so that a stale reference is seen as nil */
+    x->mdata = 0;
+#ifdef BBZ_GENERATIONAL_GC
+    /* Nursery slots are chained by the next collection */
+    if (i >= vm->heap.young) return;
+#endif // BBZ_GENERATIONAL_GC
+    x->s.value = vm->heap.ofree;
+    vm->heap.ofree = i;
+}
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_HEAP_ROOTS
+void bbzheap_root_add(bbzheap_idx_t i) {
+    /* Immediate integers are not in the heap */
+    if (i >= (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t)) return;
+    bbzobj_t* x = bbzheap_obj_at(i);
+    if (bbzheap_obj_ispermanent(*x)) return;
+    x->mdata |= BBZHEAP_MASK_PERMANENT;
+#ifdef BBZ_INCREMENTAL_GC
+    bbzheap_gc_write(i);
+#endif // BBZ_INCREMENTAL_GC
+    if (vm->heap.rootnum < BBZHEAP_ROOTS_CAP) {
+        vm->heap.roots[vm->heap.rootnum++] = i;
+    }
+    else {
+        vm->heap.rootlost = 1;
+    }
+}
+
+void bbzheap_root_remove(bbzheap_idx_t i) {
+    if (i >= (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t)) return;
+    bbzobj_t* x = bbzheap_obj_at(i);
+    /* A valid object that is not permanent is not in the registry */
+    if (bbzheap_obj_isvalid(*x) && !bbzheap_obj_ispermanent(*x)) return;
+    x->mdata &= ~BBZHEAP_MASK_PERMANENT;
+    for (uint8_t j = vm->heap.rootnum; j-- != 0;) {
+        if (vm->heap.roots[j] == i) {
+            vm->heap.roots[j] = vm->heap.roots[--vm->heap.rootnum];
+            return;
+        }
+    }
+}
+#endif // BBZ_HEAP_ROOTS
+
+/****************************************/
+/****************************************/
+
+#if defined(BBZ_IMMEDIATE_INTS) && defined(DEBUG)
+/**
+ * @brief Checks that a temporary object of the immediate integers was not
+ * written to since it was made, as such writes are lost.
+ * @param[in] k The number of the temporary object.
+ */
+static void imm_check(uint8_t k) {
+    bbzheap_idx_t i = vm->heap.immidx[k];
+    bbzobj_t* x = vm->heap.imm + k;
+    if (bbzheap_idx_isimm(i) &&
+        (x->mdata != ((BBZTYPE_INT << BBZTYPE_TYPEIDX) | BBZHEAP_OBJ_MASK_VALID) ||
+         x->i.value != bbzheap_imm_get(i))) {
+        bbzvm_seterror(BBZVM_ERROR_TYPE);
+    }
+}
+#endif // BBZ_IMMEDIATE_INTS && DEBUG
+
 bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i) {
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_idx_isimm(i)) {
+        uint8_t k = (uint8_t)(vm->heap.immnext++ % BBZHEAP_IMM_OBJS);
+        bbzobj_t* x = vm->heap.imm + k;
+#ifdef DEBUG
+        imm_check(k);
+        vm->heap.immidx[k] = i;
+#endif // DEBUG
+        x->mdata = (BBZTYPE_INT << BBZTYPE_TYPEIDX) | BBZHEAP_OBJ_MASK_VALID;
+        x->i.value = bbzheap_imm_get(i);
+        return x;
+    }
+#endif // BBZ_IMMEDIATE_INTS
     return (bbzobj_t*)vm->heap.data + i;
 }
 
@@ -84,25 +388,33 @@ static uint8_t bbzheap_tseg_alloc_prepare_seg(bbzheap_tseg_t* x) {
         x->keys[j] = 0;
         x->values[j] = 0;
     }
+    stats_newseg();
+    gc_consume(sizeof(bbzheap_tseg_t));
     /* Success */
     return 1;
 }
 
-uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
-    /* Look for empty slot */
-    int16_t qot = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
-    for(int16_t i = 0;
-        i < qot;
-        ++i) {
-        if(!bbzheap_tseg_isvalid(*bbzheap_tseg_at(i))) {
-            /* Empty slot found */
-            /* Set result */
-            bbzvm_assign(s, &i);
-            // *(uint8_t*)s = (uint8_t)i;
-            // *((uint8_t*)s + 1) = (uint8_t)(i >> 8);
-            return bbzheap_tseg_alloc_prepare_seg(bbzheap_tseg_at(i));
-        }
+/**
+ * @brief Allocates a table segment without collecting garbage.
+ * @param[out] s A buffer for the index of the allocated segment.
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t bbzheap_tseg_alloc_once(bbzheap_idx_t* s) {
+    /* Take the first free segment, if any */
+    if (vm->heap.sfree != BBZHEAP_SEG_NO_NEXT
+#ifdef BBZ_GENERATIONAL_GC
+        /* ...unless there is room in the nursery */
+        && !nursery_hasroom()
+#endif // BBZ_GENERATIONAL_GC
+        ) {
+        bbzheap_idx_t i = vm->heap.sfree;
+        bbzheap_tseg_t* x = bbzheap_tseg_at(i);
+        vm->heap.sfree = bbzheap_tseg_next_get(x);
+        /* Set result */
+        bbzvm_assign(s, &i);
+        return bbzheap_tseg_alloc_prepare_seg(x);
     }
+    int16_t qot = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
     /* Make sure there is room */
     if(vm->heap.ltseg - sizeof(bbzheap_tseg_t) < vm->heap.rtobj) return 0;
     /* Set result */
@@ -114,62 +426,376 @@ uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
     return bbzheap_tseg_alloc_prepare_seg((bbzheap_tseg_t*)vm->heap.ltseg);
 }
 
+void bbzheap_tseg_free(bbzheap_tseg_t* s) {
+    if (!bbzheap_tseg_isvalid(*s)) return;
+#ifdef BBZ_HEAP_STATS
+    --vm->heap.stats.segs;
+#endif // BBZ_HEAP_STATS
+    bbzheap_idx_t i = (bbzheap_idx_t)((bbzheap_tseg_t*)(vm->heap.data + BBZHEAP_SIZE) - s - 1);
+#ifdef BBZ_GENERATIONAL_GC
+    /* Nursery segments are chained by the next collection */
+    if (i >= vm->heap.syoung) {
+        s->mdata = 0;
+        return;
+    }
+#endif // BBZ_GENERATIONAL_GC
+    s->mdata = vm->heap.sfree & BBZHEAP_SEG_MASK_NEXT;
+    vm->heap.sfree = i;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s) {
+#ifdef BBZ_LAZY_GC
+    if (bbzheap_tseg_alloc_once(s)) {
+        stats_alloc(BBZHEAP_STATS_TSEG, 1);
+        return 1;
+    }
+    /* Out of memory ; collect garbage and retry */
+    bbzheap_gc_retry();
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+    uint8_t ok = bbzheap_tseg_alloc_once(s);
+    stats_alloc(BBZHEAP_STATS_TSEG, ok);
+    return ok;
+#else // BBZ_HEAP_STATS
+    return bbzheap_tseg_alloc_once(s);
+#endif // BBZ_HEAP_STATS
+}
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_SMALL_OBJECTS
+/**
+ * @brief Entry of the pointer table where the lookup of a pointer starts.
+ * @details The lowest bit is dropped, as it is usually 0 for aligned
+ * data. The table is probed linearly from there.
+ * @param[in] p The pointer.
+ */
+#define ptr_hash(p) ((uint16_t)(((p) >> 1) ^ ((p) >> 7)) % BBZHEAP_PTRS_CAP)
+
+/**
+ * @brief Looks for a pointer in the pointer table, or adds it to a free entry.
+ * @details The lookup stops at the first entry that was never used, so
+ * it usually only probes a few entries.
+ * @param[in] p The pointer.
+ * @param[out] i A buffer for the index of the pointer.
+ * @return 1 for success, 0 for failure (table full)
+ */
+static uint8_t bbzheap_ptr_add_once(uintptr_t p,
+                                    uint16_t* i) {
+    uint16_t f = BBZHEAP_PTRS_CAP;
+    uint16_t j = ptr_hash(p);
+    for (uint16_t n = BBZHEAP_PTRS_CAP; n; --n) {
+        if (!(vm->heap.ptrflags[j] & BBZHEAP_PTR_VALID)) {
+            if (f == BBZHEAP_PTRS_CAP) f = j;
+            /* Never used: the pointer is not further */
+            if (!vm->heap.ptrflags[j]) break;
+        }
+        else if (vm->heap.ptrs[j] == p) {
+            f = j;
+            break;
+        }
+        if (++j == BBZHEAP_PTRS_CAP) j = 0;
+    }
+    if (f == BBZHEAP_PTRS_CAP) return 0;
+    vm->heap.ptrs[f] = p;
+    vm->heap.ptrflags[f] &= ~BBZHEAP_PTR_FREED;
+    vm->heap.ptrflags[f] |= BBZHEAP_PTR_VALID;
+#ifdef BBZ_INCREMENTAL_GC
+    /* The object that refers to the entry may be on the part of the heap
+     * that was already swept */
+    if (vm->heap.gcphase == BBZHEAP_GC_SWEEP) vm->heap.ptrflags[f] |= BBZHEAP_PTR_GCMARK;
+#endif // BBZ_INCREMENTAL_GC
+    *i = f;
+    return 1;
+}
+
+uint8_t bbzheap_ptr_add(uintptr_t p,
+                        uint16_t* i) {
+#ifdef BBZ_LAZY_GC
+    if (bbzheap_ptr_add_once(p, i)) return 1;
+    /* Table full ; collect garbage and retry */
+    bbzheap_gc_retry();
+#endif // BBZ_LAZY_GC
+    return bbzheap_ptr_add_once(p, i);
+}
+
+/**
+ * @brief Whether an object refers to an entry of the pointer table.
+ * @param[in] x The object.
+ */
+#define gc_hasptr(x) (bbzheap_obj_isvalid(x) &&                       \
+                      (bbztype_isuserdata(x) ||                       \
+                       (bbztype_isclosure(x) &&                       \
+                        !bbztype_isclosurenative(x) &&                \
+                        !bbztype_isclosurelambda(x))) &&              \
+                      bbzheap_obj_hasptr(x))
+
+/**
+ * @brief Keeps the pointer of an object kept by the garbage collector.
+ * @param[in] x The object.
+ */
+#define gc_keep_ptr(x) do{                                              \
+    if (gc_hasptr(x)) vm->heap.ptrflags[(x).u.value] |= BBZHEAP_PTR_GCMARK; \
+}while(0)
+
+/**
+ * @brief Frees the pointers that no object kept by the garbage collector
+ * refers to.
+ */
+static void bbzheap_gc_sweep_ptrs() {
+    uint16_t e = BBZHEAP_PTRS_CAP;
+    for (uint16_t i = 0; i < BBZHEAP_PTRS_CAP; ++i) {
+        if (vm->heap.ptrflags[i] & BBZHEAP_PTR_GCMARK) {
+            vm->heap.ptrflags[i] &= ~BBZHEAP_PTR_GCMARK;
+        }
+        else if (vm->heap.ptrflags[i]) {
+            vm->heap.ptrflags[i] = BBZHEAP_PTR_FREED;
+        }
+        else {
+            e = i;
+        }
+    }
+    if (e == BBZHEAP_PTRS_CAP) return;
+    /* Freed entries followed by a never used one end no probe sequence
+     * anymore: forget them, walking backwards from a never used entry. */
+    for (uint16_t n = BBZHEAP_PTRS_CAP - 1; n; --n) {
+        uint16_t p = e ? e - 1 : BBZHEAP_PTRS_CAP - 1;
+        if (vm->heap.ptrflags[p] == BBZHEAP_PTR_FREED && !vm->heap.ptrflags[e]) {
+            vm->heap.ptrflags[p] = 0;
+        }
+        e = p;
+    }
+}
+#else // BBZ_SMALL_OBJECTS
+#define gc_keep_ptr(x)
+#endif // BBZ_SMALL_OBJECTS
+
 /****************************************/
 /****************************************/
+/**
+ * @brief Whether an object refers to other objects.
+ * @param[in] x The object.
+ */
+#define gc_hasrefs(x) (bbztype_istable(x) ||                          \
+                       (bbztype_isclosure(x) &&                       \
+                        bbztype_isclosurelambda(x) &&                 \
+                        (x).l.value.actrec != BBZHEAP_CLOSURE_DFLT_ACTREC))
+
+/**
+ * @brief Marked objects whose references are not marked yet.
+ */
+static bbzheap_idx_t gc_gray[BBZHEAP_GCMARK_DEPTH];
+
+/**
+ * @brief Number of objects in gc_gray.
+ */
+static uint8_t gc_graynum;
+
+/**
+ * @brief Set when a marked object did not fit in gc_gray.
+ */
+static uint8_t gc_graylost;
+
+#ifdef BBZ_GENERATIONAL_GC
+/**
+ * @brief Index of the first object visited by the running collection.
+ * @details A minor collection assumes that the objects below the nursery
+ * are alive.
+ */
+static bbzheap_idx_t gc_young;
+
+/**
+ * @brief Whether an object is assumed alive by the running collection.
+ * @param[in] i The index of the object.
+ */
+#define gc_ismature(i) ((i) < gc_young)
+#else // BBZ_GENERATIONAL_GC
+#define gc_ismature(i) 0
+#endif // BBZ_GENERATIONAL_GC
+
+/**
+ * @brief Marks an object and queues it so that its references get marked.
+ * @param[in] obj The object.
+ */
+static void bbzheap_gc_shade(bbzheap_idx_t obj) {
+#ifdef BBZ_IMMEDIATE_INTS
+    /* Immediate integers are not in the heap */
+    if (bbzheap_idx_isimm(obj)) return;
+#endif // BBZ_IMMEDIATE_INTS
+    if (gc_ismature(obj)) return;
+    bbzobj_t* x = bbzheap_obj_at(obj);
+    if (gc_hasmark(*x)) return;
+    /* Mark gc bit */
+    gc_mark(*x);
+    if (!gc_hasrefs(*x)) return;
+    if (gc_graynum < BBZHEAP_GCMARK_DEPTH) {
+        gc_gray[gc_graynum++] = obj;
+    }
+    else {
+        /* Its references are marked when rescanning the heap */
+        gc_graylost = 1;
+        ++vm->heap.gcoverflows;
+    }
+}
+
+/**
+ * @brief Marks the objects a marked object refers to.
+ * @param[in] obj The object.
+ */
+static void bbzheap_gc_scan(bbzheap_idx_t obj) {
+    /* If it's a table, go through it and mark all associated objects */
+    if (bbztype_istable(*bbzheap_obj_at(obj))) {
+        /* Segment index in heap */
+        bbzheap_idx_t si = bbzheap_obj_at(obj)->t.value;
+        /* Actual segment data in heap */
+        bbzheap_aseg_t *sd = bbzheap_aseg_at(si);
+        /* Go through the segments */
+        while (1) {
+            bbzheap_gc_tseg_mark(*sd);
+            for (uint8_t j = 0; j < BBZHEAP_ELEMS_PER_ASEG; ++j) {
+                if (bbzheap_aseg_elem_isvalid(sd->values[j])) {
+                    bbzheap_gc_shade(bbzheap_aseg_elem_get(sd->values[j]));
+                }
+            }
+            if (!bbzheap_aseg_hasnext(sd)) break;
+            si = bbzheap_aseg_next_get(sd);
+            sd = bbzheap_aseg_at(si);
+        }
+    }
+    else {
+        bbzheap_gc_shade(bbzheap_obj_at(obj)->l.value.actrec);
+    }
+}
+
+/**
+ * @brief Marks an object and everything reachable from it.
+ * @details Objects that do not fit in the mark stack are only marked;
+ * bbzheap_gc_mark_lost() marks what they refer to.
+ * @param[in] obj The object.
+ */
 static void bbzheap_gc_mark(bbzheap_idx_t obj) {
-    static uint8_t callstack = 1; // The value of 1 is necessary
-    if (++callstack <= BBZHEAP_GCMARK_DEPTH && !gc_hasmark(*bbzheap_obj_at(obj))) {
-        /* Mark gc bit */
-        gc_mark(*bbzheap_obj_at(obj));
-        /* If it's a table, go through it and mark all associated objects */
-        if (bbztype_istable(*bbzheap_obj_at(obj))) {
-            /* Segment index in heap */
-            bbzheap_idx_t si = bbzheap_obj_at(obj)->t.value;
-            /* Actual segment data in heap */
-            bbzheap_aseg_t *sd = bbzheap_aseg_at(si);
-            /* Go through the segments */
-            while (1) {
-                bbzheap_gc_tseg_mark(*sd);
-                for (uint8_t j = 0; j < BBZHEAP_ELEMS_PER_ASEG; ++j) {
-                    if (bbzheap_aseg_elem_isvalid(sd->values[j])) {
-                        bbzheap_gc_mark(bbzheap_aseg_elem_get(sd->values[j]));
-                    }
+    bbzheap_gc_shade(obj);
+    while (gc_graynum) {
+        bbzheap_gc_scan(gc_gray[--gc_graynum]);
+    }
+}
+
+/**
+ * @brief Marks the references of the objects that did not fit in the
+ * mark stack, by scanning the heap for marked objects until none is lost.
+ */
+static void bbzheap_gc_mark_lost() {
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+    while (gc_graylost) {
+        gc_graylost = 0;
+        for(uint16_t i = 0; i < qot; ++i) {
+            if (gc_ismature(i)) continue;
+            bbzobj_t* x = bbzheap_obj_at(i);
+            if (bbzheap_obj_isvalid(*x) && gc_hasmark(*x) && gc_hasrefs(*x)) {
+                bbzheap_gc_scan(i);
+                while (gc_graynum) {
+                    bbzheap_gc_scan(gc_gray[--gc_graynum]);
                 }
-                if (!bbzheap_aseg_hasnext(sd)) break;
-                si = bbzheap_aseg_next_get(sd);
-                sd = bbzheap_aseg_at(si);
             }
         }
-        else if (bbztype_isclosurelambda(*bbzheap_obj_at(obj)) &&
-                 bbzheap_obj_at(obj)->l.value.actrec != BBZHEAP_CLOSURE_DFLT_ACTREC) {
-            bbzheap_gc_mark(bbzheap_obj_at(obj)->l.value.actrec);
+    }
+}
+
+#ifdef BBZ_HEAP_ROOTS
+/**
+ * @brief Whether the permanent objects must be found by scanning the heap.
+ */
+#define gc_findroots() (vm->heap.rootlost)
+
+/**
+ * @brief Marks the objects of the root registry, and drops the entries of
+ * the objects that were freed or are no longer permanent.
+ */
+static void bbzheap_gc_mark_roots() {
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+    for(uint8_t j = vm->heap.rootnum; j-- != 0;) {
+        bbzheap_idx_t i = vm->heap.roots[j];
+        if (i < qot &&
+            bbzheap_obj_isvalid(*bbzheap_obj_at(i)) &&
+            bbzheap_obj_ispermanent(*bbzheap_obj_at(i))) {
+            bbzheap_gc_mark(i);
+        }
+        else {
+            vm->heap.roots[j] = vm->heap.roots[--vm->heap.rootnum];
         }
     }
-    --callstack;
 }
+#else // BBZ_HEAP_ROOTS
+#define gc_findroots() 1
+#endif // BBZ_HEAP_ROOTS
 
-void bbzheap_gc(bbzheap_idx_t* st,
-                uint16_t sz) {
+/**
+ * @brief Clears all GC marks, then marks the permanent objects.
+ */
+static void bbzheap_gc_mark_permanents() {
     uint16_t i;
     const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t),
                    qot2 = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
     /* Set all segment's gc bits to zero */
     for(i = qot2; i-- != 0;)
         bbzheap_gc_tseg_unmark(*bbzheap_tseg_at(i));
+#ifdef BBZ_INCREMENTAL_GC
+    /* A full collection replaces the running incremental one */
+    vm->heap.gcphase = BBZHEAP_GC_IDLE;
+    gc_graynum = 0;
+#endif // BBZ_INCREMENTAL_GC
     /* Set all gc bits to zero */
     for(i = qot; i-- != 0;) {
         gc_unmark(*bbzheap_obj_at(i));
     }
+    gc_graylost = 0;
+#ifdef BBZ_HEAP_ROOTS
+    if (!vm->heap.rootlost) {
+        bbzheap_gc_mark_roots();
+        return;
+    }
+    /* Some permanent objects are missing from the registry; rebuild it */
+    vm->heap.rootnum = 0;
+    vm->heap.rootlost = 0;
+#endif // BBZ_HEAP_ROOTS
     for(i = qot; i-- != 0;) {
         if (bbzheap_obj_ispermanent(*bbzheap_obj_at(i))) {
+#ifdef BBZ_HEAP_ROOTS
+            if (vm->heap.rootnum < BBZHEAP_ROOTS_CAP) {
+                vm->heap.roots[vm->heap.rootnum++] = (bbzheap_idx_t)i;
+            }
+            else {
+                vm->heap.rootlost = 1;
+            }
+#endif // BBZ_HEAP_ROOTS
             bbzheap_gc_mark((bbzheap_idx_t)(i));
         }
     }
-    /* Go through the stack and set the gc bit of valid variables */
-    for(i = sz; i-- != 0;) {
-        /* Mark gc bit */
-        bbzheap_gc_mark(st[i]);
-    }
+}
+
+#ifdef BBZ_GENERATIONAL_GC
+/**
+ * @brief Makes every object and segment older than the nursery, and
+ * empties the remembered set.
+ */
+static void bbzheap_gc_tenure() {
+    vm->heap.young = (bbzheap_idx_t)((vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t));
+    vm->heap.syoung = (bbzheap_idx_t)((vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t));
+    vm->heap.remnum = 0;
+    vm->heap.remlost = 0;
+}
+#endif // BBZ_GENERATIONAL_GC
+
+/**
+ * @brief Invalidates all unmarked objects and trims the heap.
+ */
+static void bbzheap_gc_sweep() {
+    uint16_t i;
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
     /* Go through the objects; invalidate those with 0 gc bit */
     for(i = qot; i-- != 0;) {
         if(!gc_hasmark(*bbzheap_obj_at(i)) && bbzheap_obj_isvalid(*bbzheap_obj_at(i))) {
@@ -197,7 +823,13 @@ void bbzheap_gc(bbzheap_idx_t* st,
                 }
             }
         }
+        else {
+            gc_keep_ptr(*bbzheap_obj_at(i));
+        }
     }
+#ifdef BBZ_SMALL_OBJECTS
+    bbzheap_gc_sweep_ptrs();
+#endif // BBZ_SMALL_OBJECTS
     /* Move rightmost object pointer as far left as possible */
     for(;
         vm->heap.rtobj > vm->heap.data + BBZHEAP_RSV_ACTREC_MAX*sizeof(bbzobj_t);
@@ -211,7 +843,634 @@ void bbzheap_gc(bbzheap_idx_t* st,
         if(bbzheap_tseg_isvalid(*(bbzheap_tseg_t*)vm->heap.ltseg))
             break;
     }
+    /* Rebuild the lists of free slots and segments, lowest indexes first.
+     * This must come last, as it overwrites the 'next' field of the
+     * invalidated segments. */
+#ifdef BBZ_LAZY_GC
+    uint16_t f = (uint16_t)(vm->heap.ltseg - vm->heap.rtobj);
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+    const uint16_t objs = vm->heap.stats.objs;
+    vm->heap.stats.objs = (uint16_t)((vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t) - BBZHEAP_RSV_ACTREC_MAX);
+    vm->heap.stats.segs = (uint16_t)((vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t));
+#endif // BBZ_HEAP_STATS
+    vm->heap.ofree = BBZHEAP_OBJ_NO_FREE;
+    for(i = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); i-- > BBZHEAP_RSV_ACTREC_MAX;) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if(!bbzheap_obj_isvalid(*x)) {
+            x->mdata = 0;
+            x->s.value = vm->heap.ofree;
+            vm->heap.ofree = i;
+#ifdef BBZ_LAZY_GC
+            f += sizeof(bbzobj_t);
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+            --vm->heap.stats.objs;
+#endif // BBZ_HEAP_STATS
+        }
+    }
+    vm->heap.sfree = BBZHEAP_SEG_NO_NEXT;
+    for(i = (uint16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t); i-- != 0;) {
+        bbzheap_tseg_t* x = bbzheap_tseg_at(i);
+        if(!bbzheap_tseg_isvalid(*x)) {
+            x->mdata = vm->heap.sfree & BBZHEAP_SEG_MASK_NEXT;
+            vm->heap.sfree = i;
+#ifdef BBZ_LAZY_GC
+            f += sizeof(bbzheap_tseg_t);
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+            --vm->heap.stats.segs;
+#endif // BBZ_HEAP_STATS
+        }
+    }
+#ifdef BBZ_LAZY_GC
+    vm->heap.gcfree = f;
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_HEAP_STATS
+    vm->heap.stats.gclast = (uint16_t)(objs - vm->heap.stats.objs);
+    stats_gcdone();
+#endif // BBZ_HEAP_STATS
+#ifdef BBZ_GENERATIONAL_GC
+    bbzheap_gc_tenure();
+#endif // BBZ_GENERATIONAL_GC
+}
+
+void bbzheap_gc(bbzheap_idx_t* st,
+                uint16_t sz) {
+    uint16_t i;
+    bbzheap_gc_mark_permanents();
+    /* Go through the stack and set the gc bit of valid variables */
+    for(i = sz; i-- != 0;) {
+        /* Mark gc bit */
+        bbzheap_gc_mark(st[i]);
+    }
+    /* Same for the local symbols of the running closures */
+    for(i = (uint16_t)(vm->lstackptr + 1); i-- != 0;) {
+        bbzheap_gc_mark(vm->lstack[i]);
+    }
+    bbzheap_gc_mark_lost();
+    bbzheap_gc_sweep();
+#ifdef BBZ_LAZY_GC
+    bbzheap_gc_safepoint();
+#endif // BBZ_LAZY_GC
+}
+
+#ifdef BBZ_LAZY_GC
+/**
+ * @brief Collects garbage in the middle of an instruction.
+ * @details The objects allocated since the last safe point and the objects
+ * found anywhere in the stack and local symbol buffers are kept, as they may still be in use
+ * by the caller of the allocation.
+ */
+static void bbzheap_gc_retry() {
+    uint16_t i;
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+    bbzheap_gc_mark_permanents();
+    /* Go through the whole stack buffer, popped slots included */
+    for(i = BBZSTACK_SIZE; i-- != 0;) {
+        if (vm->stack[i] < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(vm->stack[i]))) {
+            bbzheap_gc_mark(vm->stack[i]);
+        }
+    }
+    for(i = BBZLSTACK_SIZE; i-- != 0;) {
+        if (vm->lstack[i] < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(vm->lstack[i]))) {
+            bbzheap_gc_mark(vm->lstack[i]);
+        }
+    }
+    /* Keep the objects allocated since the last safe point */
+    for(i = vm->heap.newmin; i <= vm->heap.newmax && i < qot; ++i) {
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(i))) {
+            bbzheap_gc_mark(i);
+        }
+    }
+    bbzheap_gc_mark_lost();
+    bbzheap_gc_sweep();
+}
+#endif // BBZ_LAZY_GC
+
+#ifdef BBZ_GENERATIONAL_GC
+void bbzheap_gc_remember(bbzheap_idx_t obj) {
+    /* The same object is often stored several times in a row */
+    if (vm->heap.remnum > 0 && vm->heap.remset[vm->heap.remnum - 1] == obj) return;
+    if (vm->heap.remnum < BBZHEAP_REMSET_CAP) {
+        vm->heap.remset[vm->heap.remnum++] = obj;
+    }
+    else {
+        vm->heap.remlost = 1;
+    }
+}
+
+/**
+ * @brief Frees the unmarked objects of the nursery with their segments,
+ * trims the heap down to the nursery, then chains the free slots and
+ * segments left in the nursery.
+ */
+static void bbzheap_gc_minor_sweep() {
+    uint16_t i;
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t),
+                   qot2 = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
+#ifdef BBZ_HEAP_STATS
+    const uint16_t objs = vm->heap.stats.objs;
+#endif // BBZ_HEAP_STATS
+    for(i = qot; i-- > vm->heap.young;) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if(gc_hasmark(*x) || !bbzheap_obj_isvalid(*x)) continue;
+        /* The segments of a table may be shared with a copy of it. A copy
+         * made since the last collection is in the nursery, and marks the
+         * segments if it is alive. An older copy has older segments. */
+        if(bbztype_istable(*x) &&
+           x->t.value >= vm->heap.syoung &&
+           !bbzheap_gc_tseg_hasmark(*bbzheap_tseg_at(x->t.value))) {
+            bbzheap_idx_t si = x->t.value;
+            while(1) {
+                bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+                uint8_t last = !bbzheap_tseg_hasnext(sd);
+                si = bbzheap_tseg_next_get(sd);
+                bbzheap_tseg_free(sd);
+                if(last) break;
+            }
+        }
+        bbzheap_obj_free(i);
+    }
+    /* Move rightmost object pointer and leftmost table segment pointer
+     * down to the nursery */
+    for(;
+        vm->heap.rtobj > vm->heap.data + vm->heap.young * sizeof(bbzobj_t);
+        vm->heap.rtobj -= sizeof(bbzobj_t))
+        if(bbzheap_obj_isvalid(*(bbzobj_t*)(vm->heap.rtobj - sizeof(bbzobj_t))))
+            break;
+    for(;
+        vm->heap.ltseg < vm->heap.data + BBZHEAP_SIZE - vm->heap.syoung * sizeof(bbzheap_tseg_t);
+        vm->heap.ltseg += sizeof(bbzheap_tseg_t)) {
+        if(bbzheap_tseg_isvalid(*(bbzheap_tseg_t*)vm->heap.ltseg))
+            break;
+    }
+    /* Chain the free slots and segments left in the nursery */
+    uint16_t f = (uint16_t)(qot * sizeof(bbzobj_t) - (vm->heap.rtobj - vm->heap.data));
+    for(i = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); i-- > vm->heap.young;) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if(!bbzheap_obj_isvalid(*x)) {
+            x->mdata = 0;
+            x->s.value = vm->heap.ofree;
+            vm->heap.ofree = i;
+            f += sizeof(bbzobj_t);
+        }
+    }
+    f += (uint16_t)(vm->heap.ltseg - (vm->heap.data + BBZHEAP_SIZE - qot2 * sizeof(bbzheap_tseg_t)));
+    for(i = (uint16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t); i-- > vm->heap.syoung;) {
+        bbzheap_tseg_t* x = bbzheap_tseg_at(i);
+        if(!bbzheap_tseg_isvalid(*x)) {
+            x->mdata = vm->heap.sfree & BBZHEAP_SEG_MASK_NEXT;
+            vm->heap.sfree = i;
+            f += sizeof(bbzheap_tseg_t);
+        }
+    }
+    vm->heap.gcfree += f;
+#ifdef BBZ_HEAP_STATS
+    vm->heap.stats.gclast = (uint16_t)(objs - vm->heap.stats.objs);
+    stats_gcdone();
+#endif // BBZ_HEAP_STATS
+}
+
+void bbzheap_gc_minor(bbzheap_idx_t* st,
+                      uint16_t sz) {
+    uint16_t i;
+    if (vm->heap.remlost) {
+        /* Some references from older objects to the nursery are unknown */
+        bbzheap_gc(st, sz);
+        return;
+    }
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t),
+                   qot2 = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
+    gc_young = vm->heap.young;
+    /* Clear the GC bits of the nursery */
+    for(i = qot2; i-- > vm->heap.syoung;)
+        bbzheap_gc_tseg_unmark(*bbzheap_tseg_at(i));
+    for(i = qot; i-- > gc_young;)
+        gc_unmark(*bbzheap_obj_at(i));
+    gc_graylost = 0;
+    /* Mark from the permanent objects of the nursery... */
+#ifdef BBZ_HEAP_ROOTS
+    if (!gc_findroots()) bbzheap_gc_mark_roots();
+    else
+#endif // BBZ_HEAP_ROOTS
+    for(i = qot; i-- > gc_young;) {
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(i)) &&
+            bbzheap_obj_ispermanent(*bbzheap_obj_at(i))) {
+            bbzheap_gc_mark(i);
+        }
+    }
+    /* ...the remembered set... */
+    for(i = vm->heap.remnum; i-- != 0;) {
+        bbzheap_idx_t r = vm->heap.remset[i];
+        bbzobj_t* x = bbzheap_obj_at(r);
+        if (!gc_ismature(r)) {
+            bbzheap_gc_mark(r);
+        }
+        else if (bbzheap_obj_isvalid(*x) && gc_hasrefs(*x)) {
+            /* An older object allocated since the last collection */
+            bbzheap_gc_scan(r);
+            while (gc_graynum) {
+                bbzheap_gc_scan(gc_gray[--gc_graynum]);
+            }
+        }
+    }
+    /* ...the stack and the local symbols */
+    for(i = sz; i-- != 0;) {
+        bbzheap_gc_mark(st[i]);
+    }
+    for(i = (uint16_t)(vm->lstackptr + 1); i-- != 0;) {
+        bbzheap_gc_mark(vm->lstack[i]);
+    }
+    bbzheap_gc_mark_lost();
+    gc_young = 0;
+    bbzheap_gc_minor_sweep();
+    bbzheap_gc_tenure();
+    ++vm->heap.minorgcs;
+    bbzheap_gc_safepoint();
+}
+#endif // BBZ_GENERATIONAL_GC
+
+#ifdef BBZ_INCREMENTAL_GC
+void bbzheap_gc_barrier(bbzheap_idx_t obj) {
+    bbzheap_gc_shade(obj);
+}
+
+/**
+ * @brief Marks the objects referenced by the stack and the local symbols,
+ * and those of the root registry.
+ * @details The stack and the local symbols are not covered by
+ * bbzheap_gc_write(), so they are marked again at the end of the marking
+ * phase.
+ * @param[in] st The stack.
+ * @param[in] sz The stack size.
+ * @return The number of references visited.
+ */
+static uint16_t bbzheap_gc_shade_roots(bbzheap_idx_t* st,
+                                       uint16_t sz) {
+    uint16_t i;
+    for(i = sz; i-- != 0;) {
+        bbzheap_gc_shade(st[i]);
+    }
+    for(i = (uint16_t)(vm->lstackptr + 1); i-- != 0;) {
+        bbzheap_gc_shade(vm->lstack[i]);
+    }
+#ifdef BBZ_HEAP_ROOTS
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+    for(i = vm->heap.rootnum; i-- != 0;) {
+        bbzheap_idx_t r = vm->heap.roots[i];
+        if (r < qot && bbzheap_obj_isvalid(*bbzheap_obj_at(r)) && bbzheap_obj_ispermanent(*bbzheap_obj_at(r))) {
+            bbzheap_gc_shade(r);
+        }
+    }
+    return (uint16_t)(sz + vm->lstackptr + 1 + vm->heap.rootnum);
+#else // BBZ_HEAP_ROOTS
+    return (uint16_t)(sz + vm->lstackptr + 1);
+#endif // BBZ_HEAP_ROOTS
+}
+
+/**
+ * @brief Visits the next object or segment of the running collection.
+ * @param[in] st The stack.
+ * @param[in] sz The stack size.
+ * @return The amount of work done.
+ */
+static uint16_t bbzheap_gc_step(bbzheap_idx_t* st,
+                                uint16_t sz) {
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t),
+                   qot2 = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
+    uint16_t i = vm->heap.gccursor;
+    bbzobj_t* x;
+    switch(vm->heap.gcphase) {
+        case BBZHEAP_GC_CLEAR:
+            if (i < qot) gc_unmark(*bbzheap_obj_at(i));
+            if (i < qot2) bbzheap_gc_tseg_unmark(*bbzheap_tseg_at(i));
+            vm->heap.gccursor = ++i;
+            if (i < qot || i < qot2) return 1;
+            vm->heap.gcphase = BBZHEAP_GC_MARK;
+            vm->heap.gccursor = 0;
+            vm->heap.gcrescan = 0;
+            gc_graynum = 0;
+            gc_graylost = 0;
+            return 1 + bbzheap_gc_shade_roots(st, sz);
+        case BBZHEAP_GC_MARK:
+            if (gc_graynum) {
+                i = gc_gray[--gc_graynum];
+                /* The object may have been freed since it was queued */
+                x = bbzheap_obj_at(i);
+                if (bbzheap_obj_isvalid(*x) && gc_hasrefs(*x)) bbzheap_gc_scan(i);
+                return 1;
+            }
+            /* The permanent objects are found by a heap scan if they
+             * are not all in the root registry */
+            if (i < qot && (vm->heap.gcrescan || gc_findroots())) {
+                vm->heap.gccursor = i + 1;
+                x = bbzheap_obj_at(i);
+                if (!bbzheap_obj_isvalid(*x)) return 1;
+                if (vm->heap.gcrescan) {
+                    if (gc_hasmark(*x) && gc_hasrefs(*x)) bbzheap_gc_scan(i);
+                }
+                else if (bbzheap_obj_ispermanent(*x)) {
+                    bbzheap_gc_shade(i);
+                }
+                return 1;
+            }
+            if (gc_graylost) {
+                /* Scan the heap again for the objects that did not fit */
+                gc_graylost = 0;
+                vm->heap.gcrescan = 1;
+                vm->heap.gccursor = 0;
+                return 1;
+            }
+            /* The roots may have changed since the start of the phase */
+            i = bbzheap_gc_shade_roots(st, sz);
+            if (gc_graynum || gc_graylost) return i;
+            vm->heap.gcphase = BBZHEAP_GC_SWEEP;
+            vm->heap.gccursor = 0;
+#ifdef BBZ_HEAP_STATS
+            vm->heap.stats.gclast = 0;
+#endif // BBZ_HEAP_STATS
+#ifdef BBZ_LAZY_GC
+            /* The free space is counted again while sweeping */
+            vm->heap.gcfree = (uint16_t)(vm->heap.ltseg - vm->heap.rtobj);
+#endif // BBZ_LAZY_GC
+            return i;
+        case BBZHEAP_GC_SWEEP:
+            if (i >= qot) {
+#ifdef BBZ_SMALL_OBJECTS
+                bbzheap_gc_sweep_ptrs();
+#endif // BBZ_SMALL_OBJECTS
+                vm->heap.gcphase = BBZHEAP_GC_SWEEPSEGS;
+                vm->heap.gccursor = 0;
+                return 1;
+            }
+            vm->heap.gccursor = i + 1;
+            x = bbzheap_obj_at(i);
+            if (bbzheap_obj_isvalid(*x)) {
+                if (gc_hasmark(*x)) {
+                    gc_keep_ptr(*x);
+                    return 1;
+                }
+                bbzheap_obj_free(i);
+#ifdef BBZ_HEAP_STATS
+                if (i >= BBZHEAP_RSV_ACTREC_MAX) ++vm->heap.stats.gclast;
+#endif // BBZ_HEAP_STATS
+            }
+#ifdef BBZ_LAZY_GC
+            if (i >= BBZHEAP_RSV_ACTREC_MAX) vm->heap.gcfree += sizeof(bbzobj_t);
+#endif // BBZ_LAZY_GC
+            return 1;
+        default: {
+            if (i >= qot2) {
+                vm->heap.gcphase = BBZHEAP_GC_IDLE;
+                ++vm->heap.gccycles;
+                stats_gcdone();
+                return 1;
+            }
+            vm->heap.gccursor = i + 1;
+            bbzheap_tseg_t* sd = bbzheap_tseg_at(i);
+            if (bbzheap_tseg_isvalid(*sd)) {
+                if (bbzheap_gc_tseg_hasmark(*sd)) return 1;
+                bbzheap_tseg_free(sd);
+            }
+#ifdef BBZ_LAZY_GC
+            vm->heap.gcfree += sizeof(bbzheap_tseg_t);
+#endif // BBZ_LAZY_GC
+            return 1;
+        }
+    }
+}
+
+uint8_t bbzheap_gc_slice(bbzheap_idx_t* st,
+                         uint16_t sz,
+                         uint16_t budget) {
+    uint16_t work = 0;
+    if (vm->heap.gcphase == BBZHEAP_GC_IDLE) {
+        vm->heap.gcphase = BBZHEAP_GC_CLEAR;
+        vm->heap.gccursor = 0;
+    }
+    while (work < budget && vm->heap.gcphase != BBZHEAP_GC_IDLE) {
+        work += bbzheap_gc_step(st, sz);
+    }
+    if (work > vm->heap.gcmaxwork) vm->heap.gcmaxwork = work;
+    return vm->heap.gcphase != BBZHEAP_GC_IDLE;
+}
+#endif // BBZ_INCREMENTAL_GC
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_HEAP_COMPACTION
+/**
+ * @brief Returns the new index of an object moved by bbzheap_compact().
+ * @details A moved object leaves its new index in its old slot, which is
+ * invalid and has a GC mark.
+ * @param[in] i The index of the object.
+ * @return The new index of the object.
+ */
+static bbzheap_idx_t bbzheap_compact_obj(bbzheap_idx_t i) {
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_idx_isimm(i)) return i;
+#endif // BBZ_IMMEDIATE_INTS
+    bbzobj_t* x = (bbzobj_t*)vm->heap.data + i;
+    if (i >= BBZHEAP_RSV_ACTREC_MAX && !bbzheap_obj_isvalid(*x) && gc_hasmark(*x)) {
+        return x->s.value;
+    }
+    return i;
+}
+
+/**
+ * @brief Returns the new index of a segment moved by bbzheap_compact().
+ * @details A moved segment leaves its new index in the 'next' field of
+ * its old slot, which is invalid and has a GC mark.
+ * @param[in] i The index of the segment.
+ * @return The new index of the segment.
+ */
+static bbzheap_idx_t bbzheap_compact_seg(bbzheap_idx_t i) {
+    bbzheap_tseg_t* sd = bbzheap_tseg_at(i);
+    if (!bbzheap_tseg_isvalid(*sd) && bbzheap_gc_tseg_hasmark(*sd)) {
+        return bbzheap_tseg_next_get(sd);
+    }
+    return i;
+}
+
+/**
+ * @brief Updates a reference to an object moved by bbzheap_compact().
+ * @param[in,out] i The reference.
+ */
+#define compact_fix(i) (i) = bbzheap_compact_obj(i)
+
+void bbzheap_compact(bbzheap_idx_t* st,
+                     uint16_t sz) {
+    uint16_t i, lo, hi;
+    const uint16_t qot = (int16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t),
+                   qot2 = (int16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t);
+#ifdef BBZ_INCREMENTAL_GC
+    /* The marks are used below */
+    vm->heap.gcphase = BBZHEAP_GC_IDLE;
+    gc_graynum = 0;
+#endif // BBZ_INCREMENTAL_GC
+    /* Segments with a GC mark are not moved */
+    for(i = qot2; i-- != 0;) {
+        bbzheap_gc_tseg_unmark(*bbzheap_tseg_at(i));
+    }
+#ifdef BBZ_HASHED_TABLES
+    /* The hash of a table is the index of its first segment */
+    for(i = qot; i-- != 0;) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if (!bbzheap_obj_isvalid(*x) || !bbztype_istable(*x) || bbztype_isdarray(*x)) continue;
+        bbzheap_idx_t si = x->t.value;
+        while (1) {
+            bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+            for (uint8_t j = 0; j < BBZHEAP_ELEMS_PER_TSEG; ++j) {
+                if (!bbzheap_tseg_elem_isvalid(sd->keys[j])) continue;
+                bbzheap_idx_t k = bbzheap_tseg_elem_get(sd->keys[j]);
+#ifdef BBZ_IMMEDIATE_INTS
+                if (bbzheap_idx_isimm(k)) continue;
+#endif // BBZ_IMMEDIATE_INTS
+                if (bbztype_istable(*bbzheap_obj_at(k))) {
+                    bbzheap_gc_tseg_mark(*bbzheap_tseg_at(bbzheap_obj_at(k)->t.value));
+                }
+            }
+            if (!bbzheap_tseg_hasnext(sd)) break;
+            si = bbzheap_tseg_next_get(sd);
+        }
+    }
+#endif // BBZ_HASHED_TABLES
+    /* Move the topmost objects into the lowest free slots */
+    lo = BBZHEAP_RSV_ACTREC_MAX;
+    hi = qot;
+    while (1) {
+        while (lo < hi && bbzheap_obj_isvalid(*bbzheap_obj_at(lo))) ++lo;
+        while (hi > lo && !bbzheap_obj_isvalid(*bbzheap_obj_at(hi - 1))) --hi;
+        if (lo >= hi) break;
+        bbzobj_t* x = bbzheap_obj_at(--hi);
+        *bbzheap_obj_at(lo) = *x;
+        x->mdata = BBZHEAP_MASK_GCMARK;
+        x->s.value = lo++;
+    }
+    vm->heap.rtobj = vm->heap.data + lo * sizeof(bbzobj_t);
+    vm->heap.ofree = BBZHEAP_OBJ_NO_FREE;
+    /* Same for the segments, except the marked ones */
+    lo = 0;
+    hi = qot2;
+    while (1) {
+        while (lo < hi && bbzheap_tseg_isvalid(*bbzheap_tseg_at(lo))) ++lo;
+        while (hi > lo && (!bbzheap_tseg_isvalid(*bbzheap_tseg_at(hi - 1)) ||
+                           bbzheap_gc_tseg_hasmark(*bbzheap_tseg_at(hi - 1)))) --hi;
+        if (lo >= hi) break;
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(--hi);
+        *bbzheap_tseg_at(lo) = *sd;
+        sd->mdata = BBZHEAP_TSEG_MASK_GCMARK | lo++;
+    }
+    /* Update the references held by the tables and the segments */
+    for(i = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); i-- != 0;) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if (bbzheap_obj_isvalid(*x) && bbztype_istable(*x)) {
+            x->t.value = bbzheap_compact_seg(x->t.value);
+            bbzheap_aseg_t* hd = bbzheap_aseg_at(x->t.value);
+            if (bbztype_isdarray(*x) && bbzheap_aseg_hasnext(hd)) {
+                /* The header of a dynamic array holds its last segment */
+                bbzdarray_hdr_tail(hd) = bbzheap_compact_seg(bbzdarray_hdr_tail(hd));
+            }
+        }
+    }
+    for(i = qot2; i-- != 0;) {
+        bbzheap_aseg_t* sd = bbzheap_aseg_at(i);
+        if (!bbzheap_aseg_isvalid(*sd)) continue;
+        bbzheap_gc_tseg_unmark(*sd);
+        if (bbzheap_aseg_hasnext(sd)) {
+            bbzheap_aseg_next_set(sd, bbzheap_compact_seg(bbzheap_aseg_next_get(sd)));
+        }
+        for (uint8_t j = 0; j < BBZHEAP_ELEMS_PER_ASEG; ++j) {
+            if (bbzheap_aseg_elem_isvalid(sd->values[j])) {
+                bbzheap_aseg_elem_set(sd->values[j], bbzheap_compact_obj(bbzheap_aseg_elem_get(sd->values[j])));
+            }
+        }
+    }
+    /* Update the references held outside of the heap */
+    for(i = sz; i-- != 0;) {
+        compact_fix(st[i]);
+    }
+    for(i = (uint16_t)(vm->lstackptr + 1); i-- != 0;) {
+        compact_fix(vm->lstack[i]);
+    }
+    compact_fix(vm->gsyms);
+    compact_fix(vm->nil);
+    compact_fix(vm->dflt_actrec);
+    compact_fix(vm->flist);
+#ifndef BBZ_DISABLE_SWARMS
+    compact_fix(vm->swarm.hpos);
+    compact_fix(vm->swarm.swarmstack);
+    compact_fix(vm->swarm.proto);
+#endif // !BBZ_DISABLE_SWARMS
+#ifndef BBZ_DISABLE_NEIGHBORS
+    compact_fix(vm->neighbors.hpos);
+    compact_fix(vm->neighbors.listeners);
+    compact_fix(vm->neighbors.proto);
+#endif // !BBZ_DISABLE_NEIGHBORS
+#ifndef BBZ_DISABLE_VSTIGS
+    compact_fix(vm->vstig.hpos);
+    compact_fix(vm->vstig.proto);
+    for(i = vm->vstig.size; i-- != 0;) {
+        compact_fix(vm->vstig.data[i].value);
+    }
+#endif // !BBZ_DISABLE_VSTIGS
+#ifdef BBZ_HEAP_ROOTS
+    for(i = vm->heap.rootnum; i-- != 0;) {
+        if (vm->heap.roots[i] < qot) compact_fix(vm->heap.roots[i]);
+    }
+#endif // BBZ_HEAP_ROOTS
+#ifdef BBZ_INTERN_STRINGS
+    for(i = BBZHEAP_STRINGS_CAP; i-- != 0;) {
+        /* The map may hold stale indexes (see bbzheap_obj_alloc_once()) */
+        if (vm->heap.strings[i] < qot) compact_fix(vm->heap.strings[i]);
+    }
+#endif // BBZ_INTERN_STRINGS
+    /* Trim the segments, then rebuild their free list */
+    for(;
+        vm->heap.ltseg < vm->heap.data + BBZHEAP_SIZE;
+        vm->heap.ltseg += sizeof(bbzheap_tseg_t)) {
+        if(bbzheap_tseg_isvalid(*(bbzheap_tseg_t*)vm->heap.ltseg))
+            break;
+    }
+    vm->heap.sfree = BBZHEAP_SEG_NO_NEXT;
+    for(i = (uint16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t); i-- != 0;) {
+        bbzheap_tseg_t* x = bbzheap_tseg_at(i);
+        if(!bbzheap_tseg_isvalid(*x)) {
+            x->mdata = vm->heap.sfree & BBZHEAP_SEG_MASK_NEXT;
+            vm->heap.sfree = i;
+        }
+    }
+#ifdef BBZ_GENERATIONAL_GC
+    bbzheap_gc_tenure();
+#endif // BBZ_GENERATIONAL_GC
+    ++vm->heap.compactions;
+}
+#endif // BBZ_HEAP_COMPACTION
+
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_HEAP_STATS
+void bbzheap_stats_get(bbzheap_stats_t* s) {
+    *s = vm->heap.stats;
+    s->gap = (uint16_t)(vm->heap.ltseg - vm->heap.rtobj);
+    s->tablemax = 0;
+    const uint16_t qot = (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t);
+    for(uint16_t i = 0; i < qot; ++i) {
+        bbzobj_t* x = bbzheap_obj_at(i);
+        if(!bbzheap_obj_isvalid(*x) || !bbztype_istable(*x)) continue;
+        uint16_t n = 1;
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(x->t.value);
+        while(bbzheap_tseg_hasnext(sd)) {
+            sd = bbzheap_tseg_at(bbzheap_tseg_next_get(sd));
+            ++n;
+        }
+        if (n > s->tablemax) s->tablemax = n;
+    }
 }
+#endif // BBZ_HEAP_STATS
 
 /****************************************/
 /****************************************/
@@ -250,7 +1509,7 @@ void bbzheap_print() {
                     printf(" %" PRIu16, bbzheap_obj_at(i)->t.value);
                     break;
                 case BBZTYPE_USERDATA:
-                    printf(" %" PRIXPTR, bbzheap_obj_at(i)->u.value);
+                    printf(" %" PRIXPTR, bbzheap_obj_hasptr(*bbzheap_obj_at(i)) ? (uintptr_t)bbzheap_obj_ptr(*bbzheap_obj_at(i)) : 0);
                     break;
                 case BBZTYPE_CLOSURE:
                     if (bbztype_isclosurenative(*bbzheap_obj_at(i))) printf("[n]");
@@ -287,6 +1546,12 @@ void bbzheap_print() {
     int usage = (objnum * sizeof(bbzobj_t)) + (tsegnum * sizeof(bbzheap_tseg_t));
     printf("Heap usage (B): %04d/%04d (%.1f%%)\n", usage, BBZHEAP_SIZE, ((double)usage/BBZHEAP_SIZE)*100.0);
     printf("Heap usage (B) for 16-bit pointers: %04d\n", (int)(objnum * 3 + (tsegnum * sizeof(bbzheap_tseg_t))));
+#ifdef BBZ_SMALL_OBJECTS
+    int ptrnum = 0;
+    for(int i = 0; i < BBZHEAP_PTRS_CAP; ++i)
+        if(vm->heap.ptrflags[i] & BBZHEAP_PTR_VALID) ++ptrnum;
+    printf("Pointers: %d/%d\n", ptrnum, BBZHEAP_PTRS_CAP);
+#endif // BBZ_SMALL_OBJECTS
     int uspace = ((vm->heap.ltseg)-(vm->heap.rtobj));
     printf("Unclaimed space (B): %d (=%d object(s) or %d segment(s))\n",
            uspace,
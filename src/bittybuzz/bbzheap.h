@@ -24,6 +24,64 @@ extern "C" {
  */
 #define BBZHEAP_ELEMS_PER_ASEG (2*(BBZHEAP_ELEMS_PER_TSEG))
 
+#ifdef BBZ_IMMEDIATE_INTS
+/**
+ * @brief Flag of the heap indexes which hold an integer value instead of
+ * referring to an object of the heap.
+ * @details The flag fits below the validity bit of the table segments'
+ * elements, so immediate integers can be stored in tables as well.
+ */
+#define BBZHEAP_IDX_IMM_FLAG ((bbzheap_idx_t)0x4000)
+
+/**
+ * @brief Mask for the value of an immediate integer.
+ */
+#define BBZHEAP_IDX_IMM_MASK ((bbzheap_idx_t)0x3FFF)
+
+/**
+ * @brief Smallest integer that can be immediate.
+ */
+#define BBZHEAP_IMM_MIN (-8192)
+
+/**
+ * @brief Largest integer that can be immediate.
+ */
+#define BBZHEAP_IMM_MAX 8191
+
+/**
+ * @brief Number of temporary objects used to access immediate integers.
+ * @see bbzheap_obj_at()
+ */
+#define BBZHEAP_IMM_OBJS 4
+
+/**
+ * @brief Returns non-zero if a heap index holds an immediate integer.
+ * @param[in] i The heap index.
+ */
+#define bbzheap_idx_isimm(i) (((i) & BBZHEAP_IDX_IMM_FLAG) != 0)
+
+/**
+ * @brief Returns non-zero if an integer can be immediate.
+ * @param[in] v The integer.
+ */
+#define bbzheap_imm_fits(v) ((v) >= BBZHEAP_IMM_MIN && (v) <= BBZHEAP_IMM_MAX)
+
+/**
+ * @brief Returns the heap index holding an integer.
+ * @warning The integer must fit; see bbzheap_imm_fits().
+ * @param[in] v The integer.
+ */
+#define bbzheap_imm_make(v) ((bbzheap_idx_t)(((uint16_t)(v) & BBZHEAP_IDX_IMM_MASK) | BBZHEAP_IDX_IMM_FLAG))
+
+/**
+ * @brief Returns the integer held by an immediate heap index.
+ * @param[in] i The heap index.
+ */
+#define bbzheap_imm_get(i) ((int16_t)((uint16_t)((i) << 2)) >> 2)
+#else // BBZ_IMMEDIATE_INTS
+#define bbzheap_idx_isimm(i) 0 /**< @brief Heap indexes always refer to an object. */
+#endif // BBZ_IMMEDIATE_INTS
+
 /**
  * @brief A table segment.
  */
@@ -63,6 +121,34 @@ typedef struct PACKED bbzheap_aseg_t {
     uint16_t mdata;
 } bbzheap_aseg_t;
 
+#ifdef BBZ_HEAP_STATS
+/**
+ * @brief Index of the table segments in bbzheap_stats_t::allocs and
+ * bbzheap_stats_t::allocfails, which are first indexed by object type.
+ */
+#define BBZHEAP_STATS_TSEG (BBZTYPE_USERDATA + 1)
+
+/**
+ * @brief Heap and garbage collector counters.
+ * @details The counters wrap around. The objects in the slots reserved for
+ * activation records are not counted.
+ * @see bbzheap_stats_get()
+ */
+typedef struct PACKED bbzheap_stats_t {
+    uint16_t objs;     /**< @brief Number of live objects */
+    uint16_t objspeak; /**< @brief Highest number of live objects */
+    uint16_t segs;     /**< @brief Number of live table segments */
+    uint16_t segspeak; /**< @brief Highest number of live table segments */
+    uint16_t allocs[BBZHEAP_STATS_TSEG + 1];     /**< @brief Number of allocations, by object type, then of table segments */
+    uint16_t allocfails[BBZHEAP_STATS_TSEG + 1]; /**< @brief Number of failed allocations, by object type, then of table segments */
+    uint16_t gcs;      /**< @brief Number of garbage collections */
+    uint16_t gclast;   /**< @brief Number of objects reclaimed by the last garbage collection (so far, while an incremental one runs) */
+    uint16_t gcmax;    /**< @brief Most objects reclaimed by a single garbage collection */
+    uint16_t gap;      /**< @brief Unclaimed space between the objects and the table segments (B). Filled by bbzheap_stats_get(). */
+    uint16_t tablemax; /**< @brief Number of segments of the largest table. Filled by bbzheap_stats_get(). */
+} bbzheap_stats_t;
+#endif // BBZ_HEAP_STATS
+
 /**
  * @brief The heap structure.
  *
@@ -86,13 +172,95 @@ typedef struct PACKED bbzheap_aseg_t {
  *    each composed of a (bbzobj_t,bbzobj_t) pair. Each segment also has a
  *    2-byte field which contains flags and a pointer to the next
  *    segment, if any.
+ *
+ * Free object slots and free segments are chained in two lists, so that
+ * allocating takes constant time. A free object holds the index of the
+ * next free object in its value; a free segment holds the index of the
+ * next free segment in its 'next' field. The garbage collector rebuilds
+ * both lists, lowest indexes first.
+ *
+ * With BBZ_GENERATIONAL_GC, the objects and segments allocated since the
+ * last garbage collection form the nursery: they are above the 'young'
+ * and 'syoung' indexes, and new ones are taken past its end as long as
+ * there is room. Freeing a nursery object or segment does not chain it in
+ * the free lists, which only hold older slots, until a collection.
+ *
+ * With BBZ_HEAP_ROOTS, the indexes of the permanent objects are also
+ * listed in the 'roots' registry, which the garbage collector walks
+ * instead of testing the permanent flag of every object.
+ *
+ * With BBZ_SMALL_OBJECTS, C closures and userdata do not store their
+ * pointer in the object, but an index in a table of pointers kept next to
+ * the data buffer. All objects then take 3 bytes, whatever the size of a
+ * pointer on the target.
  */
 typedef struct PACKED bbzheap_t {
     uint8_t* rtobj;             /**< @brief Pointer to after the rightmost object in heap, not necessarly valid */
     uint8_t* ltseg;             /**< @brief Pointer to the leftmost table segment in heap, not necessarly valid */
+    bbzheap_idx_t ofree;        /**< @brief Index of the first free object slot, or BBZHEAP_OBJ_NO_FREE */
+    bbzheap_idx_t sfree;        /**< @brief Index of the first free segment, or BBZHEAP_SEG_NO_NEXT */
+    uint16_t gcoverflows;       /**< @brief Number of objects that did not fit in the garbage collector's mark stack */
+#ifdef BBZ_LAZY_GC
+    uint16_t gcfree;            /**< @brief Free space (in bytes) left before the next garbage collection is due */
+    bbzheap_idx_t newmin;       /**< @brief Lowest index of the objects allocated since the last safe point */
+    bbzheap_idx_t newmax;       /**< @brief Highest index of the objects allocated since the last safe point */
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_GENERATIONAL_GC
+    bbzheap_idx_t young;        /**< @brief Index of the first object allocated since the last garbage collection */
+    bbzheap_idx_t syoung;       /**< @brief Index of the first segment allocated since the last garbage collection */
+    bbzheap_idx_t remset[BBZHEAP_REMSET_CAP]; /**< @brief Nursery objects stored in the heap and objects allocated out of the nursery since the last garbage collection */
+    uint8_t remnum;             /**< @brief Number of objects in the remembered set */
+    uint8_t remlost;            /**< @brief Whether an object did not fit in the remembered set */
+    uint16_t minorgcs;          /**< @brief Number of minor garbage collections (see bbzheap_gc_minor()) */
+#endif // BBZ_GENERATIONAL_GC
+#ifdef BBZ_IMMEDIATE_INTS
+    bbzobj_t imm[BBZHEAP_IMM_OBJS]; /**< @brief Temporary objects of the immediate integers */
+#ifdef DEBUG
+    bbzheap_idx_t immidx[BBZHEAP_IMM_OBJS]; /**< @brief Immediate integer each temporary object was made from */
+#endif // DEBUG
+    uint16_t immnext;           /**< @brief Next temporary object to use (16 bits, to keep the following members aligned) */
+#endif // BBZ_IMMEDIATE_INTS
+#ifdef BBZ_INCREMENTAL_GC
+    uint8_t gcphase;            /**< @brief Phase of the running incremental garbage collection (see bbzheap_gc_phase) */
+    uint8_t gcrescan;           /**< @brief Whether the marking phase is scanning the heap for objects that did not fit in the mark stack */
+    uint16_t gccursor;          /**< @brief Next object or segment visited by the running incremental garbage collection */
+    uint16_t gccycles;          /**< @brief Number of incremental garbage collections completed */
+    uint16_t gcmaxwork;         /**< @brief Most work done by a single garbage collection slice (see bbzheap_gc_slice()) */
+#endif // BBZ_INCREMENTAL_GC
+#ifdef BBZ_HEAP_COMPACTION
+    uint16_t compactions;       /**< @brief Number of compactions (see bbzheap_compact()) */
+#endif // BBZ_HEAP_COMPACTION
+#ifdef BBZ_HEAP_STATS
+    bbzheap_stats_t stats;      /**< @brief Counters (see bbzheap_stats_get()) */
+#endif // BBZ_HEAP_STATS
+#ifdef BBZ_SMALL_OBJECTS
+    uintptr_t ptrs[BBZHEAP_PTRS_CAP]; /**< @brief Pointers of the C closures and userdata, which refer to them by index */
+    uint8_t ptrflags[BBZHEAP_PTRS_CAP]; /**< @brief Whether each pointer is in use, was referenced since the last garbage collection or was freed */
+#endif // BBZ_SMALL_OBJECTS
+#ifdef BBZ_HEAP_ROOTS
+    bbzheap_idx_t roots[BBZHEAP_ROOTS_CAP]; /**< @brief Indexes of the permanent objects */
+    uint8_t rootnum;            /**< @brief Number of entries in the root registry */
+    uint8_t rootlost;           /**< @brief Whether a permanent object did not fit in the root registry */
+#endif // BBZ_HEAP_ROOTS
+#ifdef BBZ_INTERN_STRINGS
+    bbzheap_idx_t strings[BBZHEAP_STRINGS_CAP]; /**< @brief Index of the last string object allocated for each string ID */
+#endif // BBZ_INTERN_STRINGS
     uint8_t data[BBZHEAP_SIZE]; /**< @brief Data buffer */
 } bbzheap_t;
 
+#ifdef BBZ_INCREMENTAL_GC
+/**
+ * @brief Phases of an incremental garbage collection.
+ */
+typedef enum {
+    BBZHEAP_GC_IDLE = 0, /**< @brief No garbage collection is running */
+    BBZHEAP_GC_CLEAR,    /**< @brief Clearing the marks of the previous collection */
+    BBZHEAP_GC_MARK,     /**< @brief Marking the objects reachable from the roots */
+    BBZHEAP_GC_SWEEP,    /**< @brief Freeing the unmarked objects */
+    BBZHEAP_GC_SWEEPSEGS /**< @brief Freeing the unmarked segments */
+} bbzheap_gc_phase;
+#endif // BBZ_INCREMENTAL_GC
+
 #ifdef DEBUG
 void bbzheap_print();
 #endif
@@ -103,11 +271,23 @@ void bbzheap_print();
  */
 void bbzheap_clear();
 
+#ifdef BBZ_HEAP_STATS
+/**
+ * @brief Gets the heap and garbage collector counters.
+ * @details Looks for the largest table, so it takes time proportional to
+ * the size of the heap.
+ * @param[out] s A buffer for the counters.
+ */
+void bbzheap_stats_get(bbzheap_stats_t* s);
+#endif // BBZ_HEAP_STATS
+
 /**
  * @brief Allocates space for an object on the heap.
  * In the general case, sets as output the value of <code>o</code>, a buffer for the index of the allocated object.
  * The value of <code>o</code> is not checked for <code>NULL</code>, so make sure it's a valid pointer.
  * @details In the case of a string allocation, the parameter <code>o</code> must be set to the string ID beforehand.
+ * If a string object with this ID already exists, its index is returned instead. With BBZ_INTERN_STRINGS,
+ * it is found in constant time through a string ID -> heap index map.
  * @param[in] t The type of the object.
  * @param[in,out] o A buffer for the index of the allocated object. In the case of a string allocation,
  * this must be set to the string ID beforehand.
@@ -116,8 +296,31 @@ void bbzheap_clear();
 uint8_t bbzheap_obj_alloc(uint8_t t,
                           bbzheap_idx_t* o);
 
+/**
+ * @brief Marks the end of the list of free object slots.
+ */
+#define BBZHEAP_OBJ_NO_FREE ((bbzheap_idx_t)0xFFFF)
+
+/**
+ * @brief Frees an object, making its slot available for allocation.
+ * @details Does nothing if the object is already free or is an immediate
+ * integer. The slots reserved for activation records are invalidated, but
+ * not chained in the list of free slots.
+ * @param[in] i The index of the object.
+ */
+void bbzheap_obj_free(bbzheap_idx_t i);
+
 /**
  * @brief Returns a pointer located at position i within the heap.
+ * @details When i holds an immediate integer, the returned object is one
+ * of BBZHEAP_IMM_OBJS temporary integer objects, used in turn.
+ * @warning Such a pointer is only valid until BBZHEAP_IMM_OBJS other
+ * immediate integers are looked up, which any call into the VM or the heap
+ * may do. Do not keep it across such calls. The object must not be written
+ * to: changes made to it are lost. Code that modifies an object must
+ * reject immediate integers first (see bbzheap_idx_isimm()). With DEBUG,
+ * a temporary object found modified when it is reused sets a
+ * #BBZVM_ERROR_TYPE error.
  * @param[in] i The position (a bbzheap_idx_t).
  * @return A pointer to the object.
  */
@@ -135,7 +338,7 @@ bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i);
  *  @param [in] iSrc The position of the source object.
  *  @param [in] iDest The position of the destination object.
  */
-#define bbzheap_obj_copy(iSrc, iDest) do{(*bbzheap_obj_at(iDest)) = (*bbzheap_obj_at(iSrc));}while(0)
+#define bbzheap_obj_copy(iSrc, iDest) do{if (!bbzheap_idx_isimm(iDest)) (*bbzheap_obj_at(iDest)) = (*bbzheap_obj_at(iSrc));}while(0)
 
 /**
  * @brief Check if an object is permanent (should never be garbage collected).
@@ -144,17 +347,125 @@ bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i);
  */
 #define bbzheap_obj_ispermanent(x) ((x).mdata & BBZHEAP_MASK_PERMANENT)
 
+#ifdef BBZ_HEAP_ROOTS
+/**
+ * @brief Makes an object permanent, and adds it to the root registry.
+ * @details When the registry is full, the object is still kept, but
+ * garbage collections scan the heap for the permanent objects until the
+ * next full collection rebuilds the registry.
+ * @param[in] i The heap index of the object.
+ */
+void bbzheap_root_add(bbzheap_idx_t i);
+
+/**
+ * @brief Unmakes an object permanent, and removes it from the root
+ * registry.
+ * @details The object may have been freed already.
+ * @param[in] i The heap index of the object.
+ */
+void bbzheap_root_remove(bbzheap_idx_t i);
+
+/**
+ * @brief Make an object permanent.
+ * @param[in,out] x The object to make permanent.
+ * @see bbzheap_root_add()
+ */
+#define bbzheap_obj_make_permanent(x) bbzheap_root_add((bbzheap_idx_t)(&(x) - (bbzobj_t*)vm->heap.data))
+
+/**
+ * @brief Unmake an object permanent.
+ * @param[in,out] x The object to unmake permanent.
+ * @see bbzheap_root_remove()
+ */
+#define bbzheap_obj_unmake_permanent(x) bbzheap_root_remove((bbzheap_idx_t)(&(x) - (bbzobj_t*)vm->heap.data))
+#else // BBZ_HEAP_ROOTS
 /**
  * @brief Make an object permanent.
  * @param[in,out] x The object to make permanent.
  */
+#ifdef BBZ_INCREMENTAL_GC
+#define bbzheap_obj_make_permanent(x) do{(x).mdata|=BBZHEAP_MASK_PERMANENT;bbzheap_gc_write_obj(&(x));}while(0)
+#else // BBZ_INCREMENTAL_GC
 #define bbzheap_obj_make_permanent(x) do{(x).mdata|=BBZHEAP_MASK_PERMANENT;}while(0)
+#endif // BBZ_INCREMENTAL_GC
 /**
  * @brief Unmake an object permanent.
  * @param[in,out] x The object to unmake permanent.
  */
 #define bbzheap_obj_unmake_permanent(x) do{(x).mdata&=~BBZHEAP_MASK_PERMANENT;}while(0)
 
+/**
+ * @brief Makes an object permanent.
+ * @param[in] i The heap index of the object.
+ */
+#define bbzheap_root_add(i) do{if (!bbzheap_idx_isimm(i)) bbzheap_obj_make_permanent(*bbzheap_obj_at(i));}while(0)
+
+/**
+ * @brief Unmakes an object permanent.
+ * @param[in] i The heap index of the object.
+ */
+#define bbzheap_root_remove(i) do{if (!bbzheap_idx_isimm(i)) bbzheap_obj_unmake_permanent(*bbzheap_obj_at(i));}while(0)
+#endif // BBZ_HEAP_ROOTS
+
+#ifdef BBZ_SMALL_OBJECTS
+/**
+ * @brief Flag of the pointers in use in the pointer table.
+ */
+#define BBZHEAP_PTR_VALID 0x01
+
+/**
+ * @brief Flag of the pointers referenced since the last garbage collection.
+ */
+#define BBZHEAP_PTR_GCMARK 0x02
+
+/**
+ * @brief Flag of the entries of the pointer table that were freed.
+ * @details Lookups probe past them, as the pointer they look for may have
+ * been added after them.
+ */
+#define BBZHEAP_PTR_FREED 0x04
+
+/**
+ * @brief Finds a pointer in the pointer table, or adds it.
+ * @details Equal pointers share the same index. Pointers that no C closure
+ * or userdata refers to are removed by the garbage collector.
+ * @param[in] p The pointer.
+ * @param[out] i A buffer for the index of the pointer.
+ * @return 1 for success, 0 for failure (table full)
+ */
+uint8_t bbzheap_ptr_add(uintptr_t p,
+                        uint16_t* i);
+
+/**
+ * @brief Returns the pointer held by a C closure or a userdata.
+ * @param[in] x The object.
+ * @return The pointer.
+ */
+#define bbzheap_obj_ptr(x) (vm->heap.ptrs[(x).u.value])
+
+/**
+ * @brief Returns non-zero if a C closure or a userdata holds the index of
+ * a pointer in use.
+ * @details Objects received in messages may hold any value.
+ * @param[in] x The object.
+ */
+#define bbzheap_obj_hasptr(x) ((x).u.value < BBZHEAP_PTRS_CAP && \
+                               (vm->heap.ptrflags[(x).u.value] & BBZHEAP_PTR_VALID))
+#else // BBZ_SMALL_OBJECTS
+/**
+ * @brief Returns the pointer held by a C closure or a userdata.
+ * @param[in] x The object.
+ * @return The pointer.
+ */
+#define bbzheap_obj_ptr(x) ((x).u.value)
+
+/**
+ * @brief Returns non-zero if a C closure or a userdata holds a pointer.
+ * @param[in] x The object.
+ */
+#define bbzheap_obj_hasptr(x) (1)
+#endif // BBZ_SMALL_OBJECTS
+
 /**
  * @brief Allocates space for a table segment on the heap.
  * Sets as output the value of s, the index of the allocated segment.
@@ -163,6 +474,15 @@ bbzobj_t* bbzheap_obj_at(bbzheap_idx_t i);
  */
 uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s);
 
+/**
+ * @brief Frees a table segment, making it available for allocation.
+ * @details Does nothing if the segment is already free. The caller must
+ * have unlinked the segment from its table beforehand, and must not read
+ * its 'next' field afterwards.
+ * @param[in,out] s The table segment.
+ */
+void bbzheap_tseg_free(bbzheap_tseg_t* s);
+
 /**
  * Next segment index when the segment doesn't have any next.
  */
@@ -255,6 +575,13 @@ uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s);
  */
 #define bbzheap_aseg_alloc(s) bbzheap_tseg_alloc(s)
 
+/**
+ * @brief Frees an array segment, making it available for allocation.
+ * @see bbzheap_tseg_free()
+ * @param[in,out] s The array segment.
+ */
+#define bbzheap_aseg_free(s) bbzheap_tseg_free((bbzheap_tseg_t*)(s))
+
 /**
  * @brief Returns an array segment located at position i within the heap.
  * @param[in] i The position.
@@ -312,12 +639,185 @@ uint8_t bbzheap_tseg_alloc(bbzheap_idx_t* s);
 
 /**
  * Performs garbage collection on the heap.
+ * @details This is a safe point: every object that is not reachable from
+ * the permanent objects, from the passed stack or from the local symbols
+ * of the VM is reclaimed.
  * @param[in,out] st The stack.
  * @param[in] sz The stack size (number of elements in the stack).
  */
 void bbzheap_gc(bbzheap_idx_t* st,
                 uint16_t sz);
 
+#ifdef BBZ_LAZY_GC
+/**
+ * @brief Returns non-zero if the free space of the heap went under
+ * BBZHEAP_GC_WATERMARK since the last garbage collection.
+ * @details The estimate is conservative: objects and segments freed
+ * outside of the garbage collector are only accounted for at the next
+ * collection.
+ * @return Non-zero if a garbage collection is due.
+ */
+#define bbzheap_gc_isdue() (vm->heap.gcfree < BBZHEAP_GC_WATERMARK)
+
+/**
+ * @brief Notifies the heap that every object in use is reachable from the
+ * permanent objects or from the VM's stack.
+ * @details When an allocation fails, the heap collects garbage and retries
+ * once. That collection keeps all objects allocated since the last safe
+ * point (they may only be referenced by C variables) as well as all objects
+ * referenced by the whole stack buffer, including the popped slots.
+ * Call this between two instructions. bbzheap_gc() is also a safe point.
+ */
+#define bbzheap_gc_safepoint() do{vm->heap.newmin=(bbzheap_idx_t)0xFFFF;vm->heap.newmax=0;}while(0)
+#endif // BBZ_LAZY_GC
+
+#ifdef BBZ_INCREMENTAL_GC
+/**
+ * @brief Performs a bounded amount of garbage collection work.
+ * @details Starts a collection if none is running. A collection clears
+ * the marks, marks the objects reachable from the permanent objects, from
+ * the passed stack and from the local symbols, then frees the other
+ * objects and segments, a few of them at a time. The program may run
+ * between two slices: the objects it allocates during the collection are
+ * kept, and the references it stores in tables are marked by
+ * bbzheap_gc_write().
+ * A full collection (bbzheap_gc(), or a failed allocation) aborts the
+ * running incremental collection.
+ * @param[in,out] st The stack.
+ * @param[in] sz The stack size (number of elements in the stack).
+ * @param[in] budget The number of objects, segments and references to
+ * visit. The slice that ends the marking phase visits the whole stack and
+ * local symbols, and may exceed it.
+ * @return Non-zero if the collection is still running.
+ */
+uint8_t bbzheap_gc_slice(bbzheap_idx_t* st,
+                         uint16_t sz,
+                         uint16_t budget);
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Marks an object stored in the heap during the marking phase.
+ * @param[in] obj The object.
+ */
+void bbzheap_gc_barrier(bbzheap_idx_t obj);
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Tells the running incremental garbage collection that a reference to
+ * an object was stored in the heap.
+ * @param[in] obj The object.
+ */
+#define bbzheap_gc_write(obj) do{if(vm->heap.gcphase==BBZHEAP_GC_MARK)bbzheap_gc_barrier(obj);}while(0)
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Same as bbzheap_gc_write(), for a pointer to an object.
+ * @param[in] x The object.
+ */
+#define bbzheap_gc_write_obj(x) do{                                         \
+    if(vm->heap.gcphase==BBZHEAP_GC_MARK &&                                 \
+       (uint8_t*)(x) >= vm->heap.data && (uint8_t*)(x) < vm->heap.rtobj)    \
+        bbzheap_gc_barrier((bbzheap_idx_t)((bbzobj_t*)(x) - (bbzobj_t*)vm->heap.data)); \
+}while(0)
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Keeps an object allocated during an incremental garbage collection
+ * from being freed by it.
+ * @param[in,out] x The object.
+ */
+#define bbzheap_gc_newobj(x) do{if(vm->heap.gcphase>=BBZHEAP_GC_MARK)(x).mdata|=BBZHEAP_MASK_GCMARK;}while(0)
+#elif defined(BBZ_GENERATIONAL_GC)
+/**
+ * @brief Returns non-zero if an object was allocated since the last
+ * garbage collection, i.e., is in the nursery.
+ * @param[in] i The heap index of the object.
+ */
+#ifdef BBZ_IMMEDIATE_INTS
+#define bbzheap_obj_isyoung(i) ((i) >= vm->heap.young && !bbzheap_idx_isimm(i))
+#else // BBZ_IMMEDIATE_INTS
+#define bbzheap_obj_isyoung(i) ((i) >= vm->heap.young)
+#endif // BBZ_IMMEDIATE_INTS
+
+/**
+ * @brief Returns non-zero if the objects and segments allocated since the
+ * last garbage collection take BBZHEAP_NURSERY_SIZE bytes or more.
+ * @return Non-zero if a minor garbage collection is due.
+ */
+#define bbzheap_gc_minor_isdue() ((uint16_t)((vm->heap.rtobj - vm->heap.data) - vm->heap.young * sizeof(bbzobj_t) + \
+                                             (vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) - vm->heap.syoung * sizeof(bbzheap_tseg_t)) >= BBZHEAP_NURSERY_SIZE)
+
+/**
+ * Collects the garbage of the nursery.
+ * @details This is a safe point. The roots are the passed stack, the local
+ * symbols, the remembered set and the permanent objects of the nursery;
+ * older objects are assumed to be alive and are not visited, except the
+ * remembered ones. Unreachable nursery objects are freed, and the others
+ * become older objects. Runs bbzheap_gc() instead if an object did not fit
+ * in the remembered set.
+ * @param[in,out] st The stack.
+ * @param[in] sz The stack size (number of elements in the stack).
+ */
+void bbzheap_gc_minor(bbzheap_idx_t* st,
+                      uint16_t sz);
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Adds an object to the remembered set, so that the next minor garbage
+ * collection keeps it and marks what it refers to.
+ * @param[in] obj The object.
+ */
+void bbzheap_gc_remember(bbzheap_idx_t obj);
+
+/**
+ * @brief <b>For the VM's internal use only</b>.
+ *
+ * Tells the garbage collector that a reference to an object was stored in
+ * the heap. A nursery object stored in a table, an array or a global
+ * symbol is kept by the next minor garbage collection.
+ * @param[in] obj The object.
+ */
+#define bbzheap_gc_write(obj) do{if(bbzheap_obj_isyoung(obj))bbzheap_gc_remember(obj);}while(0)
+#define bbzheap_gc_newobj(x)
+#else // BBZ_INCREMENTAL_GC
+#define bbzheap_gc_write(obj)
+#define bbzheap_gc_newobj(x)
+#endif // BBZ_INCREMENTAL_GC
+
+#ifdef BBZ_HEAP_COMPACTION
+/**
+ * @brief Returns non-zero if the free space between the objects and the
+ * table segments went under BBZHEAP_GC_WATERMARK while free object slots
+ * or segments are scattered in the heap.
+ * @return Non-zero if a compaction is due.
+ */
+#define bbzheap_compact_isdue() ((uint16_t)(vm->heap.ltseg - vm->heap.rtobj) < BBZHEAP_GC_WATERMARK && \
+                                 (vm->heap.ofree != BBZHEAP_OBJ_NO_FREE || vm->heap.sfree != BBZHEAP_SEG_NO_NEXT))
+
+/**
+ * @brief Moves the objects to the start of the heap and the table
+ * segments to its end, so that all free space is between them.
+ * @details Objects and segments are moved from the top into the free
+ * slots at the bottom, then every reference is updated: the segments,
+ * the tables, the passed stack, the local symbols, the VM's global
+ * symbols, function list and swarm, neighbors and stigmergy structures.
+ * Heap indexes held by C code become invalid: only call this when no C
+ * code holds one.
+ * With BBZ_HASHED_TABLES, the first segment of a table used as a key is
+ * not moved, as it gives the hash of the key.
+ * Aborts the running incremental garbage collection, if any.
+ * @param[in,out] st The stack.
+ * @param[in] sz The stack size (number of elements in the stack).
+ */
+void bbzheap_compact(bbzheap_idx_t* st,
+                     uint16_t sz);
+#endif // BBZ_HEAP_COMPACTION
+
 /**
  * @brief <b>For the VM's internal use only</b>.
  *
@@ -4,9 +4,46 @@
 /****************************************/
 /****************************************/
 
+/**
+ * @brief Queues a received message.
+ * @details A broadcast replaces the queued broadcast of the same robot on
+ * the same topic, if any.
+ * @param[in] m The message.
+ */
+static void inmsg_queue_push(bbzmsg_t* m) {
+#ifndef BBZ_DISABLE_NEIGHBORS
+    if (m->base.type == BBZMSG_BROADCAST) {
+        for (uint8_t i = vm->inmsgs.queue.first[BBZMSG_BROADCAST];
+             i != BBZMSG_QUEUE_NO_SLOT;
+             i = vm->inmsgs.queue.next[i]) {
+            bbzmsg_t* msg = vm->inmsgs.buf + i;
+            if (msg->base.rid == m->base.rid &&
+                msg->bc.topic == m->bc.topic) {
+                *msg = *m;
+                return;
+            }
+        }
+    }
+#endif
+    // If everything succeed, we push the message after those of the same type.
+    // If full, the message with the lowest priority (the last of the queue) is replaced with the new one.
+    *bbzmsg_queue_makeslot(&vm->inmsgs.queue, m->base.type) = *m;
+}
+
+/****************************************/
+/****************************************/
+
 void bbzinmsg_queue_append(bbzmsg_payload_t* payload) {
+    uint8_t size = bbzringbuf_bytes_size(payload);
+    if (size > 0 && (*bbzringbuf_bytes_at(payload, 0) & BBZMSG_COMPACT)) {
+        // Compact messages are read from a flat copy.
+        uint8_t buf[BBZMSG_PAYLOAD_CAP];
+        for (uint8_t i = 0; i < size; ++i) buf[i] = *bbzringbuf_bytes_at(payload, i);
+        bbzinmsg_queue_append_raw(buf, size);
+        return;
+    }
     int16_t pos = 0;
-    bbzmsg_t* m = vm->inmsgs.buf+vm->inmsgs.queue.capacity;
+    bbzmsg_t* m = vm->inmsgs.buf+BBZINMSG_QUEUE_CAP;
     m->base.type = (bbzmsg_payload_type_t)0;
     bbzmsg_deserialize_u8((uint8_t*)&m->base.type, payload, &pos);
     if (pos < 0) return;
@@ -52,41 +89,99 @@ void bbzinmsg_queue_append(bbzmsg_payload_t* payload) {
             // Unknown type of message, the message is dropped.
             return;
     }
-#ifndef BBZ_DISABLE_NEIGHBORS
-    if (m->base.type == BBZMSG_BROADCAST) {
-        for (uint8_t i = 0; i < bbzringbuf_size(&vm->inmsgs.queue); ++i) {
-            bbzmsg_t* msg = (bbzmsg_t*)bbzringbuf_at(&vm->inmsgs.queue, i);
-            if (msg->base.type == m->base.type &&
-                msg->base.rid  == m->base.rid  &&
-                msg->bc.topic  == m->bc.topic) {
-                *msg = *m;
-                return;
-            }
+    inmsg_queue_push(m);
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Appends a message to the queue, reading the fields that follow its
+ * type directly from a flat buffer.
+ * @param[in] type The type byte of the message, which tells its encoding.
+ * @param[in] buf The serialized fields, starting with the robot ID.
+ * @param[in] len The number of bytes in the buffer.
+ */
+static void inmsg_queue_append_fields(uint8_t type, const uint8_t* buf, uint8_t len) {
+    bbzmsg_t* m = vm->inmsgs.buf+BBZINMSG_QUEUE_CAP;
+    if (type & BBZMSG_COMPACT) {
+        if (bbzmsg_compact_get(m, (bbzmsg_payload_type_t)(type & ~BBZMSG_COMPACT), buf, len)) {
+            inmsg_queue_push(m);
         }
+        return;
     }
+    if (len < BBZMSG_HDR_SIZE - 1) return;
+    m->base.type = (bbzmsg_payload_type_t)type;
+    m->base.rid = bbzmsg_raw_get_u16(buf);
+    buf += BBZMSG_HDR_SIZE - 1;
+    switch(m->base.type) {
+        case BBZMSG_BROADCAST:
+#ifndef BBZ_DISABLE_NEIGHBORS
+            if (len < BBZMSG_BROADCAST_SIZE - 1) return;
+            m->bc.topic = bbzmsg_raw_get_u16(buf);
+            bbzmsg_raw_get_obj(&m->bc.value, buf + 2);
+            bbzheap_obj_makevalid(m->bc.value);
+            break;
+#else
+            return;
 #endif
-    // If everything succeed, we push the ring buffer forward.
-    if (bbzringbuf_full(&vm->inmsgs.queue)) {
-        // If full, replace the message with the lowest priority (the last of the queue) with the new one.
-        *((bbzmsg_t*)bbzringbuf_rawat(&vm->inmsgs.queue, vm->inmsgs.queue.dataend - (uint8_t)1 + vm->inmsgs.queue.capacity)) = *m;
+        case BBZMSG_VSTIG_PUT: // fallthrough
+        case BBZMSG_VSTIG_QUERY:
+#ifndef BBZ_DISABLE_VSTIGS
+            if (len < BBZMSG_VSTIG_SIZE - 1) return;
+            m->vs.key = bbzmsg_raw_get_u16(buf);
+            bbzmsg_raw_get_obj(&m->vs.data, buf + 2);
+            bbzheap_obj_makevalid(m->vs.data);
+            m->vs.lamport = buf[2 + BBZMSG_OBJ_SIZE];
+            break;
+#else
+            return;
+#endif
+        case BBZMSG_SWARM:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            if (len < BBZMSG_SWARM_SIZE - 1) return;
+            m->sw.lamport = bbzmsg_raw_get_u16(buf);
+            m->sw.swarms = buf[2];
+            break;
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            return;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+        default:
+            // Unknown type of message, the message is dropped.
+            return;
     }
-    else {
-        // If not full, push the message at the end of the queue.
-        *((bbzmsg_t*)bbzringbuf_rawat(&vm->inmsgs.queue, bbzringbuf_makeslot(&vm->inmsgs.queue))) = *m;
+    inmsg_queue_push(m);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzinmsg_queue_append_raw(const uint8_t* buf, uint8_t len) {
+    if (len == 0) return;
+    inmsg_queue_append_fields(buf[0], buf + 1, len - 1);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzinmsg_queue_unpack(const uint8_t* frame, uint8_t len) {
+    uint8_t pos = 0;
+    while (pos < len && frame[pos] != 0) {
+        uint8_t hdr = frame[pos++];
+        uint8_t n = BBZMSG_PACK_LEN(hdr);
+        if (n > (uint8_t)(len - pos)) return;
+        inmsg_queue_append_fields(BBZMSG_PACK_TYPE(hdr), frame + pos, n);
+        pos += n;
     }
-    bbzmsg_sort_priority(&vm->inmsgs.queue);
 }
 
 /****************************************/
 /****************************************/
 
 bbzmsg_t * bbzinmsg_queue_extract() {
-    bbzmsg_t* ret = &vm->inmsgs.buf[vm->inmsgs.queue.capacity];
+    bbzmsg_t* ret = &vm->inmsgs.buf[BBZINMSG_QUEUE_CAP];
     *ret = *bbzinmsg_queue_get(0);
-    bbzringbuf_pop(&vm->inmsgs.queue);
-#ifdef BBZMSG_POP_NEEDS_SORT
-    bbzmsg_sort_priority(&vm->inmsgs.queue);
-#endif
+    bbzmsg_queue_pop(&vm->inmsgs.queue);
     return ret;
 }
 
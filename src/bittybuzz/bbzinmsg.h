@@ -22,8 +22,9 @@ extern "C" {
  */
 typedef struct PACKED bbzinmsg_queue_t {
 #ifndef BBZ_DISABLE_MESSAGES
-    bbzringbuf_t queue; /**< @brief Message queue. */
-    bbzmsg_t buf[BBZINMSG_QUEUE_CAP+2]; /**< @brief Output message buffer */
+    bbzmsg_queue_t queue; /**< @brief Message queue. */
+    bbzmsg_t buf[BBZINMSG_QUEUE_CAP+1]; /**< @brief Input message buffer ; the last slot holds the message being received or extracted */
+    uint8_t links[2*BBZINMSG_QUEUE_CAP]; /**< @brief Links of the message slots */
 #endif
 } bbzinmsg_queue_t;
 
@@ -34,6 +35,27 @@ typedef struct PACKED bbzinmsg_queue_t {
  */
 void bbzinmsg_queue_append(bbzmsg_payload_t* payload);
 
+/**
+ * @brief Appends a message to the queue, reading its fields directly from
+ * a flat buffer, such as a received radio frame.
+ * @details The fields are found at fixed offsets (see #BBZMSG_HDR_SIZE),
+ * unless the type byte has the #BBZMSG_COMPACT flag. The message is dropped
+ * if it is shorter than its type requires.
+ * @param[in] buf The serialized message.
+ * @param[in] len The number of bytes in the buffer.
+ */
+void bbzinmsg_queue_append_raw(const uint8_t* buf, uint8_t len);
+
+/**
+ * @brief Appends the messages packed in a frame by bbzoutmsg_queue_pack()
+ * to the queue.
+ * @details Unpacking stops at a null header, or at a message that does not
+ * fit in the frame.
+ * @param[in] frame The frame.
+ * @param[in] len The number of bytes in the frame.
+ */
+void bbzinmsg_queue_unpack(const uint8_t* frame, uint8_t len);
+
 /**
  * @brief Extracts a message from the queue.
  * @note You are in charge of allocating and freeing the payload buffer.
@@ -44,33 +66,35 @@ bbzmsg_t * bbzinmsg_queue_extract();
 /**
  * Create a new message queue.
  */
-#define bbzinmsg_queue_construct() bbzringbuf_construct(&vm->inmsgs.queue, (uint8_t*)vm->inmsgs.buf, sizeof(bbzmsg_t), BBZINMSG_QUEUE_CAP+1);
+#define bbzinmsg_queue_construct() bbzmsg_queue_construct(&vm->inmsgs.queue, vm->inmsgs.buf, vm->inmsgs.links, BBZINMSG_QUEUE_CAP);
 
 /**
  * Destroys a message queue.
  */
-#define bbzinmsg_queue_destruct() bbzringbuf_clear(&vm->inmsgs.queue)
+#define bbzinmsg_queue_destruct() bbzmsg_queue_clear(&vm->inmsgs.queue)
 
 /**
  * Returns the size of a message queue.
  * @return The size of a message queue.
  */
-#define bbzinmsg_queue_size() bbzringbuf_size(&vm->inmsgs.queue)
+#define bbzinmsg_queue_size() (vm->inmsgs.queue.size)
 
 /**
  * Returns <tt>true</tt> if the message queue is empty.
  * @return <tt>true</tt> if the message queue is empty.
  */
-#define bbzinmsg_queue_isempty() bbzringbuf_empty(&vm->inmsgs.queue)
+#define bbzinmsg_queue_isempty() (vm->inmsgs.queue.size == 0)
 
 /**
  * Returns the message at the given position in the queue.
  * @param pos The position.
  * @return The message at the given position.
  */
-#define bbzinmsg_queue_get(pos) ((bbzmsg_t*)bbzringbuf_at(&vm->inmsgs.queue, pos))
+#define bbzinmsg_queue_get(pos) bbzmsg_queue_at(&vm->inmsgs.queue, pos)
 #else
 #define bbzinmsg_queue_append(...)
+#define bbzinmsg_queue_append_raw(...)
+#define bbzinmsg_queue_unpack(...)
 #define bbzinmsg_queue_extract(...) ((bbzmsg_t*)NULL)
 #define bbzinmsg_queue_construct(...)
 #define bbzinmsg_queue_destruct(...)
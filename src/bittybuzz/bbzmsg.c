@@ -5,41 +5,41 @@
 /****************************************/
 /****************************************/
 
-void bbzmsg_serialize_u8(bbzringbuf_t *rb,
+void bbzmsg_serialize_u8(bbzmsg_payload_t *rb,
                          uint8_t data) {
-    *bbzringbuf_rawat(rb, bbzringbuf_makeslot(rb)) = data;
+    bbzringbuf_bytes_push(rb, data);
 }
 
 /****************************************/
 /****************************************/
 
 void bbzmsg_deserialize_u8(uint8_t *data,
-                           const bbzringbuf_t *rb,
+                           const bbzmsg_payload_t *rb,
                            int16_t *pos) {
-    if (*pos + sizeof(uint8_t) > bbzringbuf_size(rb)) { *pos = -1; return; }
-    *data = *bbzringbuf_at(rb, (uint8_t)*pos);
+    if (*pos + sizeof(uint8_t) > bbzringbuf_bytes_size(rb)) { *pos = -1; return; }
+    *data = *bbzringbuf_bytes_at(rb, (uint8_t)*pos);
     *pos += sizeof(uint8_t);
 }
 
 /****************************************/
 /****************************************/
 
-void bbzmsg_serialize_u16(bbzringbuf_t *rb,
+void bbzmsg_serialize_u16(bbzmsg_payload_t *rb,
                           uint16_t data) {
     data = htons(data);
-    *bbzringbuf_rawat(rb, bbzringbuf_makeslot(rb)) = ((uint8_t*)&data)[0];
-    *bbzringbuf_rawat(rb, bbzringbuf_makeslot(rb)) = ((uint8_t*)&data)[1];
+    bbzringbuf_bytes_push(rb, ((uint8_t*)&data)[0]);
+    bbzringbuf_bytes_push(rb, ((uint8_t*)&data)[1]);
 }
 
 /****************************************/
 /****************************************/
 
 void bbzmsg_deserialize_u16(uint16_t *data,
-                            const bbzringbuf_t *rb,
+                            const bbzmsg_payload_t *rb,
                             int16_t *pos) {
-    if (*pos + sizeof(uint16_t) > bbzringbuf_size(rb)) { *pos = -1; return; }
-    ((uint8_t*)data)[0] = *bbzringbuf_at(rb, (uint8_t)*pos);
-    ((uint8_t*)data)[1] = *bbzringbuf_at(rb, (uint8_t)(*pos + 1));
+    if (*pos + sizeof(uint16_t) > bbzringbuf_bytes_size(rb)) { *pos = -1; return; }
+    ((uint8_t*)data)[0] = *bbzringbuf_bytes_at(rb, (uint8_t)*pos);
+    ((uint8_t*)data)[1] = *bbzringbuf_bytes_at(rb, (uint8_t)(*pos + 1));
     *data = ntohs(*data);
     *pos += sizeof(uint16_t);
 }
@@ -47,7 +47,7 @@ void bbzmsg_deserialize_u16(uint16_t *data,
 /****************************************/
 /****************************************/
 
-void bbzmsg_serialize_obj(bbzringbuf_t *rb, bbzobj_t *obj) {
+void bbzmsg_serialize_obj(bbzmsg_payload_t *rb, bbzobj_t *obj) {
     bbzmsg_serialize_u8(rb, obj->mdata);
     bbzmsg_serialize_u16(rb, (uint16_t)obj->biggest.value);
 }
@@ -55,7 +55,7 @@ void bbzmsg_serialize_obj(bbzringbuf_t *rb, bbzobj_t *obj) {
 /****************************************/
 /****************************************/
 
-void bbzmsg_deserialize_obj(bbzobj_t *data, bbzringbuf_t *rb, int16_t *pos) {
+void bbzmsg_deserialize_obj(bbzobj_t *data, bbzmsg_payload_t *rb, int16_t *pos) {
     bbzmsg_deserialize_u8(&data->mdata, rb, pos);
     if (*pos < 0) return;
     bbzmsg_deserialize_u16((uint16_t*)&data->biggest.value, rb, pos);
@@ -64,16 +64,347 @@ void bbzmsg_deserialize_obj(bbzobj_t *data, bbzringbuf_t *rb, int16_t *pos) {
 /****************************************/
 /****************************************/
 
-void bbzmsg_sort_priority(bbzringbuf_t* rb) {
-    // +=-=-=-= QuickSort =-=-=-=+
-    for(uint16_t i = 1; i < bbzringbuf_size(rb); ++i) {
-        uint16_t j = i;
-        while(j > 0 && ((bbzmsg_t*)bbzringbuf_at(rb,(uint8_t)(j)))->type < ((bbzmsg_t*)bbzringbuf_at(rb,(uint8_t)(j-1)))->type) {
-            bbzutil_swapArrays(bbzringbuf_at(rb, (uint8_t) (j)), bbzringbuf_at(rb, (uint8_t) (j - 1)), sizeof(bbzmsg_t));
-            --j;
+/**
+ * @brief Immediate of a compact object's tag meaning that its value follows
+ * the tag as a varint.
+ */
+#define COMPACT_IMM_NONE 0x0F
+
+/**
+ * @brief Writes a 16-bit unsigned integer as a varint.
+ * @param[out] buf The buffer, of at least 3 bytes.
+ * @param[in] data The data to write.
+ * @return The number of bytes written.
+ */
+static uint8_t compact_put_varint(uint8_t* buf, uint16_t data) {
+    uint8_t n = 0;
+    while (data >= 0x80) {
+        buf[n++] = (uint8_t)(data | 0x80);
+        data >>= 7;
+    }
+    buf[n++] = (uint8_t)data;
+    return n;
+}
+
+/**
+ * @brief Reads a varint holding a 16-bit unsigned integer.
+ * @param[out] data The data read.
+ * @param[in] buf The buffer.
+ * @param[in] len The number of bytes in the buffer.
+ * @return The number of bytes read, or 0 if the varint is truncated or too
+ * long.
+ */
+static uint8_t compact_get_varint(uint16_t* data, const uint8_t* buf, uint8_t len) {
+    uint16_t v = 0;
+    for (uint8_t n = 0; n < len && n < 3; ++n) {
+        v |= (uint16_t)(buf[n] & 0x7F) << (7 * n);
+        if (!(buf[n] & 0x80)) {
+            *data = v;
+            return (uint8_t)(n + 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes an object with the compact encoding.
+ * @param[out] buf The buffer, of at least 4 bytes.
+ * @param[in] obj The object to write.
+ * @return The number of bytes written, or 0 if the object cannot be encoded.
+ */
+static uint8_t compact_put_obj(uint8_t* buf, const bbzobj_t* obj) {
+    uint8_t type = bbztype(*obj);
+    uint16_t v;
+    switch (type) {
+        case BBZTYPE_NIL:
+            buf[0] = type;
+            return 1;
+        case BBZTYPE_INT:
+            // Zigzag encoding, so that small negative integers stay small.
+            v = (uint16_t)((uint16_t)obj->i.value << 1) ^ (uint16_t)(obj->i.value < 0 ? 0xFFFF : 0);
+            break;
+        case BBZTYPE_STRING:
+            v = obj->s.value;
+            break;
+        case BBZTYPE_FLOAT:
+            buf[0] = type;
+            bbzmsg_raw_put_u16(buf + 1, obj->f.value);
+            return 3;
+        default:
+            return 0;
+    }
+    if (v < COMPACT_IMM_NONE) {
+        buf[0] = (uint8_t)(type | (v << 4));
+        return 1;
+    }
+    buf[0] = (uint8_t)(type | (COMPACT_IMM_NONE << 4));
+    return (uint8_t)(1 + compact_put_varint(buf + 1, v));
+}
+
+/**
+ * @brief Reads an object written with the compact encoding.
+ * @param[out] obj The object read, made valid.
+ * @param[in] buf The buffer.
+ * @param[in] len The number of bytes in the buffer.
+ * @return The number of bytes read, or 0 if the object is truncated or
+ * malformed.
+ */
+static uint8_t compact_get_obj(bbzobj_t* obj, const uint8_t* buf, uint8_t len) {
+    if (len == 0) return 0;
+    uint8_t type = (uint8_t)(buf[0] & 0x0F);
+    uint16_t v = (uint16_t)(buf[0] >> 4);
+    uint8_t n = 1;
+    obj->mdata = 0;
+    bbztype_cast(*obj, type);
+    bbzheap_obj_makevalid(*obj);
+    switch (type) {
+        case BBZTYPE_NIL:
+            return 1;
+        case BBZTYPE_FLOAT:
+            if (len < 3) return 0;
+            obj->f.value = bbzmsg_raw_get_u16(buf + 1);
+            return 3;
+        case BBZTYPE_INT: // fallthrough
+        case BBZTYPE_STRING:
+            if (v == COMPACT_IMM_NONE) {
+                n = compact_get_varint(&v, buf + 1, (uint8_t)(len - 1));
+                if (!n) return 0;
+                ++n;
+            }
+            if (type == BBZTYPE_INT) obj->i.value = (int16_t)((v >> 1) ^ (uint16_t)-(int16_t)(v & 1));
+            else obj->s.value = v;
+            return n;
+        default:
+            return 0;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzmsg_compact_put(uint8_t* buf, const bbzmsg_t* msg) {
+    uint8_t n = 0, m;
+    buf[n++] = (uint8_t)(msg->type | BBZMSG_COMPACT);
+    n += compact_put_varint(buf + n, msg->base.rid);
+    switch (msg->type) {
+        case BBZMSG_BROADCAST:
+#ifndef BBZ_DISABLE_NEIGHBORS
+            n += compact_put_varint(buf + n, msg->bc.topic);
+            m = compact_put_obj(buf + n, &msg->bc.value);
+            return m ? (uint8_t)(n + m) : (uint8_t)0;
+#else // !BBZ_DISABLE_NEIGHBORS
+            return 0;
+#endif // !BBZ_DISABLE_NEIGHBORS
+        case BBZMSG_VSTIG_PUT: // fallthrough
+        case BBZMSG_VSTIG_QUERY:
+#ifndef BBZ_DISABLE_VSTIGS
+            n += compact_put_varint(buf + n, msg->vs.key);
+            m = compact_put_obj(buf + n, &msg->vs.data);
+            if (!m) return 0;
+            n += m;
+            buf[n++] = msg->vs.lamport;
+            return n;
+#else // !BBZ_DISABLE_VSTIGS
+            return 0;
+#endif // !BBZ_DISABLE_VSTIGS
+        case BBZMSG_SWARM:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            n += compact_put_varint(buf + n, msg->sw.lamport);
+            buf[n++] = msg->sw.swarms;
+            return n;
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            return 0;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+        default:
+            RM_UNUSED_WARN(m);
+            return 0;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzmsg_compact_get(bbzmsg_t* msg, bbzmsg_payload_type_t type, const uint8_t* buf, uint8_t len) {
+    // The fields are decoded in a local, as those of packed messages may be
+    // misaligned.
+    uint16_t v;
+    uint8_t n = compact_get_varint(&v, buf, len);
+    if (!n) return 0;
+    msg->base.rid = v;
+    msg->base.type = type;
+    buf += n;
+    len -= n;
+    switch (type) {
+        case BBZMSG_BROADCAST:
+#ifndef BBZ_DISABLE_NEIGHBORS
+            n = compact_get_varint(&v, buf, len);
+            if (!n) return 0;
+            msg->bc.topic = v;
+            return compact_get_obj(&msg->bc.value, buf + n, (uint8_t)(len - n)) != 0;
+#else // !BBZ_DISABLE_NEIGHBORS
+            return 0;
+#endif // !BBZ_DISABLE_NEIGHBORS
+        case BBZMSG_VSTIG_PUT: // fallthrough
+        case BBZMSG_VSTIG_QUERY:
+#ifndef BBZ_DISABLE_VSTIGS
+            n = compact_get_varint(&v, buf, len);
+            if (!n) return 0;
+            msg->vs.key = v;
+            buf += n;
+            len -= n;
+            n = compact_get_obj(&msg->vs.data, buf, len);
+            if (!n || n >= len) return 0;
+            msg->vs.lamport = buf[n];
+            return 1;
+#else // !BBZ_DISABLE_VSTIGS
+            return 0;
+#endif // !BBZ_DISABLE_VSTIGS
+        case BBZMSG_SWARM:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            n = compact_get_varint(&v, buf, len);
+            if (!n || n >= len) return 0;
+            msg->sw.lamport = v;
+            msg->sw.swarms = buf[n];
+            return 1;
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            return 0;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+        default:
+            // Unknown type of message
+            return 0;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzmsg_raw_get_rid(bbzrobot_id_t* rid, uint8_t type, const uint8_t* buf, uint8_t len) {
+    if (type & BBZMSG_COMPACT) {
+        uint16_t v;
+        if (!compact_get_varint(&v, buf, len)) return 0;
+        *rid = v;
+        return 1;
+    }
+    if (len < BBZMSG_HDR_SIZE - 1) return 0;
+    *rid = bbzmsg_raw_get_u16(buf);
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzmsg_queue_construct(bbzmsg_queue_t* q,
+                            bbzmsg_t* buf,
+                            uint8_t* links,
+                            uint8_t cap) {
+    q->buf = buf;
+    q->next = links;
+    q->prev = links + cap;
+    q->capacity = cap;
+    bbzmsg_queue_clear(q);
+}
+
+/****************************************/
+/****************************************/
+
+void bbzmsg_queue_clear(bbzmsg_queue_t* q) {
+    for (uint8_t t = 0; t < BBZMSG_TYPE_COUNT; ++t) {
+        q->first[t] = BBZMSG_QUEUE_NO_SLOT;
+        q->last[t] = BBZMSG_QUEUE_NO_SLOT;
+    }
+    /* Link all the slots in the free list */
+    for (uint8_t i = 0; i < q->capacity; ++i) {
+        q->next[i] = i + (uint8_t)1;
+    }
+    q->next[q->capacity - 1] = BBZMSG_QUEUE_NO_SLOT;
+    q->free = 0;
+    q->size = 0;
+}
+
+/****************************************/
+/****************************************/
+
+bbzmsg_t* bbzmsg_queue_makeslot(bbzmsg_queue_t* q,
+                                bbzmsg_payload_type_t type) {
+    uint8_t s = q->free;
+    if (s != BBZMSG_QUEUE_NO_SLOT) {
+        q->free = q->next[s];
+        ++q->size;
+    }
+    else {
+        /* Full ; drop the newest message of the lowest priority */
+        uint8_t t = BBZMSG_TYPE_COUNT;
+        while (q->last[--t] == BBZMSG_QUEUE_NO_SLOT);
+        s = q->last[t];
+        q->last[t] = q->prev[s];
+        if (q->last[t] == BBZMSG_QUEUE_NO_SLOT) q->first[t] = BBZMSG_QUEUE_NO_SLOT;
+        else q->next[q->last[t]] = BBZMSG_QUEUE_NO_SLOT;
+    }
+    /* Append the slot to the FIFO of the type */
+    q->next[s] = BBZMSG_QUEUE_NO_SLOT;
+    q->prev[s] = q->last[type];
+    if (q->last[type] == BBZMSG_QUEUE_NO_SLOT) q->first[type] = s;
+    else q->next[q->last[type]] = s;
+    q->last[type] = s;
+    return q->buf + s;
+}
+
+/****************************************/
+/****************************************/
+
+bbzmsg_t* bbzmsg_queue_at(const bbzmsg_queue_t* q,
+                          uint8_t pos) {
+    for (uint8_t t = 0; t < BBZMSG_TYPE_COUNT; ++t) {
+        for (uint8_t s = q->first[t]; s != BBZMSG_QUEUE_NO_SLOT; s = q->next[s]) {
+            if (pos-- == 0) return q->buf + s;
         }
     }
+    return (bbzmsg_t*)NULL;
+}
+
+/****************************************/
+/****************************************/
+
+void bbzmsg_queue_pop(bbzmsg_queue_t* q) {
+    for (uint8_t t = 0; t < BBZMSG_TYPE_COUNT; ++t) {
+        uint8_t s = q->first[t];
+        if (s == BBZMSG_QUEUE_NO_SLOT) continue;
+        q->first[t] = q->next[s];
+        if (q->first[t] == BBZMSG_QUEUE_NO_SLOT) q->last[t] = BBZMSG_QUEUE_NO_SLOT;
+        else q->prev[q->first[t]] = BBZMSG_QUEUE_NO_SLOT;
+        /* Give the slot back */
+        q->next[s] = q->free;
+        q->free = s;
+        --q->size;
+        return;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+#if !defined(BBZ_DISABLE_NEIGHBORS) || !defined(BBZ_DISABLE_VSTIGS)
+/**
+ * @brief Puts an object received in a message on the heap.
+ * @details Integers that fit in a heap index are not allocated.
+ * @param[in] x The received object.
+ * @param[out] o A buffer for the index of the object.
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t bbzmsg_obj_import(const bbzobj_t* x, bbzheap_idx_t* o) {
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbztype_isint(*x) && bbzheap_imm_fits(x->i.value)) {
+        *o = bbzheap_imm_make(x->i.value);
+        return 1;
+    }
+#endif // BBZ_IMMEDIATE_INTS
+    if (!bbzheap_obj_alloc(BBZTYPE_USERDATA, o)) return 0;
+    *bbzheap_obj_at(*o) = *x;
+    bbzheap_obj_makevalid(*bbzheap_obj_at(*o));
+    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(*o));
+    return 1;
 }
+#endif // !BBZ_DISABLE_NEIGHBORS || !BBZ_DISABLE_VSTIGS
 
 /****************************************/
 /****************************************/
@@ -91,15 +422,13 @@ void bbzmsg_process_broadcast(bbzmsg_t* msg) {
     bbzvm_pushnil(); // Push self table
     bbzvm_push(l);
     bbzvm_push(topic);
-    bbzvm_pushu(0);
-    bbzobj_t* x = bbzheap_obj_at(bbzvm_stack_at(0));
-    bbztype_copy(msg->bc.value, *x);
-    bbzheap_obj_unmake_permanent(*x);
-    x->biggest.value = msg->bc.value.biggest.value;
+    bbzheap_idx_t v;
+    bbzvm_assert_exec(bbzmsg_obj_import(&msg->bc.value, &v), BBZVM_ERROR_MEM);
+    bbzvm_push(v);
     bbzvm_pushi(msg->bc.rid);
     bbzvm_closure_call(3);
     bbzvm_pop(); // Pop self table
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 #endif
 
@@ -126,13 +455,11 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
                 // Update the value
                 data->robot = msg->vs.rid;
                 data->key = msg->vs.key;
-                bbzheap_obj_makeinvalid(*bbzheap_obj_at(data->value));
-                bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o);
-                *bbzheap_obj_at(o) = msg->vs.data;
-                bbzheap_obj_makevalid(*bbzheap_obj_at(o));
-                bbzheap_obj_unmake_permanent(*bbzheap_obj_at(data->value));
+                bbzheap_obj_free(data->value);
+                bbzvm_assert_exec(bbzmsg_obj_import(&msg->vs.data, &o), BBZVM_ERROR_MEM);
+                bbzheap_root_remove(data->value);
                 data->value = o;
-                bbzheap_obj_make_permanent(*bbzheap_obj_at(o));
+                bbzheap_root_add(o);
                 data->timestamp = msg->vs.lamport;
                 // Propagate the value.
                 bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, data->robot,
@@ -157,19 +484,21 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
                     bbzvm_push(tmp);
                     bbzvm_pushs(msg->vs.key);
                     // push the local data
-                    bbzvm_pusht();
-                    bbztable_add_data(__BBZSTRID_robot, bbzint_new(data->robot));
-                    bbztable_add_data(__BBZSTRID_data, data->value);
-                    bbztable_add_data(__BBZSTRID_timestamp, bbzint_new(data->timestamp));
+                    const bbztable_init_t lfields[] = {
+                        { __BBZSTRID_robot,     NULL, bbzint_new(data->robot) },
+                        { __BBZSTRID_data,      NULL, data->value },
+                        { __BBZSTRID_timestamp, NULL, bbzint_new(data->timestamp) },
+                    };
+                    bbzvm_push(bbztable_new_from(lfields, sizeof(lfields) / sizeof(*lfields)));
                     // push the remote data
-                    bbzvm_pusht();
+                    bbzvm_assert_exec(bbzmsg_obj_import(&msg->vs.data, &o), BBZVM_ERROR_MEM);
+                    const bbztable_init_t rfields[] = {
+                        { __BBZSTRID_robot,     NULL, bbzint_new(msg->vs.rid) },
+                        { __BBZSTRID_data,      NULL, o },
+                        { __BBZSTRID_timestamp, NULL, bbzint_new(msg->vs.lamport) },
+                    };
+                    bbzvm_push(bbztable_new_from(rfields, sizeof(rfields) / sizeof(*rfields)));
                     bbzheap_idx_t rd = bbzvm_stack_at(0);
-                    bbztable_add_data(__BBZSTRID_robot, bbzint_new(msg->vs.rid));
-                    bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o);
-                    *bbzheap_obj_at(o) = msg->vs.data;
-                    bbzheap_obj_makevalid(*bbzheap_obj_at(o));
-                    bbztable_add_data(__BBZSTRID_data, o);
-                    bbztable_add_data(__BBZSTRID_timestamp, bbzint_new(msg->vs.lamport));
                     bbzvm_closure_call(3);
                     // Update the value with the table returned by the closure.
                     // If error, either no value was returned, or the returned value is of the wrong type.
@@ -181,11 +510,12 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
                                   (bbzrobot_id_t) bbzheap_obj_at(tmp)->i.value :
                                   data->robot;
                     tmp = vm->nil;
-                    bbzheap_obj_makeinvalid(*bbzheap_obj_at(data->value));
-                    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(data->value));
+                    // The old value is still referenced by the local data table,
+                    // and may be the winner; let the garbage collector reclaim it.
+                    bbzheap_root_remove(data->value);
                     bbztable_get(bbzvm_stack_at(0), bbzstring_get(__BBZSTRID_data), &tmp);
                     data->value = tmp;
-                    bbzheap_obj_make_permanent(*bbzheap_obj_at(tmp));
+                    bbzheap_root_add(tmp);
                     data->timestamp = msg->vs.lamport;
                     // If this is the robot that lost, call the onconflictlost callback closure.
                     if ((bbzrobot_id_t) bbzheap_obj_at(tmp)->i.value != vm->robot &&
@@ -211,13 +541,11 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
                     if (msg->vs.rid >= data->robot) {
                         data->robot = msg->vs.rid;
                         data->key = msg->vs.key;
-                        bbzheap_obj_makeinvalid(*bbzheap_obj_at(data->value));
-                        bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o);
-                        *bbzheap_obj_at(o) = msg->vs.data;
-                        bbzheap_obj_makevalid(*bbzheap_obj_at(o));
-                        bbzheap_obj_unmake_permanent(*bbzheap_obj_at(data->value));
+                        bbzheap_obj_free(data->value);
+                        bbzvm_assert_exec(bbzmsg_obj_import(&msg->vs.data, &o), BBZVM_ERROR_MEM);
+                        bbzheap_root_remove(data->value);
                         data->value = o;
-                        bbzheap_obj_make_permanent(*bbzheap_obj_at(o));
+                        bbzheap_root_add(o);
                         data->timestamp = msg->vs.lamport;
                     }
                     // Propagate the winning value.
@@ -233,11 +561,9 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
         data = vm->vstig.data + vm->vstig.size;
         data->robot = msg->vs.rid;
         data->key = msg->vs.key;
-        bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o);
-        *bbzheap_obj_at(o) = msg->vs.data;
-        bbzheap_obj_makevalid(*bbzheap_obj_at(o));
+        bbzvm_assert_exec(bbzmsg_obj_import(&msg->vs.data, &o), BBZVM_ERROR_MEM);
         data->value = o;
-        bbzheap_obj_make_permanent(*bbzheap_obj_at(o));
+        bbzheap_root_add(o);
         data->timestamp = msg->vs.lamport;
         bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT,
                                      data->robot,
@@ -246,7 +572,7 @@ void bbzmsg_process_vstig(bbzmsg_t* msg) {
                                      data->timestamp);
         ++vm->vstig.size;
     }
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 #endif
 
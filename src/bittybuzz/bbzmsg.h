@@ -80,8 +80,133 @@ typedef union PACKED bbzmsg_t {
 
 /**
  * @brief Data of a message.
+ * @details Its linear buffer must hold #BBZMSG_PAYLOAD_CAP bytes.
  */
-typedef bbzringbuf_t bbzmsg_payload_t;
+typedef bbzringbuf_bytes_t bbzmsg_payload_t;
+
+/**
+ * @brief Maximum size of the data of a message (B).
+ */
+#define BBZMSG_PAYLOAD_CAP BBZRINGBUF_BYTES_CAP
+
+/**
+ * @brief Size of a serialized message's type and robot ID (B).
+ * @details The fields of a serialized message are found at fixed offsets:
+ * the type, the robot ID, then the fields of the message's type, in the
+ * order of bbzoutmsg_queue_first().
+ */
+#define BBZMSG_HDR_SIZE 3
+
+/**
+ * @brief Size of a serialized object (B).
+ */
+#define BBZMSG_OBJ_SIZE 3
+
+/**
+ * @brief Size of a serialized broadcast message (B).
+ */
+#define BBZMSG_BROADCAST_SIZE (BBZMSG_HDR_SIZE + 2 + BBZMSG_OBJ_SIZE)
+
+/**
+ * @brief Size of a serialized virtual stigmergy message (B).
+ */
+#define BBZMSG_VSTIG_SIZE (BBZMSG_HDR_SIZE + 2 + BBZMSG_OBJ_SIZE + 1)
+
+/**
+ * @brief Size of a serialized swarm message (B).
+ */
+#define BBZMSG_SWARM_SIZE (BBZMSG_HDR_SIZE + 2 + 1)
+
+/**
+ * @brief Size of the largest serialized message (B).
+ */
+#define BBZMSG_MAX_SIZE BBZMSG_VSTIG_SIZE
+
+/**
+ * @brief Size of a serialized message of the given type (B).
+ * @param[in] type The type of the message.
+ */
+#define BBZMSG_SIZE(type) ((type) == BBZMSG_BROADCAST ? BBZMSG_BROADCAST_SIZE : \
+                           (type) == BBZMSG_SWARM ? BBZMSG_SWARM_SIZE : BBZMSG_VSTIG_SIZE)
+
+/**
+ * @brief Flag of the type byte of a message serialized with the compact
+ * encoding.
+ * @details In the compact encoding, the robot ID and the 16-bit fields
+ * holding string IDs or a swarm's lamport clock are written as varints
+ * (7 bits per byte, least significant first, the high bit telling whether
+ * another byte follows). An object is written as a tag byte holding its type
+ * (low nibble) and an immediate (high nibble), which is the zigzag-encoded
+ * value of an integer or the ID of a string when it is below 0xF. Otherwise,
+ * the immediate is 0xF and the value follows as a varint. Floats follow
+ * their tag as is, and nil has no value. Other objects cannot be encoded.
+ *
+ * Receivers read both encodings. Senders use the compact one when
+ * BBZ_COMPACT_MESSAGES is defined and it makes the message shorter.
+ */
+#define BBZMSG_COMPACT 0x08
+
+/**
+ * @brief Size of the largest message serialized with the compact encoding (B).
+ */
+#define BBZMSG_COMPACT_MAX_SIZE (1 + 3 + 3 + 1 + 3 + 1)
+
+/**
+ * @brief Makes the header of a message packed in a frame.
+ * @details Packed messages are serialized like single ones, except that their
+ * first byte holds both the type byte (low nibble, #BBZMSG_COMPACT flag
+ * included) and the number of bytes that follow it (high nibble). As the
+ * robot ID always follows, a header is never null, and a null byte ends a
+ * frame.
+ * @param[in] type The type byte of the message.
+ * @param[in] len The size of the message, header excluded (B).
+ */
+#define BBZMSG_PACK_HDR(type, len) ((uint8_t)((type) | ((len) << 4)))
+
+/**
+ * @brief Returns the type of a packed message from its header.
+ * @param[in] hdr The header.
+ */
+#define BBZMSG_PACK_TYPE(hdr) ((hdr) & 0x0F)
+
+/**
+ * @brief Returns the type of a packed message from its header, without
+ * the #BBZMSG_COMPACT flag.
+ * @param[in] hdr The header.
+ */
+#define BBZMSG_PACK_BASETYPE(hdr) (BBZMSG_PACK_TYPE(hdr) & ~BBZMSG_COMPACT)
+
+/**
+ * @brief Returns the size of a packed message, header excluded, from its
+ * header.
+ * @param[in] hdr The header.
+ */
+#define BBZMSG_PACK_LEN(hdr) ((hdr) >> 4)
+
+/**
+ * @brief Slot index meaning "no slot" in a message queue.
+ * @note Message queues can thus hold at most 254 messages.
+ */
+#define BBZMSG_QUEUE_NO_SLOT ((uint8_t)0xFF)
+
+/**
+ * @brief Priority queue of messages.
+ * @details The messages are stored in slots. The slots holding the messages
+ * of a type form a FIFO (a doubly linked list), and the FIFOs are served
+ * in the order of #bbzmsg_payload_type_t, so that inserting and extracting
+ * a message take a constant time. Free slots are linked with the 'next'
+ * links.
+ */
+typedef struct PACKED bbzmsg_queue_t {
+    bbzmsg_t* buf;  /**< @brief Message slots */
+    uint8_t* next;  /**< @brief For each slot, the next slot of the same type */
+    uint8_t* prev;  /**< @brief For each slot, the previous slot of the same type */
+    uint8_t first[BBZMSG_TYPE_COUNT]; /**< @brief Oldest message of each type */
+    uint8_t last[BBZMSG_TYPE_COUNT];  /**< @brief Newest message of each type */
+    uint8_t free;     /**< @brief First free slot */
+    uint8_t size;     /**< @brief Number of messages */
+    uint8_t capacity; /**< @brief Number of slots */
+} bbzmsg_queue_t;
 
 #ifndef BBZ_DISABLE_MESSAGES
 /**
@@ -90,7 +215,7 @@ typedef bbzringbuf_t bbzmsg_payload_t;
  * @param[in,out] rb The buffer where the serialized data is appended.
  * @param[in] data The data to serialize.
  */
-void bbzmsg_serialize_u8(bbzringbuf_t *rb,
+void bbzmsg_serialize_u8(bbzmsg_payload_t *rb,
                          uint8_t data);
 
 /**
@@ -102,7 +227,7 @@ void bbzmsg_serialize_u8(bbzringbuf_t *rb,
  * @param[in] pos The position at which the data starts.
  */
 void bbzmsg_deserialize_u8(uint8_t *data,
-                           const bbzringbuf_t *rb,
+                           const bbzmsg_payload_t *rb,
                            int16_t *pos);
 
 /**
@@ -111,7 +236,7 @@ void bbzmsg_deserialize_u8(uint8_t *data,
  * @param[in,out] rb The buffer where the serialized data is appended.
  * @param[in] data The data to serialize.
  */
-void bbzmsg_serialize_u16(bbzringbuf_t *rb,
+void bbzmsg_serialize_u16(bbzmsg_payload_t *rb,
                           uint16_t data);
 
 /**
@@ -123,7 +248,7 @@ void bbzmsg_serialize_u16(bbzringbuf_t *rb,
  * @param[in] pos The position at which the data starts.
  */
 void bbzmsg_deserialize_u16(uint16_t *data,
-                            const bbzringbuf_t *rb,
+                            const bbzmsg_payload_t *rb,
                             int16_t *pos);
 
 /**
@@ -132,7 +257,7 @@ void bbzmsg_deserialize_u16(uint16_t *data,
  * @param[in,out] rb The buffer where the serialized data is appended.
  * @param[in] obj The object to serialize.
  */
-void bbzmsg_serialize_obj(bbzringbuf_t *rb, bbzobj_t *obj);
+void bbzmsg_serialize_obj(bbzmsg_payload_t *rb, bbzobj_t *obj);
 
 /**
  * @brief Serializes a BittyBuzz's object.
@@ -142,7 +267,93 @@ void bbzmsg_serialize_obj(bbzringbuf_t *rb, bbzobj_t *obj);
  * @param[in] rb The buffer where the serialized data is stored.
  * @param[in] pos The position at which the data starts.
  */
-void bbzmsg_deserialize_obj(bbzobj_t *data, bbzringbuf_t *rb, int16_t *pos);
+void bbzmsg_deserialize_obj(bbzobj_t *data, bbzmsg_payload_t *rb, int16_t *pos);
+
+/**
+ * @brief Writes a 16-bit unsigned integer in a flat buffer, in the byte
+ * order of bbzmsg_serialize_u16().
+ * @param[out] buf The buffer.
+ * @param[in] data The data to write.
+ */
+ALWAYS_INLINE
+void bbzmsg_raw_put_u16(uint8_t* buf, uint16_t data) {
+    data = htons(data);
+    buf[0] = ((uint8_t*)&data)[0];
+    buf[1] = ((uint8_t*)&data)[1];
+}
+
+/**
+ * @brief Reads a 16-bit unsigned integer from a flat buffer, in the byte
+ * order of bbzmsg_deserialize_u16().
+ * @param[in] buf The buffer.
+ * @return The data read.
+ */
+ALWAYS_INLINE
+uint16_t bbzmsg_raw_get_u16(const uint8_t* buf) {
+    uint16_t data;
+    ((uint8_t*)&data)[0] = buf[0];
+    ((uint8_t*)&data)[1] = buf[1];
+    return ntohs(data);
+}
+
+/**
+ * @brief Writes a BittyBuzz's object in a flat buffer, like
+ * bbzmsg_serialize_obj().
+ * @param[out] buf The buffer, of at least #BBZMSG_OBJ_SIZE bytes.
+ * @param[in] obj The object to write.
+ */
+ALWAYS_INLINE
+void bbzmsg_raw_put_obj(uint8_t* buf, const bbzobj_t* obj) {
+    buf[0] = obj->mdata;
+    bbzmsg_raw_put_u16(buf + 1, (uint16_t)obj->biggest.value);
+}
+
+/**
+ * @brief Reads a BittyBuzz's object from a flat buffer, like
+ * bbzmsg_deserialize_obj().
+ * @param[out] obj The object read.
+ * @param[in] buf The buffer, of at least #BBZMSG_OBJ_SIZE bytes.
+ */
+ALWAYS_INLINE
+void bbzmsg_raw_get_obj(bbzobj_t* obj, const uint8_t* buf) {
+    obj->mdata = buf[0];
+    *(uint16_t*)&obj->biggest.value = bbzmsg_raw_get_u16(buf + 1);
+}
+
+/**
+ * @brief Writes a message in a flat buffer with the compact encoding.
+ * @details The type byte, #BBZMSG_COMPACT flag included, comes first.
+ * @param[out] buf The buffer, of at least #BBZMSG_COMPACT_MAX_SIZE bytes.
+ * @param[in] msg The message to write.
+ * @return The size of the message (B), or 0 if its object cannot be
+ * encoded.
+ */
+uint8_t bbzmsg_compact_put(uint8_t* buf, const bbzmsg_t* msg);
+
+/**
+ * @brief Reads a message serialized with the compact encoding from a flat
+ * buffer.
+ * @param[out] msg The message read.
+ * @param[in] type The type of the message, without the #BBZMSG_COMPACT flag.
+ * @param[in] buf The fields that follow the type byte.
+ * @param[in] len The number of bytes in the buffer.
+ * @return 1 if the message was read, 0 if it is truncated, malformed or of
+ * a disabled type.
+ */
+uint8_t bbzmsg_compact_get(bbzmsg_t* msg, bbzmsg_payload_type_t type, const uint8_t* buf, uint8_t len);
+
+/**
+ * @brief Reads the robot ID of a message from a flat buffer, in either
+ * encoding.
+ * @details Useful to platforms that add the sender of a broadcast to the
+ * neighbors when they receive it.
+ * @param[out] rid The robot ID read.
+ * @param[in] type The type byte of the message, which tells its encoding.
+ * @param[in] buf The fields that follow the type byte.
+ * @param[in] len The number of bytes in the buffer.
+ * @return 1 if the robot ID was read, 0 if the buffer is too short.
+ */
+uint8_t bbzmsg_raw_get_rid(bbzrobot_id_t* rid, uint8_t type, const uint8_t* buf, uint8_t len);
 
 #ifndef BBZ_DISABLE_NEIGHBORS
 /**
@@ -173,12 +384,51 @@ void bbzmsg_process_swarm(bbzmsg_t* msg);
 // +=-=-=-=-=-=-=-=-=-=-=-=-=-=+
 
 /**
- * @brief Applies a sorting algorithm to the given ring buffer.
- * @note It currently uses quicksort, but it could change in the futur.
- *       It also modifies the unused space at the end of the ring buffer.
- * @param[in,out] rb The ring buffer which we want to sort.
+ * @brief Initializes a message queue.
+ * @param[out] q The queue.
+ * @param[in] buf The message slots.
+ * @param[in] links Buffer for the links of the slots, of 2*cap elements.
+ * @param[in] cap The number of slots, less than #BBZMSG_QUEUE_NO_SLOT.
  */
-void bbzmsg_sort_priority(bbzringbuf_t* rb);
+void bbzmsg_queue_construct(bbzmsg_queue_t* q,
+                            bbzmsg_t* buf,
+                            uint8_t* links,
+                            uint8_t cap);
+
+/**
+ * @brief Erases all the messages of a message queue.
+ * @param[in,out] q The queue.
+ */
+void bbzmsg_queue_clear(bbzmsg_queue_t* q);
+
+/**
+ * @brief Makes room for a new message at the end of the FIFO of its type.
+ * @details If the queue is full, the newest message of the lowest priority
+ * is dropped first, and its slot is reused.
+ * @param[in,out] q The queue.
+ * @param[in] type The type of the new message.
+ * @return The slot of the new message, to be filled by the caller.
+ */
+bbzmsg_t* bbzmsg_queue_makeslot(bbzmsg_queue_t* q,
+                                bbzmsg_payload_type_t type);
+
+/**
+ * @brief Returns the message at the given position in a message queue.
+ * @details Position 0 is the message with the highest priority. Finding a
+ * message takes a time proportional to its position.
+ * @param[in] q The queue.
+ * @param[in] pos The position, less than the size of the queue.
+ * @return The message.
+ */
+bbzmsg_t* bbzmsg_queue_at(const bbzmsg_queue_t* q,
+                          uint8_t pos);
+
+/**
+ * @brief Removes the message with the highest priority from a message
+ * queue, if any.
+ * @param[in,out] q The queue.
+ */
+void bbzmsg_queue_pop(bbzmsg_queue_t* q);
 #else // !BBZ_DISABLE_MESSAGES
 #define bbzmsg_serialize_u8(...) /**< @brief */
 #define bbzmsg_deserialize_u8(...) /**< @brief */
@@ -186,7 +436,9 @@ void bbzmsg_sort_priority(bbzringbuf_t* rb);
 #define bbzmsg_deserialize_u16(...) /**< @brief */
 #define bbzmsg_serialize_obj(...) /**< @brief */
 #define bbzmsg_deserialize_obj(...) /**< @brief */
-#define bbzmsg_sort_priority(...) /**< @brief */
+#define bbzmsg_compact_put(...) (0) /**< @brief */
+#define bbzmsg_compact_get(...) (0) /**< @brief */
+#define bbzmsg_raw_get_rid(...) (0) /**< @brief */
 #endif // !BBZ_DISABLE_MESSAGES
 
 #if defined(BBZ_DISABLE_NEIGHBORS) || defined(BBZ_DISABLE_MESSAGES)
@@ -199,12 +451,6 @@ void bbzmsg_sort_priority(bbzringbuf_t* rb);
 #define bbzmsg_process_swarm(...) /**< @brief */
 #endif
 
-/*
- * Uncomment this line if the sorting algorithm above needs
- * to be called when an element is removed from the ring buffer.
- */
-//#define BBZMSG_POP_NEEDS_SORT
-
 #ifdef __cplusplus
 }
 #endif // __cplusplus
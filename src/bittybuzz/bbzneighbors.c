@@ -7,33 +7,26 @@
  */
 #define INTERNAL_STRID_SUB_TBL __BBZSTRID___INTERNAL_1_DO_NOT_USE__
 
-/**
- * String ID of the count subfield.
- */
-#define INTERNAL_STRID_COUNT   __BBZSTRID___INTERNAL_2_DO_NOT_USE__
-
 /**
  * @brief Given a neighbor data, pushes a table containing the fields
  * 'distance', 'azimuth' and 'elevation'.
  * @param[in] elem Data of the neighbor structure.
  */
 static void push_neighbor_data_table(const bbzneighbors_elem_t* elem) {
-    bbzvm_pusht();
 #ifndef BBZ_NEIGHBORS_USE_FLOATS
-    // Distance
-    bbztable_add_data(__BBZSTRID_distance,  bbzint_new(elem->distance));
-    // Azimuth
-    bbztable_add_data(__BBZSTRID_azimuth,   bbzint_new(elem->azimuth));
-    // Elevation
-    bbztable_add_data(__BBZSTRID_elevation, bbzint_new(elem->elevation));
+    const bbztable_init_t fields[] = {
+        { __BBZSTRID_distance,  NULL, bbzint_new(elem->distance) },
+        { __BBZSTRID_azimuth,   NULL, bbzint_new(elem->azimuth) },
+        { __BBZSTRID_elevation, NULL, bbzint_new(elem->elevation) },
+    };
 #else // !BBZ_NEIGHBORS_USE_FLOATS
-    // Distance
-    bbztable_add_data(__BBZSTRID_distance,  bbzfloat_new(elem->distance));
-    // Azimuth
-    bbztable_add_data(__BBZSTRID_azimuth,   bbzfloat_new(elem->azimuth));
-    // Elevation
-    bbztable_add_data(__BBZSTRID_elevation, bbzfloat_new(elem->elevation));
+    const bbztable_init_t fields[] = {
+        { __BBZSTRID_distance,  NULL, bbzfloat_new(elem->distance) },
+        { __BBZSTRID_azimuth,   NULL, bbzfloat_new(elem->azimuth) },
+        { __BBZSTRID_elevation, NULL, bbzfloat_new(elem->elevation) },
+    };
 #endif // !BBZ_NEIGHBORS_USE_FLOATS
+    bbzvm_push(bbztable_new_from(fields, sizeof(fields) / sizeof(*fields)));
 }
 
 /**
@@ -46,32 +39,14 @@ static void push_neighbor_data_table(const bbzneighbors_elem_t* elem) {
 static void neighborlike_foreach(bbztable_elem_funp elem_fun, void* params);
 
 /**
- * @brief Adds some fields that are common to both the 'neighbors' table
- * and neighbor-like tables gotten from some neighbor operations, such
- * as 'map' or 'filter'.
- * @param[in] count The number of neighbors.
+ * @brief Pushes a new neighbor-like table, such as the ones returned by
+ * 'map' or 'filter'.
+ * @details The table only holds the neighbors' data. Its methods are
+ * looked up in <code>vm->neighbors.proto</code> by bbzvm_tget().
  */
-static void add_neighborlike_fields(int16_t count) {
-
-#ifndef BBZ_XTREME_MEMORY
-    // Add a sub-table which will contain the neighbors' data
-    bbzheap_idx_t sub_tbl = bbztable_new();
-    bbztable_add_data(INTERNAL_STRID_SUB_TBL, sub_tbl);
-
-    // Add neighbor count
-    bbzheap_idx_t cnt = bbzint_new(count);
-    bbztable_add_data(INTERNAL_STRID_COUNT, cnt);
-#else
-    RM_UNUSED_WARN(count);
-#endif // !BBZ_XTREME_MEMORY
-
-    // Add function fields
-    bbztable_add_function(__BBZSTRID_foreach, bbzneighbors_foreach);
-    bbztable_add_function(__BBZSTRID_filter,  bbzneighbors_filter);
-    bbztable_add_function(__BBZSTRID_map,     bbzneighbors_map);
-    bbztable_add_function(__BBZSTRID_get,     bbzneighbors_get);
-    bbztable_add_function(__BBZSTRID_reduce,  bbzneighbors_reduce);
-    bbztable_add_function(__BBZSTRID_count,   bbzneighbors_count);
+static void push_neighborlike_table() {
+    bbzvm_pusht();
+    bbztype_make_neighborlike(*bbzheap_obj_at(bbzvm_stack_at(0)));
 }
 
 /****************************************/
@@ -84,8 +59,8 @@ static void add_neighborlike_fields(int16_t count) {
 static void neighbors_construct(bbzheap_idx_t n, bbzheap_idx_t l) {
     vm->neighbors.hpos = n;
     vm->neighbors.listeners = l;
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->neighbors.hpos));
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->neighbors.listeners));
+    bbzheap_root_add(vm->neighbors.hpos);
+    bbzheap_root_add(vm->neighbors.listeners);
     vm->neighbors.clear_counter = BBZNEIGHBORS_CLR_PERIOD;
 #ifdef BBZ_XTREME_MEMORY
     bbzringbuf_construct(&vm->neighbors.rb, (uint8_t *) vm->neighbors.data,
@@ -103,19 +78,36 @@ void bbzneighbors_register() {
     bbzheap_idx_t l = bbzvm_stack_at(0);
     bbzvm_pop();
 
-    // Create the 'neighbors' table
-    bbzvm_pusht();
+    // Create the table of the methods shared by the neighbor-like tables
+    const bbztable_init_t methods[] = {
+        { __BBZSTRID_foreach, bbzneighbors_foreach, 0 },
+        { __BBZSTRID_filter,  bbzneighbors_filter,  0 },
+        { __BBZSTRID_map,     bbzneighbors_map,     0 },
+        { __BBZSTRID_get,     bbzneighbors_get,     0 },
+        { __BBZSTRID_reduce,  bbzneighbors_reduce,  0 },
+        { __BBZSTRID_count,   bbzneighbors_count,   0 },
+    };
+    vm->neighbors.proto = bbztable_new_from(methods, sizeof(methods) / sizeof(*methods));
+    bbzheap_root_add(vm->neighbors.proto);
+
+    // Create the 'neighbors' table (most common fields first), which is
+    // neighbor-like too
+    const bbztable_init_t fields[] = {
+        { __BBZSTRID_broadcast, bbzneighbors_broadcast, 0 },
+        { __BBZSTRID_listen,    bbzneighbors_listen,    0 },
+        { __BBZSTRID_ignore,    bbzneighbors_ignore,    0 },
+#ifndef BBZ_XTREME_MEMORY
+        // Sub-table which will contain the neighbors' data
+        { INTERNAL_STRID_SUB_TBL, NULL, bbztable_new() },
+#endif // !BBZ_XTREME_MEMORY
+    };
+    bbzvm_push(bbztable_new_from(fields, sizeof(fields) / sizeof(*fields)));
+    bbztype_make_neighborlike(*bbzheap_obj_at(bbzvm_stack_at(0)));
 
     // Construct the 'neighbors' structure.
     bbzheap_idx_t n = bbzvm_stack_at(0);
     neighbors_construct(n, l);
 
-    // Add some fields to the table (most common fields first)
-    bbztable_add_function(__BBZSTRID_broadcast, bbzneighbors_broadcast);
-    bbztable_add_function(__BBZSTRID_listen, bbzneighbors_listen);
-    bbztable_add_function(__BBZSTRID_ignore, bbzneighbors_ignore);
-    add_neighborlike_fields(0);
-
     // Table is stack top, and string 'neighbors' is stack #1. Register it.
     bbzvm_gstore();
 }
@@ -127,12 +119,6 @@ void bbzneighbors_reset() {
 #ifdef BBZ_XTREME_MEMORY
     // Reset the ring-buffer
     bbzringbuf_clear(&vm->neighbors.rb);
-
-    // Reset 'neighbor''s count subfield
-    bbzvm_pushi(0);
-    bbzheap_idx_t cnt = bbzvm_stack_at(0);
-    bbzvm_pop();
-    bbztable_add_data(INTERNAL_STRID_COUNT, cnt);
 #else
     // Reset the count
     vm->neighbors.count = 0;
@@ -210,7 +196,7 @@ static void neighbor_foreach_fun(bbzheap_idx_t key,
     bbzvm_pop();
 
     // Garbage-collect to reduce memory usage.
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 void bbzneighbors_foreach() {
@@ -281,11 +267,11 @@ static void neighbor_map_base(bbzheap_idx_t key,
 
     // Add a value to return table.
     bbzvm_push(nm->t);
-    bbzvm_pushi(key);
+    bbzvm_push(key);
     nm->put_elem(value, ret);
 
     // Garbage-collect to reduce memory usage.
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /**
@@ -300,9 +286,8 @@ static void neighbors_map_base(put_elem_funp put_elem) {
     bbzvm_assert_type(c, BBZTYPE_CLOSURE);
 
     // Make return table
-    bbzvm_pusht();
+    push_neighborlike_table();
     bbzheap_idx_t ret_tbl = bbzvm_stack_at(0);
-    add_neighborlike_fields(0);
 
     // Perform foreach
     neighbor_map_base_t nm = { .t = ret_tbl, .c = c, .put_elem = put_elem };
@@ -383,7 +368,7 @@ static void neighbor_reduce(bbzheap_idx_t key,
     bbzvm_assert_exec(bbzvm_stack_size() > ss, BBZVM_ERROR_RET);
 
     // Garbage-collect to reduce memory usage.
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 
     // Accumulator is at stack #0.
 }
@@ -450,6 +435,21 @@ __attribute__((unused)) static void bringToBottom(bbzringbuf_t *rb, uint8_t pos)
 // -      REGULAR IMPLEMENTATIONS      -
 // -------------------------------------
 
+/**
+ * @brief Gets the table which contains the neighbors' data of the table we
+ * are using an algorithm on.
+ * @details This is the sub-table of the 'neighbors' table. The other
+ * neighbor-like tables contain their data directly.
+ * @return The table.
+ */
+static bbzheap_idx_t neighborlike_data() {
+    bbzheap_idx_t self = bbzvm_locals_at(0);
+    if (self != vm->neighbors.hpos) return self;
+    bbzheap_idx_t sub_tbl = vm->nil;
+    bbztable_get(self, bbzstring_get(INTERNAL_STRID_SUB_TBL), &sub_tbl);
+    return sub_tbl;
+}
+
 /**
  * @brief Function called by the foreach algorithm used to garbage-collect unused neighbors' data.
  * @param key The robot id associated with the current value.
@@ -509,10 +509,8 @@ void bbzneighbors_get() {
 //    bbzheap_idx_t robot = bbzvm_locals_at(1);
     bbzvm_assert_type(bbzvm_locals_at(1), BBZTYPE_INT);
 
-    // Get the sub-table of the table we are using 'get' on.
-    bbzvm_lload(0); // Self table
-    bbzvm_pushs(INTERNAL_STRID_SUB_TBL);
-    bbzvm_tget();
+    // Get the data of the table we are using 'get' on.
+    bbzvm_push(neighborlike_data());
     bbzvm_lload(1);
     bbzvm_tget();
 
@@ -525,13 +523,8 @@ void bbzneighbors_get() {
 void bbzneighbors_count() {
     bbzvm_assert_lnum(0);
 
-    // Get neighbors' sub-table
-    bbzvm_lload(0);
-    bbzheap_idx_t neighbor_data = bbztable_get_subfield(INTERNAL_STRID_SUB_TBL);
-    bbzvm_pop();
-
     // Push count and return.
-    bbzvm_pushi(bbztable_size(neighbor_data));
+    bbzvm_pushi(bbztable_size(neighborlike_data()));
     bbzvm_ret1();
 }
 
@@ -539,12 +532,7 @@ void bbzneighbors_count() {
 /****************************************/
 
 void neighborlike_foreach(bbztable_elem_funp elem_fun, void* params) {
-    // Get the sub-table we are using the algorithm on.
-    bbzvm_lload(0); // Self table
-    bbzheap_idx_t sub_tbl = bbztable_get_subfield(INTERNAL_STRID_SUB_TBL);
-    bbzvm_pop();
-
-    bbztable_foreach(sub_tbl, elem_fun, params);
+    bbztable_foreach(neighborlike_data(), elem_fun, params);
 }
 
 // -------------------------------------
@@ -657,7 +645,7 @@ void bbzneighbors_get() {
         bbzvm_pushnil();
     }
     bbzvm_ret1();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
@@ -676,13 +664,9 @@ void bbzneighbors_count() {
     }
     else {
         //
-        // Neighbor-like table ; uses Buzz implementation.
+        // Neighbor-like table ; it only contains the neighbors' data.
         //
-
-        // Get 'count' subfield
-        bbzvm_lload(0); // Push self table
-        bbzvm_pushs(INTERNAL_STRID_COUNT);
-        bbzvm_tget();
+        bbzvm_pushi(bbztable_size(bbzvm_locals_at(0)));
     }
 
     bbzvm_ret1();
@@ -711,7 +695,7 @@ static void neighborlike_foreach(bbztable_elem_funp elem_fun, void* params) {
             bbzheap_idx_t data = bbzvm_stack_at(0);
             bbzvm_pop();
             elem_fun(bbzint_new(elem->robot), data, params);
-            bbzvm_gc(); // Garbage-Collect the created data table
+            bbzvm_gc_ifdue(); // Garbage-Collect the created data table
         }
     }
     else {
@@ -720,7 +704,7 @@ static void neighborlike_foreach(bbztable_elem_funp elem_fun, void* params) {
         //
         bbztable_foreach(self, elem_fun, params);
     }
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 #endif // !BBZ_XTREME_MEMORY
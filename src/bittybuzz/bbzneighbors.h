@@ -7,11 +7,15 @@
  *
  * <h3>'Regular' implementation (non Xtreme):</h3>
  *
- * Both the <code>neighbors</code> table and the neighbor-like tables
- * (such as the one returned by the filter closure) have the same
- * implementation:
- * The table contains a subfield  (string __BBZSTRID_INTERNAL_1_DO_NOT_USE)
- * which itself contains one table for each neighbor.
+ * The <code>neighbors</code> table contains a subfield (string
+ * __BBZSTRID_INTERNAL_1_DO_NOT_USE) which itself contains one table for
+ * each neighbor. The neighbor-like tables (such as the one returned by the
+ * filter closure) contain their data directly.
+ *
+ * The methods ('foreach', 'map', etc.) are not stored in these tables:
+ * they are marked as neighbor-like (see bbztype_isneighborlike()), and
+ * bbzvm_tget() looks the fields they lack up in a single permanent table,
+ * <code>vm->neighbors.proto</code>.
  *
  * <h3>BBZ_XTREME_MEMORY implementation:</h3>
  *
@@ -36,13 +40,11 @@
  *
  * Thus, we end up with the following implementation:
  * <ul>
- * <li> The <code>neighbors</code> table, apart from the closures, contains a
- * count subfield (string __BBZSTRID_INTERNAL_2_DO_NOT_USE). The actual
- * data is placed inside a C structure (a table of #bbzneighbors_elem_t).
- * <li> The neighbor-like tables, apart from the closures, contain a
- * count subfield (string __BBZSTRID_INTERNAL_2_DO_NOT_USE). The actual
- * data is placed directly inside the neighbor-like table, and is a table
- * containing the <code>{distance, azumuth, elevation}</code> subfields.
+ * <li> The data of the <code>neighbors</code> table is placed inside a C
+ * structure (a table of #bbzneighbors_elem_t).
+ * <li> The data of the neighbor-like tables is placed directly inside the
+ * neighbor-like table, and is a table containing the
+ * <code>{distance, azumuth, elevation}</code> subfields.
  * Thus, we <i>could</i> access the distance for a neighbor by doing
  * something like <code>neighborlike[32].distance</code>.
  * </ul>
@@ -115,6 +117,7 @@ typedef struct PACKED bbzneighbors_t {
 #ifndef BBZ_DISABLE_NEIGHBORS
     bbzheap_idx_t hpos;      /**< @brief Heap's position of the 'neighbors' table. */
     bbzheap_idx_t listeners; /**< @brief Neighbor value listeners. */
+    bbzheap_idx_t proto;     /**< @brief Methods of the neighbor-like tables. */
     uint8_t clear_counter;   /**< @brief Counter to clear neighbors' data */
 #ifdef BBZ_XTREME_MEMORY
     bbzringbuf_t rb;         /**< @brief Neighbors' data ringbuffer. */
@@ -5,36 +5,36 @@
 /****************************************/
 
 void bbzoutmsg_queue_construct() {
-    bbzringbuf_construct(&vm->outmsgs.queue, (uint8_t*)vm->outmsgs.buf, sizeof(bbzmsg_t), BBZOUTMSG_QUEUE_CAP+1);
+    bbzmsg_queue_construct(&vm->outmsgs.queue, vm->outmsgs.buf, vm->outmsgs.links, BBZOUTMSG_QUEUE_CAP);
 }
 
 /****************************************/
 /****************************************/
 
 void bbzoutmsg_queue_destruct() {
-    bbzringbuf_clear(&vm->outmsgs.queue);
+    bbzmsg_queue_clear(&vm->outmsgs.queue);
 }
 
 /****************************************/
 /****************************************/
 
 uint16_t bbzoutmsg_queue_size() {
-    return bbzringbuf_size(&vm->outmsgs.queue);
+    return vm->outmsgs.queue.size;
 }
 
 /****************************************/
 /****************************************/
 
-static bbzmsg_t* outmsg_queue_append_template() {
-    bbzmsg_t* m = ((bbzmsg_t*)bbzringbuf_rawat(&vm->outmsgs.queue, vm->outmsgs.queue.dataend));
-    if (bbzringbuf_full(&vm->outmsgs.queue)) {
-        // If full, replace the message with the lowest priority (the last of the queue) with the new one.
-        *((bbzmsg_t*)bbzringbuf_rawat(&vm->outmsgs.queue, vm->outmsgs.queue.dataend - (uint8_t)1 + vm->outmsgs.queue.capacity)) = *m;
-    }
-    else {
-        // If not full, push the message at the end of the queue.
-        bbzringbuf_makeslot(&vm->outmsgs.queue);
-    }
+/**
+ * @brief Makes room for a new message in the queue.
+ * @details If the queue is full, the message with the lowest priority (the
+ * last of the queue) is replaced with the new one.
+ * @param[in] type The type of the new message.
+ * @return The new message, whose type is set.
+ */
+static bbzmsg_t* outmsg_queue_append_template(bbzmsg_payload_type_t type) {
+    bbzmsg_t* m = bbzmsg_queue_makeslot(&vm->outmsgs.queue, type);
+    m->type = type;
     return m;
 }
 
@@ -44,12 +44,10 @@ static bbzmsg_t* outmsg_queue_append_template() {
 #ifndef BBZ_DISABLE_NEIGHBORS
 void bbzoutmsg_queue_append_broadcast(bbzheap_idx_t topic, bbzheap_idx_t value) {
     /* Make a new BROADCAST message */
-    bbzmsg_t* m = outmsg_queue_append_template();
-    m->bc.type = BBZMSG_BROADCAST;
+    bbzmsg_t* m = outmsg_queue_append_template(BBZMSG_BROADCAST);
     m->bc.rid = vm->robot;
     m->bc.topic = bbzheap_obj_at(topic)->s.value;
     m->bc.value = *bbzheap_obj_at(value);
-    bbzmsg_sort_priority(&vm->outmsgs.queue);
 }
 #endif // !BBZ_DISABLE_NEIGHBORS
 
@@ -61,12 +59,10 @@ void bbzoutmsg_queue_append_swarm(bbzrobot_id_t robot,
                                   bbzswarmlist_t swarms,
                                   bbzlamport_t lamport) {
     /* Make a new swarm message */
-    bbzmsg_t* m = outmsg_queue_append_template();
-    m->sw.type = BBZMSG_SWARM;
+    bbzmsg_t* m = outmsg_queue_append_template(BBZMSG_SWARM);
     m->sw.rid = robot;
     m->sw.lamport = lamport;
     m->sw.swarms = swarms;
-    bbzmsg_sort_priority(&vm->outmsgs.queue);
 }
 #endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
 
@@ -80,13 +76,11 @@ void bbzoutmsg_queue_append_vstig(bbzmsg_payload_type_t type,
                                   bbzheap_idx_t value,
                                   uint8_t lamport) {
     /* Make a new VSTIG_PUT/VSTIG_QUERY message */
-    bbzmsg_t* m = outmsg_queue_append_template();
-    m->vs.type = type;
+    bbzmsg_t* m = outmsg_queue_append_template(type);
     m->vs.rid = rid;
     m->vs.lamport = lamport;
     m->vs.key = key;
     m->vs.data = *bbzheap_obj_at(value);
-    bbzmsg_sort_priority(&vm->outmsgs.queue);
 }
 #endif // !BBZ_DISABLE_VSTIGS
 
@@ -94,8 +88,8 @@ void bbzoutmsg_queue_append_vstig(bbzmsg_payload_type_t type,
 /****************************************/
 
 void bbzoutmsg_queue_first(bbzmsg_payload_t* buf) {
-    bbzmsg_t* msg = (bbzmsg_t*)bbzringbuf_at(&vm->outmsgs.queue, 0);
-    bbzringbuf_clear(buf);
+    bbzmsg_t* msg = bbzmsg_queue_at(&vm->outmsgs.queue, 0);
+    bbzringbuf_bytes_clear(buf);
     bbzmsg_serialize_u8(buf, msg->type);
     bbzmsg_serialize_u16(buf, msg->base.rid);
     switch (msg->type) {
@@ -135,11 +129,116 @@ void bbzoutmsg_queue_first(bbzmsg_payload_t* buf) {
 /****************************************/
 /****************************************/
 
+/**
+ * @brief Serializes the fields of a message that follow its type directly
+ * in a flat buffer.
+ * @param[in] msg The message.
+ * @param[out] buf The buffer, of at least #BBZMSG_MAX_SIZE - 1 bytes.
+ * @return The size of the serialized fields, or 0 if the message cannot be
+ * sent.
+ */
+static uint8_t outmsg_serialize_fields(const bbzmsg_t* msg, uint8_t* buf) {
+    bbzmsg_raw_put_u16(buf, msg->base.rid);
+    buf += BBZMSG_HDR_SIZE - 1;
+    switch (msg->type) {
+        case BBZMSG_BROADCAST:
+#ifndef BBZ_DISABLE_NEIGHBORS
+            if (bbztype_istable(msg->bc.value)) return 0;
+            bbzmsg_raw_put_u16(buf, msg->bc.topic);
+            bbzmsg_raw_put_obj(buf + 2, &msg->bc.value);
+            return BBZMSG_BROADCAST_SIZE - 1;
+#else // !BBZ_DISABLE_NEIGHBORS
+            return 0;
+#endif // !BBZ_DISABLE_NEIGHBORS
+        case BBZMSG_VSTIG_PUT: // fallthrough
+        case BBZMSG_VSTIG_QUERY:
+#ifndef BBZ_DISABLE_VSTIGS
+            if (bbztype_istable(msg->vs.data)) return 0;
+            bbzmsg_raw_put_u16(buf, msg->vs.key);
+            bbzmsg_raw_put_obj(buf + 2, &msg->vs.data);
+            buf[2 + BBZMSG_OBJ_SIZE] = msg->vs.lamport;
+            return BBZMSG_VSTIG_SIZE - 1;
+#else // !BBZ_DISABLE_VSTIGS
+            return 0;
+#endif // !BBZ_DISABLE_VSTIGS
+        case BBZMSG_SWARM:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            bbzmsg_raw_put_u16(buf, msg->sw.lamport);
+            buf[2] = msg->sw.swarms;
+            return BBZMSG_SWARM_SIZE - 1;
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            return 0;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+        default:
+            return BBZMSG_HDR_SIZE - 1;
+    }
+}
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Serializes a message in a flat buffer, type byte included.
+ * @param[in] msg The message.
+ * @param[out] buf The buffer, of at least #BBZMSG_MAX_SIZE bytes.
+ * @return The size of the message (B), or 0 if it cannot be sent.
+ */
+static uint8_t outmsg_serialize(const bbzmsg_t* msg, uint8_t* buf) {
+    uint8_t n;
+#ifdef BBZ_COMPACT_MESSAGES
+    uint8_t tmp[BBZMSG_COMPACT_MAX_SIZE];
+    n = bbzmsg_compact_put(tmp, msg);
+    if (n > 0 && n < BBZMSG_SIZE(msg->type)) {
+        for (uint8_t i = 0; i < n; ++i) buf[i] = tmp[i];
+        return n;
+    }
+#endif // BBZ_COMPACT_MESSAGES
+    buf[0] = msg->type;
+    n = outmsg_serialize_fields(msg, buf + 1);
+    return n ? (uint8_t)(n + 1) : (uint8_t)0;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzoutmsg_queue_first_raw(uint8_t* buf) {
+    return outmsg_serialize(bbzmsg_queue_at(&vm->outmsgs.queue, 0), buf);
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbzoutmsg_queue_pack(uint8_t* frame, uint8_t len) {
+    const bbzmsg_queue_t* q = &vm->outmsgs.queue;
+    uint8_t tmp[BBZMSG_MAX_SIZE];
+    uint8_t count = 0;
+    uint8_t pos = 0;
+    for (uint8_t t = 0; t < BBZMSG_TYPE_COUNT; ++t) {
+        for (uint8_t i = q->first[t]; i != BBZMSG_QUEUE_NO_SLOT; i = q->next[i]) {
+            // Near the end of the frame, messages are serialized aside first.
+            uint8_t room = (uint8_t)(len - pos);
+            uint8_t* buf = room < BBZMSG_MAX_SIZE ? tmp : frame + pos;
+            uint8_t n = outmsg_serialize(q->buf + i, buf);
+            // Messages are packed in order, until one does not fit.
+            if (n > room) goto done;
+            if (n > 0) {
+                for (uint8_t j = 1; buf == tmp && j < n; ++j) frame[pos + j] = tmp[j];
+                frame[pos] = BBZMSG_PACK_HDR(buf[0], n - 1);
+                pos += n;
+            }
+            ++count;
+        }
+    }
+done:
+    if (pos < len) frame[pos] = 0;
+    return count;
+}
+
+/****************************************/
+/****************************************/
+
 void bbzoutmsg_queue_next() {
-    bbzringbuf_pop(&vm->outmsgs.queue);
-#ifdef BBZMSG_POP_NEEDS_SORT
-    bbzmsg_sort_priority(&vm->outmsgs.queue);
-#endif // !BBZMSG_POP_NEEDS_SORT
+    bbzmsg_queue_pop(&vm->outmsgs.queue);
 }
 
 /****************************************/
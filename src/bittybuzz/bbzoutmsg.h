@@ -21,8 +21,9 @@ extern "C" {
  */
 typedef struct PACKED bbzoutmsg_queue_t {
 #ifndef BBZ_DISABLE_MESSAGES
-    bbzringbuf_t queue; /**< @brief Message queue. */
-    bbzmsg_t buf[BBZOUTMSG_QUEUE_CAP+2]; /**< @brief Output message buffer */
+    bbzmsg_queue_t queue; /**< @brief Message queue. */
+    bbzmsg_t buf[BBZOUTMSG_QUEUE_CAP]; /**< @brief Output message buffer */
+    uint8_t links[2*BBZOUTMSG_QUEUE_CAP]; /**< @brief Links of the message slots */
 #endif // !BBZ_DISABLE_MESSAGES
 } bbzoutmsg_queue_t;
 
@@ -87,6 +88,33 @@ void bbzoutmsg_queue_append_vstig(bbzmsg_payload_type_t type,
  */
 void bbzoutmsg_queue_first(bbzmsg_payload_t *buf);
 
+/**
+ * @brief Serializes the first message in the queue directly in a flat
+ * buffer, such as the radio frame to send.
+ * @details The fields are written at fixed offsets (see #BBZMSG_HDR_SIZE),
+ * in the same format as bbzoutmsg_queue_first(). If BBZ_COMPACT_MESSAGES is
+ * defined, the compact encoding (see #BBZMSG_COMPACT) is used instead when
+ * it makes the message shorter.
+ * @param[out] buf A buffer of at least #BBZMSG_MAX_SIZE bytes.
+ * @return The size of the serialized message, or 0 if the message cannot be
+ * sent.
+ */
+uint8_t bbzoutmsg_queue_first_raw(uint8_t* buf);
+
+/**
+ * @brief Packs as many messages from the head of the queue as fit in a
+ * frame, in the order in which they would be sent.
+ * @details Each message is preceded by a one-byte header made with
+ * #BBZMSG_PACK_HDR. The messages stay in the queue: once the frame is sent,
+ * call bbzoutmsg_queue_next() once per packed message. Messages that
+ * cannot be sent take no room but are counted, so that they are removed too.
+ * If the frame is not full, a null byte ends it.
+ * @param[out] frame The frame.
+ * @param[in] len The size of the frame (B), at least #BBZMSG_MAX_SIZE.
+ * @return The number of messages packed.
+ */
+uint8_t bbzoutmsg_queue_pack(uint8_t* frame, uint8_t len);
+
 /**
  * @brief Removes the first element of the queue.
  */
@@ -97,12 +125,14 @@ void bbzoutmsg_queue_next();
  * @param[in] pos The position of the rquested message.
  * @return The requested message.
  */
-#define bbzoutmsg_queue_get(pos) ((bbzmsg_t*)bbzringbuf_at(&vm->outmsgs.queue, pos))
+#define bbzoutmsg_queue_get(pos) bbzmsg_queue_at(&vm->outmsgs.queue, pos)
 #else // !BBZ_DISABLE_MESSAGES
 #define bbzoutmsg_queue_construct(...)
 #define bbzoutmsg_queue_destruct(...)
 #define bbzoutmsg_queue_size(...) (0)
 #define bbzoutmsg_queue_first(...)
+#define bbzoutmsg_queue_first_raw(...) (0)
+#define bbzoutmsg_queue_pack(...) (0)
 void bbzoutmsg_queue_next(){}
 #define bbzoutmsg_queue_get(...) ((bbzmsg_t*)NULL)
 #endif // !BBZ_DISABLE_MESSAGES
@@ -114,6 +114,101 @@ uint8_t bbzringbuf_pop(bbzringbuf_t* rb);
  */
 uint8_t bbzringbuf_makeslot(bbzringbuf_t* rb);
 
+/**
+ * @brief Capacity of a byte ring buffer (#bbzringbuf_bytes_t).
+ * @details It must be a power of two, so that indices wrap around with a
+ * mask, and at most 128, so that the size fits in the index type.
+ */
+#define BBZRINGBUF_BYTES_CAP 16
+
+#if (BBZRINGBUF_BYTES_CAP & (BBZRINGBUF_BYTES_CAP - 1)) || BBZRINGBUF_BYTES_CAP > 128
+#error "BBZRINGBUF_BYTES_CAP must be a power of two no greater than 128."
+#endif
+
+/**
+ * @brief Mask wrapping an index of a byte ring buffer around its capacity.
+ */
+#define BBZRINGBUF_BYTES_MASK ((uint8_t)(BBZRINGBUF_BYTES_CAP - 1))
+
+/**
+ * @brief Ring buffer of bytes whose capacity is #BBZRINGBUF_BYTES_CAP.
+ * @details Unlike in a #bbzringbuf_t, the size of the elements and the
+ * capacity are known at compile-time. The start and end indices run freely
+ * and are wrapped around with #BBZRINGBUF_BYTES_MASK when accessing the
+ * linear buffer, so that no index is normalized with a loop, the size is
+ * the difference of the indices and all the slots of the buffer are used.
+ */
+typedef struct PACKED bbzringbuf_bytes_t {
+    uint8_t* buffer;    /**< @brief Pointer to a linear buffer of #BBZRINGBUF_BYTES_CAP bytes */
+    uint8_t  datastart; /**< @brief Data start index, not wrapped around */
+    uint8_t  dataend;   /**< @brief Data end index, not wrapped around */
+} bbzringbuf_bytes_t;
+
+/**
+ * @brief Erases all the bytes in the byte ring buffer.
+ * @param[in,out] rb The byte ring buffer.
+ */
+ALWAYS_INLINE
+void bbzringbuf_bytes_clear(bbzringbuf_bytes_t* rb) { rb->datastart = 0; rb->dataend = 0; }
+
+/**
+ * @brief Initializes a new byte ring buffer.
+ * @param[in,out] rb The byte ring buffer.
+ * @param[in] buf The pointer to a linear buffer of #BBZRINGBUF_BYTES_CAP bytes.
+ */
+ALWAYS_INLINE
+void bbzringbuf_bytes_construct(bbzringbuf_bytes_t* rb, uint8_t* buf) { rb->buffer = buf; bbzringbuf_bytes_clear(rb); }
+
+/**
+ * @brief Returns the number of bytes in the byte ring buffer.
+ * @param[in] rb The byte ring buffer.
+ * @return The number of bytes in the byte ring buffer.
+ */
+ALWAYS_INLINE
+uint8_t bbzringbuf_bytes_size(const bbzringbuf_bytes_t* rb) { return (uint8_t)(rb->dataend - rb->datastart); }
+
+/**
+ * @brief Checks whether the byte ring buffer is full.
+ * @param[in] rb The byte ring buffer.
+ * @return 1 if the buffer is full, 0 otherwise.
+ */
+ALWAYS_INLINE
+uint8_t bbzringbuf_bytes_full(const bbzringbuf_bytes_t* rb) { return (uint8_t)(bbzringbuf_bytes_size(rb) == BBZRINGBUF_BYTES_CAP); }
+
+/**
+ * @brief Returns the byte at the given index in the byte ring buffer.
+ * The index starts from 0 for the oldest byte in the structure.
+ * @param[in] rb The byte ring buffer.
+ * @param[in] idx The index.
+ * @return A pointer to the byte at the given index.
+ */
+ALWAYS_INLINE
+uint8_t* bbzringbuf_bytes_at(const bbzringbuf_bytes_t* rb, uint8_t idx) { return rb->buffer + ((uint8_t)(rb->datastart + idx) & BBZRINGBUF_BYTES_MASK); }
+
+/**
+ * @brief Appends a byte to the byte ring buffer.
+ * If the buffer is full, its oldest byte is dropped.
+ * @param[in,out] rb The byte ring buffer.
+ * @param[in] data The byte to append.
+ */
+ALWAYS_INLINE
+void bbzringbuf_bytes_push(bbzringbuf_bytes_t* rb, uint8_t data) {
+    if (bbzringbuf_bytes_full(rb)) ++rb->datastart;
+    rb->buffer[rb->dataend++ & BBZRINGBUF_BYTES_MASK] = data;
+}
+
+/**
+ * @brief Pops the oldest byte of the byte ring buffer, if any.
+ * @param[in,out] rb The byte ring buffer.
+ * @return 1 if the pop was sucessful, 0 if the buffer was already empty.
+ */
+ALWAYS_INLINE
+uint8_t bbzringbuf_bytes_pop(bbzringbuf_bytes_t* rb) {
+    if (rb->datastart == rb->dataend) return 0;
+    ++rb->datastart;
+    return 1;
+}
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
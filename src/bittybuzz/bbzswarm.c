@@ -79,30 +79,45 @@ static bbzswarm_id_t get_id() {
     return swarm;
 }
 
+/**
+ * Creates the prototype of the subswarm tables.
+ * @details The prototype is only created when a subswarm is, so that the
+ * scripts which do not use subswarms do not pay for it.
+ */
+static void make_proto() {
+    const bbztable_init_t fields[] = {
+        { __BBZSTRID_id,       NULL,              bbzint_new(0) },
+        { __BBZSTRID_join,     bbzswarm_join,     0 },
+        { __BBZSTRID_leave,    bbzswarm_leave,    0 },
+        { __BBZSTRID_in,       bbzswarm_in,       0 },
+        { __BBZSTRID_select,   bbzswarm_select,   0 },
+        { __BBZSTRID_unselect, bbzswarm_unselect, 0 },
+        { __BBZSTRID_exec,     bbzswarm_exec,     0 },
+#ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
+        { __BBZSTRID_others,   bbzswarm_others,   0 },
+#endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    };
+    bbzheap_idx_t p = bbztable_new_from(fields, sizeof(fields) / sizeof(*fields));
+    if (vm->state == BBZVM_STATE_ERROR) return;
+    vm->swarm.proto = p;
+    bbzheap_root_add(vm->swarm.proto);
+}
+
 /**
  * Pushes a table containing all the fields that a subswarm table has.
  * @param[in] swarm The ID of the swarm that this table is for.
  */
 static void make_table(bbzswarm_id_t swarm) {
-    // Create table
-    bbzvm_pusht();
+    if (vm->swarm.proto == vm->nil) {
+        make_proto();
+        if (vm->state == BBZVM_STATE_ERROR) return;
+    }
 
-    // Add swarm id
-    bbzvm_pushi(swarm);
-    bbzheap_idx_t swarm_obj = bbzvm_stack_at(0);
-    bbzvm_pop();
-    bbztable_add_data(__BBZSTRID_id, swarm_obj);
-
-    // Add closures
-    bbztable_add_function(__BBZSTRID_join,   bbzswarm_join);
-    bbztable_add_function(__BBZSTRID_leave,  bbzswarm_leave);
-    bbztable_add_function(__BBZSTRID_in,     bbzswarm_in);
-    bbztable_add_function(__BBZSTRID_select, bbzswarm_select);
-    bbztable_add_function(__BBZSTRID_unselect, bbzswarm_unselect);
-    bbztable_add_function(__BBZSTRID_exec,   bbzswarm_exec);
-#ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
-    bbztable_add_function(__BBZSTRID_others, bbzswarm_others);
-#endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    // Copy the prototype, which shares its closures with the other subswarm tables
+    bbzvm_push(bbztable_new_copy(vm->swarm.proto));
+
+    // Set swarm id
+    bbztable_add_data(__BBZSTRID_id, bbzint_new(swarm));
 }
 
 /****************************************/
@@ -119,9 +134,12 @@ static void swarm_construct(bbzheap_idx_t swarm) {
     // Create swarmstack
     bbzdarray_new(&vm->swarm.swarmstack);
 
+    // The prototype of the subswarm tables is created on first use
+    vm->swarm.proto = vm->nil;
+
     // Make stuff permanent
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->swarm.hpos));
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->swarm.swarmstack));
+    bbzheap_root_add(vm->swarm.hpos);
+    bbzheap_root_add(vm->swarm.swarmstack);
 
 #ifdef BBZ_DISABLE_SWARMLIST_BROADCASTS
     // Initialize swarmlist.
@@ -132,21 +150,23 @@ static void swarm_construct(bbzheap_idx_t swarm) {
 void bbzswarm_register() {
     bbzvm_pushs(__BBZSTRID_swarm);
 
-    // Create the 'swarm' table
-    bbzvm_pusht();
+    // Create the 'swarm' table (most common fields first)
+    const bbztable_init_t fields[] = {
+        { __BBZSTRID_create,       bbzswarm_create,       0 },
+        { __BBZSTRID_id,           bbzswarm_id,           0 },
+#ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
+        { __BBZSTRID_intersection, bbzswarm_intersection, 0 },
+        { __BBZSTRID_union,        bbzswarm_union,        0 },
+        { __BBZSTRID_difference,   bbzswarm_difference,   0 },
+#endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    };
+    bbzvm_push(bbztable_new_from(fields, sizeof(fields) / sizeof(*fields)));
 
     // Construct the 'swarm' structure.
     bbzheap_idx_t s = bbzvm_stack_at(0);
     swarm_construct(s);
 
-    // Add some fields to the table (most common fields first)
-    bbztable_add_function(__BBZSTRID_create,       bbzswarm_create);
-    bbztable_add_function(__BBZSTRID_id,           bbzswarm_id);
 #ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
-    bbztable_add_function(__BBZSTRID_intersection, bbzswarm_intersection);
-    bbztable_add_function(__BBZSTRID_union,        bbzswarm_union);
-    bbztable_add_function(__BBZSTRID_difference,   bbzswarm_difference);
-
     // Create our own swarm list
     bbzswarm_addmember(vm->robot, 0); // Add us as member of swarm 0, which creates the entry.
     bbzswarm_rmmember(vm->robot, 0); // Immediately remove us from swarm 0. The entry will still exist.
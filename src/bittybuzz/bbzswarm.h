@@ -96,6 +96,7 @@ typedef struct PACKED bbzswarm_t {
 #ifndef BBZ_DISABLE_SWARMS
     bbzheap_idx_t hpos;          /**< @brief Heap's position of the 'swarm' table. */
     bbzheap_idx_t swarmstack;    /**< @brief The stack of swarm IDs that we push to/pop from when we call/return from the 'exec' function. */
+    bbzheap_idx_t proto;         /**< @brief Table copied by 'swarm.create', which holds the methods of a subswarm. Created on first use. */
 #ifdef BBZ_DISABLE_SWARMLIST_BROADCASTS
     bbzswarmlist_t my_swarmlist; /**< @brief Current robot's swarmlist */
 #endif // !BBZ_DISABLE_SWARMLIST_BROADCASTS
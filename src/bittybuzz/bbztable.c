@@ -1,12 +1,267 @@
 #include "bbztable.h"
 #include "bbzvm.h"
 
+#ifdef BBZ_HASHED_TABLES
+/*
+ * The segments of a hashed table are its buckets: a key is stored in the
+ * segment at the position given by its hash in the chain or, when that
+ * segment is full, in the next segment with a free slot (wrapping around
+ * to the first segment). The number of segments is a power of two.
+ *
+ * The first slot of the first segment holds a header instead of an
+ * element. Its key and value are kept invalid, so that the garbage
+ * collector and bbztable_foreach() skip it.
+ *
+ * Removed keys are replaced by a 'deleted' mark, so that a lookup can
+ * stop at the first segment with an empty slot.
+ */
+
+/**
+ * @brief Number of used slots (valid or deleted) of a hashed table.
+ * @param[in] sd The first segment of the table.
+ */
+#define table_fill(sd) ((sd)->keys[0])
+
+/**
+ * @brief Base-2 logarithm of the number of segments of a hashed table.
+ * @param[in] sd The first segment of the table.
+ */
+#define table_lgseg(sd) ((sd)->values[0])
+
+/**
+ * @brief Key of a slot whose element was removed.
+ */
+#define TABLE_KEY_DELETED ((bbzheap_idx_t)0x7FFF)
+
+/**
+ * @brief Number of used slots above which a table with 2^lg segments
+ * is rehashed.
+ * @param[in] lg The base-2 logarithm of the number of segments.
+ */
+#define table_maxfill(lg) ((uint16_t)(((uint16_t)BBZHEAP_ELEMS_PER_TSEG << (lg)) * 4 / 5))
+
+/**
+ * @brief Computes the hash of a key.
+ * @details Keys that compare equal with bbztype_cmp() have the same hash.
+ * @param[in] k The key.
+ * @return The hash of the key.
+ */
+static uint16_t table_hash(bbzheap_idx_t k) {
+    const bbzobj_t* x = bbzheap_obj_at(k);
+    switch (bbztype(*x)) {
+        case BBZTYPE_INT:
+            return (uint16_t)x->i.value;
+        case BBZTYPE_FLOAT: {
+#ifdef BBZ_USE_FLOAT
+            /* Floats equal integers of the same value */
+            float f = bbzfloat_tofloat(x->f.value);
+            if (f >= INT16_MIN && f <= INT16_MAX && f == (int16_t)f) {
+                return (uint16_t)(int16_t)f;
+            }
+#endif // BBZ_USE_FLOAT
+            return x->f.value;
+        }
+        case BBZTYPE_STRING:
+            return x->s.value;
+        case BBZTYPE_TABLE:
+            return x->t.value;
+        case BBZTYPE_USERDATA:
+            return (uint16_t)x->u.value;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Looks for a key in a hashed table.
+ * @param[in] si0 The index of the first segment of the table.
+ * @param[in] k The key.
+ * @param[out] seg The segment of the key if it was found. Otherwise, the
+ * segment of the first free slot where the key can be added, or
+ * BBZHEAP_SEG_NO_NEXT if there is none.
+ * @param[out] slot The slot of the key or of the free slot in the segment.
+ * @return 1 if the key was found, 0 otherwise.
+ */
+static uint8_t table_find(bbzheap_idx_t si0,
+                          bbzheap_idx_t k,
+                          bbzheap_idx_t* seg,
+                          uint8_t* slot) {
+    const uint8_t lg = (uint8_t)table_lgseg(bbzheap_tseg_at(si0));
+    /* Go to the segment given by the hash */
+    uint16_t b = lg ? (uint16_t)(table_hash(k) * 40503u) >> (16 - lg) : 0;
+    bbzheap_idx_t si = si0;
+    for (; b != 0; --b) {
+        si = bbzheap_tseg_next_get(bbzheap_tseg_at(si));
+    }
+    *seg = BBZHEAP_SEG_NO_NEXT;
+    /* Go through segments, until one with an empty slot */
+    for (uint16_t n = (uint16_t)1 << lg; n != 0; --n) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+        uint8_t hasempty = 0;
+        for (uint8_t i = (si == si0); i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+            if (bbzheap_tseg_elem_isvalid(sd->keys[i])) {
+                if (bbztype_cmp(bbzheap_obj_at(bbzheap_tseg_elem_get(sd->keys[i])),
+                                bbzheap_obj_at(k)) == 0) {
+                    /* Key found */
+                    *seg = si;
+                    *slot = i;
+                    return 1;
+                }
+            }
+            else {
+                if (*seg == BBZHEAP_SEG_NO_NEXT) {
+                    /* First free slot found */
+                    *seg = si;
+                    *slot = i;
+                }
+                if (sd->keys[i] == 0) hasempty = 1;
+            }
+        }
+        if (hasempty) return 0;
+        si = bbzheap_tseg_hasnext(sd) ? bbzheap_tseg_next_get(sd) : si0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuilds a hashed table with enough segments for one more
+ * element, dropping the deleted slots.
+ * @param[in] si0 The index of the first segment of the table. It remains
+ * the first segment, so that the table keeps its identity.
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t table_rehash(bbzheap_idx_t si0) {
+    /* Count the elements, plus the one to add */
+    uint16_t n = 1;
+    bbzheap_idx_t si = si0;
+    while (1) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+        for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+            if (bbzheap_tseg_elem_isvalid(sd->keys[i])) ++n;
+        }
+        if (!bbzheap_tseg_hasnext(sd)) break;
+        si = bbzheap_tseg_next_get(sd);
+    }
+    /* Leave some room to grow before the next rehash */
+    uint8_t lg = 0;
+    while (table_maxfill(lg) < n + n / 4) ++lg;
+    /* Allocate the new segments */
+    bbzheap_idx_t nsi0 = BBZHEAP_SEG_NO_NEXT;
+    for (uint16_t i = (uint16_t)1 << lg; i != 0; --i) {
+        bbzheap_idx_t s;
+        if (!bbzheap_tseg_alloc(&s)) {
+            while (nsi0 != BBZHEAP_SEG_NO_NEXT) {
+                bbzheap_tseg_t* sd = bbzheap_tseg_at(nsi0);
+                nsi0 = bbzheap_tseg_next_get(sd);
+                bbzheap_tseg_free(sd);
+            }
+            return 0;
+        }
+        bbzheap_tseg_next_set(bbzheap_tseg_at(s), nsi0);
+        nsi0 = s;
+    }
+    bbzheap_tseg_t* nhd = bbzheap_tseg_at(nsi0);
+    table_lgseg(nhd) = lg;
+    /* Move the elements */
+    si = si0;
+    while (1) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+        for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+            if (bbzheap_tseg_elem_isvalid(sd->keys[i])) {
+                bbzheap_idx_t seg;
+                uint8_t slot;
+                table_find(nsi0, bbzheap_tseg_elem_get(sd->keys[i]), &seg, &slot);
+                bbzheap_tseg_at(seg)->keys[slot] = sd->keys[i];
+                bbzheap_tseg_at(seg)->values[slot] = sd->values[i];
+                ++table_fill(nhd);
+            }
+        }
+        if (!bbzheap_tseg_hasnext(sd)) break;
+        si = bbzheap_tseg_next_get(sd);
+    }
+    /* Free the old segments, except the first one */
+    bbzheap_tseg_t* hd = bbzheap_tseg_at(si0);
+    si = bbzheap_tseg_next_get(hd);
+    while (si != BBZHEAP_SEG_NO_NEXT) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+        si = bbzheap_tseg_next_get(sd);
+        bbzheap_tseg_free(sd);
+    }
+    /* Replace the new first segment by the old one */
+    for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+        hd->keys[i] = nhd->keys[i];
+        hd->values[i] = nhd->values[i];
+    }
+    bbzheap_tseg_next_set(hd, bbzheap_tseg_next_get(nhd));
+    bbzheap_tseg_free(nhd);
+    return 1;
+}
+
 /****************************************/
 /****************************************/
 
-uint8_t bbztable_get(bbzheap_idx_t t,
+uint8_t bbztable_locate(bbzheap_idx_t t,
+                        bbzheap_idx_t k,
+                        bbzheap_idx_t* seg,
+                        uint8_t* slot) {
+    if (!bbztype_istable(*bbzheap_obj_at(t))) return 0;
+    return table_find(bbzheap_obj_at(t)->t.value, k, seg, slot);
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbztable_set(bbzheap_idx_t t,
                      bbzheap_idx_t k,
-                     bbzheap_idx_t* v) {
+                     bbzheap_idx_t v) {
+    bbzheap_gc_write(k);
+    bbzheap_gc_write(v);
+    bbzheap_idx_t si0 = bbzheap_obj_at(t)->t.value;
+    bbzheap_idx_t seg;
+    uint8_t slot;
+    if (table_find(si0, k, &seg, &slot)) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(seg);
+        /* NOTE: Setting a value to nil is equivalent to erasing the element from the table */
+        if (!bbztype_isnil(*bbzheap_obj_at(v))) {
+            bbzheap_tseg_elem_set(sd->values[slot], v);
+        }
+        else {
+            sd->keys[slot] = TABLE_KEY_DELETED;
+            sd->values[slot] = 0;
+        }
+        return 1;
+    }
+    /* Ignore setting nil on new elements */
+    if (bbztype_isnil(*bbzheap_obj_at(v))) return 1;
+    bbzheap_tseg_t* hd = bbzheap_tseg_at(si0);
+    /* Rehash if the table is full, or about to be */
+    if (seg == BBZHEAP_SEG_NO_NEXT ||
+        (bbzheap_tseg_at(seg)->keys[slot] == 0 &&
+         table_fill(hd) >= table_maxfill(table_lgseg(hd)))) {
+        if (table_rehash(si0)) {
+            table_find(si0, k, &seg, &slot);
+        }
+        else if (seg == BBZHEAP_SEG_NO_NEXT) {
+            return 0;
+        }
+    }
+    /* Set key and value */
+    bbzheap_tseg_t* sd = bbzheap_tseg_at(seg);
+    if (sd->keys[slot] == 0) ++table_fill(hd);
+    bbzheap_tseg_elem_set(sd->keys[slot], k);
+    bbzheap_tseg_elem_set(sd->values[slot], v);
+    return 1;
+}
+
+#else // BBZ_HASHED_TABLES
+
+/****************************************/
+/****************************************/
+
+uint8_t bbztable_locate(bbzheap_idx_t t,
+                        bbzheap_idx_t k,
+                        bbzheap_idx_t* seg,
+                        uint8_t* slot) {
     if (!bbztype_istable(*bbzheap_obj_at(t))) return 0;
     /* Get segment index */
     int16_t si = bbzheap_obj_at(t)->t.value;
@@ -20,7 +275,8 @@ uint8_t bbztable_get(bbzheap_idx_t t,
                 bbztype_cmp(bbzheap_obj_at(bbzheap_tseg_elem_get(sd->keys[i])),
                             bbzheap_obj_at(k)) == 0) {
                 /* Key found */
-                *v = bbzheap_tseg_elem_get(sd->values[i]);
+                *seg = si;
+                *slot = i;
                 return 1;
             }
         }
@@ -38,6 +294,8 @@ uint8_t bbztable_get(bbzheap_idx_t t,
 uint8_t bbztable_set(bbzheap_idx_t t,
                      bbzheap_idx_t k,
                      bbzheap_idx_t v) {
+    bbzheap_gc_write(k);
+    bbzheap_gc_write(v);
     /* Search for the given key, keeping track of first free slot */
     /* Get segment index */
     int16_t si = bbzheap_obj_at(t)->t.value;
@@ -103,7 +361,7 @@ uint8_t bbztable_set(bbzheap_idx_t t,
                     /* Update the table segment index */
                     bbzheap_obj_at(t)->t.value = bbzheap_tseg_next_get(sd);
                     /* Invalidate the segment */
-                    sd->mdata = 0;
+                    bbzheap_tseg_free(sd);
                 }
             }
             else {
@@ -118,7 +376,7 @@ uint8_t bbztable_set(bbzheap_idx_t t,
                 /* Set the next of the preceding to the next of current */
                 bbzheap_tseg_next_set(pd, bbzheap_tseg_next_get(sd));
                 /* Invalidate the current segment */
-                sd->mdata = 0;
+                bbzheap_tseg_free(sd);
             }
         }
     }
@@ -144,6 +402,99 @@ uint8_t bbztable_set(bbzheap_idx_t t,
     return 1;
 }
 
+#endif // BBZ_HASHED_TABLES
+
+/****************************************/
+/****************************************/
+
+/**
+ * @brief Adds segments to a new, empty table so that it can hold a
+ * number of elements without growing.
+ * @param[in] si0 The index of the first segment of the table.
+ * @param[in] n The number of elements.
+ * @return 1 for success, 0 for failure (out of memory)
+ */
+static uint8_t table_presize(bbzheap_idx_t si0, uint8_t n) {
+#ifdef BBZ_HASHED_TABLES
+    uint8_t lg = 0;
+    while (table_maxfill(lg) < n) ++lg;
+    uint16_t nseg = (uint16_t)1 << lg;
+#else // BBZ_HASHED_TABLES
+    uint16_t nseg = (n + BBZHEAP_ELEMS_PER_TSEG - 1) / BBZHEAP_ELEMS_PER_TSEG;
+#endif // BBZ_HASHED_TABLES
+    bbzheap_tseg_t* hd = bbzheap_tseg_at(si0);
+    for (; nseg > 1; --nseg) {
+        bbzheap_idx_t s;
+        if (!bbzheap_tseg_alloc(&s)) return 0;
+        bbzheap_tseg_next_set(bbzheap_tseg_at(s), bbzheap_tseg_next_get(hd));
+        bbzheap_tseg_next_set(hd, s);
+    }
+#ifdef BBZ_HASHED_TABLES
+    table_lgseg(hd) = lg;
+#endif // BBZ_HASHED_TABLES
+    return 1;
+}
+
+/****************************************/
+/****************************************/
+
+bbzheap_idx_t bbztable_new_from(const bbztable_init_t* init, uint8_t n) {
+    bbzheap_idx_t t = bbztable_new();
+    if (vm->state == BBZVM_STATE_ERROR) return vm->nil;
+    bbzvm_assert_exec(table_presize(bbzheap_obj_at(t)->t.value, n), BBZVM_ERROR_MEM, vm->nil);
+    /* Keep the table on the stack while the keys and closures are allocated */
+    bbzvm_push(t);
+    for (; n != 0; --n, ++init) {
+        bbzheap_idx_t v = init->fun ? bbzclosure_new((intptr_t)init->fun) : init->data;
+        bbzheap_idx_t k = bbzstring_get(init->strid);
+        if (vm->state == BBZVM_STATE_ERROR) return vm->nil;
+        /* The table is large enough: this does not allocate */
+        bbztable_set(t, k, v);
+    }
+    bbzvm_pop();
+    return t;
+}
+
+/****************************************/
+/****************************************/
+
+bbzheap_idx_t bbztable_new_copy(bbzheap_idx_t t) {
+    bbzheap_idx_t c = bbztable_new();
+    if (vm->state == BBZVM_STATE_ERROR) return vm->nil;
+    bbzheap_idx_t si = bbzheap_obj_at(t)->t.value;
+    bbzheap_idx_t ci = bbzheap_obj_at(c)->t.value;
+    while (1) {
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(si);
+        bbzheap_tseg_t* cd = bbzheap_tseg_at(ci);
+        for (uint8_t i = 0; i < BBZHEAP_ELEMS_PER_TSEG; ++i) {
+            if (bbzheap_tseg_elem_isvalid(sd->keys[i])) {
+                bbzheap_gc_write(bbzheap_tseg_elem_get(sd->keys[i]));
+                bbzheap_gc_write(bbzheap_tseg_elem_get(sd->values[i]));
+            }
+            cd->keys[i] = sd->keys[i];
+            cd->values[i] = sd->values[i];
+        }
+        if (!bbzheap_tseg_hasnext(sd)) break;
+        bbzvm_assert_exec(bbzheap_tseg_alloc(&ci), BBZVM_ERROR_MEM, vm->nil);
+        bbzheap_tseg_next_set(cd, ci);
+        si = bbzheap_tseg_next_get(sd);
+    }
+    return c;
+}
+
+/****************************************/
+/****************************************/
+
+uint8_t bbztable_get(bbzheap_idx_t t,
+                     bbzheap_idx_t k,
+                     bbzheap_idx_t* v) {
+    bbzheap_idx_t seg;
+    uint8_t slot;
+    if (!bbztable_locate(t, k, &seg, &slot)) return 0;
+    *v = bbzheap_tseg_elem_get(bbzheap_tseg_at(seg)->values[slot]);
+    return 1;
+}
+
 /****************************************/
 /****************************************/
 
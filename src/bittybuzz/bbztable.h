@@ -44,6 +44,21 @@ uint8_t bbztable_get(bbzheap_idx_t t,
                      bbzheap_idx_t k,
                      bbzheap_idx_t* v);
 
+/**
+ * @brief Finds where the value associated with the key k is stored in the table t.
+ * @details The location remains valid until an element is added to or
+ * removed from the table.
+ * @param[in] t The position of the table's object in the heap.
+ * @param[in] k The key (can be any object).
+ * @param[out] seg A buffer for the index of the segment holding the key.
+ * @param[out] slot A buffer for the position of the key in the segment.
+ * @return 1 for success, 0 for failure (index not in table)
+ */
+uint8_t bbztable_locate(bbzheap_idx_t t,
+                        bbzheap_idx_t k,
+                        bbzheap_idx_t* seg,
+                        uint8_t* slot);
+
 /**
  * @brief Add/Edit the value corresponding to the key k in the table t from the heap h.
  * If the key isn't in the table, it will be added.
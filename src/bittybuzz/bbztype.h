@@ -73,6 +73,14 @@ extern "C" {
  */
 #define BBZTABLE_DARRAY_HAS_SELF_MASK ((uint8_t)(1 << BBZTYPE_TYPEDEP_FLAG2_IDX))
 
+/**
+ * @brief Mask for the flag that tells whether a table is neighbor-like,
+ * i.e. whether the fields it lacks are looked up in the table of the
+ * neighbor methods.
+ * @note This is only for tables that are not darrays.
+ */
+#define BBZTABLE_NEIGHBORLIKE_MASK ((uint8_t)(1 << BBZTYPE_TYPEDEP_FLAG2_IDX))
+
 /**
  * @brief Mask for the object's heap "validity" flag (if it is used or not)
  */
@@ -163,7 +171,11 @@ typedef struct PACKED bbzclosure_t {
      *          1st bit: 'lambda' flag.
      */
     uint8_t mdata;
+#ifdef BBZ_SMALL_OBJECTS
+    uint16_t value; /**< @brief Closure object's value (index of the C function in the heap's pointer table). */
+#else // BBZ_SMALL_OBJECTS
     void (*value)(); /**< @brief Closure object's value. */
+#endif // BBZ_SMALL_OBJECTS
 } bbzclosure_t;
 
 /**
@@ -200,7 +212,11 @@ typedef struct PACKED bbzlclosure_t {
  */
 typedef struct PACKED bbzuserdata_t {
     uint8_t mdata; /**< @brief Object metadata. */
+#ifdef BBZ_SMALL_OBJECTS
+    uint16_t value;    /**< @brief User value (index of the pointer in the heap's pointer table). */
+#else // BBZ_SMALL_OBJECTS
     uintptr_t value;   /**< @brief User value. */
+#endif // BBZ_SMALL_OBJECTS
 } bbzuserdata_t;
 
 /**
@@ -324,6 +340,18 @@ uint8_t bbztype_tobool(const bbzobj_t* o) {
  */
 #define bbztype_isdarray(obj) (bbztype_istable(obj) && ((obj).mdata & BBZTABLE_DARRAY_MASK))
 
+/**
+ * @brief Returns 1 if an object is a neighbor-like table, 0 otherwise.
+ * @param[in] obj The object.
+ */
+#define bbztype_isneighborlike(obj) (bbztype_istable(obj) && ((obj).mdata & (BBZTABLE_DARRAY_MASK | BBZTABLE_NEIGHBORLIKE_MASK)) == BBZTABLE_NEIGHBORLIKE_MASK)
+
+/**
+ * @brief Makes a table neighbor-like.
+ * @param[in] obj The table.
+ */
+#define bbztype_make_neighborlike(obj) ((obj).mdata |= BBZTABLE_NEIGHBORLIKE_MASK)
+
 /**
  * @brief Returns non-zero if the darray has a self-table, 0 otherwise.
  * @note This is only for darrays that are used as an activation record.
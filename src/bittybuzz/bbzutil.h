@@ -48,6 +48,8 @@ extern "C" {
  * available on the GitHub repository of BittyBuzz.</li>
  * </ul>
  *
+ * @see bbztable_new_from() to create a table with all its fields at once.
+ *
  * @param[in] strid The string ID of the field in which the function will be
  * stored.
  * @param[in] fun The function to store.
@@ -87,6 +89,8 @@ void bbztable_add_function(uint16_t strid, bbzvm_funp fun);
  * available on the GitHub repository of BittyBuzz.</li>
  * </ul>
  *
+ * @see bbztable_new_from() to create a table with all its fields at once.
+ *
  * @param[in] strid The string ID of the field in which the data will be
  * stored.
  * @param[in] data The data to store.
@@ -13,7 +13,7 @@ void bbzvm_process_inmsgs() {
     /* Go through the messages */
     uint8_t count = 0;
     while(!bbzinmsg_queue_isempty() && count++ < BBZMSG_IN_PROC_MAX) {
-        bbzvm_gc();
+        bbzvm_gc_ifdue();
         bbzvm_assert_state();
         /* Extract the message data */
         bbzmsg_t* msg = bbzinmsg_queue_extract();
@@ -78,11 +78,11 @@ char* _state_desc[] = {"BBZVM_STATE_NOCODE", "BBZVM_STATE_READY", "BBZVM_STATE_S
 char* _error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STACK", "BBZVM_ERROR_LNUM", "BBZVM_ERROR_PC",
                        "BBZVM_ERROR_FLIST", "BBZVM_ERROR_TYPE", "BBZVM_ERROR_OUTOFRANGE", "BBZVM_ERROR_NOTIMPL",
                        "BBZVM_ERROR_RET", "BBZVM_ERROR_STRING", "BBZVM_ERROR_SWARM", "BBZVM_ERROR_VSTIG", "BBZVM_ERROR_MEM",
-                       "BBZVM_ERROR_MATH"};
+                       "BBZVM_ERROR_MATH", "BBZVM_ERROR_PTRS"};
 char* _instr_desc[] = {"NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB", "MUL", "DIV", "MOD", "POW",
                        "UNM", "LAND", "LOR", "LNOT","BAND","BOR","BNOT","LSHIFT","RSHIFT","EQ", "NEQ", "GT", "GTE", "LT", "LTE", "GLOAD", "GSTORE", "PUSHT", "TPUT",
                        "TGET", "CALLC", "CALLS", "PUSHF", "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE","LREMOVE",
-                       "JUMP", "JUMPZ", "JUMPNZ", "COUNT"};
+                       "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "LTGETS", "ADDI", "JLT", "COUNT"};
 #endif // DEBUG && !BBZ_XTREME_MEMORY
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -96,8 +96,59 @@ ALWAYS_INLINE void dftl_error_receiver(bbzvm_error errcode) {
 #endif // DEBUG
 }
 
+/****************************************/
+/****************************************/
+
+#ifdef BBZ_GLOBAL_SLOTS
+/**
+ * @brief Location of a global symbol that is not known yet.
+ */
+#define BBZVM_GSLOT_NONE ((uint16_t)0xFFFF)
+
+static void bbzvm_gslots_clear() {
+    for (uint16_t i = 0; i < BBZHEAP_STRINGS_CAP; ++i) {
+        vm->gslots[i] = BBZVM_GSLOT_NONE;
+    }
+}
+
+/**
+ * @brief Finds the value of a global symbol in the global symbols table.
+ * @details The location of the symbol is remembered, so that finding it
+ * again takes constant time.
+ * @param[in] str The string of the symbol.
+ * @return The value element of the symbol in the table, or NULL if the
+ * symbol is not defined.
+ */
+static bbzheap_idx_t* bbzvm_gslot(bbzheap_idx_t str) {
+    const uint16_t strid = bbzheap_obj_at(str)->s.value;
+    bbzheap_idx_t seg;
+    uint8_t slot;
+    if (strid < BBZHEAP_STRINGS_CAP && vm->gslots[strid] != BBZVM_GSLOT_NONE) {
+        seg = vm->gslots[strid] / BBZHEAP_ELEMS_PER_TSEG;
+        slot = vm->gslots[strid] % BBZHEAP_ELEMS_PER_TSEG;
+        bbzheap_tseg_t* sd = bbzheap_tseg_at(seg);
+        /* Make sure the symbol is still there */
+        if (bbzheap_tseg_elem_isvalid(sd->keys[slot])) {
+            bbzobj_t* k = bbzheap_obj_at(bbzheap_tseg_elem_get(sd->keys[slot]));
+            if (bbztype_isstring(*k) && k->s.value == strid) {
+                return sd->values + slot;
+            }
+        }
+    }
+    if (!bbztable_locate(vm->gsyms, str, &seg, &slot)) return NULL;
+    if (strid < BBZHEAP_STRINGS_CAP) {
+        vm->gslots[strid] = seg * BBZHEAP_ELEMS_PER_TSEG + slot;
+    }
+    return bbzheap_tseg_at(seg)->values + slot;
+}
+#endif // BBZ_GLOBAL_SLOTS
+
+/****************************************/
+/****************************************/
+
 void bbzvm_construct(bbzrobot_id_t robot) {
     vm->bcode_fetch_fun = NULL;
+    vm->bcode_ptr = NULL;
     vm->bcode_size = 0;
     vm->pc = 0;
     vm->state = BBZVM_STATE_NOCODE;
@@ -105,9 +156,13 @@ void bbzvm_construct(bbzrobot_id_t robot) {
     vm->error_receiver_fun = dftl_error_receiver;
     vm->stackptr = -1;
     vm->blockptr = vm->stackptr;
-    vm->lsyms = 0;
+    vm->lsymsptr = -1;
+    vm->lstackptr = -1;
     vm->robot = robot;
     vm->flist = 0;
+#ifdef BBZ_HEAP_COMPACTION
+    vm->ccalls = 0;
+#endif // BBZ_HEAP_COMPACTION
 
     // Setup things
     bbzheap_clear();
@@ -116,19 +171,22 @@ void bbzvm_construct(bbzrobot_id_t robot) {
 
     // Allocate singleton objects
     bbzheap_obj_alloc(BBZTYPE_NIL, &vm->nil);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->nil));
+    bbzheap_root_add(vm->nil);
     bbzheap_obj_at(vm->nil)->i.value = 0;
     bbzdarray_new(&vm->dflt_actrec);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->dflt_actrec));
+    bbzheap_root_add(vm->dflt_actrec);
     bbzdarray_push(vm->dflt_actrec, vm->nil);
 
     // Create various arrays
     bbzdarray_new(&vm->flist);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->flist));
+    bbzheap_root_add(vm->flist);
 
     // Create global symbols table
     bbzheap_obj_alloc(BBZTYPE_TABLE, &vm->gsyms);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->gsyms));
+    bbzheap_root_add(vm->gsyms);
+#ifdef BBZ_GLOBAL_SLOTS
+    bbzvm_gslots_clear();
+#endif // BBZ_GLOBAL_SLOTS
 
     bbzvm_register_globals();
 
@@ -165,19 +223,32 @@ void bbzvm_seterror(bbzvm_error errcode) {
 /****************************************/
 /****************************************/
 
-void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size) {
-    // 1) Set the bytecode
-    vm->bcode_fetch_fun = bcode_fetch_fun;
-    vm->bcode_size = bcode_size;
+/**
+ * @brief Fetches bytecode from the buffer set with bbzvm_set_bcode_ptr().
+ * @details Lets the functions other than the interpreter loop read the
+ * bytecode the same way in both modes.
+ * @param[in] offset Offset of the bytes to fetch.
+ * @param[in] size Size of the data to fetch.
+ * @return A pointer to the data fetched.
+ */
+static const uint8_t* bbzvm_bcode_ptr_fetch(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return vm->bcode_ptr + offset;
+}
 
-    // 2) Reset the VM
+/**
+ * @brief Resets the VM and executes the bytecode's registration of
+ * strings and built-in functions.
+ */
+static void bbzvm_load_bcode() {
+    // 1) Reset the VM
     vm->state = BBZVM_STATE_READY;
     vm->error = BBZVM_ERROR_NONE;
 
-    // 3) Register global strings
+    // 2) Register global strings
     vm->pc = sizeof(uint16_t);
 
-    // 4) Register Buzz's built-in functions
+    // 3) Register Buzz's built-in functions
     while(*vm->bcode_fetch_fun(vm->pc, sizeof(uint8_t)) != BBZVM_INSTR_NOP) {
         bbzvm_step();
         if(vm->state != BBZVM_STATE_READY) return;
@@ -186,6 +257,23 @@ void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size)
     bbzvm_step();
 }
 
+void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size) {
+    vm->bcode_fetch_fun = bcode_fetch_fun;
+    vm->bcode_ptr = NULL;
+    vm->bcode_size = bcode_size;
+    bbzvm_load_bcode();
+}
+
+/****************************************/
+/****************************************/
+
+void bbzvm_set_bcode_ptr(const uint8_t* bcode, uint16_t bcode_size) {
+    vm->bcode_fetch_fun = bbzvm_bcode_ptr_fetch;
+    vm->bcode_ptr = bcode;
+    vm->bcode_size = bcode_size;
+    bbzvm_load_bcode();
+}
+
 /****************************************/
 /****************************************/
 
@@ -199,244 +287,461 @@ void bbzvm_gc() {
     bbzheap_gc(vm->stack, (uint16_t)bbzvm_stack_size());
 }
 
+#ifdef BBZ_INCREMENTAL_GC
+uint8_t bbzvm_gc_slice(uint16_t budget) {
+    return bbzheap_gc_slice(vm->stack, (uint16_t)bbzvm_stack_size(), budget);
+}
+#endif // BBZ_INCREMENTAL_GC
+
+#ifdef BBZ_GENERATIONAL_GC
+void bbzvm_gc_minor() {
+    bbzheap_gc_minor(vm->stack, (uint16_t)bbzvm_stack_size());
+}
+#endif // BBZ_GENERATIONAL_GC
+
+#ifdef BBZ_HEAP_COMPACTION
+void bbzvm_compact() {
+    bbzheap_compact(vm->stack, (uint16_t)bbzvm_stack_size());
+#ifdef BBZ_GLOBAL_SLOTS
+    /* The segments of the global symbols table may have moved */
+    bbzvm_gslots_clear();
+#endif // BBZ_GLOBAL_SLOTS
+}
+
 /**
- * @brief Executes a single Buzz instruction.
+ * @brief Compacts the heap if the last garbage collection left it
+ * fragmented, unless C code that may hold heap indexes is running.
  */
-//ALWAYS_INLINE
-static void bbzvm_exec_instr() {
-    bbzpc_t instrOffset = vm->pc; // Save PC in case of error or DONE.
+#define compact_if_due() if (vm->ccalls == 0 && bbzheap_compact_isdue()) bbzvm_compact()
+#else // BBZ_HEAP_COMPACTION
+#define compact_if_due()
+#endif // BBZ_HEAP_COMPACTION
+
+#if defined(BBZ_THREADED_DISPATCH) && defined(__GNUC__)
+/**
+ * @brief Defined when instructions are dispatched through a table of
+ * label addresses rather than a switch.
+ */
+#define BBZVM_DISPATCH_TABLE
+#endif // defined(BBZ_THREADED_DISPATCH) && defined(__GNUC__)
+
+/**
+ * @brief Value of the block pointer argument of bbzvm_exec() which never
+ * stops the execution.
+ */
+#define BBZVM_BLOCKPTR_NONE INT16_MIN
+
+/**
+ * @brief Reads the two operands of a binary operation if both are
+ * integers.
+ * @details Leaves the stack untouched. Used by bbzvm_exec() to perform
+ * integer arithmetic and comparisons without going through the generic
+ * operators.
+ * @param[out] lhs Value of the left-hand side, i.e., stack #1.
+ * @param[out] rhs Value of the right-hand side, i.e., stack #0.
+ * @return Non-zero if both operands are integers.
+ */
+ALWAYS_INLINE
+uint8_t bbzvm_int_operands(int16_t* lhs, int16_t* rhs) {
+    if (vm->stackptr < 1) return 0;
+    bbzheap_idx_t l = vm->stack[vm->stackptr - 1];
+    bbzheap_idx_t r = vm->stack[vm->stackptr];
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_idx_isimm(l) && bbzheap_idx_isimm(r)) {
+        *lhs = bbzheap_imm_get(l);
+        *rhs = bbzheap_imm_get(r);
+        return 1;
+    }
+#endif // BBZ_IMMEDIATE_INTS
+    bbzobj_t* lo = bbzheap_obj_at(l);
+    bbzobj_t* ro = bbzheap_obj_at(r);
+    if (!bbztype_isint(*lo) || !bbztype_isint(*ro)) return 0;
+    *lhs = lo->i.value;
+    *rhs = ro->i.value;
+    return 1;
+}
+
+/**
+ * @brief Reads the value on top of the stack if it is an integer.
+ * @details Leaves the stack untouched.
+ * @param[out] v Value of stack #0.
+ * @return Non-zero if stack #0 is an integer.
+ */
+ALWAYS_INLINE
+uint8_t bbzvm_int_operand(int16_t* v) {
+    if (vm->stackptr < 0) return 0;
+    bbzheap_idx_t i = vm->stack[vm->stackptr];
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_idx_isimm(i)) {
+        *v = bbzheap_imm_get(i);
+        return 1;
+    }
+#endif // BBZ_IMMEDIATE_INTS
+    bbzobj_t* o = bbzheap_obj_at(i);
+    if (!bbztype_isint(*o)) return 0;
+    *v = o->i.value;
+    return 1;
+}
+
+#ifdef BBZVM_DISPATCH_TABLE
+#define exec_dispatch(INSTR) if ((INSTR) >= BBZVM_INSTR_COUNT) goto exec_INVALID; goto *labels[INSTR];
+#define exec_case(INSTR) exec_##INSTR
+#define exec_default exec_INVALID
+#else // BBZVM_DISPATCH_TABLE
+#define exec_dispatch(INSTR) switch(INSTR)
+#define exec_case(INSTR) case BBZVM_INSTR_##INSTR
+#define exec_default default
+#endif // BBZVM_DISPATCH_TABLE
+
+#define exec_assert_pc(IDX) if((IDX) > vm->bcode_size) { bbzvm_seterror(BBZVM_ERROR_PC); goto next; }
+
+#define exec_fetch(OFFSET, SIZE) (vm->bcode_ptr ? vm->bcode_ptr + (OFFSET) : (*vm->bcode_fetch_fun)((OFFSET), (SIZE)))
+
+#define exec_get_arg(TYPE) exec_assert_pc(vm->pc + sizeof(TYPE)); TYPE arg; {const TYPE* parg = ((const TYPE*)exec_fetch(vm->pc, sizeof(TYPE))); bbzvm_assign(&arg, parg);} vm->pc += sizeof(TYPE);
 
-    uint8_t instr = *(*vm->bcode_fetch_fun)(vm->pc, 1);
+#define exec_binary_int(OP, SLOW)                                           \
+    if (bbzvm_int_operands(&lhs, &rhs)) {                                   \
+        --vm->stackptr;                                                     \
+        vm->stack[vm->stackptr] = bbzint_new((int16_t)(lhs OP rhs));        \
+    }                                                                       \
+    else {                                                                  \
+        SLOW();                                                             \
+    }                                                                       \
+    goto next;
+
+/**
+ * @brief Executes Buzz instructions.
+ * @details Stops after @p n instructions, when the VM leaves the READY
+ * state, or when a closure call or return brings the block pointer to
+ * @p blockptr or below.
+ * @param[in] n Maximum number of instructions to execute.
+ * @param[in] blockptr Block pointer at which to stop, or
+ * BBZVM_BLOCKPTR_NONE.
+ * @return The number of instructions executed.
+ */
+static uint16_t bbzvm_exec(uint16_t n, int16_t blockptr) {
+#ifdef BBZVM_DISPATCH_TABLE
+    static const void* const labels[BBZVM_INSTR_COUNT] = {
+        &&exec_NOP, &&exec_DONE, &&exec_PUSHNIL, &&exec_DUP, &&exec_POP,
+        &&exec_RET0, &&exec_RET1, &&exec_ADD, &&exec_SUB, &&exec_MUL,
+        &&exec_DIV, &&exec_MOD, &&exec_POW, &&exec_UNM, &&exec_LAND,
+        &&exec_LOR, &&exec_LNOT, &&exec_BAND, &&exec_BOR, &&exec_BNOT,
+        &&exec_INVALID, &&exec_INVALID, // LSHIFT and RSHIFT
+        &&exec_EQ, &&exec_NEQ, &&exec_GT, &&exec_GTE, &&exec_LT,
+        &&exec_LTE, &&exec_GLOAD, &&exec_GSTORE, &&exec_PUSHT, &&exec_TPUT,
+        &&exec_TGET, &&exec_CALLC, &&exec_CALLS, &&exec_PUSHF, &&exec_PUSHI,
+        &&exec_PUSHS, &&exec_PUSHCN, &&exec_PUSHCC, &&exec_PUSHL,
+        &&exec_LLOAD, &&exec_LSTORE, &&exec_LREMOVE, &&exec_JUMP,
+        &&exec_JUMPZ, &&exec_JUMPNZ, &&exec_GLOADS, &&exec_LTGETS,
+        &&exec_ADDI, &&exec_JLT
+    };
+#endif // BBZVM_DISPATCH_TABLE
+    uint16_t count = 0;
+    bbzpc_t instrOffset = vm->pc; // Save PC in case of error or DONE.
+    uint8_t instr;
+    int16_t lhs, rhs;
+    if (vm->state != BBZVM_STATE_READY || n == 0) return 0;
+    goto fetch;
+
+next_frame:
+    // After a call or a return.
+    if (vm->state == BBZVM_STATE_READY) {
+        exec_assert_pc(vm->pc);
+        if (vm->blockptr <= blockptr) return count;
+    }
+next:
+    if (vm->state != BBZVM_STATE_READY) {
+        // Stay on the instruction that caused the error,
+        // or, in the case of BBZVM_INSTR_DONE, loop on it.
+        vm->pc = instrOffset;
+        return count;
+    }
+    if (count == n) return count;
+fetch:
+    ++count;
+#ifndef BBZ_LAZY_GC
+    bbzvm_gc();
+    compact_if_due();
+#elif defined(BBZ_INCREMENTAL_GC)
+    if (vm->heap.gcphase != BBZHEAP_GC_IDLE || bbzheap_gc_isdue()) {
+        if (!bbzvm_gc_slice(BBZHEAP_GC_SLICE)) {
+            compact_if_due();
+        }
+    }
+    bbzheap_gc_safepoint();
+#else // !BBZ_LAZY_GC
+    if (bbzheap_gc_isdue()) {
+        bbzvm_gc();
+        compact_if_due();
+    }
+#ifdef BBZ_GENERATIONAL_GC
+    else if (bbzheap_gc_minor_isdue()) {
+        bbzvm_gc_minor();
+    }
+#endif // BBZ_GENERATIONAL_GC
+    else {
+        bbzheap_gc_safepoint();
+    }
+#endif // !BBZ_LAZY_GC
+    instrOffset = vm->pc;
+    instr = *exec_fetch(vm->pc, 1);
 #ifdef DEBUG
     vm->dbg_pc = vm->pc;
     vm->instr = (bbzvm_instr)instr;
 #endif
-    if (instr != BBZVM_INSTR_DONE) inc_pc();
-    switch(instr) {
-        case BBZVM_INSTR_NOP: {
-            break;
+    if (instr != BBZVM_INSTR_DONE) {
+        exec_assert_pc(vm->pc);
+        ++vm->pc;
+    }
+    exec_dispatch(instr) {
+        exec_case(NOP): {
+            goto next;
         }
-        case BBZVM_INSTR_DONE: {
+        exec_case(DONE): {
             bbzvm_done();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHNIL: {
+        exec_case(PUSHNIL): {
             bbzvm_pushnil();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_DUP: {
+        exec_case(DUP): {
             bbzvm_dup();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_POP: {
+        exec_case(POP): {
             bbzvm_pop();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_RET0: {
+        exec_case(RET0): {
             bbzvm_ret0();
-            if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
-            }
-            break;
+            goto next_frame;
         }
-        case BBZVM_INSTR_RET1: {
+        exec_case(RET1): {
             bbzvm_ret1();
-            if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
-            }
-            break;
+            goto next_frame;
         }
-        case BBZVM_INSTR_ADD: {
-            bbzvm_add();
-            break;
+        exec_case(ADD): {
+            exec_binary_int(+, bbzvm_add);
         }
-        case BBZVM_INSTR_SUB: {
-            bbzvm_sub();
-            break;
+        exec_case(SUB): {
+            exec_binary_int(-, bbzvm_sub);
         }
-        case BBZVM_INSTR_MUL: {
-            bbzvm_mul();
-            break;
+        exec_case(MUL): {
+            exec_binary_int(*, bbzvm_mul);
         }
-        case BBZVM_INSTR_DIV: {
+        exec_case(DIV): {
             bbzvm_div();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_MOD: {
+        exec_case(MOD): {
             bbzvm_mod();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_POW: {
+        exec_case(POW): {
             bbzvm_pow();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_UNM: {
+        exec_case(UNM): {
             bbzvm_unm();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_LAND: {
-	    bbzvm_land();
-            break;
+        exec_case(LAND): {
+            bbzvm_land();
+            goto next;
         }
-        case BBZVM_INSTR_LOR: {
+        exec_case(LOR): {
             bbzvm_lor();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_LNOT: {
+        exec_case(LNOT): {
             bbzvm_lnot();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_BAND: {
+        exec_case(BAND): {
             bbzvm_band();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_BOR: {
+        exec_case(BOR): {
             bbzvm_bor();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_BNOT: {
+        exec_case(BNOT): {
             bbzvm_bnot();
-            break;
-        }
-	  /*    case BBZVM_INSTR_LSHIFT: {
-            bbzvm_lshift();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_RSHIFT: {
-            bbzvm_rshift();
-            break;
-	    }  */
-        case BBZVM_INSTR_EQ: {
-            bbzvm_eq();
-            break;
+        exec_case(EQ): {
+            exec_binary_int(==, bbzvm_eq);
         }
-        case BBZVM_INSTR_NEQ: {
-            bbzvm_neq();
-            break;
+        exec_case(NEQ): {
+            exec_binary_int(!=, bbzvm_neq);
         }
-        case BBZVM_INSTR_GT: {
-            bbzvm_gt();
-            break;
+        exec_case(GT): {
+            exec_binary_int(>, bbzvm_gt);
         }
-        case BBZVM_INSTR_GTE: {
-            bbzvm_gte();
-            break;
+        exec_case(GTE): {
+            exec_binary_int(>=, bbzvm_gte);
         }
-        case BBZVM_INSTR_LT: {
-            bbzvm_lt();
-            break;
+        exec_case(LT): {
+            exec_binary_int(<, bbzvm_lt);
         }
-        case BBZVM_INSTR_LTE: {
-            bbzvm_lte();
-            break;
+        exec_case(LTE): {
+            exec_binary_int(<=, bbzvm_lte);
         }
-        case BBZVM_INSTR_GLOAD: {
+        exec_case(GLOAD): {
             bbzvm_gload();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_GSTORE: {
+        exec_case(GSTORE): {
             bbzvm_gstore();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHT: {
+        exec_case(PUSHT): {
             bbzvm_pusht();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_TPUT: {
+        exec_case(TPUT): {
             bbzvm_tput();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_TGET: {
+        exec_case(TGET): {
             bbzvm_tget();
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_CALLC: {
+        exec_case(CALLC): {
             bbzvm_callc();
-            if (vm->state == BBZVM_STATE_READY) {
-                assert_pc(vm->pc);
-            }
-            break;
+            goto next_frame;
         }
-        case BBZVM_INSTR_CALLS: { // For compatibility only
-            break;
+        exec_case(CALLS): { // For compatibility only
+            goto next;
         }
-        case BBZVM_INSTR_PUSHF: {
-            get_arg(bbzfloat);
+        exec_case(PUSHF): {
+            exec_get_arg(bbzfloat);
             bbzvm_pushf(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHI: {
-            get_arg(int16_t);
+        exec_case(PUSHI): {
+            exec_get_arg(int16_t);
             bbzvm_pushi(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHS: {
-            get_arg(uint16_t);
+        exec_case(PUSHS): {
+            exec_get_arg(uint16_t);
             bbzvm_pushs(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHCN: {
-            get_arg(uint16_t);
+        exec_case(PUSHCN): {
+            exec_get_arg(uint16_t);
             bbzvm_pushcn(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHCC: { // _FIXME I don't think that a buzz script should/would ever use this instruction... Neither is it used in the buzz parser.
-            get_arg(int16_t);
+        exec_case(PUSHCC): { // _FIXME I don't think that a buzz script should/would ever use this instruction... Neither is it used in the buzz parser.
+            exec_get_arg(int16_t);
             bbzvm_pushcc((bbzvm_funp)(intptr_t)arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_PUSHL: {
-            get_arg(uint16_t);
+        exec_case(PUSHL): {
+            exec_get_arg(uint16_t);
             bbzvm_pushl(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_LLOAD: {
-            get_arg(uint16_t);
+        exec_case(LLOAD): {
+            exec_get_arg(uint16_t);
             bbzvm_lload(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_LSTORE: {
-            get_arg(uint16_t);
+        exec_case(LSTORE): {
+            exec_get_arg(uint16_t);
             bbzvm_lstore(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_LREMOVE: {
-            get_arg(uint16_t);
+        exec_case(LREMOVE): {
+            exec_get_arg(uint16_t);
             bbzvm_lremove(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_JUMP: {
-            get_arg(uint16_t);
+        exec_case(JUMP): {
+            exec_get_arg(uint16_t);
             bbzvm_jump(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_JUMPZ: {
-            get_arg(uint16_t);
+        exec_case(JUMPZ): {
+            exec_get_arg(uint16_t);
             bbzvm_jumpz(arg);
-            break;
+            goto next;
         }
-        case BBZVM_INSTR_JUMPNZ: {
-            get_arg(uint16_t);
+        exec_case(JUMPNZ): {
+            exec_get_arg(uint16_t);
             bbzvm_jumpnz(arg);
-            break;
+            goto next;
+        }
+        exec_case(GLOADS): {
+            exec_get_arg(uint16_t);
+            bbzvm_pushs(arg);
+            if (vm->state == BBZVM_STATE_READY) bbzvm_gload();
+            goto next;
+        }
+        exec_case(LTGETS): {
+            uint16_t lidx;
+            {
+                exec_get_arg(uint16_t);
+                lidx = arg;
+            }
+            exec_get_arg(uint16_t);
+            bbzvm_lload(lidx);
+            if (vm->state == BBZVM_STATE_READY) bbzvm_pushs(arg);
+            if (vm->state == BBZVM_STATE_READY) bbzvm_tget();
+            goto next;
+        }
+        exec_case(ADDI): {
+            exec_get_arg(int16_t);
+            if (bbzvm_int_operand(&lhs)) {
+                vm->stack[vm->stackptr] = bbzint_new((int16_t)(lhs + arg));
+            }
+            else {
+                bbzvm_pushi(arg);
+                if (vm->state == BBZVM_STATE_READY) bbzvm_add();
+            }
+            goto next;
+        }
+        exec_case(JLT): {
+            exec_get_arg(uint16_t);
+            if (bbzvm_int_operands(&lhs, &rhs)) {
+                vm->stackptr -= 2;
+                if (!(lhs < rhs)) vm->pc = arg;
+                exec_assert_pc(vm->pc);
+            }
+            else {
+                bbzvm_lt();
+                if (vm->state == BBZVM_STATE_READY) bbzvm_jumpz(arg);
+            }
+            goto next;
         }
-        default:
+        exec_default:
             bbzvm_seterror(BBZVM_ERROR_INSTR);
-            break;
-    }
-
-    if (vm->state != BBZVM_STATE_READY) {
-        // Stay on the instruction that caused the error,
-        // or, in the case of BBZVM_INSTR_DONE, loop on it.
-        vm->pc = instrOffset;
+            goto next;
     }
+    // Not reached
+    return count;
 }
 
 void bbzvm_step() {
-    if(vm->state == BBZVM_STATE_READY) {
-        bbzvm_gc();
-        bbzvm_exec_instr();
-    }
+    bbzvm_exec(1, BBZVM_BLOCKPTR_NONE);
+}
+
+/****************************************/
+/****************************************/
+
+uint16_t bbzvm_run(uint16_t n) {
+    return bbzvm_exec(n, BBZVM_BLOCKPTR_NONE);
+}
+
+/****************************************/
+/****************************************/
+
+uint16_t bbzvm_run_call(int16_t blockptr, uint16_t n) {
+    if (vm->blockptr <= blockptr) return 0;
+    return bbzvm_exec(n, blockptr);
 }
 
 /****************************************/
@@ -857,21 +1162,21 @@ void bbzvm_pusht() {
 /****************************************/
 
 void bbzvm_lload(uint16_t idx) {
-    bbzheap_idx_t id = vm->nil;
-    bbzvm_assert_exec(bbzdarray_get(vm->lsyms, idx, &id), BBZVM_ERROR_LNUM);
-    return bbzvm_push(id);
+    bbzvm_assert_exec(vm->lsymsptr >= 0 && idx <= bbzvm_locals_count(), BBZVM_ERROR_LNUM);
+    return bbzvm_push(bbzvm_locals_at(idx));
 }
 
 /****************************************/
 /****************************************/
 
 void bbzvm_lstore(uint16_t idx) {
-    bbzheap_idx_t o = bbzvm_stack_at(0);
-    uint16_t size = bbzdarray_size(vm->lsyms);
-    while (size++ <= idx) {
-        bbzvm_assert_exec(bbzdarray_push(vm->lsyms, vm->nil), BBZVM_ERROR_MEM);
+    bbzvm_assert_exec(vm->lsymsptr >= 0, BBZVM_ERROR_LNUM);
+    /* Grow the frame up to the symbol */
+    bbzvm_assert_exec(idx < BBZLSTACK_SIZE - vm->lsymsptr, BBZVM_ERROR_STACK);
+    while (bbzvm_locals_count() < idx) {
+        vm->lstack[++vm->lstackptr] = vm->nil;
     }
-    bbzdarray_set(vm->lsyms, idx, o);
+    bbzvm_locals_at(idx) = bbzvm_stack_at(0);
     return bbzvm_pop();
 }
 
@@ -879,9 +1184,8 @@ void bbzvm_lstore(uint16_t idx) {
 /****************************************/
 
 void bbzvm_lremove(uint16_t num) {
-    uint16_t i;
-    for( i = 0 ; i < num ; i++ )
-      bbzvm_assert_exec(bbzdarray_pop(vm->lsyms), BBZVM_ERROR_LNUM);
+    bbzvm_assert_exec(vm->lsymsptr >= 0 && num <= bbzvm_locals_count() + 1, BBZVM_ERROR_LNUM);
+    vm->lstackptr -= num;
 }
 
 
@@ -939,6 +1243,9 @@ uint8_t bbzvm_gsym_register(uint16_t sid, bbzheap_idx_t v) {
 /****************************************/
 
 bbzheap_idx_t bbzint_new(int16_t val) {
+#ifdef BBZ_IMMEDIATE_INTS
+    if (bbzheap_imm_fits(val)) return bbzheap_imm_make(val);
+#endif // BBZ_IMMEDIATE_INTS
     bbzheap_idx_t o;
     bbzvm_assert_mem_alloc(BBZTYPE_INT, &o, vm->nil);
     bbzheap_obj_at(o)->i.value = val;
@@ -980,7 +1287,13 @@ bbzheap_idx_t bbztable_new() {
 bbzheap_idx_t bbzclosure_new(intptr_t val) {
     bbzheap_idx_t o;
     bbzvm_assert_mem_alloc(BBZTYPE_CLOSURE, &o, vm->nil);
+#ifdef BBZ_SMALL_OBJECTS
+    uint16_t p;
+    bbzvm_assert_exec(bbzheap_ptr_add((uintptr_t)val, &p), BBZVM_ERROR_PTRS, vm->nil);
+    bbzheap_obj_at(o)->c.value = p;
+#else // BBZ_SMALL_OBJECTS
     bbzheap_obj_at(o)->c.value = (void(*)())val;
+#endif // BBZ_SMALL_OBJECTS
     return o;
 }
 
@@ -990,7 +1303,13 @@ bbzheap_idx_t bbzclosure_new(intptr_t val) {
 bbzheap_idx_t bbzuserdata_new(void* val) {
     bbzheap_idx_t o;
     bbzvm_assert_mem_alloc(BBZTYPE_USERDATA, &o, vm->nil);
+#ifdef BBZ_SMALL_OBJECTS
+    uint16_t p;
+    bbzvm_assert_exec(bbzheap_ptr_add((uintptr_t)val, &p), BBZVM_ERROR_PTRS, vm->nil);
+    bbzheap_obj_at(o)->u.value = p;
+#else // BBZ_SMALL_OBJECTS
     bbzheap_obj_at(o)->u.value = (uintptr_t)val;
+#endif // BBZ_SMALL_OBJECTS
     return o;
 }
 
@@ -1002,17 +1321,32 @@ bbzheap_idx_t bbzvm_stack_at(int16_t idx) { return vm->stack[vm->stackptr - idx]
 /****************************************/
 /****************************************/
 
-void bbzvm_closure_call(uint16_t argc) {
+/**
+ * @brief Calls a closure and runs it until it returns.
+ * @param[in] argc The number of closure parameters.
+ */
+static void bbzvm_closure_run(uint16_t argc) {
     bbzvm_assert_state();
     bbzvm_pushi(argc);
     int16_t blockptr = vm->blockptr;
     bbzvm_callc();
     while(blockptr < vm->blockptr) {
         if(vm->state != BBZVM_STATE_READY) return;
-        bbzvm_step();
+        bbzvm_run_call(blockptr, UINT16_MAX);
     }
 }
 
+void bbzvm_closure_call(uint16_t argc) {
+#ifdef BBZ_HEAP_COMPACTION
+    /* The caller may hold heap indexes */
+    ++vm->ccalls;
+    bbzvm_closure_run(argc);
+    --vm->ccalls;
+#else // BBZ_HEAP_COMPACTION
+    bbzvm_closure_run(argc);
+#endif // BBZ_HEAP_COMPACTION
+}
+
 /****************************************/
 /****************************************/
 
@@ -1039,7 +1373,7 @@ void bbzvm_function_call(uint16_t fname, uint16_t argc) {
         vm->stack[vm->stackptr - argc] = c;
     }
     /* Call the closure */
-    return bbzvm_closure_call(argc);
+    return bbzvm_closure_run(argc);
 }
 
 /****************************************/
@@ -1076,56 +1410,62 @@ void bbzvm_callc() {
     /* Make sure that the data about lambda closures is correct */
     bbzvm_assert_exec(!(bbztype_isclosurelambda(*c) && ((c->l.value.ref) >= bbzdarray_size(vm->flist))),
                       BBZVM_ERROR_FLIST);
-    /* Keep a refererence to the old local symbol list */
-    bbzheap_idx_t oldLsyms = vm->lsyms;
-    /* Create a new local symbol list copying the parent's */
-    if (!bbztype_isclosurelambda(*c) ||
-        (c->l.value.actrec) == BBZHEAP_CLOSURE_DFLT_ACTREC) {
-        bbzvm_assert_exec(bbzdarray_clone(vm->dflt_actrec, &vm->lsyms), BBZVM_ERROR_MEM);
+    /* Keep the old local symbols pointer */
+    int16_t oldLsyms = vm->lsymsptr;
+    /* Start a new frame with the activation record's entries */
+    bbzheap_idx_t ar = vm->dflt_actrec;
+    if (bbztype_isclosurelambda(*c) &&
+        (c->l.value.actrec) != BBZHEAP_CLOSURE_DFLT_ACTREC) {
+        ar = c->l.value.actrec;
     }
-    else {
-        bbzvm_assert_exec(bbzdarray_clone(c->l.value.actrec, &vm->lsyms), BBZVM_ERROR_MEM);
+    uint16_t i = bbzdarray_size(ar);
+    bbzvm_assert_exec(vm->lstackptr + i + argn < BBZLSTACK_SIZE, BBZVM_ERROR_STACK);
+    vm->lsymsptr = vm->lstackptr + 1;
+    for (uint16_t j = 0; j < i; ++j) {
+        bbzdarray_get(ar, j, &vm->lstack[++vm->lstackptr]);
     }
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->lsyms));
     /* Add function arguments to the local symbols */
     /* and */
     /* Get rid of the function arguments */
-    uint16_t i;
     for (i = argn; i; --i) {
-        bbzdarray_push(vm->lsyms, bbzvm_stack_at(i - (uint16_t)1));
+        vm->lstack[++vm->lstackptr] = bbzvm_stack_at(i - (uint16_t)1);
     }
     vm->stackptr -= argn + 1; // Get rid of the closure's reference on the stack.
     /* Recover and pop the self table */
-    if (!bbztype_isclosurelambda(*c) ||
-        c->l.value.actrec == BBZHEAP_CLOSURE_DFLT_ACTREC ||
-        !bbztype_darray_hasself(*bbzheap_obj_at(c->l.value.actrec))) {
-        bbzdarray_set(vm->lsyms, 0, bbzvm_stack_at(0));
+    if (!bbztype_darray_hasself(*bbzheap_obj_at(ar))) {
+        bbzvm_locals_at(0) = bbzvm_stack_at(0);
     }
     bbzvm_pop();
     /* Push return address */
     bbzvm_pushi(vm->pc);
     bbzvm_assert_state();
-    /* Push old local symbol list */
-    bbzvm_push(oldLsyms);
+    /* Push old local symbols pointer */
+    bbzvm_pushi(oldLsyms);
     bbzvm_assert_state();
     /* Push block pointer */
     bbzvm_pushi(vm->blockptr);
     bbzvm_assert_state();
     vm->blockptr = vm->stackptr;
     /* Jump to/execute the function */
-    uintptr_t x;
+    bbzobj_t* f = c;
     if (bbztype_isclosurelambda(*c)) {
         bbzdarray_get(vm->flist, c->l.value.ref, &i);
-        x = bbzheap_obj_at((uint16_t)i)->biggest.value;
-    }
-    else {
-        x = c->biggest.value;
+        f = bbzheap_obj_at((uint16_t)i);
     }
     if (bbztype_isclosurenative(*c)) {
-        vm->pc = (bbzpc_t)x;
+        vm->pc = (bbzpc_t)f->biggest.value;
     }
     else {
+        bbzvm_assert_exec(bbzheap_obj_hasptr(*f), BBZVM_ERROR_TYPE);
+        uintptr_t x = bbzheap_obj_ptr(*f);
+#ifdef BBZ_HEAP_COMPACTION
+        /* C closures may hold heap indexes while they run a closure */
+        ++vm->ccalls;
         ((bbzvm_funp)x)();
+        --vm->ccalls;
+#else // BBZ_HEAP_COMPACTION
+        ((bbzvm_funp)x)();
+#endif // BBZ_HEAP_COMPACTION
     }
 }
 
@@ -1177,6 +1517,16 @@ void bbzvm_pushnil() {
 /****************************************/
 
 void bbzvm_pushc(intptr_t rfrnc, int16_t nat) {
+#ifdef BBZ_SMALL_OBJECTS
+    if (nat) {
+        /* Native closures hold a bytecode address, not a C function */
+        bbzheap_idx_t o;
+        bbzvm_assert_mem_alloc(BBZTYPE_CLOSURE, &o);
+        bbzheap_obj_at(o)->c.value = (uint16_t)rfrnc;
+        bbzclosure_make_native(*bbzheap_obj_at(o));
+        return bbzvm_push(o);
+    }
+#endif // BBZ_SMALL_OBJECTS
     bbzheap_idx_t o = bbzclosure_new(rfrnc);
     if (nat) bbzclosure_make_native(*bbzheap_obj_at(o));
     return bbzvm_push(o);
@@ -1222,13 +1572,19 @@ void bbzvm_pushl(uint16_t addr) {
     }
     else {
         /* ... else, Free the memory used by the buffer */
-        bbzheap_obj_makeinvalid(*bbzheap_obj_at(idx));
+        bbzheap_obj_free(idx);
     }
     bbzheap_obj_at(o)->l.value.ref = (uint8_t)addr;
-    if (vm->lsyms) {
+    if (vm->lsymsptr >= 0) {
+        /* The closure may outlive the frame; copy the local symbols */
         bbzvm_assert_exec(
-                bbzdarray_lambda_alloc(vm->lsyms, &bbzheap_obj_at(o)->l.value.actrec),
+                bbzdarray_lambda_alloc(vm->dflt_actrec, &bbzheap_obj_at(o)->l.value.actrec),
                 BBZVM_ERROR_MEM);
+        bbzheap_idx_t ar = bbzheap_obj_at(o)->l.value.actrec;
+        bbzdarray_set(ar, 0, bbzvm_locals_at(0));
+        for (uint16_t i = 1; i <= bbzvm_locals_count(); ++i) {
+            bbzvm_assert_exec(bbzdarray_push(ar, bbzvm_locals_at(i)), BBZVM_ERROR_MEM);
+        }
     }
 
     bbzvm_push(o);
@@ -1275,7 +1631,7 @@ void bbzvm_tput() {
             bbzvm_assert_exec(bbzdarray_push(vm->flist, v), BBZVM_ERROR_MEM);
         }
         else {
-            bbzheap_obj_makeinvalid(*bbzheap_obj_at(v));
+            bbzheap_obj_free(v);
         }
 
         bbzvm_assert_exec(
@@ -1306,7 +1662,14 @@ void bbzvm_tget() {
 
     // Get the value and push it
     bbzheap_idx_t idx = vm->nil;
-    bbztable_get(t, k, &idx);
+    if (!bbztable_get(t, k, &idx)) {
+#ifndef BBZ_DISABLE_NEIGHBORS
+        // Neighbor-like tables share their methods
+        if (bbztype_isneighborlike(*bbzheap_obj_at(t))) {
+            bbztable_get(vm->neighbors.proto, k, &idx);
+        }
+#endif // !BBZ_DISABLE_NEIGHBORS
+    }
     bbzvm_push(idx);
 }
 
@@ -1322,10 +1685,17 @@ void bbzvm_gload() {
     bbzvm_assert_state();
 
     // Get and push the associated value
+#ifdef BBZ_GLOBAL_SLOTS
+    bbzheap_idx_t* v = bbzvm_gslot(str);
+    if(v) {
+        bbzvm_push(bbzheap_tseg_elem_get(*v));
+    }
+#else // BBZ_GLOBAL_SLOTS
     bbzheap_idx_t o;
     if(bbztable_get(vm->gsyms, str, &o)) {
         bbzvm_push(o);
     }
+#endif // BBZ_GLOBAL_SLOTS
     else {
         bbzvm_pushnil();
     }
@@ -1345,6 +1715,18 @@ void bbzvm_gstore() {
     bbzvm_assert_state();
 
     // Store the value
+#ifdef BBZ_GLOBAL_SLOTS
+    if(!bbztype_isnil(*bbzheap_obj_at(o))) {
+        bbzheap_idx_t* v = bbzvm_gslot(str);
+        if(v) {
+            bbzheap_gc_write(o);
+            bbzheap_tseg_elem_set(*v, o);
+            return;
+        }
+    }
+    // Adding or removing a symbol may move the others in the table
+    bbzvm_gslots_clear();
+#endif // BBZ_GLOBAL_SLOTS
     bbzvm_assert_exec(bbztable_set(vm->gsyms, str, o), BBZVM_ERROR_MEM);
 }
 
@@ -1358,10 +1740,9 @@ void bbzvm_ret0() {
     vm->stackptr = vm->blockptr;
     vm->blockptr = bbzheap_obj_at(vm->stack[vm->stackptr])->i.value;
     bbzvm_pop();
-    /* Pop local symbol table */
-    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_destroy(vm->lsyms);
-    vm->lsyms = bbzvm_stack_at(0);
+    /* Pop the frame of local symbols */
+    vm->lstackptr = vm->lsymsptr - 1;
+    vm->lsymsptr = bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
     bbzvm_pop();
     /* Make sure the stack contains at least one element */
     bbzvm_assert_stack(1);
@@ -1387,10 +1768,9 @@ void bbzvm_ret1() {
     vm->stackptr = vm->blockptr;
     vm->blockptr = bbzheap_obj_at(vm->stack[vm->blockptr])->i.value;
     bbzvm_pop();
-    /* Pop local symbol table */
-    bbzheap_obj_unmake_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_destroy(vm->lsyms);
-    vm->lsyms = bbzvm_stack_at(0);
+    /* Pop the frame of local symbols */
+    vm->lstackptr = vm->lsymsptr - 1;
+    vm->lsymsptr = bbzheap_obj_at(bbzvm_stack_at(0))->i.value;
     bbzvm_pop();
     /* Make sure that element is an integer */
     bbzvm_assert_type(bbzvm_stack_at(0), BBZTYPE_INT);
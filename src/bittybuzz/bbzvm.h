@@ -60,6 +60,15 @@ extern "C" {
      */
     typedef void (*bbzvm_funp)();
 
+    /**
+     * @brief Initializer of a table field, for bbztable_new_from().
+     */
+    typedef struct bbztable_init_t {
+        uint16_t strid;     /**< @brief String ID of the field's key. */
+        bbzvm_funp fun;     /**< @brief C function to store in the field, or NULL to store 'data'. */
+        bbzheap_idx_t data; /**< @brief Object to store in the field when 'fun' is NULL. */
+    } bbztable_init_t;
+
     /**
      * @brief The BittyBuzz Virtual Machine.
      *
@@ -70,10 +79,14 @@ extern "C" {
     typedef struct PACKED bbzvm_t {
         bbzvm_error_receiver_fun error_receiver_fun; /**< @brief Error receiver. */
         bbzvm_bcode_fetch_fun bcode_fetch_fun; /**< @brief Bytecode fetcher function */
+        const uint8_t* bcode_ptr;  /**< @brief Bytecode read directly by the VM, or NULL to use the fetcher function */
         uint16_t bcode_size;       /**< @brief Size of the loaded bytecode */
         bbzpc_t pc;                /**< @brief Program counter */
-        bbzheap_idx_t lsyms;       /**< @brief Current local variable table */
+        int16_t lsymsptr;          /**< @brief Local symbols pointer (Index in the local symbol stack of the running closure's self table, or -1) */
         bbzheap_idx_t gsyms;       /**< @brief Global symbols */
+#ifdef BBZ_GLOBAL_SLOTS
+        uint16_t gslots[BBZHEAP_STRINGS_CAP]; /**< @brief Location in the global symbols table of each symbol, by string ID */
+#endif // BBZ_GLOBAL_SLOTS
         bbzheap_t heap;            /**< @brief Heap content */
         bbzheap_idx_t nil;         /**< @brief Singleton bbznil_t */
         bbzheap_idx_t dflt_actrec; /**< @brief Singleton bbzdarray_t for the default activations record */
@@ -93,6 +106,11 @@ extern "C" {
         int16_t stackptr;          /**< @brief Stack pointer (Index of the last valid element of the stack) */
         int16_t blockptr;          /**< @brief Block pointer (Index of the previous block pointer in the stack) */
         bbzheap_idx_t stack[BBZSTACK_SIZE] __attribute__((aligned(2))); /**< @brief Current stack content */
+        int16_t lstackptr;         /**< @brief Local symbol stack pointer (Index of the last valid element of the local symbol stack) */
+        bbzheap_idx_t lstack[BBZLSTACK_SIZE] __attribute__((aligned(2))); /**< @brief Local symbols of the running closures, one frame after the other */
+#ifdef BBZ_HEAP_COMPACTION
+        uint8_t ccalls;            /**< @brief Number of running C functions that may hold heap indexes; the heap is only compacted when there is none */
+#endif // BBZ_HEAP_COMPACTION
     } bbzvm_t;
 
     /**
@@ -137,6 +155,21 @@ extern "C" {
      */
     void bbzvm_set_bcode(bbzvm_bcode_fetch_fun bcode_fetch_fun, uint16_t bcode_size);
 
+    /**
+     * @brief Sets the bytecode in the VM, from memory the VM can read
+     * directly.
+     * @details Instructions and operands are then read in place instead
+     * of through a fetcher function. Meant for bytecode in RAM or in a
+     * memory-mapped flash. Bytecode in the program memory of AVR targets
+     * must be set with bbzvm_set_bcode() instead.
+     * @warning The passed buffer should not be deleted until the VM is done with it.
+     * @warning Operands are not aligned in the bytecode. Targets which do
+     * not support unaligned accesses should define BBZ_BYTEWISE_ASSIGNMENT.
+     * @param[in] bcode The bytecode.
+     * @param[in] bcode_size The size (in bytes) of the bytecode.
+     */
+    void bbzvm_set_bcode_ptr(const uint8_t* bcode, uint16_t bcode_size);
+
     /**
      * @brief Sets the error receiver.
      * @see bbzvm_error_receiver_fun
@@ -160,6 +193,50 @@ extern "C" {
      */
     void bbzvm_gc();
 
+#ifdef BBZ_LAZY_GC
+    /**
+     * @brief Runs the VM's garbage collector if the heap is under
+     * allocation pressure (see bbzheap_gc_isdue()).
+     * @details Use it in C code that allocates outside of the instruction
+     * loop. Allocations that fail collect garbage by themselves anyway.
+     */
+    #define bbzvm_gc_ifdue() do{ if (bbzheap_gc_isdue()) bbzvm_gc(); }while(0)
+#else // BBZ_LAZY_GC
+    #define bbzvm_gc_ifdue() bbzvm_gc() /**< @brief Runs the VM's garbage collector. */
+#endif // BBZ_LAZY_GC
+
+#ifdef BBZ_INCREMENTAL_GC
+    /**
+     * @brief Runs a slice of the VM's incremental garbage collector.
+     * @details Starts a collection if none is running. Use it to collect
+     * garbage while the VM is idle, e.g., at the end of a control step.
+     * @param[in] budget The number of objects, segments and references
+     * to visit (see bbzheap_gc_slice()).
+     * @return Non-zero if the collection is still running.
+     */
+    uint8_t bbzvm_gc_slice(uint16_t budget);
+#endif // BBZ_INCREMENTAL_GC
+
+#ifdef BBZ_GENERATIONAL_GC
+    /**
+     * @brief Runs a minor collection of the VM's garbage collector (see
+     * bbzheap_gc_minor()).
+     * @details The VM does it by itself before an instruction, once the
+     * nursery takes BBZHEAP_NURSERY_SIZE bytes.
+     */
+    void bbzvm_gc_minor();
+#endif // BBZ_GENERATIONAL_GC
+
+#ifdef BBZ_HEAP_COMPACTION
+    /**
+     * @brief Compacts the VM's heap (see bbzheap_compact()).
+     * @details The VM does it by itself before an instruction, when a
+     * garbage collection leaves too little contiguous free space. Call it
+     * only when you do not hold any heap index.
+     */
+    void bbzvm_compact();
+#endif // BBZ_HEAP_COMPACTION
+
     /**
      * @brief Executes the next step in the bytecode, if possible.
      * @details Should there be an error during stepping, the VM's
@@ -167,6 +244,28 @@ extern "C" {
      */
     void bbzvm_step();
 
+    /**
+     * @brief Executes the next steps in the bytecode, if possible.
+     * @details Equivalent to calling bbzvm_step() @p n times, stopping
+     * as soon as the VM leaves the READY state, but without the cost of
+     * a function call per instruction.
+     * @param[in] n Maximum number of instructions to execute.
+     * @return The number of instructions executed.
+     */
+    uint16_t bbzvm_run(uint16_t n);
+
+    /**
+     * @brief Executes the next steps of a closure call, if possible.
+     * @details Like bbzvm_run(), but also stops as soon as the closure
+     * returns, i.e., once the VM's block pointer is at or below
+     * @p blockptr.
+     * @param[in] blockptr The VM's block pointer before the call.
+     * @param[in] n Maximum number of instructions to execute.
+     * @return The number of instructions executed.
+     * @see bbzvm_closure_call()
+     */
+    uint16_t bbzvm_run_call(int16_t blockptr, uint16_t n);
+
 
 
     // ======================================
@@ -414,6 +513,8 @@ extern "C" {
      * N-1 -> arg1<br/>
      * N   -> closure<br/>
      * This function pops all arguments.
+     * With BBZ_HEAP_COMPACTION, the heap is not compacted while the
+     * closure runs, so the caller may keep heap indexes across the call.
      * @param[in] argc The number of arguments.
      * @return 0 if everything OK, a non-zero value in case of error
      */
@@ -428,6 +529,8 @@ extern "C" {
      * N-2 -> arg2<br/>
      * N-1 -> arg1<br/>
      * This function pops all arguments.
+     * With BBZ_HEAP_COMPACTION, the heap may be compacted during the call,
+     * which invalidates the heap indexes held by the caller.
      * @param[in] fname The function name (bbzheap_idx_t pointing to a bbzstring_t).
      * @param[in] argc The number of arguments.
      */
@@ -452,11 +555,11 @@ extern "C" {
      * N   -> Closure arg1<br/>
      * N+1 -> Closure
      *
-     * This function pushes a new stack and a new local variable table filled with the
-     * activation record entries and the closure arguments. In addition, it leaves the stack
+     * This function pushes a new stack and a new frame on the local symbol stack filled with
+     * the activation record entries and the closure arguments. In addition, it leaves the stack
      * beneath as follows:
      * 0   -> The previous value of the block pointer (used when returning from a call)
-     * 1   -> The parent local symbol table
+     * 1   -> An integer for the previous value of the local symbols pointer
      * 2   -> An integer for the return address
      */
     void bbzvm_callc();
@@ -520,6 +623,8 @@ extern "C" {
     /**
      * @brief Pushes a lambda native closure on the stack.
      * @details Internally checks whether the operation is valid.
+     * When a closure is running, its local symbols are copied into the
+     * activation record of the new closure.
      * @see BBZVM_INSTR_PUSHL
      * @param[in] addr The closure address.
      */
@@ -603,6 +708,8 @@ extern "C" {
 
     /**
      * @brief Allocates a Buzz integer and returns its index on the heap.
+     * @details With BBZ_IMMEDIATE_INTS, small integers are held by the
+     * returned index itself and nothing is allocated.
      * @warning This function may throw a #BBZVM_ERROR_MEM error.
      * @param[in] val The value to assign to the object.
      * @return The index of the allocated object. UINT16_MAX in case of error.
@@ -635,8 +742,37 @@ extern "C" {
     bbzheap_idx_t bbztable_new();
 
     /**
-     * @brief Allocates a Buzz closure and returns its index on the heap.
+     * @brief Allocates a Buzz table holding the given fields and returns
+     * its index on the heap.
+     * @details The table gets all the segments it needs at once, so it is
+     * filled without being grown or rehashed. Each C function gets a new
+     * closure; to share the closures of a method table between several
+     * tables, build it once and give out copies with bbztable_new_copy().
      * @warning This function may throw a #BBZVM_ERROR_MEM error.
+     * @param[in] init The fields of the table.
+     * @param[in] n The number of fields.
+     * @return The index of the allocated object. UINT16_MAX in case of error.
+     */
+    bbzheap_idx_t bbztable_new_from(const bbztable_init_t* init, uint8_t n);
+
+    /**
+     * @brief Allocates a shallow copy of a Buzz table and returns its
+     * index on the heap.
+     * @details The copy has the segment layout of the original, so fields
+     * that exist in both can be set on the copy without allocating. The
+     * keys and values are shared with the original.
+     * @warning This function may throw a #BBZVM_ERROR_MEM error.
+     * @param[in] t The heap index of the table to copy.
+     * @return The index of the allocated object. UINT16_MAX in case of error.
+     */
+    bbzheap_idx_t bbztable_new_copy(bbzheap_idx_t t);
+
+    /**
+     * @brief Allocates a Buzz closure and returns its index on the heap.
+     * @details With BBZ_SMALL_OBJECTS, the value is stored in the heap's
+     * pointer table; use bbzvm_pushcn() for native closures.
+     * @warning This function may throw a #BBZVM_ERROR_MEM or, when the
+     * pointer table is full, a #BBZVM_ERROR_PTRS error.
      * @warning You shouldn't change the string id of the returned object.
      * @param[in] val The value to assign to the object.
      * @return The index of the allocated object. UINT16_MAX in case of error.
@@ -645,7 +781,8 @@ extern "C" {
 
     /**
      * @brief Allocates a Buzz userdata and returns its index on the heap.
-     * @warning This function may throw a #BBZVM_ERROR_MEM error.
+     * @warning This function may throw a #BBZVM_ERROR_MEM or, with
+     * BBZ_SMALL_OBJECTS and a full pointer table, a #BBZVM_ERROR_PTRS error.
      * @warning You shouldn't change the string id of the returned object.
      * @param[in] val The value to assign to the object.
      * @return The index of the allocated object. UINT16_MAX in case of error.
@@ -676,14 +813,14 @@ extern "C" {
      * @param[in] idx The local symbols index.
      * @return The heap index of the element at given local symbols index.
      */
-    #define bbzvm_locals_at(idx) ({ bbzheap_idx_t ret; bbzdarray_get(vm->lsyms, idx, &ret); ret; })
+    #define bbzvm_locals_at(idx) (vm->lstack[vm->lsymsptr + (idx)])
 
     /**
      * @brief Determines how many arguments were passed to the closure that
      * is being executed.
      * @return The number of arguments.
      */
-    #define bbzvm_locals_count() (bbzdarray_size(vm->lsyms) - 1)
+    #define bbzvm_locals_count() (uint16_t)(vm->lstackptr - vm->lsymsptr)
 
     /**
      * @brief Assert the correct execution of a boolean returning function.
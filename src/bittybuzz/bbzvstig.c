@@ -18,11 +18,14 @@ void bbzvstig_register() {
 
     // Construct the 'stigmergy' structure.
     vm->vstig.hpos = bbzvm_stack_at(0);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->vstig.hpos));
+    bbzheap_root_add(vm->vstig.hpos);
+
+    // The prototype of the tables returned by 'create' is created on first use.
+    vm->vstig.proto = vm->nil;
 
     // String 'stigmergy' is stack-top, and table is now stack #1. Register it.
     bbzvm_gstore();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
@@ -34,21 +37,29 @@ void bbzvstig_create() {
     // Empty the vstig.
     vm->vstig.size = 0;
 
-    // Create a table, and register some fields in it.
-    bbzvm_pusht();
+    // Create the prototype of the stigmergy tables.
+    if (vm->vstig.proto == vm->nil) {
+        const bbztable_init_t fields[] = {
+            { __BBZSTRID_id,             NULL,                    bbzint_new(0) },
+            { __BBZSTRID_put,            bbzvstig_put,            0 },
+            { __BBZSTRID_get,            bbzvstig_get,            0 },
+            { __BBZSTRID_size,           bbzvstig_size,           0 },
+            { __BBZSTRID_onconflict,     bbzvstig_onconflict,     0 },
+            { __BBZSTRID_onconflictlost, bbzvstig_onconflictlost, 0 },
+        };
+        bbzheap_idx_t p = bbztable_new_from(fields, sizeof(fields) / sizeof(*fields));
+        if (vm->state == BBZVM_STATE_ERROR) return;
+        vm->vstig.proto = p;
+        bbzheap_root_add(vm->vstig.proto);
+    }
+
+    // Copy the prototype, which shares its closures with the other
+    // stigmergy tables, and set its id.
+    bbzvm_push(bbztable_new_copy(vm->vstig.proto));
     bbztable_add_data(__BBZSTRID_id, bbzvm_locals_at(1));
-    bbztable_add_function(__BBZSTRID_put,  bbzvstig_put);
-    bbztable_add_function(__BBZSTRID_get,  bbzvstig_get);
-    bbzvm_gc();
-    bbztable_add_function(__BBZSTRID_size, bbzvstig_size);
-    bbztable_add_function(__BBZSTRID_onconflict, bbzvstig_onconflict);
-    bbzvm_gc();
-    bbztable_add_function(__BBZSTRID_onconflictlost, bbzvstig_onconflictlost);
 
     // Table is now stack top. Return it.
     bbzvm_ret1();
-
-    bbzvm_gc();
 }
 
 /****************************************/
@@ -58,12 +69,12 @@ void bbzvstig_onconflict() {
     bbzvm_assert_lnum(1);
 
     bbzvm_push(vm->vstig.hpos);
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
     bbztable_add_data(BBZVSTIG_ONCONFLICT_FIELD, bbzvm_locals_at(1));
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 
     bbzvm_ret0();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
@@ -73,12 +84,12 @@ void bbzvstig_onconflictlost() {
     bbzvm_assert_lnum(1);
 
     bbzvm_push(vm->vstig.hpos);
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
     bbztable_add_data(BBZVSTIG_ONCONFLICTLOST_FIELD, bbzvm_locals_at(1));
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 
     bbzvm_ret0();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
@@ -90,7 +101,7 @@ void bbzvstig_get() {
     // Get args
     bbzheap_idx_t key = bbzvm_locals_at(1);
 
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 
     // Find the 'key' entry.
     bbzobj_t tmp;
@@ -108,7 +119,7 @@ void bbzvstig_get() {
                                          vm->vstig.data[i].timestamp);
             bbzvm_push(vm->vstig.data[i].value);
             bbzvm_ret1();
-            bbzvm_gc();
+            bbzvm_gc_ifdue();
             return;
         }
     }
@@ -122,7 +133,7 @@ void bbzvstig_get() {
                                  0);
 
     bbzvm_ret1();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
@@ -137,7 +148,7 @@ void bbzvstig_put() {
     // BittyBuzz's virtual stigmertgie cannot handle composite types.
     bbzvm_assert_exec(!bbztype_istable(*bbzheap_obj_at(value)), BBZVM_ERROR_TYPE);
 
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 
     // Find the 'key' entry.
     bbzobj_t tmp;
@@ -149,10 +160,10 @@ void bbzvstig_put() {
                 bbzheap_obj_at(key)) == 0) {
             // Entry found. Set it and exit.
             vm->vstig.data[i].robot = vm->robot;
-            bbzheap_obj_unmake_permanent(*bbzheap_obj_at(vm->vstig.data[i].value));
+            bbzheap_root_remove(vm->vstig.data[i].value);
             vm->vstig.data[i].value = value;
-            bbzheap_obj_make_permanent(*bbzheap_obj_at(value));
-            bbzvm_gc();
+            bbzheap_root_add(value);
+            bbzvm_gc_ifdue();
             ++vm->vstig.data[i].timestamp;
             bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT,
                                          vm->vstig.data[i].robot,
@@ -160,7 +171,7 @@ void bbzvstig_put() {
                                          vm->vstig.data[i].value,
                                          vm->vstig.data[i].timestamp);
             bbzvm_ret0();
-            bbzvm_gc();
+            bbzvm_gc_ifdue();
             return;
         }
     }
@@ -169,9 +180,9 @@ void bbzvstig_put() {
     if (vm->vstig.size < BBZVSTIG_CAP) {
         vm->vstig.data[vm->vstig.size].robot = vm->robot;
         vm->vstig.data[vm->vstig.size].key   = bbzheap_obj_at(key)->s.value;
-        bbzheap_obj_make_permanent(*bbzheap_obj_at(key));
+        bbzheap_root_add(key);
         vm->vstig.data[vm->vstig.size].value = value;
-        bbzheap_obj_make_permanent(*bbzheap_obj_at(value));
+        bbzheap_root_add(value);
         vm->vstig.data[vm->vstig.size].timestamp = 1;
         bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT,
                                      vm->vstig.data[vm->vstig.size].robot,
@@ -185,7 +196,7 @@ void bbzvstig_put() {
     }
 
     bbzvm_ret0();
-    bbzvm_gc();
+    bbzvm_gc_ifdue();
 }
 
 /****************************************/
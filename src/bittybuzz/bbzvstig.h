@@ -36,8 +36,9 @@ typedef struct PACKED bbzvstig_elem_t {
 typedef struct PACKED bbzvstig_t {
 #ifndef BBZ_DISABLE_VSTIGS
     bbzvstig_elem_t data[BBZVSTIG_CAP]; /**< @brief Data of the stigmergy. */
-    uint8_t size;       /**< @brief Number of stigmergy elements. */
-    bbzheap_idx_t hpos; /**< @brief Heap's position of the 'stigmergy' table. */
+    uint8_t size;        /**< @brief Number of stigmergy elements. */
+    bbzheap_idx_t hpos;  /**< @brief Heap's position of the 'stigmergy' table. */
+    bbzheap_idx_t proto; /**< @brief Table copied by 'stigmergy.create', which holds the methods of a stigmergy. Created on first use. */
 #endif
 } bbzvstig_t;
 
@@ -63,6 +63,13 @@ typedef enum {
     INSTR_JUMP,
     INSTR_JUMPZ,
     INSTR_JUMPNZ,
+    /**
+     * BittyBuzz-only opcodes
+     */
+    INSTR_GLOADS,
+    INSTR_LTGETS,
+    INSTR_ADDI,
+    INSTR_JLT,
     INSTR_COUNT
 } instr;
 
@@ -173,17 +180,173 @@ void foreachint(void* key, void* value, void* params) {
     //printf("%d => %d\n", (int)(intptr_t)value, (int)v);
 }
 
+/**
+ * An instruction of the input file.
+ */
+typedef struct bo_instr {
+    long    pos;    /* Position in the input file */
+    uint8_t opcode;
+    int32_t argi;   /* Integer argument, if any */
+    float   argf;   /* Float argument (PUSHF) */
+    uint8_t target; /* Whether a jump or a closure refers to this instruction */
+} bo_instr;
+
+/**
+ * Kinds of arguments of the opcodes.
+ */
+typedef enum {
+    ARG_NONE = 0,
+    ARG_FLOAT,
+    ARG_INT,
+    ARG_ADDR,    /* Position in the file, which must be relocated */
+    ARG_UNKNOWN
+} arg_kind;
+
+arg_kind instr_arg(uint8_t opcode) {
+    switch(opcode) {
+        case INSTR_NOP:     // fallthrough
+        case INSTR_DONE:    // fallthrough
+        case INSTR_PUSHNIL: // fallthrough
+        case INSTR_DUP:     // fallthrough
+        case INSTR_POP:     // fallthrough
+        case INSTR_RET0:    // fallthrough
+        case INSTR_RET1:    // fallthrough
+        case INSTR_ADD:     // fallthrough
+        case INSTR_SUB:     // fallthrough
+        case INSTR_MUL:     // fallthrough
+        case INSTR_DIV:     // fallthrough
+        case INSTR_MOD:     // fallthrough
+        case INSTR_POW:     // fallthrough
+        case INSTR_UNM:     // fallthrough
+        case INSTR_LAND:    // fallthrough
+        case INSTR_LOR:     // fallthrough
+        case INSTR_LNOT:    // fallthrough
+        case INSTR_BAND:    // fallthrough
+        case INSTR_BOR:     // fallthrough
+        case INSTR_BNOT:    // fallthrough
+        case INSTR_LSHIFT:  // fallthrough
+        case INSTR_RSHIFT:  // fallthrough
+        case INSTR_EQ:      // fallthrough
+        case INSTR_NEQ:     // fallthrough
+        case INSTR_GT:      // fallthrough
+        case INSTR_GTE:     // fallthrough
+        case INSTR_LT:      // fallthrough
+        case INSTR_LTE:     // fallthrough
+        case INSTR_GLOAD:   // fallthrough
+        case INSTR_GSTORE:  // fallthrough
+        case INSTR_PUSHT:   // fallthrough
+        case INSTR_TPUT:    // fallthrough
+        case INSTR_TGET:    // fallthrough
+        case INSTR_CALLC:   // fallthrough
+        case INSTR_CALLS:
+            return ARG_NONE;
+        case INSTR_PUSHF:
+            return ARG_FLOAT;
+        case INSTR_PUSHI:   // fallthrough
+        case INSTR_PUSHS:   // fallthrough
+        case INSTR_LLOAD:   // fallthrough
+        case INSTR_LSTORE:  // fallthrough
+        case INSTR_LREMOVE:
+            return ARG_INT;
+        case INSTR_JUMP:    // fallthrough
+        case INSTR_JUMPZ:   // fallthrough
+        case INSTR_JUMPNZ:  // fallthrough
+        case INSTR_COUNT:   // fallthrough
+        case INSTR_PUSHL:   // fallthrough
+        case INSTR_PUSHCN:  // fallthrough
+        case INSTR_PUSHCC:
+            return ARG_ADDR;
+        default:
+            return ARG_UNKNOWN;
+    }
+}
+
+/**
+ * Returns the index of the instruction at a position of the input
+ * file, or -1 if there is none.
+ */
+long find_instr(bo_instr* instrs, long count, long pos) {
+    long lo = 0, hi = count - 1;
+    while (lo <= hi) {
+        long mid = (lo + hi) / 2;
+        if (instrs[mid].pos == pos) return mid;
+        if (instrs[mid].pos < pos) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+/**
+ * Returns whether the instructions from i on are the given opcodes,
+ * none of which but the first is referred to by a jump or a closure.
+ */
+int match(bo_instr* instrs, long count, long i, const uint8_t* opcodes, long len) {
+    if (i + len > count) return 0;
+    for (long j = 0; j < len; ++j) {
+        if (instrs[i + j].opcode != opcodes[j]) return 0;
+        if (j > 0 && instrs[i + j].target) return 0;
+    }
+    return 1;
+}
+
+/**
+ * A sequence of Buzz opcodes and the BittyBuzz opcode replacing it.
+ */
+typedef struct fusion {
+    uint8_t opcodes[3];
+    long    len;
+    uint8_t fused;
+    const char* name;
+} fusion;
+
+static const fusion fusions[] = {
+    {{INSTR_PUSHS, INSTR_GLOAD},             2, INSTR_GLOADS, "PUSHS GLOAD -> GLOADS"},
+    {{INSTR_LLOAD, INSTR_PUSHS, INSTR_TGET}, 3, INSTR_LTGETS, "LLOAD PUSHS TGET -> LTGETS"},
+    {{INSTR_PUSHI, INSTR_ADD},               2, INSTR_ADDI,   "PUSHI ADD -> ADDI"},
+    {{INSTR_LT, INSTR_JUMPZ},                2, INSTR_JLT,    "LT JUMPZ -> JLT"},
+};
+
+#define FUSION_COUNT (sizeof(fusions) / sizeof(*fusions))
+
+/**
+ * Writes a 16-bit integer argument, warning if it does not fit.
+ */
+void write_int(FILE* f_out, int32_t argi, const char* fname, long pos) {
+    int16_t bufi = (uint16_t)argi;
+    fwrite(&bufi,sizeof(bufi),1,f_out);
+    if (argi > INT16_MAX || argi < INT16_MIN) {
+        fprintf(stderr, "Warning [%s:%d]: Integer (0x%08X) at position %d "
+                        "is out of 16 bit integer range. "
+                        "A part of the data will be lost.\n",
+                fname,
+                (int)pos,
+                argi,
+                (uint32_t)pos);
+    }
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-result"
 int main(int argc, char **argv) {
-    if (argc != 3) {
+    int fuse = 1, stats = 0;
+    int argi0 = 1;
+    for (; argi0 < argc && argv[argi0][0] == '-'; ++argi0) {
+        if (argv[argi0][1] == 'n' && argv[argi0][2] == 0) fuse = 0;
+        else if (argv[argi0][1] == 's' && argv[argi0][2] == 0) stats = 1;
+        else break;
+    }
+    if (argc - argi0 != 2) {
         printf("Reformat buzz object file in a format compatible with BittyBuzz VM.\n");
-        printf("Usage:\n\t%s <buzzbinary.bo> <outputfile.bbo>\n", argv[0]);
+        printf("Usage:\n\t%s [-n] [-s] <buzzbinary.bo> <outputfile.bbo>\n", argv[0]);
+        printf("Options:\n"
+               "\t-n  Do not replace common sequences of instructions by BittyBuzz-only instructions.\n"
+               "\t-s  Print the number of instructions replaced.\n");
         return 1;
     }
+    const char* f_in_name = argv[argi0];
 
-    FILE* f_in  = fopen(argv[1], "rb");
-    FILE* f_out = fopen(argv[2], "wb");
+    FILE* f_in  = fopen(argv[argi0], "rb");
+    FILE* f_out = fopen(argv[argi0 + 1], "wb");
 
     if(!f_in) {
         if (f_out) fclose(f_out);
@@ -209,97 +372,113 @@ int main(int argc, char **argv) {
         do (void)fread(&charBuf,1,1,f_in);
         while (charBuf != 0);
     }
-    uint8_t  opcode;
-    int32_t  argi;
-    float    argf;
-    int16_t  bufi;
+
+    /* 1) Read the instructions */
+    long count = 0, cap = 64;
+    bo_instr* instrs = malloc(cap * sizeof(bo_instr));
     do {
-        setTable(&refs, (void*)(intptr_t)(uint32_t)ftell(f_in), (void*)(intptr_t)(int16_t)ftell(f_out));
-        read_write(opcode);
-        switch(opcode) {
-            case INSTR_NOP:     // fallthrough
-            case INSTR_DONE:    // fallthrough
-            case INSTR_PUSHNIL: // fallthrough
-            case INSTR_DUP:     // fallthrough
-            case INSTR_POP:     // fallthrough
-            case INSTR_RET0:    // fallthrough
-            case INSTR_RET1:    // fallthrough
-            case INSTR_ADD:     // fallthrough
-            case INSTR_SUB:     // fallthrough
-            case INSTR_MUL:     // fallthrough
-            case INSTR_DIV:     // fallthrough
-            case INSTR_MOD:     // fallthrough
-            case INSTR_POW:     // fallthrough
-            case INSTR_UNM:     // fallthrough
-	    case INSTR_LAND:    // fallthrough
-	    case INSTR_LOR:     // fallthrough
-	    case INSTR_LNOT:    // fallthrough
-	    case INSTR_BAND:    // fallthrough
-	    case INSTR_BOR:     // fallthrough
-	    case INSTR_BNOT:    // fallthrough
-	    case INSTR_LSHIFT:  // fallthrough
-	    case INSTR_RSHIFT:  // fallthrough
-            case INSTR_EQ:      // fallthrough
-            case INSTR_NEQ:     // fallthrough
-            case INSTR_GT:      // fallthrough
-            case INSTR_GTE:     // fallthrough
-            case INSTR_LT:      // fallthrough
-            case INSTR_LTE:     // fallthrough
-            case INSTR_GLOAD:   // fallthrough
-            case INSTR_GSTORE:  // fallthrough
-            case INSTR_PUSHT:   // fallthrough
-            case INSTR_TPUT:    // fallthrough
-            case INSTR_TGET:    // fallthrough
-            case INSTR_CALLC:   // fallthrough
-            case INSTR_CALLS:
-                break;
-            case INSTR_PUSHF:
-                (void)fread(&argf,sizeof(argf),1,f_in);
-                bufi = (uint16_t)bbzfloat_fromfloat(argf);
-                fwrite(&bufi,sizeof(bufi),1,f_out);
+        if (count == cap) {
+            cap *= 2;
+            instrs = realloc(instrs, cap * sizeof(bo_instr));
+        }
+        bo_instr* in = instrs + count++;
+        in->pos = ftell(f_in);
+        in->argi = 0;
+        in->argf = 0;
+        in->target = 0;
+        (void)fread(&in->opcode,sizeof(in->opcode),1,f_in);
+        switch(instr_arg(in->opcode)) {
+            case ARG_NONE:
                 break;
-            case INSTR_PUSHI:   // fallthrough
-            case INSTR_PUSHS:   // fallthrough
-            case INSTR_LLOAD:   // fallthrough
-            case INSTR_LSTORE:  // fallthrough
-	    case INSTR_LREMOVE: // fallthrough
-                (void)fread(&argi,sizeof(argi),1,f_in);
-                bufi = (uint16_t)argi;
-                fwrite(&bufi,sizeof(bufi),1,f_out);
-                if (argi > INT16_MAX || argi < INT16_MIN) {
-                    fprintf(stderr, "Warning [%s:%d]: Integer (0x%08X) at position %d "
-                                    "is out of 16 bit integer range. "
-                                    "A part of the data will be lost.\n",
-                            argv[1],
-                            (int)(ftell(f_in) - sizeof(argi)),
-                            argi,
-                            (uint32_t) (ftell(f_in) - sizeof(argi)));
-                }
+            case ARG_FLOAT:
+                (void)fread(&in->argf,sizeof(in->argf),1,f_in);
                 break;
-            case INSTR_JUMP:    // fallthrough
-            case INSTR_JUMPZ:   // fallthrough
-            case INSTR_JUMPNZ:  // fallthrough
-	    case INSTR_COUNT:   // fallthrough
-            case INSTR_PUSHL:   // fallthrough
-            case INSTR_PUSHCN:  // fallthrough
-            case INSTR_PUSHCC:
-                (void)fread(&argi,sizeof(argi),1,f_in);
-                insertTable(&repl, (void *) (intptr_t)ftell(f_out), (void *) (intptr_t)argi);
-                bufi = (uint16_t)(argi);
-                fwrite(&bufi,sizeof(bufi),1,f_out);
+            case ARG_INT:       // fallthrough
+            case ARG_ADDR:
+                (void)fread(&in->argi,sizeof(in->argi),1,f_in);
                 break;
             default:
                 fprintf(stderr,"Warning [%s:%d]: Unknown opcode (0x%08X).\n",
-                        argv[1],
+                        f_in_name,
                         (int)ftell(f_in),
-                        opcode);
+                        in->opcode);
                 break;
         }
     } while (ftell(f_in) < fsize);
 
+    /* 2) Find the instructions that jumps and closures refer to */
+    for (long i = 0; i < count; ++i) {
+        if (instr_arg(instrs[i].opcode) == ARG_ADDR) {
+            long t = find_instr(instrs, count, instrs[i].argi);
+            if (t >= 0) instrs[t].target = 1;
+        }
+    }
+
+    /* 3) Write the instructions, replacing the sequences found in 'fusions' */
+    long fused_count[FUSION_COUNT] = {0};
+    long out_count = 0;
+    int16_t bufi;
+    for (long i = 0; i < count; ++out_count) {
+        bo_instr* in = instrs + i;
+        setTable(&refs, (void*)(intptr_t)(uint32_t)in->pos, (void*)(intptr_t)(int16_t)ftell(f_out));
+        unsigned int f = FUSION_COUNT;
+        if (fuse) {
+            for (f = 0; f < FUSION_COUNT; ++f) {
+                if (match(instrs, count, i, fusions[f].opcodes, fusions[f].len)) break;
+            }
+        }
+        if (f < FUSION_COUNT) {
+            fwrite(&fusions[f].fused,sizeof(uint8_t),1,f_out);
+            switch(fusions[f].fused) {
+                case INSTR_GLOADS:  // fallthrough
+                case INSTR_ADDI:
+                    write_int(f_out, in[0].argi, f_in_name, in[0].pos + 1);
+                    break;
+                case INSTR_LTGETS:
+                    write_int(f_out, in[0].argi, f_in_name, in[0].pos + 1);
+                    write_int(f_out, in[1].argi, f_in_name, in[1].pos + 1);
+                    break;
+                case INSTR_JLT:
+                    insertTable(&repl, (void *) (intptr_t)ftell(f_out), (void *) (intptr_t)in[1].argi);
+                    bufi = (uint16_t)(in[1].argi);
+                    fwrite(&bufi,sizeof(bufi),1,f_out);
+                    break;
+            }
+            ++fused_count[f];
+            i += fusions[f].len;
+            continue;
+        }
+        fwrite(&in->opcode,sizeof(in->opcode),1,f_out);
+        switch(instr_arg(in->opcode)) {
+            case ARG_FLOAT:
+                bufi = (uint16_t)bbzfloat_fromfloat(in->argf);
+                fwrite(&bufi,sizeof(bufi),1,f_out);
+                break;
+            case ARG_INT:
+                write_int(f_out, in->argi, f_in_name, in->pos + 1);
+                break;
+            case ARG_ADDR:
+                insertTable(&repl, (void *) (intptr_t)ftell(f_out), (void *) (intptr_t)in->argi);
+                bufi = (uint16_t)(in->argi);
+                fwrite(&bufi,sizeof(bufi),1,f_out);
+                break;
+            default:
+                break;
+        }
+        ++i;
+    }
+
     foreachint_params p = {f_out, &refs};
     foreachTable(&repl, foreachint, &p);
 
+    if (stats) {
+        for (unsigned int f = 0; f < FUSION_COUNT; ++f) {
+            printf("%-28s %6ld\n", fusions[f].name, fused_count[f]);
+        }
+        printf("%-28s %6ld -> %ld\n", "Instructions", count, out_count);
+    }
+
+    free(instrs);
     freeTable(&refs);
     freeTable(&repl);
     fclose(f_in);
@@ -90,7 +90,10 @@ int main(int argc, char** argv) {
                "all characters that would otherwise make an invalid \n"
                "identifier should be replaced by an underscore (case remains \n"
                "unchanged). Thus, some string names may collide.\n"
-               "E.g. \"2 Swarms\" -> BBZSTRING_ID(__Swarms).\n");
+               "E.g. \"2 Swarms\" -> BBZSTRING_ID(__Swarms).\n\n"
+
+               "The number of strings is stored as 'BBZSTRING_COUNT'. The \n"
+               "BBZHEAP_STRINGS_CAP option should be at least that large.\n");
         return 1;
     }
 
@@ -167,6 +170,7 @@ int main(int argc, char** argv) {
     char buf;
     uint16_t strcnt;
     fread(&strcnt, sizeof(strcnt), 1, f_obj);
+    fprintf(f_out, "#define BBZSTRING_COUNT %d\n\n", strcnt);
     for (int i = 0; i < strcnt; ++i) {
         strcpy(str, "");
         do {
@@ -12,6 +12,7 @@ else()
 endif ()
 config_value(BBZHEAP_ELEMS_PER_TSEG 5)
 config_value(BBZSTACK_SIZE 96)
+config_value(BBZLSTACK_SIZE 32)
 config_value(BBZVSTIG_CAP 4)
 config_value(BBZNEIGHBORS_CAP 15)
 config_value(BBZINMSG_QUEUE_CAP 10)
@@ -22,10 +23,61 @@ config_value(BBZHEAP_GCMARK_DEPTH 8)
 config_value(BBZMSG_IN_PROC_MAX 10)
 config_value(BBZNEIGHBORS_CLR_PERIOD 10)
 config_value(BBZNEIGHBORS_MARK_TIME 4)
+if (CMAKE_CROSSCOMPILING)
+    config_value(BBZHEAP_GC_WATERMARK 136)
+else()
+    config_value(BBZHEAP_GC_WATERMARK 408)
+endif ()
+config_value(BBZHEAP_GC_SLICE 32)
+if (CMAKE_CROSSCOMPILING)
+    config_value(BBZHEAP_STRINGS_CAP 64)
+    config_value(BBZHEAP_PTRS_CAP 32)
+    config_value(BBZHEAP_NURSERY_SIZE 128)
+    config_value(BBZHEAP_REMSET_CAP 16)
+    config_value(BBZHEAP_ROOTS_CAP 20)
+else()
+    config_value(BBZHEAP_STRINGS_CAP 256)
+    config_value(BBZHEAP_PTRS_CAP 64)
+    config_value(BBZHEAP_NURSERY_SIZE 384)
+    config_value(BBZHEAP_REMSET_CAP 32)
+    config_value(BBZHEAP_ROOTS_CAP 24)
+endif ()
 
 # Set the XTREME memory optimization to false if it hasn't been set yet.
 option(BBZ_XTREME_MEMORY "Whether to enable high memory-optimization." OFF)
 option(BBZ_USE_PRIORITY_SORT "Whether to use priority sort on out-messages queue." OFF)
+option(BBZ_COMPACT_MESSAGES "Whether to send messages with the compact varint encoding when it makes them shorter. Receivers read both encodings." OFF)
+option(BBZ_LAZY_GC "Whether to garbage-collect only under allocation pressure instead of before every instruction." ON)
+option(BBZ_INCREMENTAL_GC "Whether to spread garbage collections over several instructions instead of collecting the whole heap at once." OFF)
+if (BBZ_INCREMENTAL_GC AND NOT BBZ_LAZY_GC)
+    message(FATAL_ERROR "BBZ_INCREMENTAL_GC requires BBZ_LAZY_GC.")
+endif ()
+option(BBZ_GENERATIONAL_GC "Whether to collect the objects allocated since the last collection separately from the rest of the heap." OFF)
+if (BBZ_GENERATIONAL_GC AND NOT BBZ_LAZY_GC)
+    message(FATAL_ERROR "BBZ_GENERATIONAL_GC requires BBZ_LAZY_GC.")
+endif ()
+if (BBZ_GENERATIONAL_GC AND BBZ_INCREMENTAL_GC)
+    message(FATAL_ERROR "BBZ_GENERATIONAL_GC and BBZ_INCREMENTAL_GC cannot be combined.")
+endif ()
+option(BBZ_HEAP_COMPACTION "Whether to compact the heap when garbage collection leaves it fragmented." OFF)
+option(BBZ_HEAP_STATS "Whether to count allocations, live objects and garbage collections." OFF)
+option(BBZ_HEAP_ROOTS "Whether to keep the permanent objects in a registry instead of scanning the heap for them." ON)
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_SMALL_OBJECTS "Whether to keep the pointers of C closures and userdata out of the heap objects, so that every object takes 3 bytes." OFF)
+else()
+    option(BBZ_SMALL_OBJECTS "Whether to keep the pointers of C closures and userdata out of the heap objects, so that every object takes 3 bytes." ON)
+endif ()
+option(BBZ_IMMEDIATE_INTS "Whether to store small integers directly in heap indexes instead of allocating them." ON)
+option(BBZ_INTERN_STRINGS "Whether to find string objects through a string ID map instead of scanning the heap." ON)
+if (CMAKE_CROSSCOMPILING)
+    option(BBZ_HASHED_TABLES "Whether to hash the keys of tables instead of storing them in insertion order." OFF)
+    option(BBZ_GLOBAL_SLOTS "Whether to remember the location of global symbols instead of looking them up." OFF)
+    option(BBZ_THREADED_DISPATCH "Whether to dispatch instructions through a table of labels instead of a switch." OFF)
+else()
+    option(BBZ_HASHED_TABLES "Whether to hash the keys of tables instead of storing them in insertion order." ON)
+    option(BBZ_GLOBAL_SLOTS "Whether to remember the location of global symbols instead of looking them up." ON)
+    option(BBZ_THREADED_DISPATCH "Whether to dispatch instructions through a table of labels instead of a switch." ON)
+endif ()
 option(BBZ_USE_FLOAT "Whether to use float type." OFF)
 option(BBZ_DISABLE_NEIGHBORS "Whether to disable usage of neighbors' data structure and messages." OFF)
 option(BBZ_DISABLE_VSTIGS "Whether to disable usage of virtual stigmergies' data structure and messages." OFF)
@@ -226,6 +226,8 @@ set(BBZ_ROBOT crazyflie)
 option(BBZ_XTREME_MEMORY "Whether to enable high memory-optimization." OFF)
 option(BBZ_NEIGHBORS_USE_FLOATS "Whether to use floats for the neighbor's range and bearing measurments." ON)
 option(BBZ_ENABLE_FLOAT_OPERATIONS "Whether to enable floats operations" ON)
+option(BBZ_INCREMENTAL_GC "Whether to spread garbage collections over several instructions instead of collecting the whole heap at once." ON)
+option(BBZ_SMALL_OBJECTS "Whether to keep the pointers of C closures and userdata out of the heap objects, so that every object takes 3 bytes." ON)
 option(BBZ_BYTEWISE_ASSIGNMENT "Whether to make assignment byte per byte or directly. (used to ensure compatibility with Cortex-M0)" OFF) #Turned ON for Cortex-M0. CF uses Cortex-M4
 set(BBZHEAP_SIZE 3500)
 set(BBZSTACK_SIZE 128)
@@ -36,10 +36,39 @@
 
 // #include "led.h"
 
+/**
+ * @brief Number of instructions executed between two checks of the
+ * outgoing radio messages.
+ */
+#define BBZCRAZYFLIE_RUN_BATCH 16
+
+#ifdef BBZ_INCREMENTAL_GC
+/**
+ * @brief Garbage collection work done at the end of each control step
+ * (see bbzvm_gc_slice()).
+ */
+#define BBZCRAZYFLIE_GC_BUDGET 64
+
+/**
+ * @brief Duration of the longest garbage collection slice run at the end
+ * of a control step (us).
+ */
+static uint32_t gcMaxPause = 0;
+#endif // BBZ_INCREMENTAL_GC
+
 bbzvm_t vmObj;
 Message bbzmsg_tx;
-uint8_t bbzmsg_buf[11];
-bbzmsg_payload_t bbz_payload_buf;
+
+/**
+ * @brief Size of the part of a radio frame that holds Buzz messages (B),
+ * after the robot ID and position.
+ */
+#define BBZCRAZYFLIE_FRAME_SIZE (sizeof(bbzmsg_tx.payload) - sizeof(uint8_t) - sizeof(Position))
+
+/**
+ * @brief Number of messages packed in the frame being sent.
+ */
+static uint8_t bbzmsg_tx_count;
 
 uint8_t myId = 0;
 
@@ -136,7 +165,7 @@ void bbzcrazyflie_func_call(uint16_t strid) {
         bbzvm_callc();
         while(blockptr < vm->blockptr) {
             if(vm->state != BBZVM_STATE_READY) return;
-            bbzvm_step();
+            bbzvm_run_call(blockptr, BBZCRAZYFLIE_RUN_BATCH);
             DEBUG_PRINT("VM: Stepping\n");
             handleOutgoingRadioMessage();
         }
@@ -195,30 +224,34 @@ void handleIncomingRadioMessage(P2PPacket *p)
 Message* bbzwhich_msg_tx() {
 #ifndef BBZ_DISABLE_MESSAGES
     if(bbzoutmsg_queue_size()) {
-        bbzoutmsg_queue_first(&bbz_payload_buf);
         bbzmsg_tx.header.type = TYPE_BBZ_MESSAGE;
         bbzmsg_tx.header.id = RECEIVER_ID;
         *(uint8_t*)bbzmsg_tx.payload = getRobotId();
         *(Position*)(bbzmsg_tx.payload + sizeof(uint8_t)) = getCurrentPosition();
-        for (uint8_t i=0;i<9;++i) {
-            bbzmsg_tx.payload[i+sizeof(Position)+sizeof(uint8_t)] = *bbzringbuf_at(&bbz_payload_buf, i);
-        }
+        bbzmsg_tx_count = bbzoutmsg_queue_pack(bbzmsg_tx.payload + sizeof(Position) + sizeof(uint8_t), BBZCRAZYFLIE_FRAME_SIZE);
         return &bbzmsg_tx;
     }
 #endif
     return 0;
 }
 
+void bbzsent_msg_tx() {
+#ifndef BBZ_DISABLE_MESSAGES
+    for (; bbzmsg_tx_count > 0; --bbzmsg_tx_count) {
+        bbzoutmsg_queue_next();
+    }
+#endif
+}
+
 void bbzprocess_msg_rx(Message* msg_rx, float distance, float azimuth, float elevation) {
 #ifndef BBZ_DISABLE_MESSAGES
     if (msg_rx->header.type == TYPE_BBZ_MESSAGE) {
-        bbzringbuf_clear(&bbz_payload_buf);
-        for (uint8_t i = 0; i < 9; ++i) {
-            *bbzringbuf_rawat(&bbz_payload_buf, bbzringbuf_makeslot(&bbz_payload_buf)) = msg_rx->payload[i + sizeof(Position) + sizeof(uint8_t)];
-        }
-        // Add the neighbor data.
+        const uint8_t* payload = msg_rx->payload + sizeof(Position) + sizeof(uint8_t);
+        // Add the neighbor data. Broadcasts come first in a frame.
 #ifndef BBZ_DISABLE_NEIGHBORS
-        if (*bbzmsg_buf == BBZMSG_BROADCAST) {
+        bbzrobot_id_t rid;
+        if (*payload != 0 && BBZMSG_PACK_BASETYPE(*payload) == BBZMSG_BROADCAST &&
+            bbzmsg_raw_get_rid(&rid, BBZMSG_PACK_TYPE(*payload), payload + 1, BBZMSG_PACK_LEN(*payload))) {
             bbzneighbors_elem_t elem;
 #ifndef BBZ_NEIGHBORS_USE_FLOATS
             elem.azimuth = azimuth;
@@ -229,11 +262,11 @@ void bbzprocess_msg_rx(Message* msg_rx, float distance, float azimuth, float ele
             elem.elevation = bbzfloat_fromfloat(elevation);
             elem.distance = bbzfloat_fromfloat(distance);
 #endif // !BBZ_NEIGHBORS_USE_FLOATS
-            elem.robot = *(uint8_t*)msg_rx->payload;
+            elem.robot = rid;
             bbzneighbors_add(&elem);
         }
 #endif // !BBZ_DISABLE_NEIGHBORS
-        bbzinmsg_queue_append(&bbz_payload_buf);
+        bbzinmsg_queue_unpack(payload, BBZCRAZYFLIE_FRAME_SIZE);
     }
 #endif // !BBZ_DISABLE_MESSAGES
 }
@@ -251,12 +284,11 @@ void bbz_init(void (*setup)(void))
   systemLaunch();
   
   vm = &vmObj;
-  bbzringbuf_construct(&bbz_payload_buf, bbzmsg_buf, 1, 11);
   
   if (!has_setup) {
     setRobotId(ROBOT_ID);
     bbzvm_construct(getRobotId());
-    bbzvm_set_bcode(bbzcrazyflie_bcodeFetcher, bcode_size);
+    bbzvm_set_bcode_ptr(bcode, bcode_size);
     bbzvm_set_error_receiver(bbz_err_receiver);
 //     bbz_createPosObject();
     setup();
@@ -289,7 +321,7 @@ void bbzTask(void * param)
         if (!init_done) {
             if (vm->state == BBZVM_STATE_READY) {
                 DEBUG_PRINT("VM: stepping now.\n");
-                bbzvm_step();
+                bbzvm_run(BBZCRAZYFLIE_RUN_BATCH);
             }
             else {
                 init_done = 1;
@@ -298,7 +330,7 @@ void bbzTask(void * param)
                 DEBUG_PRINT("VM: State Ready.\n");
 #ifndef BBZ_DISABLE_MESSAGES
                 message_tx = bbzwhich_msg_tx;
-                message_tx_success = bbzoutmsg_queue_next;
+                message_tx_success = bbzsent_msg_tx;
                 message_rx = bbzprocess_msg_rx;
                 // Register the callback function so that the CF can receive packets as well.
                 p2pRegisterCB(handleIncomingRadioMessage);
@@ -311,6 +343,13 @@ void bbzTask(void * param)
                 bbzcrazyflie_func_call(__BBZSTRID_step);
                 DEBUG_PRINT("VM: bbzcrazyflie_func_call(__BBZSTRID_ step) called.\n");
                 bbzvm_process_outmsgs();
+#ifdef BBZ_INCREMENTAL_GC
+                /* Collect garbage while waiting for the next step */
+                uint64_t gcStart = usecTimestamp();
+                bbzvm_gc_slice(BBZCRAZYFLIE_GC_BUDGET);
+                uint32_t gcPause = (uint32_t)(usecTimestamp() - gcStart);
+                if (gcPause > gcMaxPause) gcMaxPause = gcPause;
+#endif // BBZ_INCREMENTAL_GC
             }
             // checkRadio();
             // checkTouch();
@@ -364,7 +403,7 @@ void bbz_start(void (*setup)(void))
 //                 bbz_func_call(__BBZSTRID_init);
 // #ifndef BBZ_DISABLE_MESSAGES
 //                 message_tx = bbzwhich_msg_tx;
-//                 message_tx_success = bbzoutmsg_queue_next;
+//                 message_tx_success = bbzsent_msg_tx;
 //                 message_rx = bbzprocess_msg_rx;
 // #endif
 //             }
@@ -474,6 +513,10 @@ void bbz_err_receiver(bbzvm_error errcode)
 //             ___led(RGB(0, 0, 2));
 //             ___led(RGB(0, 0, 2));
             break;
+        case BBZVM_ERROR_PTRS:
+//             ___led(RGB(0, 2, 1));
+//             ___led(RGB(0, 3, 0));
+            break;
         default:
 //             ___led(RGB(2, 0, 2));
 //             ___led(RGB(2, 0, 2));
@@ -500,6 +543,14 @@ void rand_seed(uint8_t s)
 {
     seed = s;
 }
+
+#ifdef BBZ_INCREMENTAL_GC
+LOG_GROUP_START(bbz)
+LOG_ADD(LOG_UINT32, gcMaxPause, &gcMaxPause)
+LOG_ADD(LOG_UINT16, gcMaxWork, &vmObj.heap.gcmaxwork)
+LOG_ADD(LOG_UINT16, gcCycles, &vmObj.heap.gccycles)
+LOG_GROUP_STOP(bbz)
+#endif // BBZ_INCREMENTAL_GC
 /*
 void takeoff() {
         motorsSetRatio(MOTOR_M1, 10000);
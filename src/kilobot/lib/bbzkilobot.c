@@ -28,6 +28,8 @@
 #define rx_bitcycles 269
 /* Number of clock cycles for an entire message. */
 #define rx_msgcycles (11*rx_bitcycles)
+/* Number of instructions executed per iteration of the main loop during setup. */
+#define BBZKILO_RUN_BATCH 16
 
 void message_rx_txsuccess_dummy() { }
 message_t *message_tx_dummy() { return NULL; }
@@ -60,8 +62,6 @@ uint16_t kilo_irhigh;
 uint16_t kilo_irlow;
 bbzvm_t kilo_vmObj;
 message_t bbzmsg_tx;
-uint8_t bbzmsg_buf[11];
-bbzmsg_payload_t bbz_payload_buf;
 #endif // !BOOTLOADER
 
 static volatile enum {
@@ -118,7 +118,6 @@ void bbzkilo_init() {
     kilo_irlow  = ((eeprom_read_byte(EEPROM_IRLOW) <<8) | eeprom_read_byte(EEPROM_IRLOW + 1)) >> 2;
     kilo_irhigh = ((eeprom_read_byte(EEPROM_IRHIGH) <<8) | eeprom_read_byte(EEPROM_IRHIGH + 1)) >> 2;
     vm = &kilo_vmObj;
-    bbzringbuf_construct(&bbz_payload_buf, bbzmsg_buf, 1, 11);
 #ifdef DEBUG
     kilo_state = SETUP;
     kilo_uid = 0;
@@ -157,10 +156,7 @@ const uint8_t* bbzkilo_bcodeFetcher(bbzpc_t offset, uint8_t size) {
 message_t* bbzwhich_msg_tx() {
 #ifndef BBZ_DISABLE_MESSAGES
     if(bbzoutmsg_queue_size()) {
-        bbzoutmsg_queue_first(&bbz_payload_buf);
-        for (uint8_t i=0;i<9;++i) {
-            bbzmsg_tx.data[i] = *bbzringbuf_at(&bbz_payload_buf, i);
-        }
+        bbzoutmsg_queue_first_raw(bbzmsg_tx.data);
         bbzmsg_tx.type = BBZMSG;
         bbzmsg_tx.crc = bbzmessage_crc(&bbzmsg_tx);
         return &bbzmsg_tx;
@@ -172,13 +168,11 @@ message_t* bbzwhich_msg_tx() {
 void bbzprocess_msg_rx(message_t* msg_rx, distance_measurement_t* d) {
 #ifndef BBZ_DISABLE_MESSAGES
     if (msg_rx->type == BBZMSG) {
-        bbzringbuf_clear(&bbz_payload_buf);
-        for (uint8_t i = 0; i < 9; ++i) {
-            *bbzringbuf_rawat(&bbz_payload_buf, bbzringbuf_makeslot(&bbz_payload_buf)) = msg_rx->data[i];
-        }
         // Add the neighbor data.
 #ifndef BBZ_DISABLE_NEIGHBORS
-        if (*bbzmsg_buf == BBZMSG_BROADCAST) {
+        bbzrobot_id_t rid;
+        if ((msg_rx->data[0] & ~BBZMSG_COMPACT) == BBZMSG_BROADCAST &&
+            bbzmsg_raw_get_rid(&rid, msg_rx->data[0], msg_rx->data + 1, sizeof(msg_rx->data) - 1)) {
             uint8_t dist = ((uint8_t)(d->high_gain>>2) + (uint8_t)(d->low_gain>>2))>>1;
             bbzneighbors_elem_t elem = {.azimuth=0,.elevation=0};
             uint8_t distance = (kilo_irhigh + kilo_irlow) >> 1;
@@ -188,11 +182,11 @@ void bbzprocess_msg_rx(message_t* msg_rx, distance_measurement_t* d) {
 #else // !BBZ_NEIGHBORS_USE_FLOATS
             elem.distance -= bbzfloat_fromint(distance);
 #endif // !BBZ_NEIGHBORS_USE_FLOATS
-            elem.robot = *(uint16_t*)(bbzmsg_buf + 1);
+            elem.robot = rid;
             bbzneighbors_add(&elem);
         }
 #endif // !BBZ_DISABLE_NEIGHBORS
-        bbzinmsg_queue_append(&bbz_payload_buf);
+        bbzinmsg_queue_append_raw(msg_rx->data, sizeof(msg_rx->data));
     }
 #endif // !BBZ_DISABLE_MESSAGES
 }
@@ -200,29 +194,29 @@ void bbzprocess_msg_rx(message_t* msg_rx, distance_measurement_t* d) {
 #ifdef DEBUG
 __attribute__((used))
 void inject_vstig(int16_t val, bbzrobot_id_t rid, uint8_t lamport) {
-    bbzringbuf_clear(&bbz_payload_buf);
+    uint8_t buf[BBZMSG_VSTIG_SIZE];
     bbzobj_t o = {0};
     bbztype_cast(o, BBZTYPE_INT);
     o.i.value = val;
-    bbzmsg_serialize_u8(&bbz_payload_buf, BBZMSG_VSTIG_PUT);
-    bbzmsg_serialize_u16(&bbz_payload_buf, rid);
-    bbzmsg_serialize_u16(&bbz_payload_buf, 47); // STRID "1"
-    bbzmsg_serialize_obj(&bbz_payload_buf, &o);
-    bbzmsg_serialize_u8(&bbz_payload_buf, lamport);
-    bbzinmsg_queue_append(&bbz_payload_buf);
+    buf[0] = BBZMSG_VSTIG_PUT;
+    bbzmsg_raw_put_u16(buf + 1, rid);
+    bbzmsg_raw_put_u16(buf + 3, 47); // STRID "1"
+    bbzmsg_raw_put_obj(buf + 5, &o);
+    buf[8] = lamport;
+    bbzinmsg_queue_append_raw(buf, sizeof(buf));
 }
 #ifndef BBZ_DISABLE_NEIGHBORS
 __attribute__((used))
 void inject_bc(int16_t val, bbzrobot_id_t rid, uint8_t dist) {
-    bbzringbuf_clear(&bbz_payload_buf);
+    uint8_t buf[BBZMSG_BROADCAST_SIZE];
     bbzobj_t o = {0};
     bbztype_cast(o, BBZTYPE_INT);
     o.i.value = val;
-    bbzmsg_serialize_u8(&bbz_payload_buf, BBZMSG_BROADCAST);
-    bbzmsg_serialize_u16(&bbz_payload_buf, rid);
-    bbzmsg_serialize_u16(&bbz_payload_buf, 49); // STRID "1"
-    bbzmsg_serialize_obj(&bbz_payload_buf, &o);
-    bbzinmsg_queue_append(&bbz_payload_buf);
+    buf[0] = BBZMSG_BROADCAST;
+    bbzmsg_raw_put_u16(buf + 1, rid);
+    bbzmsg_raw_put_u16(buf + 3, 49); // STRID "1"
+    bbzmsg_raw_put_obj(buf + 5, &o);
+    bbzinmsg_queue_append_raw(buf, sizeof(buf));
     bbzneighbors_elem_t elem = {.azimuth=0,.elevation=0};
     elem.robot = rid;
     elem.distance = dist;
@@ -314,7 +308,7 @@ void bbzkilo_start(void (*setup)(void)) {
                     has_setup = 1;
                 }
                 if (vm->state == BBZVM_STATE_READY) {
-                    bbzvm_step();
+                    bbzvm_run(BBZKILO_RUN_BATCH);
                 }
                 else {
                     kilo_state = RUNNING;
@@ -682,6 +676,7 @@ void bbzkilo_err_receiver(bbzvm_error errcode) {
             case BBZVM_ERROR_VSTIG:      ___led(RGB(0,2,1)); ___led(RGB(1,2,0)); break;
             case BBZVM_ERROR_MEM:        ___led(RGB(0,2,1)); ___led(RGB(0,0,2)); break;
             case BBZVM_ERROR_MATH:       ___led(RGB(0,0,2)); ___led(RGB(0,0,2)); break;
+            case BBZVM_ERROR_PTRS:       ___led(RGB(0,2,1)); ___led(RGB(0,3,0)); break;
             default: ___led(RGB(2,0,2)); ___led(RGB(2,0,2)); break;
         }
     }
@@ -451,6 +451,7 @@ void set_color(uint8_t color);
  * - BBZVM_ERROR_VSTIG      :    cyan, yellow <br/>
  * - BBZVM_ERROR_MEM        :    cyan, blue <br/>
  * - BBZVM_ERROR_MATH       :    blue, blue <br/>
+ * - BBZVM_ERROR_PTRS       :    cyan, green <br/>
  * - <OTHER>                : magenta, magenta <br/>
  * @param[in] errcode The error's code.
  * @see bbzvm_set_error_receiver()
@@ -0,0 +1,240 @@
+/**
+ * @file benchmsgs.c
+ * @brief Host benchmark of the message queues under burst load.
+ * @details Prints the time taken to append a message to the output queue
+ * and to serialize and send the first one, with the queue filling up and
+ * draining, and with a full queue, in which each new message replaces the
+ * message with the lowest priority. The same is measured for received messages, which
+ * are deserialized before being queued. Both are measured with the ring
+ * buffer API and with the flat buffer ("raw") API.
+ *
+ * Messages of all the types are mixed, in decreasing order of priority,
+ * which is the worst case for keeping the queue in order.
+ *
+ * The size of typical messages with the fixed and the compact encodings is
+ * printed first, with the size of the messages actually sent, which depends
+ * on BBZ_COMPACT_MESSAGES.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <bittybuzz/bbzvm.h>
+
+#if !defined(BBZ_DISABLE_MESSAGES) && !defined(BBZ_DISABLE_NEIGHBORS) && !defined(BBZ_DISABLE_VSTIGS)
+/**
+ * @brief Minimum time spent on each measurement (s).
+ */
+#define BENCH_MIN_TIME 0.2
+
+/**
+ * @brief Number of messages in a burst.
+ */
+#define BENCH_BURST (2 * BBZOUTMSG_QUEUE_CAP)
+
+/**
+ * @brief Size of a serialized message (B).
+ */
+#define BENCH_PAYLOAD_SIZE 9
+
+/**
+ * @brief Queue loads measured by the benchmark.
+ */
+typedef enum {
+    BENCH_LOAD_FILL = 0, /**< @brief The queue fills up, then is drained. */
+    BENCH_LOAD_FULL,     /**< @brief The queue is full. */
+    BENCH_LOAD_COUNT
+} bench_load;
+
+static bbzvm_t vmObj;
+
+/**
+ * @brief The broadcast value.
+ */
+static bbzheap_idx_t value;
+
+/**
+ * @brief The broadcast topic.
+ */
+static bbzheap_idx_t topic;
+
+/**
+ * @brief Received messages, serialized.
+ */
+static uint8_t payloads[BENCH_BURST][BBZMSG_PAYLOAD_CAP];
+
+/**
+ * @brief Prevents the compiler from removing the extraction of messages.
+ */
+static volatile uint8_t sink;
+
+/**
+ * @brief Buffer where the sent messages are serialized.
+ */
+static uint8_t txbuf[BBZMSG_PAYLOAD_CAP];
+
+/**
+ * @brief Whether the flat buffer API is measured instead of the ring buffer one.
+ */
+static uint8_t raw;
+
+/**
+ * @brief Appends a message to the output queue.
+ * @param[in] i The number of the message in the burst.
+ */
+static void bench_out_append(uint8_t i) {
+    switch (BBZMSG_TYPE_COUNT - 1 - i % BBZMSG_TYPE_COUNT) {
+        case BBZMSG_BROADCAST:
+            bbzoutmsg_queue_append_broadcast(topic, value);
+            break;
+        case BBZMSG_VSTIG_PUT:
+            bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, i, __BBZSTRID_put, value, i);
+            break;
+        case BBZMSG_VSTIG_QUERY:
+            bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_QUERY, i, __BBZSTRID_put, value, i);
+            break;
+        default:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            bbzoutmsg_queue_append_swarm(i, 1, i);
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, i, __BBZSTRID_put, value, i);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            break;
+    }
+}
+
+/**
+ * @brief Sends the first message of the output queue, like the platforms do.
+ */
+static void bench_out_send() {
+    if (raw) {
+        sink = bbzoutmsg_queue_first_raw(txbuf);
+    }
+    else {
+        bbzmsg_payload_t rb;
+        bbzringbuf_bytes_construct(&rb, txbuf);
+        bbzoutmsg_queue_first(&rb);
+        sink = txbuf[0];
+    }
+    bbzoutmsg_queue_next();
+}
+
+/**
+ * @brief Serializes the received messages, like bbzoutmsg_queue_first().
+ */
+static void bench_make_payloads() {
+    bbzmsg_payload_t rb;
+    for (uint8_t i = 0; i < BENCH_BURST; ++i) {
+        bbzoutmsg_queue_destruct();
+        bbzoutmsg_queue_construct();
+        bench_out_append(i);
+        /* Distinct robots, so that broadcasts are not merged */
+        bbzoutmsg_queue_get(0)->base.rid = i;
+        bbzringbuf_bytes_construct(&rb, payloads[i]);
+        bbzoutmsg_queue_first(&rb);
+    }
+    bbzoutmsg_queue_destruct();
+    bbzoutmsg_queue_construct();
+}
+
+/**
+ * @brief Measures a burst of messages on a queue.
+ * @param[in] out 1 for the output queue, 0 for the input queue.
+ * @param[in] load The load of the queue.
+ * @return The time taken to append and remove a message (ns).
+ */
+static double bench_time(uint8_t out, bench_load load) {
+    uint32_t count = 0;
+    bbzmsg_payload_t rb;
+    clock_t start = clock();
+    double elapsed;
+    do {
+        for (uint16_t n = 0; n < 1000; ++n) {
+            for (uint8_t i = 0; i < BENCH_BURST; ++i) {
+                if (out) {
+                    bench_out_append(i);
+                }
+                else if (raw) {
+                    bbzinmsg_queue_append_raw(payloads[i], BENCH_PAYLOAD_SIZE);
+                }
+                else {
+                    bbzringbuf_bytes_construct(&rb, payloads[i]);
+                    rb.dataend = BENCH_PAYLOAD_SIZE;
+                    bbzinmsg_queue_append(&rb);
+                }
+                /* A full queue stays full ; the other one is drained after the burst */
+                if (load == BENCH_LOAD_FULL && i % 2) {
+                    if (out) bench_out_send();
+                    else sink = bbzinmsg_queue_extract()->type;
+                }
+            }
+            if (load == BENCH_LOAD_FILL) {
+                if (out) while (bbzoutmsg_queue_size() > 0) bench_out_send();
+                else while (!bbzinmsg_queue_isempty()) sink = bbzinmsg_queue_extract()->type;
+            }
+        }
+        count += 1000 * BENCH_BURST;
+        elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < BENCH_MIN_TIME);
+    return elapsed * 1e9 / count;
+}
+
+/**
+ * @brief Prints the size of typical messages in each encoding.
+ */
+static void bench_sizes() {
+    static const char* names[] = {
+        "broadcast (small int)", "broadcast (string)", "broadcast (large int)",
+        "vstig put (small int)", "vstig put (robot 300)", "swarm"
+    };
+    uint8_t buf[BBZMSG_COMPACT_MAX_SIZE];
+    uint8_t raw[BBZMSG_MAX_SIZE];
+    bbzoutmsg_queue_append_broadcast(topic, value);
+    bbzoutmsg_queue_append_broadcast(topic, bbzstring_get(__BBZSTRID_put));
+    bbzoutmsg_queue_append_broadcast(topic, bbzint_new(-12345));
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 3, __BBZSTRID_put, bbzint_new(1), 7);
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 300, __BBZSTRID_put, value, 7);
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    bbzoutmsg_queue_append_swarm(3, 1, 7);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    printf("%-24s %12s %12s %12s\n", "Message", "Fixed (B)", "Compact (B)", "Sent (B)");
+    for (uint8_t i = 0; bbzoutmsg_queue_size() > 0; ++i) {
+        const bbzmsg_t* msg = bbzoutmsg_queue_get(0);
+        printf("%-24s %12u %12u %12u\n", names[i], BBZMSG_SIZE(msg->type),
+               bbzmsg_compact_put(buf, msg), bbzoutmsg_queue_first_raw(raw));
+        bbzoutmsg_queue_next();
+    }
+    printf("\n");
+}
+
+int main() {
+    vm = &vmObj;
+    bbzvm_construct(42);
+    value = bbzint_new(42);
+    topic = bbzstring_get(__BBZSTRID_count);
+    bench_sizes();
+    bench_make_payloads();
+    printf("Queue capacity: %u (out), %u (in) messages, bursts of %u\n",
+           BBZOUTMSG_QUEUE_CAP, BBZINMSG_QUEUE_CAP, BENCH_BURST);
+    printf("%8s %16s %16s\n", "Queue", "Filling (ns)", "Full (ns)");
+    for (uint8_t out = 1; out != (uint8_t)-1; --out) {
+        for (raw = 0; raw < 2; ++raw) {
+            double ns[BENCH_LOAD_COUNT];
+            for (uint8_t load = 0; load < BENCH_LOAD_COUNT; ++load) {
+                ns[load] = bench_time(out, (bench_load)load);
+                if (out) while (bbzoutmsg_queue_size() > 0) bbzoutmsg_queue_next();
+                else while (!bbzinmsg_queue_isempty()) bbzinmsg_queue_extract();
+            }
+            printf("%8s %16.1f %16.1f\n",
+                   out ? (raw ? "out raw" : "out") : (raw ? "in raw" : "in"),
+                   ns[BENCH_LOAD_FILL], ns[BENCH_LOAD_FULL]);
+        }
+    }
+    bbzvm_destruct();
+    return 0;
+}
+#else // !BBZ_DISABLE_MESSAGES && !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS
+int main() {
+    fprintf(stderr, "benchmsgs requires messages, neighbors and virtual stigmergies.\n");
+    return 1;
+}
+#endif // !BBZ_DISABLE_MESSAGES && !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS
@@ -0,0 +1,134 @@
+/**
+ * @file benchtable.c
+ * @brief Host benchmark of table lookups and assignments.
+ * @details Fills tables of 8, 32 and 128 entries and prints the time
+ * taken by a lookup of a key in the table, a lookup of a key not in the
+ * table and an assignment to an existing key.
+ *
+ * Keys are integers, which are hashed and compared like the string IDs
+ * of global symbols, but do not take room in the heap.
+ *
+ * The layout being measured depends on BBZ_HASHED_TABLES; build the
+ * library with and without it to compare them.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <bittybuzz/bbzvm.h>
+
+/**
+ * @brief Minimum time spent on each measurement (s).
+ */
+#define BENCH_MIN_TIME 0.2
+
+/**
+ * @brief Number of operations between two checks of the time.
+ */
+#define BENCH_BATCH 10000
+
+/**
+ * @brief Largest table size.
+ */
+#define BENCH_MAX_SIZE 128
+
+/**
+ * @brief Number of keys never put in the tables.
+ */
+#define BENCH_MISS_KEYS 8
+
+/**
+ * @brief First integer used as a key.
+ */
+#define BENCH_FIRST_KEY 1000
+
+/**
+ * @brief Operations measured by the benchmark.
+ */
+typedef enum {
+    BENCH_OP_GET_HIT = 0, /**< @brief Lookup of a key in the table. */
+    BENCH_OP_GET_MISS,    /**< @brief Lookup of a key not in the table. */
+    BENCH_OP_SET,         /**< @brief Assignment to a key in the table. */
+    BENCH_OP_COUNT
+} bench_op;
+
+static const uint8_t sizes[] = { 8, 32, BENCH_MAX_SIZE };
+
+static bbzvm_t vmObj;
+
+/**
+ * @brief Keys of the tables, then keys not in the tables.
+ */
+static bbzheap_idx_t keys[BENCH_MAX_SIZE + BENCH_MISS_KEYS];
+
+/**
+ * @brief Prevents the compiler from removing lookups.
+ */
+static volatile bbzheap_idx_t sink;
+
+/**
+ * @brief Measures an operation on a table.
+ * @param[in] t The table.
+ * @param[in] sz The number of entries of the table.
+ * @param[in] op The operation.
+ * @return The time taken by one operation (ns).
+ */
+static double bench_op_time(bbzheap_idx_t t, uint8_t sz, bench_op op) {
+    uint32_t count = 0;
+    clock_t start = clock();
+    double elapsed;
+    bbzheap_idx_t v = bbzint_new(1);
+    do {
+        for (uint16_t n = 0; n < BENCH_BATCH; ++n) {
+            uint8_t i = (uint8_t)(n % sz);
+            switch (op) {
+                case BENCH_OP_GET_HIT:
+                    bbztable_get(t, keys[i], &v);
+                    break;
+                case BENCH_OP_GET_MISS:
+                    bbztable_get(t, keys[BENCH_MAX_SIZE + i % BENCH_MISS_KEYS], &v);
+                    break;
+                default:
+                    bbztable_set(t, keys[i], v);
+                    break;
+            }
+            sink = v;
+        }
+        count += BENCH_BATCH;
+        elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < BENCH_MIN_TIME);
+    return elapsed * 1e9 / count;
+}
+
+int main() {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    for (uint16_t i = 0; i < BENCH_MAX_SIZE + BENCH_MISS_KEYS; ++i) {
+        keys[i] = bbzint_new(BENCH_FIRST_KEY + i);
+    }
+#ifdef BBZ_HASHED_TABLES
+    printf("Table layout: hashed\n");
+#else
+    printf("Table layout: linear\n");
+#endif // BBZ_HASHED_TABLES
+    printf("%8s %16s %16s %16s\n", "Entries", "Get (ns)", "Get miss (ns)", "Set (ns)");
+    for (uint8_t s = 0; s < sizeof(sizes) / sizeof(*sizes); ++s) {
+        bbzvm_pusht();
+        bbzheap_idx_t t = bbzvm_stack_at(0);
+        for (uint8_t i = 0; i < sizes[s]; ++i) {
+            if (!bbztable_set(t, keys[i], bbzint_new(i))) {
+                printf("%8u %16s\n", sizes[s], "(out of memory)");
+                return 1;
+            }
+        }
+        double ns[BENCH_OP_COUNT];
+        for (uint8_t op = 0; op < BENCH_OP_COUNT; ++op) {
+            ns[op] = bench_op_time(t, sizes[s], (bench_op)op);
+        }
+        printf("%8u %16.1f %16.1f %16.1f\n", sizes[s],
+               ns[BENCH_OP_GET_HIT], ns[BENCH_OP_GET_MISS], ns[BENCH_OP_SET]);
+        bbzvm_pop();
+        bbzvm_gc();
+    }
+    bbzvm_destruct();
+    return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file benchvm.c
+ * @brief Host benchmark of the VM's instruction throughput.
+ * @details Runs BittyBuzz objects (.bbo) and prints the number of
+ * instructions executed per second when garbage is collected before every
+ * instruction (the behavior without BBZ_LAZY_GC), stepping the VM one
+ * instruction at a time, and when the VM decides by itself when to
+ * collect garbage, running instructions in batches with bbzvm_run() and
+ * bbzvm_run_call().
+ *
+ * Usage: <code>benchvm [script.bbo ...]</code>. Without arguments, the
+ * scripts of the testing resources are used. User names in the generated
+ * .bst file found next to a script are registered as C closures that do
+ * nothing.
+ *
+ * Each run executes the script to completion, then calls its global
+ * <code>init</code> closure once and its <code>step</code> closure
+ * BENCH_STEP_CALLS times, if they exist.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <bittybuzz/bbzvm.h>
+
+#include "testingbcode.h"
+
+/**
+ * @brief Minimum time spent running each script in each mode (s).
+ */
+#define BENCH_MIN_TIME 0.5
+
+/**
+ * @brief Number of calls to the script's 'step' closure per run.
+ */
+#define BENCH_STEP_CALLS 100
+
+/**
+ * @brief Block pointer argument of bench_step() outside of closure calls.
+ */
+#define BENCH_NO_CALL INT16_MIN
+
+/**
+ * @brief Garbage collection modes compared by the benchmark.
+ */
+typedef enum {
+    BENCH_GC_EVERY_STEP = 0, /**< @brief Collect before every instruction, step by step. */
+    BENCH_GC_VM,             /**< @brief Let the VM decide, run in batches. */
+    BENCH_GC_COUNT
+} bench_gc_mode;
+
+static const char* default_scripts[] = {
+    "resources/2_IfTest.bbo",
+    "resources/3_test1.bbo",
+    "resources/4_AllFeaturesTest.bbo",
+    "resources/swarm.bbo",
+    NULL
+};
+
+static bbzvm_t vmObj;
+static uint8_t* bcode;
+static uint16_t bcode_size;
+static bench_gc_mode gc_mode;
+static uint32_t instr_count;
+
+void bench_error(bbzvm_error errcode) {
+    RM_UNUSED_WARN(errcode);
+}
+
+/**
+ * @brief C closure registered for the names of the .bst file.
+ */
+void bench_dummy() {
+    bbzvm_ret0();
+}
+
+/**
+ * @brief Executes instructions according to the current mode.
+ * @param[in] blockptr The block pointer before the closure call being
+ * executed, or BENCH_NO_CALL outside of a closure call.
+ */
+static void bench_step(int16_t blockptr) {
+    if (gc_mode == BENCH_GC_EVERY_STEP) {
+        bbzvm_gc();
+        bbzvm_step();
+        ++instr_count;
+    }
+    else if (blockptr == BENCH_NO_CALL) {
+        instr_count += bbzvm_run(UINT16_MAX);
+    }
+    else {
+        instr_count += bbzvm_run_call(blockptr, UINT16_MAX);
+    }
+}
+
+/**
+ * @brief Calls a global closure without arguments, if it exists.
+ * @param[in] strid The string ID of the closure's name.
+ */
+static void bench_call(uint16_t strid) {
+    if (vm->state == BBZVM_STATE_DONE) vm->state = BBZVM_STATE_READY;
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushs(strid);
+    bbzvm_gload();
+    if (!bbztype_isclosure(*bbzheap_obj_at(bbzvm_stack_at(0)))) {
+        bbzvm_pop();
+        bbzvm_pop();
+        return;
+    }
+    bbzvm_pushi(0);
+    int16_t blockptr = vm->blockptr;
+    bbzvm_callc();
+    while (blockptr < vm->blockptr && vm->state == BBZVM_STATE_READY) {
+        bench_step(blockptr);
+    }
+    bbzvm_pop(); // Pop return value
+}
+
+/**
+ * @brief Registers the names of a string table as dummy C closures.
+ * @param[in] bst_path Path to the .bst file.
+ */
+static void bench_register_bst(const char* bst_path) {
+    FILE* f = fopen(bst_path, "r");
+    if (!f) return;
+    char line[256];
+    uint16_t strid = 0;
+    while (fgets(line, sizeof(line), f)) {
+        // The generated .bst starts with the strings of the VM itself.
+        if (strid >= _BBZSTRID_COUNT_) {
+            bbzvm_function_register(strid, bench_dummy);
+        }
+        ++strid;
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Runs a script once.
+ * @param[in] bst_path Path to the script's .bst file.
+ * @return 0 if everything went fine, 1 if the VM met an error.
+ */
+static uint8_t bench_run(const char* bst_path) {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(bench_error);
+    bbzvm_set_bcode_ptr(bcode, bcode_size);
+    bench_register_bst(bst_path);
+    while (vm->state == BBZVM_STATE_READY) {
+        bench_step(BENCH_NO_CALL);
+    }
+    bench_call(__BBZSTRID_init);
+    for (uint16_t i = 0; i < BENCH_STEP_CALLS; ++i) {
+        bench_call(__BBZSTRID_step);
+    }
+    uint8_t err = (vm->state == BBZVM_STATE_ERROR);
+    bbzvm_destruct();
+    return err;
+}
+
+/**
+ * @brief Benchmarks a script in the current mode.
+ * @param[in] bst_path Path to the script's .bst file.
+ * @return The number of instructions per second, or a negative value if
+ * the VM met an error.
+ */
+static double bench_script(const char* bst_path) {
+    instr_count = 0;
+    clock_t start = clock();
+    double elapsed;
+    do {
+        if (bench_run(bst_path)) return -1.;
+        elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < BENCH_MIN_TIME);
+    return instr_count / elapsed;
+}
+
+int main(int argc, char** argv) {
+    const char** scripts = default_scripts;
+    if (argc > 1) scripts = (const char**)argv + 1;
+#ifndef BBZ_LAZY_GC
+    printf("Note: BBZ_LAZY_GC is disabled; the VM collects garbage before every instruction in both modes.\n");
+#endif // !BBZ_LAZY_GC
+    printf("%-36s %16s %16s %8s\n", "Script", "GC/instr (i/s)", "VM GC (i/s)", "Speedup");
+    for (const char** s = scripts; *s; ++s) {
+        if (!testing_load_bcode_file(&bcode, &bcode_size, *s)) {
+            printf("%-36s %16s\n", *s, "(not found)");
+            continue;
+        }
+        char bst_path[1024];
+        strncpy(bst_path, *s, sizeof(bst_path) - 5);
+        bst_path[sizeof(bst_path) - 5] = 0;
+        char* ext = strrchr(bst_path, '.');
+        if (ext) strcpy(ext, ".bst");
+        double ips[BENCH_GC_COUNT];
+        for (gc_mode = 0; gc_mode < BENCH_GC_COUNT; ++gc_mode) {
+            ips[gc_mode] = bench_script(bst_path);
+        }
+        if (ips[BENCH_GC_EVERY_STEP] < 0. || ips[BENCH_GC_VM] < 0.) {
+            printf("%-36s %16s\n", *s, "(VM error)");
+            continue;
+        }
+        printf("%-36s %16.0f %16.0f %7.2fx\n", *s,
+               ips[BENCH_GC_EVERY_STEP], ips[BENCH_GC_VM],
+               ips[BENCH_GC_VM] / ips[BENCH_GC_EVERY_STEP]);
+    }
+    free(bcode);
+    return 0;
+}
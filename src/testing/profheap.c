@@ -0,0 +1,229 @@
+/**
+ * @file profheap.c
+ * @brief Host heap profiler.
+ * @details Runs a BittyBuzz object (.bbo) one instruction at a time and
+ * prints, for each bytecode address (PC), the number of objects and table
+ * segments allocated by the instruction found there, followed by the
+ * counters of bbzheap_stats_get().
+ *
+ * Usage: <code>profheap script.bbo [steps]</code>. User names in the
+ * generated .bst file found next to the script are registered as C
+ * closures that do nothing, as in benchvm.
+ *
+ * The script is executed to completion, then its global <code>init</code>
+ * closure is called once and its <code>step</code> closure
+ * <code>steps</code> times (PROF_STEP_CALLS by default), if they exist.
+ * Allocations made by a C closure, including those of the Buzz closures it
+ * calls, are counted at the address of the CALLC instruction. The .basm
+ * file of the script tells which Buzz code is found at each address.
+ *
+ * Requires BBZ_HEAP_STATS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bittybuzz/bbzvm.h>
+
+#include "testingbcode.h"
+
+#ifdef BBZ_HEAP_STATS
+/**
+ * @brief Default number of calls to the script's 'step' closure.
+ */
+#define PROF_STEP_CALLS 100
+
+/**
+ * @brief Allocations made at a bytecode address.
+ */
+typedef struct {
+    uint16_t pc;      /**< @brief The bytecode address */
+    uint32_t execs;   /**< @brief Number of times the instruction was executed */
+    uint32_t objs;    /**< @brief Number of objects allocated */
+    uint32_t segs;    /**< @brief Number of table segments allocated */
+    uint32_t fails;   /**< @brief Number of failed allocations */
+} prof_site_t;
+
+static const char* instr_desc[] = {"NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB", "MUL", "DIV", "MOD", "POW",
+                                   "UNM", "LAND", "LOR", "LNOT","BAND","BOR","BNOT","LSHIFT","RSHIFT","EQ", "NEQ", "GT", "GTE", "LT", "LTE", "GLOAD", "GSTORE", "PUSHT", "TPUT",
+                                   "TGET", "CALLC", "CALLS", "PUSHF", "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE","LREMOVE",
+                                   "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "LTGETS", "ADDI", "JLT"};
+
+static bbzvm_t vmObj;
+static uint8_t* bcode;
+static uint16_t bcode_size;
+static prof_site_t* sites;
+static uint16_t last_pc;
+
+void prof_error(bbzvm_error errcode) {
+    RM_UNUSED_WARN(errcode);
+}
+
+/**
+ * @brief C closure registered for the names of the .bst file.
+ */
+void prof_dummy() {
+    bbzvm_ret0();
+}
+
+/**
+ * @brief Sums the allocation counters of the object types.
+ * @return The sum.
+ */
+static uint16_t prof_sum_objs() {
+    uint16_t n = 0;
+    for (uint8_t t = 0; t < BBZHEAP_STATS_TSEG; ++t) n += vm->heap.stats.allocs[t];
+    return n;
+}
+
+/**
+ * @brief Sums the failed allocation counters, segments included.
+ * @return The sum.
+ */
+static uint16_t prof_sum_fails() {
+    uint16_t n = 0;
+    for (uint8_t t = 0; t <= BBZHEAP_STATS_TSEG; ++t) n += vm->heap.stats.allocfails[t];
+    return n;
+}
+
+/**
+ * @brief Executes one instruction and counts its allocations.
+ */
+static void prof_step() {
+    uint16_t pc = last_pc = vm->pc;
+    uint16_t objs = prof_sum_objs(),
+             segs = vm->heap.stats.allocs[BBZHEAP_STATS_TSEG],
+             fails = prof_sum_fails();
+    bbzvm_step();
+    if (pc >= bcode_size) return;
+    ++sites[pc].execs;
+    sites[pc].objs += (uint16_t)(prof_sum_objs() - objs);
+    sites[pc].segs += (uint16_t)(vm->heap.stats.allocs[BBZHEAP_STATS_TSEG] - segs);
+    sites[pc].fails += (uint16_t)(prof_sum_fails() - fails);
+}
+
+/**
+ * @brief Calls a global closure without arguments, if it exists.
+ * @param[in] strid The string ID of the closure's name.
+ */
+static void prof_call(uint16_t strid) {
+    if (vm->state == BBZVM_STATE_DONE) vm->state = BBZVM_STATE_READY;
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushs(strid);
+    bbzvm_gload();
+    if (!bbztype_isclosure(*bbzheap_obj_at(bbzvm_stack_at(0)))) {
+        bbzvm_pop();
+        bbzvm_pop();
+        return;
+    }
+    bbzvm_pushi(0);
+    int16_t blockptr = vm->blockptr;
+    bbzvm_callc();
+    while (blockptr < vm->blockptr && vm->state == BBZVM_STATE_READY) {
+        prof_step();
+    }
+    bbzvm_pop(); // Pop return value
+}
+
+/**
+ * @brief Registers the names of a string table as dummy C closures.
+ * @param[in] bst_path Path to the .bst file.
+ */
+static void prof_register_bst(const char* bst_path) {
+    FILE* f = fopen(bst_path, "r");
+    if (!f) return;
+    char line[256];
+    uint16_t strid = 0;
+    while (fgets(line, sizeof(line), f)) {
+        // The generated .bst starts with the strings of the VM itself.
+        if (strid >= _BBZSTRID_COUNT_) {
+            bbzvm_function_register(strid, prof_dummy);
+        }
+        ++strid;
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Orders allocation sites by decreasing number of allocations.
+ */
+static int prof_site_cmp(const void* a, const void* b) {
+    const prof_site_t* x = (const prof_site_t*)a;
+    const prof_site_t* y = (const prof_site_t*)b;
+    uint32_t nx = x->objs + x->segs, ny = y->objs + y->segs;
+    if (nx != ny) return nx < ny ? 1 : -1;
+    return (int)x->pc - (int)y->pc;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s script.bbo [steps]\n", argv[0]);
+        return 1;
+    }
+    uint32_t steps = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : PROF_STEP_CALLS;
+    if (!testing_load_bcode_file(&bcode, &bcode_size, argv[1])) {
+        fprintf(stderr, "%s: not found\n", argv[1]);
+        return 1;
+    }
+    char bst_path[1024];
+    strncpy(bst_path, argv[1], sizeof(bst_path) - 5);
+    bst_path[sizeof(bst_path) - 5] = 0;
+    char* ext = strrchr(bst_path, '.');
+    if (ext) strcpy(ext, ".bst");
+    sites = calloc(bcode_size, sizeof(prof_site_t));
+    for (uint16_t i = 0; i < bcode_size; ++i) sites[i].pc = i;
+
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(prof_error);
+    bbzvm_set_bcode_ptr(bcode, bcode_size);
+    prof_register_bst(bst_path);
+    while (vm->state == BBZVM_STATE_READY) {
+        prof_step();
+    }
+    prof_call(__BBZSTRID_init);
+    for (uint32_t i = 0; i < steps; ++i) {
+        prof_call(__BBZSTRID_step);
+    }
+
+    // Allocation sites
+    qsort(sites, bcode_size, sizeof(prof_site_t), prof_site_cmp);
+    printf("%6s %-8s %10s %10s %10s %8s %10s\n", "PC", "Instr", "Execs", "Objects", "Segments", "Failed", "Bytes");
+    for (uint16_t i = 0; i < bcode_size && sites[i].objs + sites[i].segs + sites[i].fails > 0; ++i) {
+        uint8_t instr = bcode[sites[i].pc];
+        printf("%6u %-8s %10u %10u %10u %8u %10lu\n",
+               sites[i].pc,
+               instr < sizeof(instr_desc) / sizeof(*instr_desc) ? instr_desc[instr] : "?",
+               sites[i].execs, sites[i].objs, sites[i].segs, sites[i].fails,
+               (unsigned long)sites[i].objs * sizeof(bbzobj_t) +
+               (unsigned long)sites[i].segs * sizeof(bbzheap_tseg_t));
+    }
+
+    // Counters
+    bbzheap_stats_t s;
+    bbzheap_stats_get(&s);
+    printf("\nLive objects:   %u (peak %u, %zu B each)\n", s.objs, s.objspeak, sizeof(bbzobj_t));
+    printf("Live segments:  %u (peak %u, %zu B each)\n", s.segs, s.segspeak, sizeof(bbzheap_tseg_t));
+    printf("Unclaimed (B):  %u/%u\n", s.gap, BBZHEAP_SIZE);
+    printf("Largest table:  %u segment(s)\n", s.tablemax);
+    printf("Collections:    %u (last reclaimed %u objects, max %u)\n", s.gcs, s.gclast, s.gcmax);
+    printf("%-10s %10s %8s\n", "Type", "Allocs", "Failed");
+    static const char* types[] = { "nil", "integer", "float", "string", "table", "closure", "userdata", "segment" };
+    for (uint8_t t = 0; t <= BBZHEAP_STATS_TSEG; ++t) {
+        printf("%-10s %10u %8u\n", types[t], s.allocs[t], s.allocfails[t]);
+    }
+    if (vm->state == BBZVM_STATE_ERROR) {
+        printf("\nThe VM stopped with error %d at PC %d.\n", vm->error, last_pc);
+    }
+
+    bbzvm_destruct();
+    free(sites);
+    free(bcode);
+    return vm->state == BBZVM_STATE_ERROR;
+}
+#else // BBZ_HEAP_STATS
+int main() {
+    fprintf(stderr, "profheap requires BBZ_HEAP_STATS.\n");
+    return 1;
+}
+#endif // BBZ_HEAP_STATS
@@ -1,6 +1,6 @@
 #include <bittybuzz/bbzdarray.h>
 
-#define NUM_TEST_CASES 10
+#define NUM_TEST_CASES 11
 #define TEST_MODULE darray
 #include "testingconfig.h"
 
@@ -235,6 +235,103 @@ TEST(da_destroy) {
     ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(darray)));
 }
 
+/**
+ * @brief Counts the valid array segments of the heap.
+ */
+static uint16_t da_segs() {
+    uint16_t n = 0;
+    for (uint8_t* p = vm->heap.ltseg; p < vm->heap.data + BBZHEAP_SIZE; p += sizeof(bbzheap_aseg_t)) {
+        if (bbzheap_aseg_isvalid(*(bbzheap_aseg_t*)p)) ++n;
+    }
+    return n;
+}
+
+/**
+ * @brief Number of segments of a dynamic array of some size.
+ * @details The header only takes slots of the first segment once the
+ * elements do not fit in it.
+ * @param[in] sz The size of the dynamic array.
+ */
+#define da_segs_for(sz) ((sz) <= BBZHEAP_ELEMS_PER_ASEG ? 1 :            \
+                         ((sz) + BBZDARRAY_HDR_LEN + BBZHEAP_ELEMS_PER_ASEG - 1) / BBZHEAP_ELEMS_PER_ASEG)
+
+TEST(da_push_pop) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+    bbzheap_clear();
+
+    uint16_t darray;
+    REQUIRE(bbzdarray_new(&darray));
+    ASSERT_EQUAL(da_segs(), 1);
+
+    const uint16_t n = 3 * BBZHEAP_ELEMS_PER_ASEG;
+    uint16_t o3;
+    bbzheap_idx_t v;
+    for (uint16_t i = 0; i < n; ++i) {
+        REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o3));
+        ((bbzint_t*)bbzheap_obj_at(o3))->value = i;
+        REQUIRE(bbzdarray_push(darray, o3));
+        ASSERT_EQUAL(bbzdarray_size(darray), i + 1);
+        REQUIRE(bbzdarray_get(darray, i, &v));
+        ASSERT_EQUAL(v, o3);
+        // A full first segment has no header
+        ASSERT_EQUAL(da_segs(), da_segs_for(i + 1));
+    }
+    ASSERT(!bbzdarray_get(darray, n, &v));
+    for (uint16_t i = 0; i < n; ++i) {
+        REQUIRE(bbzdarray_get(darray, i, &v));
+        ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, i);
+    }
+
+    // The last element replaces the removed one
+    ASSERT(!bbzdarray_remove(darray, n));
+    ASSERT(bbzdarray_remove(darray, 0));
+    ASSERT_EQUAL(bbzdarray_size(darray), n - 1);
+    REQUIRE(bbzdarray_get(darray, 0, &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, n - 1);
+
+    // Popping frees the segments that become empty
+    while (bbzdarray_size(darray) > 1) {
+        ASSERT(bbzdarray_pop(darray));
+        uint16_t sz = bbzdarray_size(darray);
+        ASSERT_EQUAL(da_segs(), da_segs_for(sz));
+        REQUIRE(bbzdarray_get(darray, sz - 1, &v));
+        ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, sz == 1 ? n - 1 : sz - 1);
+    }
+    ASSERT(bbzdarray_pop(darray));
+    ASSERT(!bbzdarray_pop(darray));
+    ASSERT_EQUAL(da_segs(), 1);
+
+    // The array grows again after being cleared
+    for (uint16_t i = 0; i < n; ++i) {
+        REQUIRE(bbzdarray_push(darray, o3));
+    }
+    bbzdarray_clear(darray);
+    ASSERT_EQUAL(bbzdarray_size(darray), 0);
+    ASSERT_EQUAL(da_segs(), 1);
+    REQUIRE(bbzdarray_push(darray, o3));
+    REQUIRE(bbzdarray_get(darray, 0, &v));
+    ASSERT_EQUAL(v, o3);
+
+    // Elements moved between the header slots and the second segment keep
+    // their order
+    bbzdarray_clear(darray);
+    for (uint16_t r = 0; r < 2; ++r) {
+        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG + 1; ++i) {
+            REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o3));
+            ((bbzint_t*)bbzheap_obj_at(o3))->value = i;
+            REQUIRE(bbzdarray_push(darray, o3));
+        }
+        REQUIRE(bbzdarray_pop(darray));
+        ASSERT_EQUAL(da_segs(), 1);
+        for (uint16_t i = 0; i < BBZHEAP_ELEMS_PER_ASEG; ++i) {
+            REQUIRE(bbzdarray_get(darray, i, &v));
+            ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, i);
+        }
+        bbzdarray_clear(darray);
+    }
+}
+
 TEST_LIST {
     ADD_TEST(da_new);
     ADD_TEST(da_push);
@@ -246,4 +343,5 @@ TEST_LIST {
     ADD_TEST(da_clone);
     ADD_TEST(da_foreach);
     ADD_TEST(da_destroy);
+    ADD_TEST(da_push_pop);
 };
\ No newline at end of file
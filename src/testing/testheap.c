@@ -1,6 +1,6 @@
 #include <bittybuzz/bbzvm.h>
 
-#define NUM_TEST_CASES 5
+#define NUM_TEST_CASES 15
 #define TEST_MODULE heap
 #include "testingconfig.h"
 
@@ -159,7 +159,898 @@ TEST(clear) {
     bbzheap_clear();
 }
 
+TEST(free_lists) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+
+    // A freed slot is the next one allocated
+    bbzheap_idx_t a, b, c;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &a));
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &b));
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &c));
+    bbzheap_obj_free(b);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(b)));
+    bbzheap_obj_free(b); // Freeing twice has no effect
+    bbzheap_idx_t o;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &o));
+#ifndef BBZ_GENERATIONAL_GC // Which takes new objects past the nursery first
+    ASSERT_EQUAL(o, b);
+#endif // !BBZ_GENERATIONAL_GC
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &o));
+    ASSERT(o != a && o != b && o != c);
+
+    // Same for segments
+    bbzheap_idx_t s1, s2;
+    REQUIRE(bbzheap_tseg_alloc(&s1));
+    REQUIRE(bbzheap_tseg_alloc(&s2));
+    bbzheap_tseg_free(bbzheap_tseg_at(s1));
+    ASSERT(!bbzheap_tseg_isvalid(*bbzheap_tseg_at(s1)));
+    REQUIRE(bbzheap_tseg_alloc(&o));
+#ifndef BBZ_GENERATIONAL_GC
+    ASSERT_EQUAL(o, s1);
+#endif // !BBZ_GENERATIONAL_GC
+
+    // The garbage collector frees what is unreachable, lowest slots first
+    bbzvm_pushu(0);
+    bbzheap_idx_t kept = bbzvm_stack_at(0);
+    bbzvm_gc();
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(kept)));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(a)));
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &o));
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(kept)));
+    ASSERT(o != kept);
+#ifndef BBZ_GENERATIONAL_GC
+    for (bbzheap_idx_t i = BBZHEAP_RSV_ACTREC_MAX; i < o; ++i) {
+        ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(i)));
+    }
+#endif // !BBZ_GENERATIONAL_GC
+
+    bbzvm_destruct();
+}
+
+TEST(tables) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+
+    // Random sets, removals and lookups, compared with a plain array
+#define TABLES_NUM_KEYS 64
+    int16_t model[TABLES_NUM_KEYS] = {0}; // 0 means 'not in the table'
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+#ifdef BBZ_HASHED_TABLES
+    const uint16_t first_seg = bbzheap_obj_at(t)->t.value;
+#endif // BBZ_HASHED_TABLES
+    uint16_t rnd = 42;
+    for (uint16_t n = 0; n < 2000; ++n) {
+        rnd = (uint16_t)(rnd * 25173u + 13849u);
+        uint8_t k = (uint8_t)((rnd >> 8) % TABLES_NUM_KEYS);
+        // Keys are integers and strings alike
+        bbzheap_idx_t key = (k & 1) ? bbzint_new(k * 100) : bbzstring_get(k);
+        if (rnd & 0x8) {
+            model[k] = (int16_t)(n + 1);
+            REQUIRE(bbztable_set(t, key, bbzint_new(model[k])));
+        }
+        else {
+            model[k] = 0;
+            REQUIRE(bbztable_set(t, key, vm->nil));
+        }
+        if (n % 16 == 0) bbzvm_gc();
+    }
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    uint8_t sz = 0;
+    for (uint8_t k = 0; k < TABLES_NUM_KEYS; ++k) {
+        bbzheap_idx_t key = (k & 1) ? bbzint_new(k * 100) : bbzstring_get(k);
+        bbzheap_idx_t v;
+        if (model[k]) {
+            ++sz;
+            REQUIRE(bbztable_get(t, key, &v));
+            ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, model[k]);
+        }
+        else {
+            ASSERT(!bbztable_get(t, key, &v));
+        }
+    }
+    ASSERT_EQUAL(bbztable_size(t), sz);
+#ifdef BBZ_HASHED_TABLES
+    // Rehashing keeps the first segment, which identifies the table
+    ASSERT_EQUAL(bbzheap_obj_at(t)->t.value, first_seg);
+#endif // BBZ_HASHED_TABLES
+
+    bbzvm_destruct();
+}
+
+void table_new_from_fun1() { bbzvm_ret0(); }
+void table_new_from_fun2() { bbzvm_ret0(); }
+
+/**
+ * @brief Counts the segments of a table.
+ */
+static uint16_t table_new_from_segs(bbzheap_idx_t t) {
+    uint16_t n = 1;
+    bbzheap_tseg_t* sd = bbzheap_tseg_at(bbzheap_obj_at(t)->t.value);
+    while (bbzheap_tseg_hasnext(sd)) {
+        sd = bbzheap_tseg_at(bbzheap_tseg_next_get(sd));
+        ++n;
+    }
+    return n;
+}
+
+TEST(table_new_from) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+
+    // A table with closures and data
+#define TABLE_NEW_FROM_N 12
+    bbztable_init_t init[TABLE_NEW_FROM_N];
+    for (uint8_t i = 0; i < TABLE_NEW_FROM_N; ++i) {
+        init[i].strid = i;
+        init[i].fun = (i % 3 == 0) ? NULL : (i % 3 == 1) ? table_new_from_fun1 : table_new_from_fun2;
+        init[i].data = (i % 3 == 0) ? bbzint_new(i) : 0;
+    }
+    bbzheap_idx_t t = bbztable_new_from(init, TABLE_NEW_FROM_N);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    bbzvm_push(t);
+    ASSERT_EQUAL(bbztable_size(t), TABLE_NEW_FROM_N);
+    for (uint8_t i = 0; i < TABLE_NEW_FROM_N; ++i) {
+        bbzheap_idx_t v;
+        REQUIRE(bbztable_get(t, bbzstring_get(i), &v));
+        if (i % 3 == 0) {
+            ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, i);
+        }
+        else {
+            ASSERT(bbztype_isclosure(*bbzheap_obj_at(v)));
+        }
+    }
+
+    // It has the segments it needs, and no more
+#ifdef BBZ_HASHED_TABLES
+    uint16_t nseg = 1;
+    while ((uint16_t)(BBZHEAP_ELEMS_PER_TSEG * nseg) * 4 / 5 < TABLE_NEW_FROM_N) nseg *= 2;
+#else // BBZ_HASHED_TABLES
+    uint16_t nseg = (TABLE_NEW_FROM_N + BBZHEAP_ELEMS_PER_TSEG - 1) / BBZHEAP_ELEMS_PER_TSEG;
+#endif // BBZ_HASHED_TABLES
+    ASSERT_EQUAL(table_new_from_segs(t), nseg);
+
+    // A copy shares the closures and can be changed without allocating
+    bbzheap_idx_t c = bbztable_new_copy(t);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    bbzvm_push(c);
+    ASSERT(c != t);
+    ASSERT_EQUAL(table_new_from_segs(c), nseg);
+    ASSERT_EQUAL(bbztable_size(c), TABLE_NEW_FROM_N);
+    for (uint8_t i = 1; i < TABLE_NEW_FROM_N; i += 3) {
+        bbzheap_idx_t v1, v2;
+        REQUIRE(bbztable_get(t, bbzstring_get(i), &v1));
+        REQUIRE(bbztable_get(c, bbzstring_get(i), &v2));
+        ASSERT_EQUAL(v1, v2);
+    }
+    bbzheap_idx_t k = bbzstring_get(0);
+    bbzheap_idx_t v = bbzint_new(-1);
+    REQUIRE(bbztable_set(c, k, v));
+    ASSERT_EQUAL(table_new_from_segs(c), nseg);
+    REQUIRE(bbztable_get(c, k, &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, -1);
+    REQUIRE(bbztable_get(t, k, &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, 0);
+
+    // Both survive a collection
+    bbzvm_gc();
+    ASSERT_EQUAL(bbztable_size(bbzvm_stack_at(0)), TABLE_NEW_FROM_N);
+    ASSERT_EQUAL(bbztable_size(bbzvm_stack_at(1)), TABLE_NEW_FROM_N);
+
+    bbzvm_destruct();
+}
+
+TEST(deep_marking) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+
+    // A chain of nested tables, deeper than the mark stack
+#define DEEP_MARKING_DEPTH (BBZHEAP_GCMARK_DEPTH * 3)
+    bbzheap_idx_t chain[DEEP_MARKING_DEPTH];
+    bbzvm_pusht();
+    chain[0] = bbzvm_stack_at(0);
+    for (uint16_t i = 1; i < DEEP_MARKING_DEPTH; ++i) {
+        bbzvm_pusht();
+        chain[i] = bbzvm_stack_at(0);
+        REQUIRE(bbztable_set(chain[i-1], bbzint_new(0), chain[i]));
+        bbzvm_pop();
+    }
+
+    // A table of tables holding tables, wider than the mark stack
+#define DEEP_MARKING_WIDTH (BBZHEAP_GCMARK_DEPTH + 4)
+    bbzheap_idx_t leaves[DEEP_MARKING_WIDTH];
+    bbzvm_pusht();
+    bbzheap_idx_t wide = bbzvm_stack_at(0);
+    for (uint16_t i = 0; i < DEEP_MARKING_WIDTH; ++i) {
+        bbzvm_pusht();
+        REQUIRE(bbztable_set(wide, bbzint_new(i), bbzvm_stack_at(0)));
+        bbzvm_pusht();
+        leaves[i] = bbzvm_stack_at(0);
+        REQUIRE(bbztable_set(bbzvm_stack_at(1), bbzint_new(0), leaves[i]));
+        bbzvm_pop();
+        bbzvm_pop();
+    }
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+
+    // Everything is kept, even what did not fit in the mark stack
+    bbzvm_gc();
+    ASSERT(vm->heap.gcoverflows > 0);
+    for (uint16_t i = 0; i < DEEP_MARKING_DEPTH; ++i) {
+        ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(chain[i])));
+        ASSERT(bbztype_istable(*bbzheap_obj_at(chain[i])));
+    }
+    for (uint16_t i = 0; i < DEEP_MARKING_WIDTH; ++i) {
+        ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(leaves[i])));
+        ASSERT(bbztype_istable(*bbzheap_obj_at(leaves[i])));
+    }
+    bbzheap_idx_t v;
+    REQUIRE(bbztable_get(chain[DEEP_MARKING_DEPTH-2], bbzint_new(0), &v));
+    ASSERT_EQUAL(v, chain[DEEP_MARKING_DEPTH-1]);
+
+    // ...and collected once unreachable
+    bbzvm_pop();
+    bbzvm_pop();
+    bbzvm_gc();
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(chain[DEEP_MARKING_DEPTH-1])));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(leaves[DEEP_MARKING_WIDTH-1])));
+
+    bbzvm_destruct();
+}
+
+#ifdef BBZ_LAZY_GC
+TEST(lazy_gc) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+    ASSERT(!bbzheap_gc_isdue());
+
+    // Keep an integer on the stack, then fill the heap with garbage
+    // without ever reaching a safe point.
+    bbzvm_pushi(42);
+    bbzheap_idx_t kept = bbzvm_stack_at(0);
+    bbzheap_idx_t o;
+    uint16_t n = 0;
+    while (bbzheap_obj_alloc(BBZTYPE_INT, &o)) {
+        bbzheap_obj_at(o)->i.value = n++;
+    }
+    REQUIRE(n > 0);
+    ASSERT(bbzheap_gc_isdue());
+
+    // The garbage becomes collectable after a safe point.
+    bbzheap_gc_safepoint();
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o));
+    ASSERT(bbztype_isint(*bbzheap_obj_at(kept)));
+    ASSERT_EQUAL(bbzheap_obj_at(kept)->i.value, 42);
+
+    bbzvm_gc();
+    ASSERT(!bbzheap_gc_isdue());
+
+    bbzvm_destruct();
+}
+#endif // BBZ_LAZY_GC
+
+#ifdef BBZ_INCREMENTAL_GC
+/**
+ * @brief Returns non-zero if an object is marked by the garbage collector.
+ */
+#define HAS_GCMARK(i) ((bbzheap_obj_at(i)->mdata & BBZHEAP_MASK_GCMARK) != 0)
+
+TEST(incremental_gc) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+    ASSERT_EQUAL(vm->heap.gcphase, BBZHEAP_GC_IDLE);
+
+    // kept (on the stack) -> src -> o
+    bbzvm_pusht();
+    bbzheap_idx_t kept = bbzvm_stack_at(0);
+    bbzvm_pusht();
+    bbzheap_idx_t src = bbzvm_stack_at(0);
+    REQUIRE(bbztable_set(kept, bbzint_new(0), src));
+    bbzvm_pusht();
+    bbzheap_idx_t o = bbzvm_stack_at(0);
+    REQUIRE(bbztable_set(src, bbzint_new(0), o));
+    bbzvm_pop();
+    bbzvm_pop();
+
+    // A full collection aborts the running incremental one
+    ASSERT(bbzvm_gc_slice(1));
+    ASSERT_EQUAL(vm->heap.gcphase, BBZHEAP_GC_CLEAR);
+    bbzvm_gc();
+    ASSERT_EQUAL(vm->heap.gcphase, BBZHEAP_GC_IDLE);
+
+    // A table nobody refers to
+    bbzvm_pusht();
+    bbzheap_idx_t garbage = bbzvm_stack_at(0);
+    bbzvm_pop();
+
+    // Run until kept is scanned but src is not
+    uint16_t slices = 0;
+    vm->heap.gcmaxwork = 0;
+    while (!HAS_GCMARK(src) || vm->heap.gcphase != BBZHEAP_GC_MARK) {
+        REQUIRE(bbzvm_gc_slice(1));
+        ++slices;
+    }
+    ASSERT(!HAS_GCMARK(o));
+
+    // Move o from src to kept; the write barrier keeps it
+    REQUIRE(bbztable_set(kept, bbzint_new(1), o));
+    REQUIRE(bbztable_set(src, bbzint_new(0), vm->nil));
+    ASSERT(HAS_GCMARK(o));
+
+    // Objects allocated while marking are kept until the next collection
+    bbzvm_pusht();
+    bbzheap_idx_t fresh = bbzvm_stack_at(0);
+    bbzvm_pop();
+
+    while (bbzvm_gc_slice(1)) ++slices;
+    ASSERT(slices > 1);
+    ASSERT_EQUAL(vm->heap.gccycles, 1);
+    ASSERT(vm->heap.gcmaxwork >= 1);
+    ASSERT(vm->heap.gcmaxwork <= 1 + bbzvm_stack_size() + BBZLSTACK_SIZE);
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(kept)));
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(src)));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(o)));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(fresh)));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(garbage)));
+    bbzheap_idx_t v;
+    REQUIRE(bbztable_get(kept, bbzint_new(1), &v));
+    ASSERT_EQUAL(v, o);
+
+    // A single slice with a large enough budget runs a whole collection
+    ASSERT(!bbzvm_gc_slice(0xFFFF));
+    ASSERT_EQUAL(vm->heap.gccycles, 2);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(fresh)));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(o)));
+
+    bbzvm_destruct();
+}
+#endif // BBZ_INCREMENTAL_GC
+
+#ifdef BBZ_GENERATIONAL_GC
+TEST(generational_gc) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_pusht();
+    bbzheap_idx_t old = bbzvm_stack_at(0);
+    bbzvm_gc();
+    ASSERT(!bbzheap_obj_isyoung(old));
+    ASSERT(!bbzheap_gc_minor_isdue());
+    ASSERT_EQUAL(vm->heap.remnum, 0);
+
+    // A temporary, an object on the stack, a table with an integer in it,
+    // and an integer stored in the older table
+    bbzheap_idx_t tmp, kept, t, inner, stored;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &tmp));
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &kept));
+    bbzheap_obj_at(kept)->i.value = 10000;
+    bbzvm_push(kept);
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_TABLE, &t));
+    bbzheap_idx_t ts = bbzheap_obj_at(t)->t.value;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &inner));
+    REQUIRE(bbztable_set(t, bbzint_new(0), inner));
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &stored));
+    bbzheap_obj_at(stored)->i.value = 10001;
+    REQUIRE(bbztable_set(old, bbzint_new(0), stored));
+    ASSERT(bbzheap_obj_isyoung(tmp));
+    ASSERT(bbzheap_obj_isyoung(stored));
+    // Without immediate integers, the keys are young objects too
+    uint8_t remembered = 0;
+    for (uint8_t i = 0; i < vm->heap.remnum; ++i) {
+        if (vm->heap.remset[i] == stored) remembered = 1;
+    }
+    ASSERT(remembered);
+
+    bbzvm_gc_minor();
+    ASSERT_EQUAL(vm->heap.minorgcs, 1);
+    ASSERT(!bbzheap_gc_isdue());
+    ASSERT_EQUAL(vm->heap.remnum, 0);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(tmp)));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(t)));
+    ASSERT(!bbzheap_tseg_isvalid(*bbzheap_tseg_at(ts)));
+    // Stored in a table, even one that died
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(inner)));
+    ASSERT_EQUAL(bbzheap_obj_at(kept)->i.value, 10000);
+    ASSERT_EQUAL(bbzheap_obj_at(stored)->i.value, 10001);
+    bbzheap_idx_t v;
+    REQUIRE(bbztable_get(old, bbzint_new(0), &v));
+    ASSERT_EQUAL(v, stored);
+    // The survivors are promoted
+    ASSERT(!bbzheap_obj_isyoung(kept));
+    ASSERT(!bbzheap_obj_isyoung(stored));
+
+    // Older objects are only freed by a full collection
+    bbzvm_pop();
+    bbzvm_pop();
+    bbzvm_gc_minor();
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(old)));
+    ASSERT(bbzheap_obj_isvalid(*bbzheap_obj_at(stored)));
+    bbzvm_gc();
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(old)));
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(stored)));
+
+    // When the remembered set overflows, the next collection is a full one
+    bbzvm_pusht();
+    old = bbzvm_stack_at(0);
+    bbzvm_gc();
+    for (int16_t i = 0; i <= BBZHEAP_REMSET_CAP; ++i) {
+        bbzheap_idx_t o;
+        REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o));
+        bbzheap_obj_at(o)->i.value = 10000 + i;
+        REQUIRE(bbztable_set(old, bbzint_new(i), o));
+    }
+    ASSERT(vm->heap.remlost);
+    uint16_t minorgcs = vm->heap.minorgcs;
+    bbzvm_gc_minor();
+    ASSERT_EQUAL(vm->heap.minorgcs, minorgcs);
+    ASSERT(!vm->heap.remlost);
+    for (int16_t i = 0; i <= BBZHEAP_REMSET_CAP; ++i) {
+        REQUIRE(bbztable_get(old, bbzint_new(i), &v));
+        ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, 10000 + i);
+    }
+
+    bbzvm_destruct();
+}
+#endif // BBZ_GENERATIONAL_GC
+
+#ifdef BBZ_HEAP_COMPACTION
+TEST(compaction) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+
+    // A table and a key at the bottom of the heap
+    bbzvm_pusht();
+    bbzheap_idx_t root = bbzvm_stack_at(0);
+    bbzvm_pusht();
+    bbzheap_idx_t key = bbzvm_stack_at(0);
+    REQUIRE(bbztable_set(root, key, bbzint_new(7)));
+    bbzvm_pop();
+
+    // Garbage in the middle, then a table at the top
+    while ((uint16_t)(vm->heap.ltseg - vm->heap.rtobj) >= BBZHEAP_GC_WATERMARK ||
+           vm->heap.ofree != BBZHEAP_OBJ_NO_FREE ||
+           vm->heap.sfree != BBZHEAP_SEG_NO_NEXT) {
+        bbzvm_pusht();
+        REQUIRE(bbztable_set(bbzvm_stack_at(0), bbzint_new(0), bbzint_new(1)));
+        bbzvm_pop();
+    }
+    bbzheap_idx_t da;
+    REQUIRE(bbzdarray_new(&da));
+    REQUIRE(bbztable_set(root, bbzint_new(2), da));
+    for (int16_t i = 0; i < 2 * BBZHEAP_ELEMS_PER_ASEG; ++i) {
+        REQUIRE(bbzdarray_push(da, bbzint_new(i)));
+    }
+    bbzvm_pusht();
+    bbzheap_idx_t top = bbzvm_stack_at(0);
+    REQUIRE(bbztable_set(top, bbzint_new(0), bbzint_new(42)));
+    REQUIRE(bbztable_set(root, bbzint_new(1), top));
+    bbzvm_pop();
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+
+    // The garbage is freed, but the table at the top keeps the heap fragmented
+    bbzvm_gc();
+    ASSERT(bbzheap_compact_isdue());
+    uint8_t* rtobj = vm->heap.rtobj;
+    uint8_t* ltseg = vm->heap.ltseg;
+
+    bbzvm_compact();
+    ASSERT_EQUAL(vm->heap.compactions, 1);
+    ASSERT(!bbzheap_compact_isdue());
+    ASSERT(vm->heap.rtobj < rtobj);
+    ASSERT(vm->heap.ltseg > ltseg);
+
+    // The references were updated
+    ASSERT_EQUAL(bbzvm_stack_at(0), root);
+    bbzheap_idx_t v;
+    REQUIRE(bbztable_get(root, bbzint_new(1), &v));
+    ASSERT(v < top);
+    ASSERT(bbztype_istable(*bbzheap_obj_at(v)));
+    REQUIRE(bbztable_get(v, bbzint_new(0), &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, 42);
+    REQUIRE(bbztable_get(root, key, &v));
+    ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, 7);
+    // Including the last segment of a dynamic array
+    REQUIRE(bbztable_get(root, bbzint_new(2), &da));
+    ASSERT_EQUAL(bbzdarray_size(da), 2 * BBZHEAP_ELEMS_PER_ASEG);
+    REQUIRE(bbzdarray_push(da, bbzint_new(-1)));
+    ASSERT_EQUAL(bbzdarray_find(da, bbztype_cmp, bbzint_new(-1)), 2 * BBZHEAP_ELEMS_PER_ASEG);
+
+    // The heap still works
+    bbzvm_pushs(0);
+    bbzvm_pusht();
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    bbzvm_gc();
+    REQUIRE(bbztable_get(root, bbzint_new(1), &v));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(v)));
+
+    bbzvm_destruct();
+}
+#endif // BBZ_HEAP_COMPACTION
+
+#ifdef BBZ_HEAP_STATS
+TEST(heap_stats) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+    bbzheap_stats_t s0, s;
+    bbzheap_stats_get(&s0);
+
+    // A table with 3 segments and some garbage
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    for (int16_t i = 0; i < 3 * BBZHEAP_ELEMS_PER_TSEG; ++i) {
+        REQUIRE(bbztable_set(t, bbzint_new(i), bbzvm_stack_at(0)));
+    }
+    bbzvm_pusht();
+    bbzvm_pop();
+    bbzvm_pushf(bbzfloat_fromint(2));
+    bbzvm_pop();
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+
+    bbzheap_stats_get(&s);
+    ASSERT_EQUAL((uint16_t)(s.allocs[BBZTYPE_TABLE] - s0.allocs[BBZTYPE_TABLE]), 2);
+    ASSERT_EQUAL((uint16_t)(s.allocs[BBZTYPE_FLOAT] - s0.allocs[BBZTYPE_FLOAT]), 1);
+    ASSERT_EQUAL(s.allocfails[BBZTYPE_TABLE], 0);
+    ASSERT(s.tablemax >= 3);
+    ASSERT_EQUAL(s.gap, (uint16_t)(vm->heap.ltseg - vm->heap.rtobj));
+    uint16_t objs = s.objs;
+    ASSERT(objs >= s0.objs + 3);
+    ASSERT_EQUAL(s.objspeak, objs);
+    ASSERT(s.segs >= s0.segs + 4);
+
+    // The garbage is counted as reclaimed
+    bbzvm_gc();
+    bbzheap_stats_get(&s);
+    ASSERT_EQUAL((uint16_t)(s.gcs - s0.gcs), 1);
+    ASSERT_EQUAL(s.gclast, 2);
+    ASSERT(s.gcmax >= 2);
+    ASSERT_EQUAL(s.objs, objs - 2);
+    ASSERT_EQUAL(s.objspeak, objs);
+
+    // The counts match the heap
+    uint16_t n = 0;
+    for (uint16_t i = BBZHEAP_RSV_ACTREC_MAX; i < (uint16_t)(vm->heap.rtobj - vm->heap.data) / sizeof(bbzobj_t); ++i) {
+        if (bbzheap_obj_isvalid(*bbzheap_obj_at(i))) ++n;
+    }
+    ASSERT_EQUAL(s.objs, n);
+    n = 0;
+    for (uint16_t i = 0; i < (uint16_t)(vm->heap.data + BBZHEAP_SIZE - vm->heap.ltseg) / sizeof(bbzheap_tseg_t); ++i) {
+        if (bbzheap_tseg_isvalid(*bbzheap_tseg_at(i))) ++n;
+    }
+    ASSERT_EQUAL(s.segs, n);
+
+    // Failed allocations are counted
+    bbzheap_idx_t o;
+    while (bbzheap_obj_alloc(BBZTYPE_TABLE, &o));
+    bbzheap_stats_get(&s);
+    ASSERT(s.allocfails[BBZTYPE_TABLE] + s.allocfails[BBZHEAP_STATS_TSEG] > 0);
+
+    bbzvm_destruct();
+}
+#endif // BBZ_HEAP_STATS
+
+#ifdef BBZ_HEAP_ROOTS
+TEST(heap_roots) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+    // The VM's permanent objects are registered
+    uint8_t rootnum = vm->heap.rootnum;
+    ASSERT(!vm->heap.rootlost);
+    uint8_t found = 0;
+    for (uint8_t i = 0; i < rootnum; ++i) {
+        if (vm->heap.roots[i] == vm->gsyms) ++found;
+    }
+    ASSERT_EQUAL(found, 1);
+
+    // A registered object survives without any other reference
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    bbzvm_pop();
+    bbzheap_root_add(t);
+    bbzheap_root_add(t);
+    ASSERT_EQUAL(vm->heap.rootnum, rootnum + 1);
+    ASSERT(bbzheap_obj_ispermanent(*bbzheap_obj_at(t)));
+    bbzvm_gc();
+    ASSERT(bbztype_istable(*bbzheap_obj_at(t)));
+
+    // ... until it is removed
+    bbzheap_root_remove(t);
+    ASSERT_EQUAL(vm->heap.rootnum, rootnum);
+    bbzvm_gc();
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(t)));
+
+    // Objects that do not fit in the registry are kept too
+    bbzheap_idx_t o[BBZHEAP_ROOTS_CAP + 1];
+    for (uint16_t i = 0; i <= BBZHEAP_ROOTS_CAP; ++i) {
+        REQUIRE(bbzheap_obj_alloc(BBZTYPE_FLOAT, &o[i]));
+        bbzheap_obj_at(o[i])->f.value = (uint16_t)i;
+        bbzheap_obj_make_permanent(*bbzheap_obj_at(o[i]));
+    }
+    ASSERT_EQUAL(vm->heap.rootnum, BBZHEAP_ROOTS_CAP);
+    ASSERT(vm->heap.rootlost);
+    bbzvm_gc();
+    for (uint16_t i = 0; i <= BBZHEAP_ROOTS_CAP; ++i) {
+        ASSERT(bbztype_isfloat(*bbzheap_obj_at(o[i])));
+        ASSERT_EQUAL(bbzheap_obj_at(o[i])->f.value, i);
+    }
+
+    // A collection rebuilds the registry once there is room again
+    for (uint16_t i = 0; i <= BBZHEAP_ROOTS_CAP; ++i) {
+        bbzheap_obj_unmake_permanent(*bbzheap_obj_at(o[i]));
+    }
+    bbzvm_gc();
+    ASSERT(!vm->heap.rootlost);
+    ASSERT_EQUAL(vm->heap.rootnum, rootnum);
+    ASSERT(!bbzheap_obj_isvalid(*bbzheap_obj_at(o[0])));
+    ASSERT(bbztype_istable(*bbzheap_obj_at(vm->gsyms)));
+
+    bbzvm_destruct();
+}
+#endif // BBZ_HEAP_ROOTS
+
+#ifdef BBZ_SMALL_OBJECTS
+static void small_objects_fun() {}
+
+TEST(small_objects) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    ASSERT_EQUAL(sizeof(bbzobj_t), 3);
+
+    bbzvm_construct(0);
+    bbzvm_gc();
+    uint16_t used = 0;
+    for (uint16_t i = 0; i < BBZHEAP_PTRS_CAP; ++i) {
+        if (vm->heap.ptrflags[i] & BBZHEAP_PTR_VALID) ++used;
+    }
+
+    // Objects with the same pointer share an entry
+    static int data;
+    bbzvm_pushcc(small_objects_fun);
+    bbzvm_pushcc(small_objects_fun);
+    bbzvm_pushu(&data);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(2))->c.value, bbzheap_obj_at(bbzvm_stack_at(1))->c.value);
+    ASSERT((intptr_t)bbzheap_obj_ptr(*bbzheap_obj_at(bbzvm_stack_at(1))) == (intptr_t)small_objects_fun);
+    ASSERT((void*)bbzheap_obj_ptr(*bbzheap_obj_at(bbzvm_stack_at(0))) == (void*)&data);
+
+    // Native closures hold their bytecode address
+    bbzvm_pushcn(1234);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->c.value, 1234);
+    bbzvm_pop();
+
+    // Entries are kept while an object refers to them...
+    uint16_t u = bbzheap_obj_at(bbzvm_stack_at(0))->u.value;
+    bbzvm_pop();
+    bbzvm_gc();
+    bbzvm_gc();
+    ASSERT(bbzheap_obj_hasptr(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    ASSERT(!(vm->heap.ptrflags[u] & BBZHEAP_PTR_VALID));
+
+    // ... and freed afterwards
+    bbzvm_pop();
+    bbzvm_pop();
+    bbzvm_gc();
+    bbzvm_gc();
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < BBZHEAP_PTRS_CAP; ++i) {
+        if (vm->heap.ptrflags[i] & BBZHEAP_PTR_VALID) ++n;
+    }
+    ASSERT_EQUAL(n, used);
+
+    // Freed entries are reused
+    for (uint16_t i = 0; i < 2 * BBZHEAP_PTRS_CAP; ++i) {
+        bbzvm_pushu((void*)(uintptr_t)(i + 1));
+        bbzvm_pop();
+        REQUIRE(vm->state != BBZVM_STATE_ERROR);
+        bbzvm_gc();
+    }
+
+    // Pointers are still found after the entries around them are freed
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    const uint16_t half = (BBZHEAP_PTRS_CAP - used) / 2;
+    for (uint16_t i = 0; i < 2 * half; ++i) {
+        REQUIRE(bbztable_set(t, bbzint_new(i), bbzuserdata_new((void*)(uintptr_t)(2 * i + 2))));
+    }
+    for (uint16_t i = 1; i < 2 * half; i += 2) {
+        REQUIRE(bbztable_set(t, bbzint_new(i), vm->nil));
+    }
+    bbzvm_gc();
+    bbzvm_gc();
+    for (uint16_t i = 0; i < 2 * half; i += 2) {
+        bbzheap_idx_t o;
+        REQUIRE(bbztable_get(t, bbzint_new(i), &o));
+        uint16_t e = bbzheap_obj_at(o)->u.value;
+        bbzvm_pushu((void*)(uintptr_t)(2 * i + 2));
+        ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->u.value, e);
+        bbzvm_pop();
+    }
+
+    // A full table is reported as such
+    for (uint16_t i = 0; i < BBZHEAP_PTRS_CAP && vm->state != BBZVM_STATE_ERROR; ++i) {
+        bbztable_set(t, bbzint_new(2 * half + i), bbzuserdata_new((void*)(uintptr_t)(4 * i + 4 * BBZHEAP_PTRS_CAP)));
+    }
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_PTRS);
+    n = 0;
+    for (uint16_t i = 0; i < BBZHEAP_PTRS_CAP; ++i) {
+        if (vm->heap.ptrflags[i] & BBZHEAP_PTR_VALID) ++n;
+    }
+    ASSERT_EQUAL(n, BBZHEAP_PTRS_CAP);
+
+    bbzvm_destruct();
+}
+#endif // BBZ_SMALL_OBJECTS
+
+#ifdef BBZ_IMMEDIATE_INTS
+TEST(immediate_ints) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+    const uint8_t* rtobj = vm->heap.rtobj;
+
+    // Integers that fit are not allocated
+    const int16_t fit[] = { 0, 1, -1, 42, -42, BBZHEAP_IMM_MIN, BBZHEAP_IMM_MAX };
+    for (uint8_t i = 0; i < sizeof(fit) / sizeof(*fit); ++i) {
+        bbzheap_idx_t x = bbzint_new(fit[i]);
+        ASSERT(bbzheap_idx_isimm(x));
+        ASSERT(bbztype_isint(*bbzheap_obj_at(x)));
+        ASSERT_EQUAL(bbzheap_obj_at(x)->i.value, fit[i]);
+    }
+    ASSERT(vm->heap.rtobj == rtobj);
+
+    // The others are
+    const int16_t nofit[] = { BBZHEAP_IMM_MIN - 1, BBZHEAP_IMM_MAX + 1, INT16_MIN, INT16_MAX };
+    for (uint8_t i = 0; i < sizeof(nofit) / sizeof(*nofit); ++i) {
+        bbzheap_idx_t x = bbzint_new(nofit[i]);
+        ASSERT(!bbzheap_idx_isimm(x));
+        ASSERT(bbztype_isint(*bbzheap_obj_at(x)));
+        ASSERT_EQUAL(bbzheap_obj_at(x)->i.value, nofit[i]);
+    }
+
+    // Immediate and allocated integers compare by value
+    bbzheap_idx_t o;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &o));
+    bbzheap_obj_at(o)->i.value = 7;
+    ASSERT_EQUAL(bbztype_cmp(bbzheap_obj_at(bbzint_new(7)), bbzheap_obj_at(o)), 0);
+    ASSERT(bbztype_cmp(bbzheap_obj_at(bbzint_new(6)), bbzheap_obj_at(o)) < 0);
+
+    // Immediate integers can be stored in tables and survive collections
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    REQUIRE(bbztable_set(t, bbzint_new(-3), bbzint_new(BBZHEAP_IMM_MAX)));
+    bbzvm_gc();
+    REQUIRE(bbztable_get(t, bbzint_new(-3), &o));
+    ASSERT(bbzheap_idx_isimm(o));
+    ASSERT_EQUAL(bbzheap_obj_at(o)->i.value, BBZHEAP_IMM_MAX);
+
+    // Immediate integers cannot be modified
+    bbzheap_idx_t x = bbzint_new(5);
+    bbzheap_obj_copy(bbzint_new(6), x);
+    bbzheap_root_add(x);
+    ASSERT_EQUAL(bbzheap_obj_at(x)->i.value, 5);
+    ASSERT(!bbzheap_obj_ispermanent(*bbzheap_obj_at(x)));
+    ASSERT(vm->state != BBZVM_STATE_ERROR);
+#ifdef DEBUG
+    // Writes to their temporary objects are detected when they are reused
+    bbzheap_obj_at(x)->i.value = 6;
+    for (uint8_t i = 0; i < BBZHEAP_IMM_OBJS; ++i) bbzheap_obj_at(x);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_TYPE);
+#endif // DEBUG
+
+    bbzvm_destruct();
+}
+#endif // BBZ_IMMEDIATE_INTS
+
+#ifdef BBZ_INTERN_STRINGS
+TEST(string_intern) {
+    bbzvm_t vmObj;
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+
+    // Getting a string again does not allocate
+    bbzheap_idx_t a = bbzstring_get(50);
+    const uint8_t* rtobj = vm->heap.rtobj;
+    bbzheap_idx_t ofree = vm->heap.ofree;
+    ASSERT_EQUAL(bbzstring_get(50), a);
+    ASSERT(vm->heap.rtobj == rtobj);
+    ASSERT_EQUAL(vm->heap.ofree, ofree);
+
+    // A stale entry is not used once the slot holds something else
+    bbzheap_obj_free(a);
+    bbzheap_idx_t o;
+    REQUIRE(bbzheap_obj_alloc(BBZTYPE_USERDATA, &o));
+#ifndef BBZ_GENERATIONAL_GC // Which takes new objects past the nursery first
+    ASSERT_EQUAL(o, a);
+#endif // !BBZ_GENERATIONAL_GC
+    bbzheap_idx_t b = bbzstring_get(50);
+    ASSERT(b != a);
+    ASSERT(bbztype_isstring(*bbzheap_obj_at(b)));
+    ASSERT_EQUAL(bbzheap_obj_at(b)->s.value, 50);
+
+    // ...even if it is another string
+    bbzheap_obj_free(b);
+    bbzheap_idx_t c = bbzstring_get(51);
+#ifndef BBZ_GENERATIONAL_GC
+    ASSERT_EQUAL(c, b);
+#endif // !BBZ_GENERATIONAL_GC
+    o = bbzstring_get(50);
+    ASSERT(o != c);
+    ASSERT_EQUAL(bbzheap_obj_at(o)->s.value, 50);
+    ASSERT_EQUAL(bbzheap_obj_at(c)->s.value, 51);
+
+    // String IDs out of the map are still deduplicated
+    o = bbzstring_get(BBZHEAP_STRINGS_CAP);
+    ASSERT_EQUAL(bbzstring_get(BBZHEAP_STRINGS_CAP), o);
+
+    bbzvm_destruct();
+}
+#endif // BBZ_INTERN_STRINGS
+
 TEST_LIST {
     ADD_TEST(all);
     ADD_TEST(clear);
+    ADD_TEST(free_lists);
+    ADD_TEST(tables);
+    ADD_TEST(table_new_from);
+    ADD_TEST(deep_marking);
+#ifdef BBZ_LAZY_GC
+    ADD_TEST(lazy_gc);
+#endif // BBZ_LAZY_GC
+#ifdef BBZ_INCREMENTAL_GC
+    ADD_TEST(incremental_gc);
+#endif // BBZ_INCREMENTAL_GC
+#ifdef BBZ_GENERATIONAL_GC
+    ADD_TEST(generational_gc);
+#endif // BBZ_GENERATIONAL_GC
+#ifdef BBZ_HEAP_COMPACTION
+    ADD_TEST(compaction);
+#endif // BBZ_HEAP_COMPACTION
+#ifdef BBZ_HEAP_STATS
+    ADD_TEST(heap_stats);
+#endif // BBZ_HEAP_STATS
+#ifdef BBZ_HEAP_ROOTS
+    ADD_TEST(heap_roots);
+#endif // BBZ_HEAP_ROOTS
+#ifdef BBZ_SMALL_OBJECTS
+    ADD_TEST(small_objects);
+#endif // BBZ_SMALL_OBJECTS
+#ifdef BBZ_IMMEDIATE_INTS
+    ADD_TEST(immediate_ints);
+#endif // BBZ_IMMEDIATE_INTS
+#ifdef BBZ_INTERN_STRINGS
+    ADD_TEST(string_intern);
+#endif // BBZ_INTERN_STRINGS
 }
\ No newline at end of file
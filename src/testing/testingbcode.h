@@ -0,0 +1,52 @@
+/**
+ * @file testingbcode.h
+ * @brief Loading of BittyBuzz objects (.bbo) in RAM, shared by the tests,
+ * the benchmarks and the host tools.
+ */
+
+#ifndef TESTING_BCODE_H
+#define TESTING_BCODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <bittybuzz/bbzinclude.h>
+
+/**
+ * @brief Loads bytecode from a file in RAM.
+ * @details The buffer is zeroed past the bytecode, so that fetching an
+ * operand at the end never reads outside of it.
+ * @param[in,out] bcode The buffer to replace, or NULL. It is freed, then
+ * set to the new buffer.
+ * @param[in] f The file, open where the bytecode starts.
+ * @param[in] size The size of the bytecode (B).
+ * @return Non-zero if the bytecode was read.
+ */
+static inline uint8_t testing_load_bcode(uint8_t** bcode, FILE* f, size_t size) {
+    free(*bcode);
+    *bcode = calloc(size + sizeof(uint32_t), 1);
+    return *bcode != NULL && fread(*bcode, 1, size, f) == size;
+}
+
+/**
+ * @brief Loads a whole bytecode file in RAM.
+ * @see testing_load_bcode()
+ * @param[in,out] bcode The buffer to replace, or NULL. It is freed, then
+ * set to the new buffer.
+ * @param[out] size The size of the bytecode (B).
+ * @param[in] path The path of the file.
+ * @return Non-zero if the file was read.
+ */
+static inline uint8_t testing_load_bcode_file(uint8_t** bcode, uint16_t* size, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    long sz = -1;
+    if (fseek(f, 0, SEEK_END) == 0) sz = ftell(f);
+    uint8_t ok = sz >= 0 && sz <= UINT16_MAX &&
+                 fseek(f, 0, SEEK_SET) == 0 &&
+                 testing_load_bcode(bcode, f, (size_t)sz);
+    fclose(f);
+    *size = (uint16_t)sz;
+    return ok;
+}
+
+#endif // !TESTING_BCODE_H
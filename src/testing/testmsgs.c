@@ -1,29 +1,30 @@
 #include <bittybuzz/bbzmsg.h>
 #include <bittybuzz/bbzoutmsg.h>
+#include <bittybuzz/bbzneighbors.h>
 
-#define NUM_TEST_CASES 8
+#define NUM_TEST_CASES 13
 #define TEST_MODULE messages
 #include "testingconfig.h"
 
 bbzvm_t vmObj;
 
-#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_NEIGHBORS) && !defined(BBZ_DISABLE_VSTIGS) && !defined(BBZ_DISABLE_MESSAGES) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+#if !defined(BBZ_DISABLE_NEIGHBORS) && !defined(BBZ_DISABLE_VSTIGS) && !defined(BBZ_DISABLE_MESSAGES)
 TEST(m_serialize8) {
-    uint8_t buf[4];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, sizeof(uint8_t), 4);
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
 
     uint8_t x = 0x56;
     bbzmsg_serialize_u8(&rb, x);
-    ASSERT_EQUAL(bbzringbuf_size(&rb), 1);
-    ASSERT_EQUAL(*bbzringbuf_at(&rb, 0), x);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), 1);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 0), x);
 }
 
 TEST(m_deserialize8) {
-    uint8_t buf[4];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, sizeof(uint8_t), 4);
-    *bbzringbuf_rawat(&rb, bbzringbuf_makeslot(&rb)) = 0x56;
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
+    bbzringbuf_bytes_push(&rb, 0x56);
     int16_t pos = 0;
 
     uint8_t x;
@@ -33,23 +34,23 @@ TEST(m_deserialize8) {
 }
 
 TEST(m_serialize16) {
-    uint8_t buf [4];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, sizeof(uint8_t), 4);
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
 
     uint16_t x = 0x2345;
     bbzmsg_serialize_u16(&rb, x);
-    ASSERT_EQUAL(bbzringbuf_size(&rb), 2);
-    ASSERT_EQUAL(*bbzringbuf_at(&rb, 0), (uint8_t)htons(x));
-    ASSERT_EQUAL(*bbzringbuf_at(&rb, 1), (uint8_t)(htons(x)>>8));
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), 2);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 0), (uint8_t)htons(x));
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 1), (uint8_t)(htons(x)>>8));
 }
 
 TEST(m_deserialize16) {
-    uint8_t buf [4];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, sizeof(uint8_t), 4);
-    *bbzringbuf_rawat(&rb, bbzringbuf_makeslot(&rb)) = (uint8_t)htons(0x3456);
-    *bbzringbuf_rawat(&rb, bbzringbuf_makeslot(&rb)) = (uint8_t)(htons(0x3456)>>8);
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
+    bbzringbuf_bytes_push(&rb, (uint8_t)htons(0x3456));
+    bbzringbuf_bytes_push(&rb, (uint8_t)(htons(0x3456)>>8));
 
     int16_t pos = 0;
     uint16_t x;
@@ -72,52 +73,57 @@ TEST(m_out_append) {
 
     // The actual tests
 
+    // The swarm message, if any, stays at the end of the queue
+    uint16_t sw = 0;
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
     bbzoutmsg_queue_append_swarm(21, 0x42, 2);
     ASSERT_EQUAL(bbzoutmsg_queue_size(), 1);
-    ASSERT_EQUAL((vm->outmsgs.buf)->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((vm->outmsgs.buf)->sw.rid, 21);
-    ASSERT_EQUAL((vm->outmsgs.buf)->sw.swarms, 0x42);
-    ASSERT_EQUAL((vm->outmsgs.buf)->sw.lamport, 2);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->type, BBZMSG_SWARM);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->sw.rid, 21);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->sw.swarms, 0x42);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->sw.lamport, 2);
+    sw = 1;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
 
     bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_id), val);
-    ASSERT_EQUAL(bbzoutmsg_queue_size(), 2);
-    ASSERT_EQUAL((vm->outmsgs.buf)->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((vm->outmsgs.buf)->bc.rid, 42);
-    ASSERT_EQUAL((vm->outmsgs.buf)->bc.topic, __BBZSTRID_id);
-    ASSERT_EQUAL((vm->outmsgs.buf)->bc.value.u.mdata, bbzheap_obj_at(val)->u.mdata);
-    ASSERT_EQUAL((vm->outmsgs.buf)->bc.value.u.value, bbzheap_obj_at(val)->u.value);
+    ASSERT_EQUAL(bbzoutmsg_queue_size(), sw + 1);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->bc.rid, 42);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->bc.topic, __BBZSTRID_id);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->bc.value.u.mdata, bbzheap_obj_at(val)->u.mdata);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->bc.value.u.value, bbzheap_obj_at(val)->u.value);
 
     bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 42, __BBZSTRID_put, val, 1);
-    ASSERT_EQUAL(bbzoutmsg_queue_size(), 3);
-    ASSERT_EQUAL((vm->outmsgs.buf)->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->type, BBZMSG_VSTIG_PUT);
-    ASSERT_EQUAL((&vm->outmsgs.buf[2])->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->vs.rid, 42);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->vs.key, __BBZSTRID_put);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->vs.data.u.mdata, bbzheap_obj_at(val)->u.mdata);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->vs.data.u.value, bbzheap_obj_at(val)->u.value);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->vs.lamport, 1);
+    ASSERT_EQUAL(bbzoutmsg_queue_size(), sw + 2);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->type, BBZMSG_VSTIG_PUT);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->vs.rid, 42);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->vs.key, __BBZSTRID_put);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->vs.data.u.mdata, bbzheap_obj_at(val)->u.mdata);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->vs.data.u.value, bbzheap_obj_at(val)->u.value);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->vs.lamport, 1);
 
     bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), val2);
-    ASSERT_EQUAL(bbzoutmsg_queue_size(), 4);
-    ASSERT_EQUAL((vm->outmsgs.buf)->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->outmsgs.buf[2])->type, BBZMSG_VSTIG_PUT);
-    ASSERT_EQUAL((&vm->outmsgs.buf[3])->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->bc.rid, 42);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->bc.topic, __BBZSTRID_count);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->bc.value.u.mdata, bbzheap_obj_at(val2)->u.mdata);
-    ASSERT_EQUAL((&vm->outmsgs.buf[1])->bc.value.u.value, bbzheap_obj_at(val2)->u.value);
+    ASSERT_EQUAL(bbzoutmsg_queue_size(), sw + 3);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(2)->type, BBZMSG_VSTIG_PUT);
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    ASSERT_EQUAL(bbzoutmsg_queue_get(3)->type, BBZMSG_SWARM);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->bc.rid, 42);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->bc.topic, __BBZSTRID_count);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->bc.value.u.mdata, bbzheap_obj_at(val2)->u.mdata);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(1)->bc.value.u.value, bbzheap_obj_at(val2)->u.value);
 }
 
 TEST(m_out_queue_first) {
     vm = &vmObj;
     bbzvm_construct(42);
 
-    uint8_t buf[9];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, 1, 9);
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
 
     bbzheap_idx_t val;
     REQUIRE(bbzheap_obj_alloc(BBZTYPE_INT, &val));
@@ -143,6 +149,66 @@ TEST(m_out_queue_first) {
     ASSERT_EQUAL(bbzoutmsg_queue_size(), 0);
 }
 
+TEST(m_out_priority) {
+    vm = &vmObj;
+    bbzvm_construct(42);
+
+    // The slots of sent messages are reused
+    bbzheap_idx_t val = bbzint_new(0);
+    for (uint8_t i = 0; i < BBZOUTMSG_QUEUE_CAP / 2; ++i) {
+        bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_QUERY, 0, __BBZSTRID_put, val, 0);
+        bbzoutmsg_queue_next();
+    }
+    REQUIRE(bbzoutmsg_queue_size() == 0);
+
+    // A burst of messages of decreasing priorities fills the queue
+    for (uint8_t i = 0; i < 2 * BBZOUTMSG_QUEUE_CAP; ++i) {
+        switch (i % 3) {
+            case 0:
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+                bbzoutmsg_queue_append_swarm(i, 0, 0);
+                break;
+#else // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+                // fallthrough
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            case 1: bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_QUERY, i, __BBZSTRID_put, val, 0); break;
+            default: bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, i, __BBZSTRID_put, val, 0); break;
+        }
+    }
+    ASSERT_EQUAL(bbzoutmsg_queue_size(), BBZOUTMSG_QUEUE_CAP);
+    // Messages are sorted by type, then by arrival
+    for (uint8_t i = 1; i < BBZOUTMSG_QUEUE_CAP; ++i) {
+        bbzmsg_t* prev = bbzoutmsg_queue_get(i - 1);
+        bbzmsg_t* m = bbzoutmsg_queue_get(i);
+        ASSERT(prev->type < m->type || (prev->type == m->type && prev->base.rid < m->base.rid));
+    }
+
+    // A new message drops the newest message of the lowest priority
+    bbzmsg_t last = *bbzoutmsg_queue_get(BBZOUTMSG_QUEUE_CAP - 1);
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), val);
+    ASSERT_EQUAL(bbzoutmsg_queue_size(), BBZOUTMSG_QUEUE_CAP);
+    ASSERT_EQUAL(bbzoutmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    for (uint8_t i = 0; i < BBZOUTMSG_QUEUE_CAP; ++i) {
+        bbzmsg_t* m = bbzoutmsg_queue_get(i);
+        ASSERT(m->type != last.type || m->base.rid != last.base.rid);
+    }
+
+    // Messages are sent by priority
+    uint8_t type = BBZMSG_BROADCAST;
+    while (bbzoutmsg_queue_size() > 0) {
+        ASSERT(bbzoutmsg_queue_get(0)->type >= type);
+        type = bbzoutmsg_queue_get(0)->type;
+        bbzoutmsg_queue_next();
+    }
+    // All the slots are free again
+    for (uint8_t i = 0; i < BBZOUTMSG_QUEUE_CAP; ++i) {
+        bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_QUERY, i, __BBZSTRID_put, val, 0);
+    }
+    for (uint8_t i = 0; i < BBZOUTMSG_QUEUE_CAP; ++i) {
+        ASSERT_EQUAL(bbzoutmsg_queue_get(i)->base.rid, i);
+    }
+}
+
 TEST(m_in_append) {
 
     vm = &vmObj;
@@ -155,11 +221,11 @@ TEST(m_in_append) {
     bbztype_cast(obj2, BBZTYPE_INT);
     obj2.i.value = 0x6789;
 
-    uint8_t buf1[10], buf2[10], buf3[10];
+    uint8_t buf1[BBZMSG_PAYLOAD_CAP], buf2[BBZMSG_PAYLOAD_CAP], buf3[BBZMSG_PAYLOAD_CAP];
     bbzmsg_payload_t payload1, payload2, payload3;
-    bbzringbuf_construct(&payload1, buf1, 1, 10);
-    bbzringbuf_construct(&payload2, buf2, 1, 10);
-    bbzringbuf_construct(&payload3, buf3, 1, 10);
+    bbzringbuf_bytes_construct(&payload1, buf1);
+    bbzringbuf_bytes_construct(&payload2, buf2);
+    bbzringbuf_bytes_construct(&payload3, buf3);
 
     bbzmsg_serialize_u8 (&payload1, BBZMSG_SWARM);
     bbzmsg_serialize_u16(&payload1, 21);
@@ -181,32 +247,38 @@ TEST(m_in_append) {
 
     // We presume that the messages are sorted when appended.
 
+    // The swarm message, if any, stays at the end of the queue
+    uint16_t sw = 0;
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
     bbzinmsg_queue_append(&payload1);
     ASSERT_EQUAL(bbzinmsg_queue_size(), 1);
-    ASSERT_EQUAL((vm->inmsgs.buf)->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((vm->inmsgs.buf)->sw.rid, 21);
-    ASSERT_EQUAL((vm->inmsgs.buf)->sw.lamport, 2);
-    ASSERT_EQUAL((vm->inmsgs.buf)->sw.swarms, 0x42);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_SWARM);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->sw.rid, 21);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->sw.lamport, 2);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->sw.swarms, 0x42);
+    sw = 1;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
 
     bbzinmsg_queue_append(&payload2);
-    ASSERT_EQUAL(bbzinmsg_queue_size(), 2);
-    ASSERT_EQUAL((vm->inmsgs.buf)->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((vm->inmsgs.buf)->bc.rid, 42);
-    ASSERT_EQUAL((vm->inmsgs.buf)->bc.topic, __BBZSTRID_id);
-    ASSERT_EQUAL((uint8_t)((vm->inmsgs.buf)->bc.value.mdata & ~BBZHEAP_OBJ_MASK_VALID), (uint8_t)(obj1.mdata & ~BBZHEAP_OBJ_MASK_VALID));
-    ASSERT_EQUAL((vm->inmsgs.buf)->bc.value.i.value, obj1.i.value);
+    ASSERT_EQUAL(bbzinmsg_queue_size(), sw + 1);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.rid, 42);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.topic, __BBZSTRID_id);
+    ASSERT_EQUAL((uint8_t)(bbzinmsg_queue_get(0)->bc.value.mdata & ~BBZHEAP_OBJ_MASK_VALID), (uint8_t)(obj1.mdata & ~BBZHEAP_OBJ_MASK_VALID));
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.value.i.value, obj1.i.value);
 
     bbzinmsg_queue_append(&payload3);
-    ASSERT_EQUAL(bbzinmsg_queue_size(), 3);
-    ASSERT_EQUAL((vm->inmsgs.buf)->type, BBZMSG_BROADCAST);
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->type, BBZMSG_VSTIG_PUT);
-    ASSERT_EQUAL((&vm->inmsgs.buf[2])->type, BBZMSG_SWARM);
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->vs.rid, 42);
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->vs.key, __BBZSTRID_put);
-    ASSERT_EQUAL((uint8_t)((&vm->inmsgs.buf[1])->vs.data.mdata & ~BBZHEAP_OBJ_MASK_VALID), (uint8_t)(obj2.mdata & ~BBZHEAP_OBJ_MASK_VALID));
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->vs.data.i.value, obj2.i.value);
-    ASSERT_EQUAL((&vm->inmsgs.buf[1])->vs.lamport, 1);
+    ASSERT_EQUAL(bbzinmsg_queue_size(), sw + 2);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->type, BBZMSG_VSTIG_PUT);
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    ASSERT_EQUAL(bbzinmsg_queue_get(2)->type, BBZMSG_SWARM);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.rid, 42);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.key, __BBZSTRID_put);
+    ASSERT_EQUAL((uint8_t)(bbzinmsg_queue_get(1)->vs.data.mdata & ~BBZHEAP_OBJ_MASK_VALID), (uint8_t)(obj2.mdata & ~BBZHEAP_OBJ_MASK_VALID));
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.data.i.value, obj2.i.value);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.lamport, 1);
 }
 
 TEST(m_in_queue_first) {
@@ -217,13 +289,13 @@ TEST(m_in_queue_first) {
     bbztype_cast(obj1, BBZTYPE_INT);
     obj1.i.value = 0x2345;
 
-    uint8_t buf[9];
-    bbzringbuf_t rb;
-    bbzringbuf_construct(&rb, buf, 1, 9);
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
 
-    uint8_t buf1[10];
+    uint8_t buf1[BBZMSG_PAYLOAD_CAP];
     bbzmsg_payload_t payload1;
-    bbzringbuf_construct(&payload1, buf1, 1, 10);
+    bbzringbuf_bytes_construct(&payload1, buf1);
     bbzmsg_serialize_u8 (&payload1, BBZMSG_BROADCAST);
     bbzmsg_serialize_u16(&payload1, 42);
     bbzmsg_serialize_u16(&payload1, __BBZSTRID_count);
@@ -237,17 +309,449 @@ TEST(m_in_queue_first) {
     ASSERT_EQUAL((uint8_t)(msg->bc.value.mdata & ~BBZHEAP_OBJ_MASK_VALID), (uint8_t)(obj1.mdata & ~BBZHEAP_OBJ_MASK_VALID));
     ASSERT_EQUAL((uint16_t)msg->bc.value.u.value, (uint16_t)obj1.u.value);
 }
-#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS && !BBZ_DISABLE_MESSAGES
+
+TEST(m_raw) {
+    vm = &vmObj;
+    bbzvm_construct(42);
+
+    uint8_t buf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
+    uint8_t raw[BBZMSG_MAX_SIZE];
+
+    bbzheap_idx_t val = bbzint_new(0x2345);
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), val);
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 21, __BBZSTRID_put, val, 7);
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    bbzoutmsg_queue_append_swarm(33, 0x42, 0x1234);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+    static const uint8_t sizes[] = { BBZMSG_BROADCAST_SIZE, BBZMSG_VSTIG_SIZE, BBZMSG_SWARM_SIZE };
+
+    for (uint8_t i = 0; bbzoutmsg_queue_size() > 0; ++i) {
+        // The flat buffer holds the same bytes as the ring buffer, unless the
+        // compact encoding is shorter
+        bbzoutmsg_queue_first(&rb);
+        ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), sizes[i]);
+        uint8_t size = bbzoutmsg_queue_first_raw(raw);
+        if (raw[0] & BBZMSG_COMPACT) {
+            ASSERT(size < sizes[i]);
+        }
+        else {
+            ASSERT_EQUAL(size, sizes[i]);
+            for (uint8_t j = 0; j < size; ++j) {
+                ASSERT_EQUAL(raw[j], *bbzringbuf_bytes_at(&rb, j));
+            }
+        }
+
+        // Both are read back into the same message
+        bbzinmsg_queue_append(&rb);
+        REQUIRE(bbzinmsg_queue_size() == 1);
+        bbzmsg_t m = *bbzinmsg_queue_extract();
+        bbzinmsg_queue_append_raw(raw, size);
+        REQUIRE(bbzinmsg_queue_size() == 1);
+        bbzmsg_t* n = bbzinmsg_queue_extract();
+        ASSERT_EQUAL(n->type, m.type);
+        ASSERT_EQUAL(n->base.rid, m.base.rid);
+        switch (m.type) {
+            case BBZMSG_BROADCAST:
+                ASSERT_EQUAL(n->bc.topic, __BBZSTRID_count);
+                ASSERT_EQUAL(n->bc.value.mdata, m.bc.value.mdata);
+                ASSERT_EQUAL(n->bc.value.i.value, 0x2345);
+                break;
+            case BBZMSG_VSTIG_PUT:
+                ASSERT_EQUAL(n->vs.rid, 21);
+                ASSERT_EQUAL(n->vs.key, __BBZSTRID_put);
+                ASSERT_EQUAL(n->vs.data.mdata, m.vs.data.mdata);
+                ASSERT_EQUAL(n->vs.data.i.value, 0x2345);
+                ASSERT_EQUAL(n->vs.lamport, 7);
+                break;
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+            case BBZMSG_SWARM:
+                ASSERT_EQUAL(n->sw.rid, 33);
+                ASSERT_EQUAL(n->sw.swarms, 0x42);
+                ASSERT_EQUAL(n->sw.lamport, 0x1234);
+                break;
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+            default:
+                ASSERT(0);
+                break;
+        }
+
+        // Truncated messages are dropped
+        bbzinmsg_queue_append_raw(raw, (uint8_t)(size - 1));
+        ASSERT_EQUAL(bbzinmsg_queue_size(), 0);
+        bbzoutmsg_queue_next();
+    }
+
+    // Tables are not sent
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), bbztable_new());
+    ASSERT_EQUAL(bbzoutmsg_queue_first_raw(raw), 0);
+}
+
+TEST(m_pack) {
+    vm = &vmObj;
+    bbzvm_construct(42);
+
+    uint8_t frame[BBZMSG_BROADCAST_SIZE + 2 * BBZMSG_VSTIG_SIZE + 1];
+    uint8_t raw[BBZMSG_MAX_SIZE];
+    bbzheap_idx_t val = bbzint_new(0x2345);
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 21, __BBZSTRID_put, val, 7);
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 22, __BBZSTRID_put, val, 8);
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), bbztable_new());
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), val);
+
+    // Both broadcasts, one of which is a table, and both PUTs fit. The
+    // headers give the type and size of each message.
+    ASSERT_EQUAL(bbzoutmsg_queue_pack(frame, sizeof(frame)), 4);
+    static const uint8_t types[] = { BBZMSG_BROADCAST, BBZMSG_VSTIG_PUT, BBZMSG_VSTIG_PUT };
+    uint8_t pos = 0;
+    for (uint8_t i = 0; i < sizeof(types); ++i) {
+#ifndef BBZ_COMPACT_MESSAGES
+        ASSERT_EQUAL(BBZMSG_PACK_TYPE(frame[pos]), types[i]);
+#else // !BBZ_COMPACT_MESSAGES
+        ASSERT_EQUAL(BBZMSG_PACK_TYPE(frame[pos]), types[i] | BBZMSG_COMPACT);
+#endif // !BBZ_COMPACT_MESSAGES
+        ASSERT_EQUAL(BBZMSG_PACK_BASETYPE(frame[pos]), types[i]);
+        pos += 1 + BBZMSG_PACK_LEN(frame[pos]);
+    }
+#ifndef BBZ_COMPACT_MESSAGES
+    ASSERT_EQUAL(pos, BBZMSG_BROADCAST_SIZE + 2 * BBZMSG_VSTIG_SIZE);
+#endif // !BBZ_COMPACT_MESSAGES
+    ASSERT_EQUAL(frame[pos], 0);
+    bbzinmsg_queue_unpack(frame, sizeof(frame));
+    REQUIRE(bbzinmsg_queue_size() == 3);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.rid, 42);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.topic, __BBZSTRID_count);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.value.i.value, 0x2345);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.rid, 21);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.lamport, 7);
+    ASSERT_EQUAL(bbzinmsg_queue_get(2)->vs.rid, 22);
+    ASSERT_EQUAL(bbzinmsg_queue_get(2)->vs.key, __BBZSTRID_put);
+    ASSERT_EQUAL(bbzinmsg_queue_get(2)->vs.data.i.value, 0x2345);
+    ASSERT_EQUAL(bbzinmsg_queue_get(2)->vs.lamport, 8);
+    for (uint8_t i = 0; i < 4; ++i) bbzoutmsg_queue_next();
+    while (!bbzinmsg_queue_isempty()) bbzinmsg_queue_extract();
+
+    // A message that does not fit stays in the queue
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_QUERY, 33, __BBZSTRID_put, val, 9);
+    uint8_t size = bbzoutmsg_queue_first_raw(raw);
+    ASSERT_EQUAL(bbzoutmsg_queue_pack(frame, size - 1), 0);
+    ASSERT_EQUAL(bbzoutmsg_queue_pack(frame, size), 1);
+    bbzinmsg_queue_unpack(frame, size);
+    REQUIRE(bbzinmsg_queue_size() == 1);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_VSTIG_QUERY);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.rid, 33);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.data.i.value, 0x2345);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.lamport, 9);
+
+    // Truncated frames are unpacked up to the last whole message
+    bbzinmsg_queue_extract();
+    bbzinmsg_queue_unpack(frame, size - 1);
+    ASSERT_EQUAL(bbzinmsg_queue_size(), 0);
+
+    // Compact and fixed messages share a frame, the flag in the header
+    // telling them apart
+    bbzmsg_t m;
+    m.vs.type = BBZMSG_VSTIG_PUT;
+    m.vs.rid = 300;
+    m.vs.key = __BBZSTRID_put;
+    m.vs.data.mdata = 0;
+    bbztype_cast(m.vs.data, BBZTYPE_INT);
+    m.vs.data.i.value = -300;
+    m.vs.lamport = 4;
+    size = bbzmsg_compact_put(frame, &m);
+    REQUIRE(size == 1 + 2 + 1 + 3 + 1);
+    frame[0] = BBZMSG_PACK_HDR(frame[0], size - 1);
+    ASSERT_EQUAL(BBZMSG_PACK_TYPE(frame[0]), BBZMSG_VSTIG_PUT | BBZMSG_COMPACT);
+    ASSERT_EQUAL(BBZMSG_PACK_BASETYPE(frame[0]), BBZMSG_VSTIG_PUT);
+    ASSERT_EQUAL(BBZMSG_PACK_LEN(frame[0]), size - 1);
+    pos = size;
+    frame[pos] = BBZMSG_PACK_HDR(BBZMSG_BROADCAST, BBZMSG_BROADCAST_SIZE - 1);
+    bbzmsg_raw_put_u16(frame + pos + 1, 43);
+    bbzmsg_raw_put_u16(frame + pos + 3, __BBZSTRID_count);
+    bbzmsg_raw_put_obj(frame + pos + 5, bbzheap_obj_at(val));
+    ASSERT_EQUAL(BBZMSG_PACK_TYPE(frame[pos]), BBZMSG_BROADCAST);
+    ASSERT_EQUAL(BBZMSG_PACK_LEN(frame[pos]), BBZMSG_BROADCAST_SIZE - 1);
+    pos += BBZMSG_BROADCAST_SIZE;
+    frame[pos] = 0;
+    bbzinmsg_queue_unpack(frame, sizeof(frame));
+    REQUIRE(bbzinmsg_queue_size() == 2);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.rid, 43);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.topic, __BBZSTRID_count);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->bc.value.i.value, 0x2345);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->type, BBZMSG_VSTIG_PUT);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.rid, 300);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.key, __BBZSTRID_put);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.data.i.value, -300);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.lamport, 4);
+}
+
+TEST(m_compact) {
+    vm = &vmObj;
+    bbzvm_construct(42);
+
+    uint8_t buf[BBZMSG_COMPACT_MAX_SIZE];
+    bbzmsg_t m;
+    bbzmsg_t* n;
+
+    // Objects round-trip in virtual stigmergy messages with a 1-byte robot ID and key.
+    static const struct { uint8_t type; int16_t value; uint8_t size; } objs[] = {
+        { BBZTYPE_NIL,    0,      1 },
+        { BBZTYPE_INT,    0,      1 },
+        { BBZTYPE_INT,    7,      1 },
+        { BBZTYPE_INT,    -7,     1 },
+        { BBZTYPE_INT,    -8,     2 },
+        { BBZTYPE_INT,    8,      2 },
+        { BBZTYPE_INT,    -300,   3 },
+        { BBZTYPE_INT,    32767,  4 },
+        { BBZTYPE_INT,    -32768, 4 },
+        { BBZTYPE_STRING, 14,     1 },
+        { BBZTYPE_STRING, 15,     2 },
+        { BBZTYPE_STRING, 1000,   3 },
+        { BBZTYPE_FLOAT,  0x3C00, 3 },
+    };
+    for (uint8_t i = 0; i < sizeof(objs) / sizeof(*objs); ++i) {
+        m.vs.type = BBZMSG_VSTIG_PUT;
+        m.vs.rid = 100;
+        m.vs.key = 3;
+        m.vs.lamport = i;
+        m.vs.data.mdata = 0;
+        bbztype_cast(m.vs.data, objs[i].type);
+        m.vs.data.i.value = objs[i].value;
+        uint8_t size = (uint8_t)(3 + objs[i].size + 1);
+        ASSERT_EQUAL(bbzmsg_compact_put(buf, &m), size);
+        ASSERT_EQUAL(buf[0], BBZMSG_VSTIG_PUT | BBZMSG_COMPACT);
+        bbzinmsg_queue_append_raw(buf, size);
+        REQUIRE(bbzinmsg_queue_size() == 1);
+        n = bbzinmsg_queue_extract();
+        ASSERT_EQUAL(n->type, BBZMSG_VSTIG_PUT);
+        ASSERT_EQUAL(n->vs.rid, 100);
+        ASSERT_EQUAL(n->vs.key, 3);
+        ASSERT_EQUAL(bbztype(n->vs.data), objs[i].type);
+        ASSERT(bbzheap_obj_isvalid(n->vs.data));
+        if (objs[i].type != BBZTYPE_NIL) ASSERT_EQUAL(n->vs.data.i.value, objs[i].value);
+        ASSERT_EQUAL(n->vs.lamport, i);
+
+        // Truncated messages are dropped
+        bbzinmsg_queue_append_raw(buf, (uint8_t)(size - 1));
+        ASSERT_EQUAL(bbzinmsg_queue_size(), 0);
+    }
+
+    // Large IDs take up to 3 bytes, and the ring buffer API reads compact messages too
+    m.bc.type = BBZMSG_BROADCAST;
+    m.bc.rid = 0xFFFF;
+    m.bc.topic = 0x1234;
+    m.bc.value.mdata = 0;
+    bbztype_cast(m.bc.value, BBZTYPE_INT);
+    m.bc.value.i.value = 1;
+    ASSERT_EQUAL(bbzmsg_compact_put(buf, &m), 1 + 3 + 2 + 1);
+    uint8_t rbbuf[BBZMSG_PAYLOAD_CAP];
+    bbzmsg_payload_t rb;
+    bbzringbuf_bytes_construct(&rb, rbbuf);
+    for (uint8_t i = 0; i < 1 + 3 + 2 + 1; ++i) bbzringbuf_bytes_push(&rb, buf[i]);
+    bbzinmsg_queue_append(&rb);
+    REQUIRE(bbzinmsg_queue_size() == 1);
+    n = bbzinmsg_queue_extract();
+    ASSERT_EQUAL(n->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(n->bc.rid, 0xFFFF);
+    ASSERT_EQUAL(n->bc.topic, 0x1234);
+    ASSERT_EQUAL(n->bc.value.i.value, 1);
+
+    // Varints longer than 16 bits are dropped
+    static const uint8_t bad[] = { BBZMSG_BROADCAST | BBZMSG_COMPACT, 0x80, 0x80, 0x80, 0x01, 0x01, 0x01, 0x42 };
+    bbzinmsg_queue_append_raw(bad, sizeof(bad));
+    ASSERT_EQUAL(bbzinmsg_queue_size(), 0);
+
+    // Tables cannot be encoded
+    m.bc.value = *bbzheap_obj_at(bbztable_new());
+    ASSERT_EQUAL(bbzmsg_compact_put(buf, &m), 0);
+
+#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+    // Swarm messages round-trip too
+    m.sw.type = BBZMSG_SWARM;
+    m.sw.rid = 1;
+    m.sw.lamport = 0x1234;
+    m.sw.swarms = 0x42;
+    ASSERT_EQUAL(bbzmsg_compact_put(buf, &m), 1 + 1 + 2 + 1);
+    bbzinmsg_queue_append_raw(buf, 1 + 1 + 2 + 1);
+    REQUIRE(bbzinmsg_queue_size() == 1);
+    n = bbzinmsg_queue_extract();
+    ASSERT_EQUAL(n->type, BBZMSG_SWARM);
+    ASSERT_EQUAL(n->sw.rid, 1);
+    ASSERT_EQUAL(n->sw.lamport, 0x1234);
+    ASSERT_EQUAL(n->sw.swarms, 0x42);
+#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_SWARMLIST_BROADCASTS
+
+    // Compact messages are packed like fixed ones
+    uint8_t frame[2 * BBZMSG_COMPACT_MAX_SIZE + 1];
+    uint8_t pos = 0;
+    m.vs.type = BBZMSG_VSTIG_PUT;
+    m.vs.rid = 1;
+    m.vs.key = 0x1234;
+    m.vs.data.mdata = 0;
+    bbztype_cast(m.vs.data, BBZTYPE_INT);
+    m.vs.data.i.value = 5;
+    m.vs.lamport = 3;
+    uint8_t size = bbzmsg_compact_put(frame + pos, &m);
+    ASSERT_EQUAL(size, 1 + 1 + 2 + 1 + 1);
+    frame[pos] = BBZMSG_PACK_HDR(frame[pos], size - 1);
+    pos += size;
+    m.vs.type = BBZMSG_VSTIG_QUERY;
+    m.vs.rid = 2;
+    m.vs.key = __BBZSTRID_put;
+    m.vs.data.mdata = 0;
+    bbztype_cast(m.vs.data, BBZTYPE_NIL);
+    m.vs.lamport = 9;
+    size = bbzmsg_compact_put(frame + pos, &m);
+    frame[pos] = BBZMSG_PACK_HDR(frame[pos], size - 1);
+    pos += size;
+    frame[pos] = 0;
+    bbzinmsg_queue_unpack(frame, sizeof(frame));
+    REQUIRE(bbzinmsg_queue_size() == 2);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->type, BBZMSG_VSTIG_PUT);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.rid, 1);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.key, 0x1234);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.data.i.value, 5);
+    ASSERT_EQUAL(bbzinmsg_queue_get(0)->vs.lamport, 3);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->type, BBZMSG_VSTIG_QUERY);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.rid, 2);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.key, __BBZSTRID_put);
+    ASSERT_EQUAL(bbztype(bbzinmsg_queue_get(1)->vs.data), BBZTYPE_NIL);
+    ASSERT_EQUAL(bbzinmsg_queue_get(1)->vs.lamport, 9);
+    while (!bbzinmsg_queue_isempty()) bbzinmsg_queue_extract();
+
+#ifdef BBZ_COMPACT_MESSAGES
+    // The compact encoding is sent only when it is shorter
+    uint8_t raw[BBZMSG_MAX_SIZE];
+    bbzoutmsg_queue_append_broadcast(bbzstring_get(__BBZSTRID_count), bbzint_new(5));
+    ASSERT_EQUAL(bbzoutmsg_queue_first_raw(raw), 1 + 1 + 1 + 1);
+    ASSERT_EQUAL(raw[0], BBZMSG_BROADCAST | BBZMSG_COMPACT);
+    bbzoutmsg_queue_next();
+    bbzoutmsg_queue_append_vstig(BBZMSG_VSTIG_PUT, 0xFFFF, 0xFFFF, bbzint_new(-32768), 1);
+    ASSERT_EQUAL(bbzoutmsg_queue_first_raw(raw), BBZMSG_VSTIG_SIZE);
+    ASSERT_EQUAL(raw[0], BBZMSG_VSTIG_PUT);
+    bbzoutmsg_queue_next();
+#endif // BBZ_COMPACT_MESSAGES
+}
+
+/**
+ * @brief Receives a message like the robots do: a broadcast also adds its
+ * sender to the neighbors.
+ * @param[in] data The message, starting with its type byte.
+ * @param[in] len The size of the message (B).
+ * @return The robot ID read, or 0 if the message is not a broadcast.
+ */
+static bbzrobot_id_t rx_msg(const uint8_t* data, uint8_t len) {
+    bbzrobot_id_t rid = 0;
+    if ((data[0] & ~BBZMSG_COMPACT) == BBZMSG_BROADCAST &&
+        bbzmsg_raw_get_rid(&rid, data[0], data + 1, (uint8_t)(len - 1))) {
+#ifndef BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_elem_t elem = {.robot=rid,.distance=10,.azimuth=0,.elevation=0};
+#else // !BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_elem_t elem = {.robot=rid,.distance=bbzfloat_fromint(10),.azimuth=bbzfloat_fromint(0),.elevation=bbzfloat_fromint(0)};
+#endif // !BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_add(&elem);
+    }
+    bbzinmsg_queue_append_raw(data, len);
+    return rid;
+}
+
+/**
+ * @brief Returns the number of neighbors.
+ */
+static uint8_t neighbors_num() {
+#ifndef BBZ_XTREME_MEMORY
+    return vm->neighbors.count;
+#else
+    return (uint8_t)bbzringbuf_size(&vm->neighbors.rb);
+#endif
+}
+
+TEST(m_rx_neighbor) {
+    vm = &vmObj;
+    bbzvm_construct(42);
+
+    // A compact broadcast with a 2-byte robot ID, in a radio frame of the
+    // size of a fixed one
+    uint8_t data[BBZMSG_BROADCAST_SIZE] = {0};
+    bbzmsg_t m;
+    m.bc.type = BBZMSG_BROADCAST;
+    m.bc.rid = 300;
+    m.bc.topic = __BBZSTRID_count;
+    m.bc.value.mdata = 0;
+    bbztype_cast(m.bc.value, BBZTYPE_INT);
+    m.bc.value.i.value = 3;
+    REQUIRE(bbzmsg_compact_put(data, &m) == 1 + 2 + 1 + 1);
+    ASSERT(bbzmsg_raw_get_u16(data + 1) != 300);
+    ASSERT_EQUAL(rx_msg(data, sizeof(data)), 300);
+    ASSERT_EQUAL(neighbors_num(), 1);
+    REQUIRE(bbzinmsg_queue_size() == 1);
+    bbzmsg_t* n = bbzinmsg_queue_extract();
+    ASSERT_EQUAL(n->type, BBZMSG_BROADCAST);
+    ASSERT_EQUAL(n->bc.rid, 300);
+    ASSERT_EQUAL(n->bc.value.i.value, 3);
+
+    // Another robot, with the fixed encoding
+    data[0] = BBZMSG_BROADCAST;
+    bbzmsg_raw_put_u16(data + 1, 302);
+    bbzmsg_raw_put_u16(data + 3, __BBZSTRID_count);
+    bbzmsg_raw_put_obj(data + 5, &m.bc.value);
+    ASSERT_EQUAL(rx_msg(data, sizeof(data)), 302);
+    ASSERT_EQUAL(neighbors_num(), 2);
+    REQUIRE(bbzinmsg_queue_size() == 1);
+    ASSERT_EQUAL(bbzinmsg_queue_extract()->bc.rid, 302);
+
+    // Other compact messages add no neighbor
+    m.vs.type = BBZMSG_VSTIG_QUERY;
+    m.vs.rid = 7;
+    m.vs.key = 1;
+    m.vs.data.mdata = 0;
+    bbztype_cast(m.vs.data, BBZTYPE_NIL);
+    m.vs.lamport = 1;
+    REQUIRE(bbzmsg_compact_put(data, &m) == 1 + 1 + 1 + 1 + 1);
+    ASSERT_EQUAL(rx_msg(data, 1 + 1 + 1 + 1 + 1), 0);
+    ASSERT_EQUAL(neighbors_num(), 2);
+    while (!bbzinmsg_queue_isempty()) bbzinmsg_queue_extract();
+
+    // Packed broadcasts are found from their header, flag included
+    uint8_t frame[BBZMSG_COMPACT_MAX_SIZE + 1] = {0};
+    m.bc.type = BBZMSG_BROADCAST;
+    m.bc.rid = 301;
+    m.bc.topic = __BBZSTRID_count;
+    m.bc.value.mdata = 0;
+    bbztype_cast(m.bc.value, BBZTYPE_INT);
+    m.bc.value.i.value = 3;
+    uint8_t size = bbzmsg_compact_put(frame, &m);
+    frame[0] = BBZMSG_PACK_HDR(frame[0], size - 1);
+    ASSERT_EQUAL(BBZMSG_PACK_BASETYPE(frame[0]), BBZMSG_BROADCAST);
+    bbzrobot_id_t rid;
+    ASSERT(bbzmsg_raw_get_rid(&rid, BBZMSG_PACK_TYPE(frame[0]), frame + 1, BBZMSG_PACK_LEN(frame[0])));
+    ASSERT_EQUAL(rid, 301);
+
+    // Truncated robot IDs are not read
+    ASSERT(!bbzmsg_raw_get_rid(&rid, BBZMSG_PACK_TYPE(frame[0]), frame + 1, 1));
+    ASSERT(!bbzmsg_raw_get_rid(&rid, BBZMSG_BROADCAST, frame + 1, 1));
+
+    bbzvm_destruct();
+}
+#endif // !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS && !BBZ_DISABLE_MESSAGES
 
 TEST_LIST {
-#if !defined(BBZ_DISABLE_SWARMS) && !defined(BBZ_DISABLE_NEIGHBORS) && !defined(BBZ_DISABLE_VSTIGS) && !defined(BBZ_DISABLE_MESSAGES) && !defined(BBZ_DISABLE_SWARMLIST_BROADCASTS)
+#if !defined(BBZ_DISABLE_NEIGHBORS) && !defined(BBZ_DISABLE_VSTIGS) && !defined(BBZ_DISABLE_MESSAGES)
     ADD_TEST(m_serialize8);
     ADD_TEST(m_deserialize8);
     ADD_TEST(m_serialize16);
     ADD_TEST(m_deserialize16);
     ADD_TEST(m_out_append);
     ADD_TEST(m_out_queue_first);
+    ADD_TEST(m_out_priority);
     ADD_TEST(m_in_append);
     ADD_TEST(m_in_queue_first);
-#endif // !BBZ_DISABLE_SWARMS && !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS && !BBZ_DISABLE_MESSAGES
+    ADD_TEST(m_raw);
+    ADD_TEST(m_pack);
+    ADD_TEST(m_compact);
+    ADD_TEST(m_rx_neighbor);
+#endif // !BBZ_DISABLE_NEIGHBORS && !BBZ_DISABLE_VSTIGS && !BBZ_DISABLE_MESSAGES
 }
\ No newline at end of file
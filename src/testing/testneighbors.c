@@ -1,6 +1,6 @@
 #include <bittybuzz/bbzneighbors.h>
 
-#define NUM_TEST_CASES 11
+#define NUM_TEST_CASES 12
 #define TEST_MODULE neighbors
 #include "testingconfig.h"
 
@@ -209,9 +209,7 @@ TEST(map) {
 void reduce_fun() {
     bbzvm_assert_lnum(3);
 
-    bbzheap_obj_at(bbzvm_locals_at(3))->i.value += 1;
-
-    bbzvm_lload(3);
+    bbzvm_pushi(bbzheap_obj_at(bbzvm_locals_at(3))->i.value + 1);
     bbzvm_ret1();
 }
 
@@ -234,10 +232,9 @@ TEST(reduce) {
     bbzvm_tget();
     bbzvm_pushcc(reduce_fun);
     bbzvm_pushi(0);
-    bbzheap_idx_t ret = bbzvm_stack_at(0);
     bbzvm_closure_call(2);
     REQUIRE(vm->state != BBZVM_STATE_ERROR);
-    ASSERT_EQUAL(bbzheap_obj_at(ret)->i.value, 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 2);
 
     bbzvm_gc();
     bbzvm_destruct();
@@ -302,6 +299,65 @@ TEST(count) {
     bbzvm_destruct();
 }
 
+TEST(neighborlike) {
+    bbzvm_construct(0);
+
+    for (uint8_t i = 1; i <= BBZNEIGHBORS_CAP; ++i) {
+#ifndef BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_elem_t elem = {.robot=i,.distance=i,.azimuth=0,.elevation=0};
+#else // !BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_elem_t elem = {.robot=i,.distance=bbzfloat_fromint(i),.azimuth=bbzfloat_fromint(0),.elevation=bbzfloat_fromint(0)};
+#endif // !BBZ_NEIGHBORS_USE_FLOATS
+        bbzneighbors_add(&elem);
+    }
+    bbzvm_gc();
+
+    // The result of 'map' only holds the results
+#ifdef BBZ_HEAP_STATS
+    uint16_t closures = vm->heap.stats.allocs[BBZTYPE_CLOSURE];
+#endif // BBZ_HEAP_STATS
+    bbzvm_push(vm->neighbors.hpos);
+    bbzvm_dup(); // Push self table
+    bbzvm_pushs(__BBZSTRID_map);
+    bbzvm_tget();
+    bbzvm_pushcc(map_fun);
+    bbzvm_closure_call(1);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+#ifdef BBZ_HEAP_STATS
+    ASSERT_EQUAL(vm->heap.stats.allocs[BBZTYPE_CLOSURE], closures + 1); // map_fun
+#endif // BBZ_HEAP_STATS
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    ASSERT(bbztype_isneighborlike(*bbzheap_obj_at(t)));
+    ASSERT_EQUAL(bbztable_size(t), BBZNEIGHBORS_CAP);
+    for (uint8_t i = 1; i <= BBZNEIGHBORS_CAP; ++i) {
+        bbzheap_idx_t v;
+        REQUIRE(bbztable_get(t, bbzint_new(i), &v));
+        ASSERT_EQUAL(bbzheap_obj_at(v)->i.value, i);
+    }
+
+    // Its methods come from the shared table
+    bbzvm_push(t);
+    bbzvm_dup(); // Push self table
+    bbzvm_pushs(__BBZSTRID_count);
+    bbzvm_tget();
+    REQUIRE(bbztype_isclosure(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    bbzvm_closure_call(0);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, BBZNEIGHBORS_CAP);
+    bbzvm_pop();
+    bbzvm_push(t);
+    bbzvm_dup(); // Push self table
+    bbzvm_pushs(__BBZSTRID_get);
+    bbzvm_tget();
+    bbzvm_pushi(3);
+    bbzvm_closure_call(1);
+    REQUIRE(vm->state != BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 3);
+
+    bbzvm_gc();
+    bbzvm_destruct();
+}
+
 #ifndef BBZ_XTREME_MEMORY
 #define data_gc_count vm->neighbors.count
 #else // !BBZ_XTREME_MEMORY
@@ -352,5 +408,6 @@ TEST_LIST {
     ADD_TEST(reduce);
     ADD_TEST(filter);
     ADD_TEST(count);
+    ADD_TEST(neighborlike);
     ADD_TEST(data_gc);
 }
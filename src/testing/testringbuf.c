@@ -1,7 +1,7 @@
 #include <bittybuzz/bbzringbuf.h>
 
 #define TEST_MODULE bbzringbuf
-#define NUM_TEST_CASES 9
+#define NUM_TEST_CASES 11
 #include "testingconfig.h"
 
 TEST(rb_construct) {
@@ -124,6 +124,54 @@ TEST(rb_makeslot) {
     ASSERT_EQUAL(rb.dataend, 2);
 }
 
+TEST(rb_bytes_push_pop) {
+    uint8_t buf[BBZRINGBUF_BYTES_CAP];
+    bbzringbuf_bytes_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
+
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), 0);
+    ASSERT_EQUAL(bbzringbuf_bytes_pop(&rb), 0);
+    for (uint8_t i = 0; i < BBZRINGBUF_BYTES_CAP; ++i) {
+        ASSERT_EQUAL(bbzringbuf_bytes_full(&rb), 0);
+        bbzringbuf_bytes_push(&rb, i);
+    }
+    ASSERT_EQUAL(bbzringbuf_bytes_full(&rb), 1);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), BBZRINGBUF_BYTES_CAP);
+
+    // When full, the oldest byte is dropped.
+    bbzringbuf_bytes_push(&rb, 0x42);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), BBZRINGBUF_BYTES_CAP);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 0), 1);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, BBZRINGBUF_BYTES_CAP - 1), 0x42);
+    ASSERT_EQUAL((uintptr_t)bbzringbuf_bytes_at(&rb, BBZRINGBUF_BYTES_CAP - 1), (uintptr_t)&buf[0]);
+
+    ASSERT_EQUAL(bbzringbuf_bytes_pop(&rb), 1);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), BBZRINGBUF_BYTES_CAP - 1);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 0), 2);
+}
+
+TEST(rb_bytes_wrap) {
+    uint8_t buf[BBZRINGBUF_BYTES_CAP];
+    bbzringbuf_bytes_t rb;
+    bbzringbuf_bytes_construct(&rb, buf);
+
+    // The indices run past the end of their type.
+    rb.datastart = 0xFE;
+    rb.dataend = 0xFE;
+    bbzringbuf_bytes_push(&rb, 0x12);
+    bbzringbuf_bytes_push(&rb, 0x34);
+    bbzringbuf_bytes_push(&rb, 0x56);
+    ASSERT_EQUAL(rb.dataend, 1);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), 3);
+    ASSERT_EQUAL((uintptr_t)bbzringbuf_bytes_at(&rb, 0), (uintptr_t)&buf[BBZRINGBUF_BYTES_CAP - 2]);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 1), 0x34);
+    ASSERT_EQUAL((uintptr_t)bbzringbuf_bytes_at(&rb, 2), (uintptr_t)&buf[0]);
+    ASSERT_EQUAL(*bbzringbuf_bytes_at(&rb, 2), 0x56);
+
+    bbzringbuf_bytes_clear(&rb);
+    ASSERT_EQUAL(bbzringbuf_bytes_size(&rb), 0);
+}
+
 TEST_LIST {
     ADD_TEST(rb_construct);
     ADD_TEST(rb_capacity);
@@ -134,4 +182,6 @@ TEST_LIST {
     ADD_TEST(rb_empty);
     ADD_TEST(rb_pop);
     ADD_TEST(rb_makeslot);
+    ADD_TEST(rb_bytes_push_pop);
+    ADD_TEST(rb_bytes_wrap);
 }
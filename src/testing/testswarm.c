@@ -1,7 +1,9 @@
 #define NUM_TEST_CASES 13
 #define TEST_MODULE swarm
 #include "testingconfig.h"
+#include "testingbcode.h"
 
+#include <stdlib.h>
 #include <bittybuzz/bbzswarm.h>
 
 #ifndef BBZ_DISABLE_SWARMLIST_BROADCASTS
@@ -18,7 +20,13 @@ int16_t fsize;
 uint8_t buf[4];
 
 /**
- * @brief Fetches bytecode from a FILE.
+ * @brief Bytecode of the file being tested.
+ * @see testing_load_bcode()
+ */
+uint8_t* bcode_buf;
+
+/**
+ * @brief Fetches bytecode from the file loaded in RAM.
  * @param[in] offset Offset of the bytes to fetch.
  * @param[in] size Size of the data to fetch.
  * @return A pointer to the data fetched.
@@ -26,16 +34,14 @@ uint8_t buf[4];
 const uint8_t* testBcode(bbzpc_t offset, uint8_t size) {
     if (offset + size - 2 >= fsize) {
         fprintf(stderr, "Trying to read outside of bytecode. Offset: %"
-                PRIu16 ", size: %" PRIu8 ".", offset, size);
+                        PRIu16 ", size: %" PRIu8 ".", offset, size);
     }
     else {
         switch(size) {
             case sizeof(uint8_t):  // Fallthrough
             case sizeof(uint16_t): // Fallthrough
             case sizeof(uint32_t): {
-                fseek(fbcode, offset, SEEK_SET);
-                RM_UNUSED_RETVAL_WARN(fread(buf, size, 1, fbcode));
-                break;
+                return bcode_buf + offset;
             }
             default: {
                 fprintf(stderr, "Bad bytecode size: %" PRIu8 ".", size);
@@ -921,9 +927,10 @@ TEST(swarm_script) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // 2) Set the bytecode in the VM.
-    bbzvm_set_bcode(&testBcode, fsize);
+    bbzvm_set_bcode_ptr(bcode_buf, fsize);
     bbzvm_function_register(BBZVM_SYMID_LED, dummy);
     bbzvm_function_register(BBZVM_SYMID_DELAY, dummy);
 
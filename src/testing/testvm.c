@@ -1,10 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <bittybuzz/bbztype.h>
 #include <bittybuzz/bbzvm.h>
 
-#define NUM_TEST_CASES 17
+#define NUM_TEST_CASES 23
 #define TEST_MODULE vm
 #include "testingconfig.h"
+#include "testingbcode.h"
 
     // ======================================
     // =                MISC                =
@@ -51,14 +53,20 @@ char* state_desc[] = {"BBZVM_STATE_NOCODE", "BBZVM_STATE_READY", "BBZVM_STATE_ST
 char* error_desc[] = {"BBZVM_ERROR_NONE", "BBZVM_ERROR_INSTR", "BBZVM_ERROR_STACK", "BBZVM_ERROR_LNUM", "BBZVM_ERROR_PC",
                       "BBZVM_ERROR_FLIST", "BBZVM_ERROR_TYPE", "BBZVM_ERROR_OUTOFRANGE", "BBZVM_ERROR_NOTIMPL",
                       "BBZVM_ERROR_RET", "BBZVM_ERROR_STRING", "BBZVM_ERROR_SWARM", "BBZVM_ERROR_VSTIG", "BBZVM_ERROR_MEM",
-                      "BBZVM_ERROR_MATH"};
+                      "BBZVM_ERROR_MATH", "BBZVM_ERROR_PTRS"};
 char* instr_desc[] = {"NOP", "DONE", "PUSHNIL", "DUP", "POP", "RET0", "RET1", "ADD", "SUB", "MUL", "DIV", "MOD", "POW",
                       "UNM", "LAND", "LOR", "LNOT","BAND","BOR","BNOT", "LSHIFT", "RSHIFT", "EQ", "NEQ", "GT", "GTE", "LT", "LTE", "GLOAD", "GSTORE", "PUSHT", "TPUT",
                       "TGET", "CALLC", "CALLS", "PUSHF", "PUSHI", "PUSHS", "PUSHCN", "PUSHCC", "PUSHL", "LLOAD", "LSTORE", "LREMOVE",
-                      "JUMP", "JUMPZ", "JUMPNZ", "COUNT"};
+                      "JUMP", "JUMPZ", "JUMPNZ", "GLOADS", "LTGETS", "ADDI", "JLT", "COUNT"};
 
 /**
- * @brief Fetches bytecode from a FILE.
+ * @brief Bytecode of the file being tested.
+ * @see testing_load_bcode()
+ */
+uint8_t* bcode_buf;
+
+/**
+ * @brief Fetches bytecode from the file loaded in RAM.
  * @param[in] offset Offset of the bytes to fetch.
  * @param[in] size Size of the data to fetch.
  * @return A pointer to the data fetched.
@@ -73,9 +81,7 @@ const uint8_t* testBcode(bbzpc_t offset, uint8_t size) {
             case sizeof(uint8_t):  // Fallthrough
             case sizeof(uint16_t): // Fallthrough
             case sizeof(uint32_t): {
-                fseek(fbcode, offset, SEEK_SET);
-                RM_UNUSED_RETVAL_WARN(fread(buf, size, 1, fbcode));
-                break;
+                return bcode_buf + offset;
             }
             default: {
                 fprintf(stderr, "Bad bytecode size: %" PRIu8 ".", size);
@@ -183,7 +189,7 @@ void logfunc() {
 }
 
 void bbzvm_log() {
-    uint16_t nArg = bbzdarray_size(vm->lsyms) - 1;
+    uint16_t nArg = bbzvm_locals_count();
     for (uint16_t i = 0; i < nArg; ++i) {
         bbzvm_lload(nArg - i);
     }
@@ -224,6 +230,7 @@ int8_t bbzvm_register_functions() {
 #define FILE_TEST2 "resources/2_IfTest.bbo"
 #define FILE_TEST3 "resources/3_test1.bbo"
 #define FILE_TEST4 "resources/4_AllFeaturesTest.bbo"
+#define FILE_TEST5 "resources/5_FuseTarget.bbo"
 
 TEST(vm_construct) {
     vm = &vmObj;
@@ -243,6 +250,366 @@ TEST(vm_construct) {
     bbzvm_destruct();
 }
 
+TEST(vm_globals) {
+    vm = &vmObj;
+
+    bbzvm_construct(0);
+
+    // Define many globals, so that their table grows
+#define VM_GLOBALS_COUNT 40
+    for (uint16_t i = 0; i < VM_GLOBALS_COUNT; ++i) {
+        bbzvm_pushs(_BBZSTRID_COUNT_ + i);
+        bbzvm_pushi(i);
+        bbzvm_gstore();
+        // Read back all of them, which remembers where they are
+        for (uint16_t j = 0; j <= i; ++j) {
+            bbzvm_pushs(_BBZSTRID_COUNT_ + j);
+            bbzvm_gload();
+            ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, j);
+            bbzvm_pop();
+        }
+    }
+
+    // Assignments are seen in the global symbols table, and the other way around
+    bbzvm_pushs(_BBZSTRID_COUNT_ + 3);
+    bbzvm_pushi(-3);
+    bbzvm_gstore();
+    bbzheap_idx_t o;
+    REQUIRE(bbztable_get(vm->gsyms, bbzstring_get(_BBZSTRID_COUNT_ + 3), &o));
+    ASSERT_EQUAL(bbzheap_obj_at(o)->i.value, -3);
+    REQUIRE(bbztable_set(vm->gsyms, bbzstring_get(_BBZSTRID_COUNT_ + 4), bbzint_new(-4)));
+    bbzvm_pushs(_BBZSTRID_COUNT_ + 4);
+    bbzvm_gload();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, -4);
+    bbzvm_pop();
+
+    // Removed globals are nil
+    bbzvm_pushs(_BBZSTRID_COUNT_ + 5);
+    bbzvm_pushnil();
+    bbzvm_gstore();
+    bbzvm_pushs(_BBZSTRID_COUNT_ + 5);
+    bbzvm_gload();
+    ASSERT(bbztype_isnil(*bbzheap_obj_at(bbzvm_stack_at(0))));
+    bbzvm_pop();
+    ASSERT(!bbztable_get(vm->gsyms, bbzstring_get(_BBZSTRID_COUNT_ + 5), &o));
+    bbzvm_pushs(_BBZSTRID_COUNT_ + 6);
+    bbzvm_gload();
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 6);
+    bbzvm_pop();
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Operand of an instruction of run_bcode.
+ */
+#define RUN_ARG(v) (uint8_t)((uint16_t)(v) & 0xFF), (uint8_t)((uint16_t)(v) >> 8)
+
+/**
+ * @brief Offset of the first instruction of the script in run_bcode.
+ */
+#define RUN_START 3
+
+/**
+ * @brief Offset of the closure in run_bcode.
+ */
+#define RUN_LAMBDA 27
+
+/**
+ * @brief Bytecode for the vm_run and vm_set_bytecode_ptr tests.
+ */
+static const uint8_t run_bcode[] = {
+    RUN_ARG(0),                         // 0: No strings
+    BBZVM_INSTR_NOP,                    // 2
+    BBZVM_INSTR_PUSHI, RUN_ARG(20),     // 3: RUN_START
+    BBZVM_INSTR_PUSHI, RUN_ARG(22),     // 6
+    BBZVM_INSTR_ADD,                    // 9
+    BBZVM_INSTR_PUSHI, RUN_ARG(40),     // 10
+    BBZVM_INSTR_LT,                     // 13
+    BBZVM_INSTR_PUSHI, RUN_ARG(10000),  // 14
+    BBZVM_INSTR_PUSHI, RUN_ARG(30000),  // 17
+    BBZVM_INSTR_ADD,                    // 20
+    BBZVM_INSTR_PUSHI, RUN_ARG(7),      // 21
+    BBZVM_INSTR_MUL,                    // 24
+    BBZVM_INSTR_NOP,                    // 25
+    BBZVM_INSTR_DONE,                   // 26
+    BBZVM_INSTR_PUSHI, RUN_ARG(5),      // 27: RUN_LAMBDA
+    BBZVM_INSTR_PUSHI, RUN_ARG(6),      // 30
+    BBZVM_INSTR_MUL,                    // 33
+    BBZVM_INSTR_RET1,                   // 34
+};
+
+/**
+ * @brief Fetches bytecode from run_bcode.
+ * @param[in] offset Offset of the bytes to fetch.
+ * @param[in] size Size of the data to fetch.
+ * @return A pointer to the data fetched.
+ */
+const uint8_t* runBcode(bbzpc_t offset, uint8_t size) {
+    RM_UNUSED_WARN(size);
+    return run_bcode + offset;
+}
+
+TEST(vm_run) {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+    bbzvm_set_bcode(runBcode, sizeof(run_bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    REQUIRE(vm->pc == RUN_START);
+
+    // Run a given number of instructions
+    ASSERT_EQUAL(bbzvm_run(3), 3);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->pc, 10);
+    ASSERT_EQUAL(bbzvm_stack_size(), 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 42);
+
+    // Run until the end of the script, which is the 9th next instruction
+    ASSERT_EQUAL(bbzvm_run(100), 9);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->pc, 26);
+    ASSERT_EQUAL(bbzvm_stack_size(), 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 0); // 42 < 40
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, (int16_t)((int16_t)(10000 + 30000) * 7));
+    ASSERT_EQUAL(bbzvm_run(100), 0);
+    ASSERT_EQUAL(vm->pc, 26);
+
+    // Run a closure call
+    vm->state = BBZVM_STATE_READY;
+    vm->pc = RUN_START;
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushl(RUN_LAMBDA);
+    bbzvm_pushi(0);
+    int16_t blockptr = vm->blockptr;
+    bbzvm_callc();
+    REQUIRE(vm->blockptr > blockptr);
+    ASSERT_EQUAL(vm->pc, RUN_LAMBDA);
+    ASSERT_EQUAL(bbzvm_run_call(blockptr, 2), 2);
+    // Stops when the closure returns
+    ASSERT_EQUAL(bbzvm_run_call(blockptr, 100), 2);
+    ASSERT_EQUAL(vm->blockptr, blockptr);
+    ASSERT_EQUAL(vm->pc, RUN_START);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 30);
+    ASSERT_EQUAL(bbzvm_run_call(blockptr, 100), 0);
+    bbzvm_pop();
+
+    // Same through bbzvm_closure_call()
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushl(RUN_LAMBDA);
+    bbzvm_closure_call(0);
+    ASSERT_EQUAL(vm->blockptr, blockptr);
+    ASSERT_EQUAL(vm->pc, RUN_START);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 30);
+    ASSERT_EQUAL(bbzvm_stack_size(), 3);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_set_bytecode_ptr) {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    bbzvm_set_bcode_ptr(run_bcode, sizeof(run_bcode));
+    ASSERT_EQUAL((uintptr_t)vm->bcode_ptr, (uintptr_t)run_bcode);
+    ASSERT_EQUAL(vm->bcode_size, sizeof(run_bcode));
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(vm->pc, RUN_START);
+    // The fetcher function still works
+    ASSERT_EQUAL(*vm->bcode_fetch_fun(RUN_LAMBDA, 1), BBZVM_INSTR_PUSHI);
+
+    ASSERT_EQUAL(bbzvm_run(100), 12);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->pc, 26);
+    ASSERT_EQUAL(bbzvm_stack_size(), 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, (int16_t)((int16_t)(10000 + 30000) * 7));
+
+    // Going back to a fetcher function
+    bbzvm_set_bcode(runBcode, sizeof(run_bcode));
+    ASSERT_EQUAL((uintptr_t)vm->bcode_ptr, (uintptr_t)NULL);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Address of the closure in fused_bcode.
+ */
+#define FUSED_LAMBDA 24
+
+/**
+ * @brief Bytecode for the vm_fused_instrs test.
+ */
+static const uint8_t fused_bcode[] = {
+    RUN_ARG(0),                                     // 0: No strings
+    BBZVM_INSTR_NOP,                                // 2
+    BBZVM_INSTR_PUSHI, RUN_ARG(0),                  // 3
+    BBZVM_INSTR_DUP,                                // 6
+    BBZVM_INSTR_PUSHI, RUN_ARG(4),                  // 7
+    BBZVM_INSTR_JLT, RUN_ARG(20),                   // 10
+    BBZVM_INSTR_ADDI, RUN_ARG(1),                   // 13
+    BBZVM_INSTR_JUMP, RUN_ARG(6),                   // 16
+    BBZVM_INSTR_NOP,                                // 19
+    BBZVM_INSTR_GLOADS, RUN_ARG(__BBZSTRID_id),     // 20
+    BBZVM_INSTR_DONE,                               // 23
+    BBZVM_INSTR_LTGETS, RUN_ARG(1), RUN_ARG(__BBZSTRID_id), // 24: FUSED_LAMBDA
+    BBZVM_INSTR_ADDI, RUN_ARG(-3),                  // 29
+    BBZVM_INSTR_RET1,                               // 32
+};
+
+TEST(vm_fused_instrs) {
+    vm = &vmObj;
+    bbzvm_construct(7);
+    bbzvm_set_error_receiver(&set_last_error);
+    bbzvm_set_bcode_ptr(fused_bcode, sizeof(fused_bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // Loop counting up to 4: 5 comparisons, 4 increments and 4 jumps
+    ASSERT_EQUAL(bbzvm_run(100), 1 + 5 * 3 + 4 * 2 + 2);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 2);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(1))->i.value, 4);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 7);
+
+    // Slow paths with non-integer operands
+    bbzvm_pop();
+    bbzvm_pop();
+    vm->state = BBZVM_STATE_READY;
+    vm->pc = 13;
+    bbzvm_pushnil();
+    bbzvm_step();
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT(get_last_error() != BBZVM_ERROR_NONE);
+    bbzvm_destruct();
+
+    // Table lookup through a local variable
+    bbzvm_construct(7);
+    bbzvm_set_error_receiver(&set_last_error);
+    bbzvm_set_bcode_ptr(fused_bcode, sizeof(fused_bcode));
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushl(FUSED_LAMBDA);
+    bbzvm_pusht();
+    bbzheap_idx_t t = bbzvm_stack_at(0);
+    bbzvm_pushs(__BBZSTRID_id);
+    bbzheap_idx_t k = bbzvm_stack_at(0);
+    bbzvm_pop();
+    bbztable_set(t, k, bbzint_new(45));
+    bbzvm_closure_call(1);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 42);
+
+    bbzvm_destruct();
+}
+
+TEST(vm_fused_jump_target) {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error);
+
+    // See 5_FuseTarget.basm: the ADD at 28 is a jump target and must stay
+    // unfused, while the PUSHI/ADD at 40 is only jumped to by its first
+    // instruction and becomes an ADDI.
+    fbcode = fopen(FILE_TEST5, "rb");
+    REQUIRE(fbcode != NULL);
+    REQUIRE(fseek(fbcode, 0, SEEK_END) == 0);
+    fsize = ftell(fbcode);
+    REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    // 13 instructions in the Buzz Object, 12 after exactly one fusion
+    ASSERT_EQUAL(fsize, 2 + 1 + 7 * 3 + 1 + 1 + 3 + 1);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
+
+    bbzvm_set_bcode_ptr(bcode_buf, fsize);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    ASSERT_EQUAL(bbzvm_run(100), 9);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_DONE);
+    ASSERT_EQUAL(vm->error, BBZVM_ERROR_NONE);
+    ASSERT_EQUAL(bbzvm_stack_size(), 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 8);
+
+    fclose(fbcode);
+    bbzvm_destruct();
+}
+
+/**
+ * @brief Address of the closure returning a closure in lsyms_bcode.
+ */
+#define LSYMS_OUTER 4
+
+/**
+ * @brief Address of the returned closure in lsyms_bcode.
+ */
+#define LSYMS_INNER 14
+
+/**
+ * @brief Bytecode for the vm_local_symbols test.
+ */
+static const uint8_t lsyms_bcode[] = {
+    RUN_ARG(0),                                 // 0: No strings
+    BBZVM_INSTR_NOP,                            // 2
+    BBZVM_INSTR_DONE,                           // 3
+    BBZVM_INSTR_PUSHI, RUN_ARG(5),              // 4: LSYMS_OUTER
+    BBZVM_INSTR_LSTORE, RUN_ARG(2),             // 7
+    BBZVM_INSTR_PUSHL, RUN_ARG(LSYMS_INNER),    // 10
+    BBZVM_INSTR_RET1,                           // 13
+    BBZVM_INSTR_LLOAD, RUN_ARG(1),              // 14: LSYMS_INNER
+    BBZVM_INSTR_LLOAD, RUN_ARG(2),              // 17
+    BBZVM_INSTR_ADD,                            // 20
+    BBZVM_INSTR_LLOAD, RUN_ARG(3),              // 21
+    BBZVM_INSTR_ADD,                            // 24
+    BBZVM_INSTR_RET1,                           // 25
+};
+
+TEST(vm_local_symbols) {
+    vm = &vmObj;
+    bbzvm_construct(0);
+    bbzvm_set_error_receiver(&set_last_error_no_print);
+    bbzvm_set_bcode_ptr(lsyms_bcode, sizeof(lsyms_bcode));
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+
+    // No local symbols outside of a closure
+    ASSERT_EQUAL(vm->lsymsptr, -1);
+    ASSERT_EQUAL(vm->lstackptr, -1);
+    bbzvm_lload(0);
+    ASSERT_EQUAL(vm->state, BBZVM_STATE_ERROR);
+    ASSERT_EQUAL(get_last_error(), BBZVM_ERROR_LNUM);
+    bbzvm_reset_state();
+
+    // The returned closure keeps the local symbols of the call that made it
+    bbzvm_pushnil(); // Push self table
+    bbzvm_pushl(LSYMS_OUTER);
+    bbzvm_pushi(10);
+    bbzvm_closure_call(1);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    ASSERT_EQUAL(vm->lsymsptr, -1);
+    ASSERT_EQUAL(vm->lstackptr, -1);
+    ASSERT_EQUAL(bbzvm_stack_size(), 1);
+    bbzheap_idx_t c = bbzvm_stack_at(0);
+    REQUIRE(bbztype_isclosurelambda(*bbzheap_obj_at(c)));
+    ASSERT(bbzheap_obj_at(c)->l.value.actrec != BBZHEAP_CLOSURE_DFLT_ACTREC);
+    ASSERT_EQUAL(bbzdarray_size(bbzheap_obj_at(c)->l.value.actrec), 3);
+
+    // Still there after a garbage collection
+    bbzvm_gc();
+    bbzvm_pop();
+    bbzvm_pushnil(); // Push self table
+    bbzvm_push(c);
+    bbzvm_pushi(7);
+    bbzvm_closure_call(1);
+    REQUIRE(vm->state == BBZVM_STATE_READY);
+    ASSERT_EQUAL(bbzvm_stack_size(), 1);
+    ASSERT_EQUAL(bbzheap_obj_at(bbzvm_stack_at(0))->i.value, 10 + 5 + 7);
+    ASSERT_EQUAL(vm->lstackptr, -1);
+
+    bbzvm_destruct();
+}
+
 TEST(vm_set_bytecode) {
     vm = &vmObj;
     bbzvm_construct(0);
@@ -255,6 +622,7 @@ TEST(vm_set_bytecode) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // 2) Set the bytecode in the VM.
     bbzvm_set_bcode(&testBcode, fsize);
@@ -271,19 +639,20 @@ TEST(vm_set_bytecode) {
     fclose(fbcode);
 }
 
-#define vm_step_instr()                         \
-    vm = &vmObj;                                \
-    bbzvm_construct(0);                         \
-    bbzvm_set_error_receiver(set_last_error);   \
-    fbcode = fopen(FILE_TEST1, "rb");           \
-    REQUIRE(fbcode != NULL);                    \
-    REQUIRE(fseek(fbcode, 0, SEEK_END) == 0);   \
-    fsize = ftell(fbcode);                      \
-    REQUIRE(fsize > 0);                         \
-    REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);   \
-    vm->state = BBZVM_STATE_READY;              \
-    vm->error = BBZVM_ERROR_NONE;               \
-    vm->bcode_fetch_fun = testBcode;            \
+#define vm_step_instr()                                             \
+    vm = &vmObj;                                                    \
+    bbzvm_construct(0);                                             \
+    bbzvm_set_error_receiver(set_last_error);                       \
+    fbcode = fopen(FILE_TEST1, "rb");                               \
+    REQUIRE(fbcode != NULL);                                        \
+    REQUIRE(fseek(fbcode, 0, SEEK_END) == 0);                       \
+    fsize = ftell(fbcode);                                          \
+    REQUIRE(fsize > 0);                                             \
+    REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);                       \
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize)); \
+    vm->state = BBZVM_STATE_READY;                                  \
+    vm->error = BBZVM_ERROR_NONE;                                   \
+    vm->bcode_fetch_fun = testBcode;                                \
     vm->bcode_size = fsize;
 
 TEST(vm_step_nop) {
@@ -486,6 +855,7 @@ TEST(vm_arith_logic) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // A) Set the bytecode in the VM.
     bbzvm_set_bcode(&testBcode, fsize);
@@ -545,6 +915,7 @@ TEST(vm_stack_empty) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // Set the bytecode in the VM.
     bbzvm_set_bcode(&testBcode, fsize);
@@ -600,6 +971,7 @@ TEST(vm_stack_full) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // 1) Reset the VM state
     vm->state = BBZVM_STATE_READY;
@@ -613,9 +985,8 @@ TEST(vm_stack_full) {
     vm->pc = 56;
 
     // 4) Set local symbols
-    bbzdarray_new(&vm->lsyms);
-    bbzheap_obj_make_permanent(*bbzheap_obj_at(vm->lsyms));
-    bbzdarray_push(vm->lsyms, vm->nil);
+    vm->lsymsptr = 0;
+    vm->lstack[++vm->lstackptr] = vm->nil;
 
     REQUIRE(bbzvm_stack_size() == 0);
     for (uint16_t i = 0; i < BBZSTACK_SIZE; ++i) {
@@ -661,6 +1032,7 @@ TEST(vm_closures) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
     // A) Set the bytecode in the VM.
     bbzvm_set_bcode(&testBcode, fsize);
@@ -673,7 +1045,7 @@ TEST(vm_closures) {
 
     REQUIRE(c > 0);
     ASSERT_EQUAL(bbztype(*bbzheap_obj_at(c)), BBZTYPE_CLOSURE);
-    ASSERT_EQUAL((intptr_t)bbzheap_obj_at(c)->c.value, (intptr_t)printIntVal);
+    ASSERT_EQUAL((intptr_t)bbzheap_obj_ptr(*bbzheap_obj_at(c)), (intptr_t)printIntVal);
 
     // C) Call registered C closure
     //REQUIRE(bbztable_size(vm->gsyms) == *(uint16_t*)vm->bcode_fetch_fun(0, 2));
@@ -720,9 +1092,9 @@ TEST(vm_message_processing) {
     bbztype_cast(obj1, BBZTYPE_INT);
     obj1.i.value = 0x2345;
 
-    uint8_t buf1[10];
+    uint8_t buf1[BBZMSG_PAYLOAD_CAP];
     bbzmsg_payload_t payload1;
-    bbzringbuf_construct(&payload1, buf1, 1, 10);
+    bbzringbuf_bytes_construct(&payload1, buf1);
 
     bbzmsg_serialize_u8 (&payload1, BBZMSG_VSTIG_PUT);
     bbzmsg_serialize_u16(&payload1, 42);
@@ -759,8 +1131,9 @@ TEST(vm_script_execution) {
     fsize = ftell(fbcode);
     REQUIRE(fsize > 0);
     REQUIRE(fseek(fbcode, 0, SEEK_SET) >= 0);
+    REQUIRE(testing_load_bcode(&bcode_buf, fbcode, (size_t)fsize));
 
-    bbzvm_set_bcode(&testBcode, fsize);
+    bbzvm_set_bcode_ptr(bcode_buf, fsize);
 
     REQUIRE(vm->state == BBZVM_STATE_READY);
     REQUIRE(bbzvm_register_functions() >= 0); // If this fails, it means that the heap doesn't have enough memory allocated to execute this test.
@@ -787,7 +1160,9 @@ TEST(vm_script_execution) {
 
 TEST_LIST {
     ADD_TEST(vm_construct);
+    ADD_TEST(vm_globals);
     ADD_TEST(vm_set_bytecode);
+    ADD_TEST(vm_set_bytecode_ptr);
     ADD_TEST(vm_step_nop);
     ADD_TEST(vm_step_done);
     ADD_TEST(vm_step_pushnil);
@@ -797,6 +1172,10 @@ TEST_LIST {
     ADD_TEST(vm_step_jump);
     ADD_TEST(vm_step_jumpz);
     ADD_TEST(vm_step_jumpnz);
+    ADD_TEST(vm_run);
+    ADD_TEST(vm_fused_instrs);
+    ADD_TEST(vm_fused_jump_target);
+    ADD_TEST(vm_local_symbols);
     ADD_TEST(vm_arith_logic);
     ADD_TEST(vm_stack_empty);
     ADD_TEST(vm_stack_full);
@@ -79,6 +79,7 @@ TEST(vstig_get) {
     bbzvm_closure_call(1);
     bbzheap_idx_t vs = bbzvm_stack_at(0);
 
+    bbzvm_dup(); // Keep the stigmergy on the stack
     bbzvm_dup(); // Push self table
     bbzvm_pushs(__BBZSTRID_put);
     bbzvm_tget();
@@ -1,9 +1,24 @@
 #include "bbzzooids.h"
 
+/**
+ * @brief Number of instructions executed between two updates of the
+ * robot's position and radio.
+ */
+#define BBZZOOIDS_RUN_BATCH 16
+
 bbzvm_t vmObj;
 Message bbzmsg_tx;
-uint8_t bbzmsg_buf[11];
-bbzmsg_payload_t bbz_payload_buf;
+
+/**
+ * @brief Size of the part of a radio frame that holds Buzz messages (B),
+ * after the robot ID and position.
+ */
+#define BBZZOOIDS_FRAME_SIZE (sizeof(bbzmsg_tx.payload) - sizeof(uint8_t) - sizeof(Position))
+
+/**
+ * @brief Number of messages packed in the frame being sent.
+ */
+static uint8_t bbzmsg_tx_count;
 
 extern Position robotPosition;
 extern float robotOrientation;
@@ -53,7 +68,7 @@ void bbzzooids_func_call(uint16_t strid) {
         bbzvm_callc();
         while(blockptr < vm->blockptr) {
             if(vm->state != BBZVM_STATE_READY) return;
-            bbzvm_step();
+            bbzvm_run_call(blockptr, BBZZOOIDS_RUN_BATCH);
 
             if (updateRobotPosition()) {
                 bbz_updatePosObject();
@@ -79,30 +94,34 @@ void bbzzooids_func_call(uint16_t strid) {
 Message* bbzwhich_msg_tx() {
 #ifndef BBZ_DISABLE_MESSAGES
     if(bbzoutmsg_queue_size()) {
-        bbzoutmsg_queue_first(&bbz_payload_buf);
         bbzmsg_tx.header.type = TYPE_BBZ_MESSAGE;
         bbzmsg_tx.header.id = RECEIVER_ID;
         *(uint8_t*)bbzmsg_tx.payload = getRobotId();
         *(Position*)(bbzmsg_tx.payload + sizeof(uint8_t)) = *getRobotPosition();
-        for (uint8_t i=0;i<9;++i) {
-            bbzmsg_tx.payload[i+sizeof(Position)+sizeof(uint8_t)] = *bbzringbuf_at(&bbz_payload_buf, i);
-        }
+        bbzmsg_tx_count = bbzoutmsg_queue_pack(bbzmsg_tx.payload + sizeof(Position) + sizeof(uint8_t), BBZZOOIDS_FRAME_SIZE);
         return &bbzmsg_tx;
     }
 #endif
     return 0;
 }
 
+void bbzsent_msg_tx() {
+#ifndef BBZ_DISABLE_MESSAGES
+    for (; bbzmsg_tx_count > 0; --bbzmsg_tx_count) {
+        bbzoutmsg_queue_next();
+    }
+#endif
+}
+
 void bbzprocess_msg_rx(Message* msg_rx, float distance, float azimuth) {
 #ifndef BBZ_DISABLE_MESSAGES
     if (msg_rx->header.type == TYPE_BBZ_MESSAGE) {
-        bbzringbuf_clear(&bbz_payload_buf);
-        for (uint8_t i = 0; i < 9; ++i) {
-            *bbzringbuf_rawat(&bbz_payload_buf, bbzringbuf_makeslot(&bbz_payload_buf)) = msg_rx->payload[i + sizeof(Position) + sizeof(uint8_t)];
-        }
-        // Add the neighbor data.
+        const uint8_t* payload = msg_rx->payload + sizeof(Position) + sizeof(uint8_t);
+        // Add the neighbor data. Broadcasts come first in a frame.
 #ifndef BBZ_DISABLE_NEIGHBORS
-        if (*bbzmsg_buf == BBZMSG_BROADCAST) {
+        bbzrobot_id_t rid;
+        if (*payload != 0 && BBZMSG_PACK_BASETYPE(*payload) == BBZMSG_BROADCAST &&
+            bbzmsg_raw_get_rid(&rid, BBZMSG_PACK_TYPE(*payload), payload + 1, BBZMSG_PACK_LEN(*payload))) {
             bbzneighbors_elem_t elem;
 #ifndef BBZ_NEIGHBORS_USE_FLOATS
             elem.azimuth = azimuth;
@@ -113,11 +132,11 @@ void bbzprocess_msg_rx(Message* msg_rx, float distance, float azimuth) {
             elem.elevation = bbzfloat_fromint(0);
             elem.distance = bbzfloat_fromfloat(distance);
 #endif // !BBZ_NEIGHBORS_USE_FLOATS
-            elem.robot = *(uint8_t*)msg_rx->payload;
+            elem.robot = rid;
             bbzneighbors_add(&elem);
         }
 #endif // !BBZ_DISABLE_NEIGHBORS
-        bbzinmsg_queue_append(&bbz_payload_buf);
+        bbzinmsg_queue_unpack(payload, BBZZOOIDS_FRAME_SIZE);
     }
 #endif // !BBZ_DISABLE_MESSAGES
 }
@@ -126,7 +145,6 @@ void bbz_init(void)
 {
     initRobot();
     vm = &vmObj;
-    bbzringbuf_construct(&bbz_payload_buf, bbzmsg_buf, 1, 11);
 }
 
 void bbz_createPosObject() {
@@ -156,14 +174,14 @@ void bbz_start(void (*setup)(void))
         if (!init_done) {
             if (!has_setup) {
                 bbzvm_construct(getRobotId());
-                bbzvm_set_bcode(bbzzooids_bcodeFetcher, bcode_size);
+                bbzvm_set_bcode_ptr(bcode, bcode_size);
                 bbzvm_set_error_receiver(bbz_err_receiver);
                 bbz_createPosObject();
                 setup();
                 has_setup = 1;
             }
             if (vm->state == BBZVM_STATE_READY) {
-                bbzvm_step();
+                bbzvm_run(BBZZOOIDS_RUN_BATCH);
             }
             else {
                 init_done = 1;
@@ -171,7 +189,7 @@ void bbz_start(void (*setup)(void))
                 bbz_func_call(__BBZSTRID_init);
 #ifndef BBZ_DISABLE_MESSAGES
                 message_tx = bbzwhich_msg_tx;
-                message_tx_success = bbzoutmsg_queue_next;
+                message_tx_success = bbzsent_msg_tx;
                 message_rx = bbzprocess_msg_rx;
 #endif
             }
@@ -281,6 +299,10 @@ void bbz_err_receiver(bbzvm_error errcode)
             ___led(RGB(0, 0, 2));
             ___led(RGB(0, 0, 2));
             break;
+        case BBZVM_ERROR_PTRS:
+            ___led(RGB(0, 2, 1));
+            ___led(RGB(0, 3, 0));
+            break;
         default:
             ___led(RGB(2, 0, 2));
             ___led(RGB(2, 0, 2));